@@ -0,0 +1,59 @@
+// Microbenchmark: small-payload AES throughput, per-call setup vs cached contexts
+#include "VitalEdgeCrypto.h"
+#include <openssl/evp.h>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The original encryptAES: new context, EVP_aes_256_cbc() and a full key schedule per call
+static std::string legacyEncryptAES(const std::string& plaintext, const std::string& key, const std::string& iv) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) throw std::runtime_error("EVP_CIPHER_CTX_new failed");
+
+    const EVP_CIPHER* cipher = EVP_aes_256_cbc();
+    EVP_EncryptInit_ex(ctx, cipher, nullptr, (const unsigned char*)key.data(), (const unsigned char*)iv.data());
+
+    std::vector<unsigned char> ciphertext(plaintext.size() + EVP_CIPHER_block_size(cipher));
+    int len = 0, ciphertextLen = 0;
+    EVP_EncryptUpdate(ctx, ciphertext.data(), &len, (const unsigned char*)plaintext.data(), plaintext.size());
+    ciphertextLen += len;
+    EVP_EncryptFinal_ex(ctx, ciphertext.data() + ciphertextLen, &len);
+    ciphertextLen += len;
+
+    EVP_CIPHER_CTX_free(ctx);
+    return std::string(ciphertext.begin(), ciphertext.begin() + ciphertextLen);
+}
+
+// Run fn repeatedly for roughly the given duration and return calls per second
+static double opsPerSecond(const std::function<void()>& fn, double seconds) {
+    using Clock = std::chrono::steady_clock;
+    size_t ops = 0;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::duration<double>(seconds);
+    while (Clock::now() < deadline) {
+        for (int i = 0; i < 256; ++i) fn();
+        ops += 256;
+    }
+    return ops / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+
+    std::printf("%-10s %16s %16s %10s\n", "payload", "per-call ops/s", "cached ops/s", "speedup");
+    for (size_t size : {16, 64, 256, 512, 1024, 4096}) {
+        std::string plaintext(size, 'v');
+
+        double before = opsPerSecond([&] { legacyEncryptAES(plaintext, key, iv); }, seconds);
+        double after = opsPerSecond([&] { VitalEdgeCrypto::encryptAES(plaintext, key, iv); }, seconds);
+
+        std::printf("%-10zu %16.0f %16.0f %9.2fx\n", size, before, after, after / before);
+    }
+    return 0;
+}
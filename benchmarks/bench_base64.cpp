@@ -0,0 +1,85 @@
+// Microbenchmark: base64 throughput, OpenSSL BIO chain vs each VitalEdgeBase64 kernel
+#include "VitalEdgeBase64.h"
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The previous obfuscate(): a BIO_f_base64 + BIO_s_mem chain per call
+static std::string bioEncode(const std::string& data) {
+    BIO* bio = BIO_push(BIO_new(BIO_f_base64()), BIO_new(BIO_s_mem()));
+    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+    BIO_write(bio, data.data(), data.size());
+    BIO_flush(bio);
+    char* encoded;
+    long length = BIO_get_mem_data(bio, &encoded);
+    std::string result(encoded, length);
+    BIO_free_all(bio);
+    return result;
+}
+
+static std::string bioDecode(const std::string& encoded) {
+    BIO* bio = BIO_push(BIO_new(BIO_f_base64()), BIO_new_mem_buf(encoded.data(), encoded.size()));
+    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+    std::vector<char> buffer(encoded.size());
+    int length = BIO_read(bio, buffer.data(), buffer.size());
+    BIO_free_all(bio);
+    return std::string(buffer.data(), length > 0 ? length : 0);
+}
+
+// Input megabytes processed per second by fn over roughly the given duration
+static double megabytesPerSecond(const std::function<void()>& fn, size_t bytes, double seconds) {
+    using Clock = std::chrono::steady_clock;
+    size_t calls = 0;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::duration<double>(seconds);
+    while (Clock::now() < deadline) {
+        for (int i = 0; i < 16; ++i) fn();
+        calls += 16;
+    }
+    return calls * bytes / 1e6 / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::stod(argv[1]) : 0.5;
+    const std::string detected = VitalEdgeBase64::implementation();
+
+    std::printf("%-9s %-7s %10s", "payload", "op", "bio MB/s");
+    const char* kernels[] = {"scalar", "ssse3", "avx2"};
+    for (const char* kernel : kernels) std::printf(" %10s", kernel);
+    std::printf("\n");
+
+    for (size_t size : {64, 1024, 16 * 1024, 1024 * 1024}) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) data[i] = (char)(i * 131 + 7);
+        std::string encoded = VitalEdgeBase64::encode(data);
+        std::string out(VitalEdgeBase64::encodedSize(size), '\0');
+
+        for (int decode = 0; decode < 2; ++decode) {
+            std::printf("%-9zu %-7s", size, decode ? "decode" : "encode");
+            std::printf(" %10.0f", decode ? megabytesPerSecond([&] { bioDecode(encoded); }, encoded.size(), seconds)
+                                          : megabytesPerSecond([&] { bioEncode(data); }, size, seconds));
+            for (const char* kernel : kernels) {
+                if (!VitalEdgeBase64::useImplementation(kernel)) {
+                    std::printf(" %10s", "n/a");
+                    continue;
+                }
+                // Straight into a preallocated buffer, as the service's call sites can
+                size_t written = 0;
+                std::printf(" %10.0f", decode
+                    ? megabytesPerSecond([&] { VitalEdgeBase64::decode(encoded.data(), encoded.size(),
+                                                                      (unsigned char*)&out[0], &written); },
+                                         encoded.size(), seconds)
+                    : megabytesPerSecond([&] { VitalEdgeBase64::encode((const unsigned char*)data.data(), size,
+                                                                      &out[0]); },
+                                         size, seconds));
+            }
+            std::printf("\n");
+        }
+    }
+    VitalEdgeBase64::useImplementation(detected);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "bench_common.h"
+#include <openssl/crypto.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+// Per-thread counters in fixed slots, so counting never allocates and threads do
+// not contend on one cache line. Threads share a slot past kSlots, which only
+// costs some contention.
+namespace {
+
+constexpr size_t kSlots = 256;
+
+struct alignas(64) Slot {
+    std::atomic<uint64_t> count{0};
+};
+
+Slot slots[kSlots];
+std::atomic<size_t> nextSlot{0};
+
+struct ThreadCounter {
+    Slot* slot = &slots[nextSlot.fetch_add(1, std::memory_order_relaxed) % kSlots];
+    bool counted = true;
+};
+
+thread_local ThreadCounter threadCounter;
+
+inline void countAllocation() {
+    ThreadCounter& counter = threadCounter;
+    if (counter.counted) counter.slot->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    countAllocation();
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    countAllocation();
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+static void* countedMalloc(size_t size, const char*, int) {
+    countAllocation();
+    return std::malloc(size);
+}
+
+static void* countedRealloc(void* p, size_t size, const char*, int) {
+    countAllocation();
+    return std::realloc(p, size);
+}
+
+static void countedFree(void* p, const char*, int) {
+    std::free(p);
+}
+
+bool startAllocationCounting() {
+    return CRYPTO_set_mem_functions(countedMalloc, countedRealloc, countedFree) == 1;
+}
+
+uint64_t allocationCount() {
+    uint64_t total = 0;
+    for (const Slot& slot : slots) total += slot.count.load(std::memory_order_relaxed);
+    return total;
+}
+
+void excludeThreadFromAllocationCount() {
+    threadCounter.counted = false;
+}
+
+double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) return 0;
+    size_t index = std::min(samples.size() - 1, size_t(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+static std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void BenchReport::add(const BenchResult& r) {
+    const double opsPerSec = r.seconds > 0 ? r.ops / r.seconds : 0;
+    const double mbPerSec = opsPerSec * r.size / 1e6;
+
+    if (json_) {
+        std::printf("{\"suite\":%s,\"name\":%s,\"variant\":%s,\"size\":%zu,\"threads\":%zu,\"ops\":%llu,"
+                    "\"seconds\":%.3f,\"ops_per_sec\":%.1f,\"mb_per_sec\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+                    "\"p999_us\":%.2f,\"allocs_per_op\":%.2f,\"errors\":%llu}\n",
+                    jsonString(r.suite).c_str(), jsonString(r.name).c_str(), jsonString(r.variant).c_str(),
+                    r.size, r.threads, (unsigned long long)r.ops, r.seconds, opsPerSec, mbPerSec,
+                    r.p50, r.p99, r.p999, r.allocsPerOp, (unsigned long long)r.errors);
+    } else {
+        if (!headerPrinted_) {
+            std::printf("%-22s %-18s %10s %4s %12s %10s %10s %10s %10s %9s\n", "name", "variant", "size", "thr",
+                        "ops/s", "MB/s", "p50 us", "p99 us", "p999 us", "allocs/op");
+            headerPrinted_ = true;
+        }
+        std::printf("%-22s %-18s %10zu %4zu %12.0f %10.1f %10.2f %10.2f %10.2f %9.1f%s\n", r.name.c_str(),
+                    r.variant.c_str(), r.size, r.threads, opsPerSec, mbPerSec, r.p50, r.p99, r.p999, r.allocsPerOp,
+                    r.errors ? " (errors)" : "");
+    }
+    std::fflush(stdout);
+}
+
+std::string benchOption(int argc, char** argv, const std::string& name, const std::string& fallback) {
+    const std::string prefix = "--" + name + "=";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, prefix.size(), prefix) == 0) return arg.substr(prefix.size());
+    }
+    return fallback;
+}
+
+bool benchFlag(int argc, char** argv, const std::string& name) {
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == "--" + name) return true;
+    }
+    return false;
+}
+
+std::vector<size_t> benchList(const std::string& csv) {
+    std::vector<size_t> values;
+    std::stringstream stream(csv);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(std::stoul(item));
+    }
+    return values;
+}
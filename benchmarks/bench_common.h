@@ -0,0 +1,64 @@
+// Shared pieces of the benchmark suite: allocation counting, latency percentiles
+// and result output (an aligned table, or one JSON object per line with --json so
+// runs from different commits can be diffed or loaded by a script).
+#ifndef VITALEDGE_BENCH_COMMON_H
+#define VITALEDGE_BENCH_COMMON_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using BenchClock = std::chrono::steady_clock;
+
+// Time point the given number of seconds from now
+inline BenchClock::time_point benchDeadline(double seconds) {
+    return BenchClock::now() + std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// Heap allocations made so far by counted threads: C++ operator new plus
+// OpenSSL's allocator (hooked by startAllocationCounting)
+uint64_t allocationCount();
+
+// Install the OpenSSL allocation hook; call first thing in main(), before any
+// OpenSSL allocation. Returns false if OpenSSL had already allocated.
+bool startAllocationCounting();
+
+// Stop counting the calling thread's allocations (load generators, so only the
+// code under test is counted)
+void excludeThreadFromAllocationCount();
+
+// Latency samples in microseconds; percentile() reorders them
+double percentile(std::vector<double>& samples, double p);
+
+struct BenchResult {
+    std::string suite;    // "primitives", "http"
+    std::string name;     // operation or route
+    std::string variant;  // e.g. "rsa-3072", "key_id", or empty
+    size_t size = 0;      // payload bytes per op
+    size_t threads = 0;   // client threads / connections
+    uint64_t ops = 0;
+    double seconds = 0;
+    double p50 = 0, p99 = 0, p999 = 0; // microseconds per op
+    double allocsPerOp = 0;
+    uint64_t errors = 0;
+};
+
+// Collects results and prints them as they arrive
+class BenchReport {
+public:
+    explicit BenchReport(bool json) : json_(json) {}
+    void add(const BenchResult& result);
+
+private:
+    bool json_;
+    bool headerPrinted_ = false;
+};
+
+// Command-line helpers: "--name=value" lookups with a fallback
+std::string benchOption(int argc, char** argv, const std::string& name, const std::string& fallback);
+bool benchFlag(int argc, char** argv, const std::string& name);
+std::vector<size_t> benchList(const std::string& csv);
+
+#endif // VITALEDGE_BENCH_COMMON_H
@@ -0,0 +1,163 @@
+// Benchmark: latency of small requests on an event loop that also receives heavy
+// ones (RSA-2048 decrypts, multi-MB AES), with the heavy work run inline versus
+// offloaded to VitalEdgeExecutor. Mirrors dispatchCrypto in src/routes.cpp.
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeExecutor.h"
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Single-threaded task queue standing in for a Drogon IO loop
+class EventLoop {
+public:
+    EventLoop() : thread_([this] { run(); }) {}
+    ~EventLoop() {
+        post(nullptr);
+        thread_.join();
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return !tasks_.empty(); });
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            if (!task) return;
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> tasks_;
+    std::thread thread_;
+};
+
+static std::string pemFromKey(EVP_PKEY* key, bool isPrivate) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    if (isPrivate) {
+        PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    } else {
+        PEM_write_bio_PUBKEY(bio, key);
+    }
+    char* data = nullptr;
+    long length = BIO_get_mem_data(bio, &data);
+    std::string pem(data, length);
+    BIO_free(bio);
+    return pem;
+}
+
+static double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) return 0;
+    size_t index = std::min(samples.size() - 1, size_t(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+struct Workload {
+    std::string key, iv, small, large, publicKey, privateKey;
+    std::vector<uint8_t> rsaCiphertext;
+};
+
+// Feed `requests` arrivals every `interval` into one loop; every `heavyEvery`-th
+// request alternates between an RSA decrypt and a large AES encrypt. Returns the
+// arrival-to-response latencies (microseconds) of the small requests.
+static std::vector<double> runMixedLoad(const Workload& w, bool offload, size_t requests,
+                                        std::chrono::microseconds interval, size_t heavyEvery) {
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    std::mutex latencyMutex;
+    std::atomic<size_t> outstanding{requests};
+
+    {
+        EventLoop loop;
+        auto next = Clock::now();
+        for (size_t i = 0; i < requests; ++i) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+            auto arrival = Clock::now();
+
+            if (i % heavyEvery == heavyEvery - 1) {
+                std::function<void()> heavy = (i / heavyEvery) % 2
+                    ? std::function<void()>([&w] { VitalEdgeCrypto::decryptRSA(w.rsaCiphertext, w.privateKey); })
+                    : std::function<void()>([&w] { VitalEdgeCrypto::encryptAES(w.large, w.key, w.iv); });
+                loop.post([&, heavy, offload] {
+                    if (!offload) {
+                        heavy();
+                        outstanding--;
+                        return;
+                    }
+                    VitalEdgeExecutor::instance().submit([&, heavy] {
+                        heavy();
+                        loop.post([&] { outstanding--; });
+                    });
+                });
+            } else {
+                loop.post([&, arrival] {
+                    VitalEdgeCrypto::encryptAES(w.small, w.key, w.iv);
+                    double micros = std::chrono::duration<double, std::micro>(Clock::now() - arrival).count();
+                    std::lock_guard<std::mutex> lock(latencyMutex);
+                    latencies.push_back(micros);
+                    outstanding--;
+                });
+            }
+        }
+        while (outstanding.load() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return latencies;
+}
+
+int main(int argc, char** argv) {
+    size_t requests = argc > 1 ? std::stoul(argv[1]) : 20000;
+
+    Workload w;
+    w.key = VitalEdgeCrypto::generateRandomKey(32);
+    w.iv = VitalEdgeCrypto::generateRandomIV(16);
+    w.small = std::string(256, 's');
+    w.large = std::string(4 << 20, 'L');
+
+    EVP_PKEY* rsa = EVP_RSA_gen(2048);
+    w.publicKey = pemFromKey(rsa, false);
+    w.privateKey = pemFromKey(rsa, true);
+    EVP_PKEY_free(rsa);
+    w.rsaCiphertext = VitalEdgeCrypto::encryptRSA("session key material", w.publicKey);
+
+    std::printf("executor threads: %zu, requests: %zu, 1 heavy per 50 (RSA-2048 decrypt / 4 MB AES)\n",
+                VitalEdgeExecutor::instance().threadCount(), requests);
+    std::printf("%-8s %12s %12s %12s %12s\n", "mode", "p50 us", "p99 us", "p999 us", "max us");
+    for (bool offload : {false, true}) {
+        auto latencies = runMixedLoad(w, offload, requests, std::chrono::microseconds(100), 50);
+        double p50 = percentile(latencies, 0.50);
+        double p99 = percentile(latencies, 0.99);
+        double p999 = percentile(latencies, 0.999);
+        double max = *std::max_element(latencies.begin(), latencies.end());
+        std::printf("%-8s %12.1f %12.1f %12.1f %12.1f\n", offload ? "offload" : "inline", p50, p99, p999, max);
+    }
+    return 0;
+}
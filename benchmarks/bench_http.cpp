@@ -0,0 +1,304 @@
+// Benchmark: the service's HTTP routes end to end. Starts the Drogon app
+// in-process on loopback with the same handlers as vitaledge-crypt, then drives
+// each route closed-loop from N client connections and reports throughput,
+// latency percentiles and server-side heap allocations per request (client
+// threads are not counted).
+//
+//   bench_http [--json] [--quick] [--seconds=1] [--sizes=16,1024,...]
+//              [--connections=1,16,64] [--io-threads=0] [--client-threads=2]
+//              [--port=18084] [--filter=/encrypt]
+#include "bench_common.h"
+#include "routes.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeWire.h"
+#include <drogon/drogon.h>
+#include <trantor/net/EventLoopThread.h>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace drogon;
+
+// ASCII key material so request bodies stay plain JSON strings
+static const std::string kKey = "0123456789abcdef0123456789abcdef";
+static const std::string kIV = "abcdef0123456789";
+
+// Seconds before an unanswered request counts as an error
+static constexpr double kRequestTimeout = 10.0;
+
+// One route and request body to drive
+struct Workload {
+    std::string path;
+    std::string variant;
+    size_t size;      // payload bytes per request
+    std::string body; // serialized once, reused by every request
+    ContentType contentType = CT_APPLICATION_JSON;
+    std::vector<std::pair<std::string, std::string>> headers = {};
+};
+
+struct Connection {
+    HttpClientPtr client;
+    std::vector<double> samples;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+};
+
+// Keeps every connection's single request in flight until the deadline
+class ClosedLoopDriver {
+public:
+    ClosedLoopDriver(const Workload& workload, std::vector<Connection>& connections, double seconds)
+        : workload_(workload),
+          connections_(connections),
+          deadline_(benchDeadline(seconds)),
+          active_(connections.size()) {}
+
+    void run() {
+        for (auto& connection : connections_) send(connection);
+        done_.get_future().wait();
+    }
+
+private:
+    void send(Connection& connection) {
+        auto req = HttpRequest::newHttpRequest();
+        req->setMethod(Post);
+        req->setPath(workload_.path);
+        req->setContentTypeCode(workload_.contentType);
+        for (const auto& header : workload_.headers) req->addHeader(header.first, header.second);
+        req->setBody(workload_.body);
+
+        const auto start = BenchClock::now();
+        connection.client->sendRequest(req, [this, &connection, start](ReqResult result, const HttpResponsePtr& resp) {
+            const auto now = BenchClock::now();
+            if (result == ReqResult::Ok && resp && resp->getStatusCode() == k200OK) {
+                connection.samples.push_back(std::chrono::duration<double, std::micro>(now - start).count());
+                connection.ops++;
+            } else {
+                connection.errors++;
+            }
+            if (now < deadline_) {
+                send(connection);
+            } else if (active_.fetch_sub(1) == 1) {
+                done_.set_value();
+            }
+        }, kRequestTimeout);
+    }
+
+    const Workload& workload_;
+    std::vector<Connection>& connections_;
+    const BenchClock::time_point deadline_;
+    std::atomic<size_t> active_;
+    std::promise<void> done_;
+};
+
+static BenchResult drive(const Workload& workload, std::vector<Connection>& connections, double seconds,
+                         const std::string& serverVariant) {
+    for (auto& connection : connections) {
+        connection.samples.clear();
+        connection.ops = connection.errors = 0;
+    }
+
+    const uint64_t allocsBefore = allocationCount();
+    const auto start = BenchClock::now();
+    ClosedLoopDriver(workload, connections, seconds).run();
+    const double elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+    const uint64_t allocs = allocationCount() - allocsBefore;
+
+    BenchResult result;
+    result.suite = "http";
+    result.name = workload.path;
+    result.variant = workload.variant.empty() ? serverVariant : workload.variant + "," + serverVariant;
+    result.size = workload.size;
+    result.threads = connections.size();
+    result.seconds = elapsed;
+
+    std::vector<double> samples;
+    for (auto& connection : connections) {
+        result.ops += connection.ops;
+        result.errors += connection.errors;
+        samples.insert(samples.end(), connection.samples.begin(), connection.samples.end());
+    }
+    result.p50 = percentile(samples, 0.50);
+    result.p99 = percentile(samples, 0.99);
+    result.p999 = percentile(samples, 0.999);
+    const uint64_t requests = result.ops + result.errors;
+    result.allocsPerOp = requests ? double(allocs) / requests : 0;
+    return result;
+}
+
+static std::string pemFromKey(EVP_PKEY* key, bool isPrivate) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    if (isPrivate) {
+        PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    } else {
+        PEM_write_bio_PUBKEY(bio, key);
+    }
+    char* data = nullptr;
+    long length = BIO_get_mem_data(bio, &data);
+    std::string pem(data, length);
+    BIO_free(bio);
+    return pem;
+}
+
+static std::string serialize(const Json::Value& value) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, value);
+}
+
+static std::vector<Workload> workloads(const std::vector<size_t>& sizes) {
+    EVP_PKEY* rsa = EVP_RSA_gen(2048);
+    const std::string publicKey = pemFromKey(rsa, false);
+    const std::string privateKey = pemFromKey(rsa, true);
+    EVP_PKEY_free(rsa);
+
+    std::vector<Workload> out;
+    for (size_t size : sizes) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) data[i] = (char)('a' + i % 26);
+
+        Json::Value encrypt;
+        encrypt["data"] = data;
+        encrypt["key_id"] = "bench";
+        encrypt["iv"] = kIV;
+        out.push_back({"/encrypt", "key_id", size, serialize(encrypt)});
+
+        encrypt.removeMember("key_id");
+        encrypt["key"] = kKey;
+        out.push_back({"/encrypt", "key", size, serialize(encrypt)});
+
+        Json::Value decrypt;
+        decrypt["data"] = VitalEdgeBase64::encode(VitalEdgeCrypto::encryptAES(data, kKey, kIV));
+        decrypt["key_id"] = "bench";
+        decrypt["iv"] = kIV;
+        out.push_back({"/decrypt", "key_id", size, serialize(decrypt)});
+
+        // The same operations in the binary wire format: raw bodies, parameters in headers
+        const std::vector<std::pair<std::string, std::string>> binaryHeaders = {
+            {"X-VitalEdge-Key-Id", "bench"}, {"X-VitalEdge-IV", kIV}};
+        out.push_back({"/encrypt", "key_id,binary", size, data, CT_APPLICATION_OCTET_STREAM, binaryHeaders});
+        out.push_back({"/decrypt", "key_id,binary", size, VitalEdgeCrypto::encryptAES(data, kKey, kIV),
+                       CT_APPLICATION_OCTET_STREAM, binaryHeaders});
+
+        Json::Value obfuscate;
+        obfuscate["data"] = data;
+        out.push_back({"/obfuscate", "", size, serialize(obfuscate)});
+
+        // 64 items per batch; size counts the whole batch
+        if (size <= 4096) {
+            Json::Value batch;
+            Json::Value item;
+            item["data"] = data;
+            item["key_id"] = "bench";
+            item["iv"] = kIV;
+            for (int i = 0; i < 64; ++i) batch["items"].append(item);
+            out.push_back({"/encrypt/batch", "items=64", size * 64, serialize(batch)});
+
+            std::string frames;
+            for (int i = 0; i < 64; ++i) VitalEdgeWire::appendItem(frames, {"bench", "", kIV, data});
+            out.push_back({"/encrypt/batch", "items=64,binary", size * 64, frames, CT_APPLICATION_OCTET_STREAM});
+        }
+
+        // One patient-style record with 8 sealed fields, data filling the notes field
+        Json::Value fields;
+        fields["key_id"] = "bench";
+        for (const char* path : {"name", "mrn", "dob", "ssn", "address.street", "address.zip", "phones[*]", "notes"}) {
+            fields["fields"].append(path);
+        }
+        Json::Value& record = fields["document"];
+        record["name"] = "Ann Example";
+        record["mrn"] = 12345678;
+        record["dob"] = "1980-01-01";
+        record["ssn"] = "000-00-0000";
+        record["address"]["street"] = "1 Main St";
+        record["address"]["zip"] = "02139";
+        record["phones"].append("555-0100");
+        record["notes"] = data;
+        out.push_back({"/encrypt/fields", "fields=8", size, serialize(fields)});
+
+        Json::Value envelope;
+        envelope["data"] = data;
+        envelope["public_key"] = publicKey;
+        out.push_back({"/envelope/encrypt", "rsa-2048", size, serialize(envelope)});
+
+        Json::Value open;
+        open["envelope"] = VitalEdgeBase64::encode(VitalEdgeCrypto::encryptEnvelope(data, publicKey));
+        open["private_key"] = privateKey;
+        out.push_back({"/envelope/decrypt", "rsa-2048", size, serialize(open)});
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    startAllocationCounting();
+
+    const bool quick = benchFlag(argc, argv, "quick");
+    const double seconds = std::stod(benchOption(argc, argv, "seconds", quick ? "0.3" : "1"));
+    // Drogon's default 1 MB body limit applies, as in the service
+    const auto sizes = benchList(benchOption(argc, argv, "sizes", quick ? "16,4096" : "16,1024,16384,262144"));
+    const auto connectionCounts = benchList(benchOption(argc, argv, "connections", quick ? "1,16" : "1,16,64"));
+    size_t ioThreads = std::stoul(benchOption(argc, argv, "io-threads", "0"));
+    if (ioThreads == 0) ioThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t clientThreads = std::stoul(benchOption(argc, argv, "client-threads", "2"));
+    const uint16_t port = (uint16_t)std::stoul(benchOption(argc, argv, "port", "18084"));
+    const std::string filter = benchOption(argc, argv, "filter", "");
+    BenchReport report(benchFlag(argc, argv, "json"));
+
+    VitalEdgeKeyring::add("bench", kKey);
+    const std::vector<Workload> runs = workloads(sizes);
+
+    registerRoutes();
+    app().setThreadNum(ioThreads).enableRequestStream().addListener("127.0.0.1", port);
+    std::thread server([] { app().run(); });
+
+    // Client loops, excluded from allocation counts
+    std::vector<std::unique_ptr<trantor::EventLoopThread>> loops;
+    for (size_t i = 0; i < clientThreads; ++i) {
+        loops.push_back(std::make_unique<trantor::EventLoopThread>("bench-client"));
+        loops.back()->run();
+        std::promise<void> excluded;
+        loops.back()->getLoop()->runInLoop([&excluded] {
+            excludeThreadFromAllocationCount();
+            excluded.set_value();
+        });
+        excluded.get_future().wait();
+    }
+
+    // Wait for the listener: one small request until it succeeds
+    {
+        std::vector<Connection> probe(1);
+        probe[0].client = HttpClient::newHttpClient("http://127.0.0.1:" + std::to_string(port), loops[0]->getLoop());
+        const Workload ping{"/obfuscate", "", 2, "{\"data\":\"ok\"}"};
+        for (int attempt = 0; attempt < 100 && drive(ping, probe, 0, "").ops == 0; ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    const std::string serverVariant = "io=" + std::to_string(ioThreads);
+    for (size_t count : connectionCounts) {
+        std::vector<Connection> connections(count);
+        for (size_t i = 0; i < count; ++i) {
+            connections[i].client = HttpClient::newHttpClient("http://127.0.0.1:" + std::to_string(port),
+                                                              loops[i % loops.size()]->getLoop());
+        }
+
+        for (const auto& workload : runs) {
+            if (workload.path.find(filter) == std::string::npos) continue;
+            drive(workload, connections, seconds / 10, serverVariant); // connect and warm up
+            report.add(drive(workload, connections, seconds, serverVariant));
+        }
+    }
+
+    app().quit();
+    server.join();
+    return 0;
+}
@@ -0,0 +1,431 @@
+// Benchmark suite: every VitalEdgeCrypto primitive across payload sizes (16 B to
+// 64 MB), client thread counts and RSA key sizes. Reports ops/s, MB/s, per-op
+// latency percentiles and heap allocations per op.
+//
+//   bench_primitives [--json] [--quick] [--seconds=0.5] [--sizes=16,4096,...]
+//                    [--threads=1,4,...] [--rsa-bits=2048,3072,4096] [--filter=aes]
+#include "bench_common.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeChunkedAEAD.h"
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeEnvelope.h"
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeSession.h"
+#include "VitalEdgeStreamCipher.h"
+#include "VitalEdgeTokenVault.h"
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Samples kept per thread; past this, reservoir sampling keeps a uniform subset
+// without allocating while the clock is running
+static constexpr size_t kMaxSamples = 1 << 17;
+
+// Calls made by each thread even when one call outlasts the time budget
+static constexpr uint64_t kMinOpsPerThread = 3;
+
+using Op = std::function<void()>;
+
+// Builds one thread's operation; called before timing starts so per-thread setup
+// (buffers, first-use context caches) is not measured
+using OpFactory = std::function<Op()>;
+
+struct Options {
+    double seconds = 0.5;
+    std::vector<size_t> sizes;
+    std::vector<size_t> threads;
+    std::vector<size_t> rsaBits;
+    std::string filter;
+};
+
+static BenchResult measure(const std::string& name, const std::string& variant, size_t bytesPerOp,
+                           size_t threadCount, double seconds, const OpFactory& factory) {
+    struct Worker {
+        std::vector<double> samples;
+        uint64_t ops = 0;
+    };
+    std::vector<Worker> workers(threadCount);
+    for (auto& worker : workers) worker.samples.resize(kMaxSamples);
+
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            Worker& worker = workers[t];
+            Op op = factory();
+            op(); // warm the thread's caches
+            ready++;
+            while (!go.load()) std::this_thread::yield();
+
+            const auto deadline = benchDeadline(seconds);
+            uint64_t rng = 0x9E3779B97F4A7C15ull ^ t;
+            for (;;) {
+                const auto start = BenchClock::now();
+                if (start >= deadline && worker.ops >= kMinOpsPerThread) break;
+                op();
+                const double micros = std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+
+                if (worker.ops < kMaxSamples) {
+                    worker.samples[worker.ops] = micros;
+                } else {
+                    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+                    uint64_t slot = (rng >> 11) % (worker.ops + 1);
+                    if (slot < kMaxSamples) worker.samples[slot] = micros;
+                }
+                worker.ops++;
+            }
+        });
+    }
+
+    while (ready.load() < threadCount) std::this_thread::yield();
+    const uint64_t allocsBefore = allocationCount();
+    const auto start = BenchClock::now();
+    go = true;
+    for (auto& thread : threads) thread.join();
+    const double elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+    const uint64_t allocs = allocationCount() - allocsBefore;
+
+    BenchResult result;
+    result.suite = "primitives";
+    result.name = name;
+    result.variant = variant;
+    result.size = bytesPerOp;
+    result.threads = threadCount;
+    result.seconds = elapsed;
+
+    std::vector<double> samples;
+    for (auto& worker : workers) {
+        result.ops += worker.ops;
+        samples.insert(samples.end(), worker.samples.begin(),
+                       worker.samples.begin() + std::min<uint64_t>(worker.ops, kMaxSamples));
+    }
+    result.p50 = percentile(samples, 0.50);
+    result.p99 = percentile(samples, 0.99);
+    result.p999 = percentile(samples, 0.999);
+    result.allocsPerOp = result.ops ? double(allocs) / result.ops : 0;
+    return result;
+}
+
+static std::string pemFromKey(EVP_PKEY* key, bool isPrivate) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    if (isPrivate) {
+        PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    } else {
+        PEM_write_bio_PUBKEY(bio, key);
+    }
+    char* data = nullptr;
+    long length = BIO_get_mem_data(bio, &data);
+    std::string pem(data, length);
+    BIO_free(bio);
+    return pem;
+}
+
+// A watch's vitals time series as JSON, about size bytes: one sample a second
+// with slowly varying readings, as clients send it to /encrypt
+static std::string vitalsPayload(size_t size) {
+    std::string json = "[";
+    char sample[128];
+    for (unsigned i = 0; json.size() < size; ++i) {
+        const int length = std::snprintf(sample, sizeof(sample),
+                                         "{\"t\":%u,\"hr\":%u,\"spo2\":%u,\"resp\":%u,\"temp\":%.1f},",
+                                         1700000000 + i, 68 + (i * 7 / 11) % 9, 96 + i / 17 % 3, 14 + i / 5 % 4,
+                                         36.5 + (i / 23 % 5) * 0.1);
+        json.append(sample, length);
+    }
+    json.back() = ']';
+    return json;
+}
+
+static std::string payload(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) data[i] = (char)('a' + i % 26);
+    return data;
+}
+
+int main(int argc, char** argv) {
+    startAllocationCounting();
+
+    const bool quick = benchFlag(argc, argv, "quick");
+    Options options;
+    options.seconds = std::stod(benchOption(argc, argv, "seconds", quick ? "0.1" : "0.5"));
+    options.sizes = benchList(benchOption(argc, argv, "sizes",
+        quick ? "16,256,4096,65536,1048576" : "16,256,4096,65536,1048576,16777216,67108864"));
+    std::string defaultThreads = "1";
+    for (size_t t = 2; t <= std::thread::hardware_concurrency(); t *= 2) defaultThreads += "," + std::to_string(t);
+    options.threads = benchList(benchOption(argc, argv, "threads", defaultThreads));
+    options.rsaBits = benchList(benchOption(argc, argv, "rsa-bits", quick ? "2048" : "2048,3072,4096"));
+    options.filter = benchOption(argc, argv, "filter", "");
+
+    BenchReport report(benchFlag(argc, argv, "json"));
+    auto run = [&](const std::string& name, const std::string& variant, size_t bytesPerOp,
+                   const OpFactory& factory) {
+        if (name.find(options.filter) == std::string::npos) return;
+        for (size_t threads : options.threads) {
+            report.add(measure(name, variant, bytesPerOp, threads, options.seconds, factory));
+        }
+    };
+
+    const std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    const std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    const std::string nonce = VitalEdgeCrypto::generateRandomIV(12);
+    const auto entry = VitalEdgeKeyring::add("bench", key);
+
+    for (size_t size : options.sizes) {
+        const auto data = std::make_shared<const std::string>(payload(size));
+        const auto cbc = std::make_shared<const std::string>(VitalEdgeCrypto::encryptAES(*data, key, iv));
+        const auto gcm = std::make_shared<const std::string>(VitalEdgeCrypto::encryptGCM(*data, key, nonce));
+
+        run("aes-cbc-encrypt", "key", size, [&, data] {
+            return [&, data] { VitalEdgeCrypto::encryptAES(*data, key, iv); };
+        });
+        run("aes-cbc-encrypt", "key_id", size, [&, data] {
+            return [&, data] { VitalEdgeCrypto::encryptAES(*data, *entry, iv); };
+        });
+        run("aes-cbc-decrypt", "key", size, [&, cbc] {
+            return [&, cbc] { VitalEdgeCrypto::decryptAES(*cbc, key, iv); };
+        });
+        // Into a fresh secure buffer per call: arena blocks, no malloc
+        run("aes-cbc-decrypt", "key_id-secure", size, [&, cbc] {
+            return [&, cbc] {
+                VitalEdgeCrypto::SecureString plaintext;
+                VitalEdgeCrypto::decryptAES(*cbc, *entry, iv, plaintext);
+            };
+        });
+        run("aes-gcm-encrypt", "key", size, [&, data] {
+            return [&, data] { VitalEdgeCrypto::encryptGCM(*data, key, nonce); };
+        });
+        run("aes-gcm-decrypt", "key", size, [&, gcm] {
+            return [&, gcm] { VitalEdgeCrypto::decryptGCM(*gcm, key, nonce); };
+        });
+        run("hmac-sha256", "key_id", size, [&, data] {
+            return [&, data] { entry->hmac(*data); };
+        });
+        run("obfuscate", VitalEdgeBase64::implementation(), size, [data] {
+            return [data] { VitalEdgeCrypto::obfuscate(*data); };
+        });
+        const auto encoded = std::make_shared<const std::string>(VitalEdgeCrypto::obfuscate(*data));
+        run("deobfuscate", VitalEdgeBase64::implementation(), encoded->size(), [encoded] {
+            return [encoded] { VitalEdgeCrypto::deobfuscate(*encoded); };
+        });
+
+        // Stream cipher fed in 64 KiB chunks into a reused buffer
+        run("aes-cbc-stream", "64k-chunks", size, [&, data] {
+            return [&, data, out = std::make_shared<std::string>(65536 + 16, '\0')] {
+                VitalEdgeStreamCipher cipher(key, iv, true);
+                unsigned char* buffer = (unsigned char*)&(*out)[0];
+                for (size_t offset = 0; offset < data->size(); offset += 65536) {
+                    size_t chunk = std::min<size_t>(65536, data->size() - offset);
+                    cipher.update((const unsigned char*)data->data() + offset, chunk, buffer);
+                }
+                cipher.finish(buffer);
+            };
+        });
+
+        // Batches of 64 items of this size, up to 64 KiB items
+        if (size <= 65536) {
+            run("aes-cbc-batch", "items=64", size * 64, [&, data] {
+                auto items = std::make_shared<std::vector<VitalEdgeCrypto::BatchItem>>(
+                    64, VitalEdgeCrypto::BatchItem{*data, key, iv});
+                return [items] { VitalEdgeCrypto::encryptAESBatch(items->data(), items->size()); };
+            });
+        }
+
+        // Segmented AEAD spreads large payloads across the executor
+        if (size >= 65536) {
+            const auto sealed = std::make_shared<const std::string>(VitalEdgeChunkedAEAD::seal(*data, key));
+            run("chunked-aead-seal", "1m-segments", size, [&, data] {
+                return [&, data] { VitalEdgeChunkedAEAD::seal(*data, key); };
+            });
+            run("chunked-aead-open", "1m-segments", size, [&, sealed] {
+                return [&, sealed] { VitalEdgeChunkedAEAD::open(*sealed, key); };
+            });
+        }
+    }
+
+    // IVs and keys: one RAND_bytes call each, as before, against the per-thread
+    // DRBG service (run with --threads=1,2,4,8,16,32,64 to see contention)
+    run("random-iv", "rand_bytes", 16, [] {
+        return [buffer = std::make_shared<std::vector<unsigned char>>(16)] { RAND_bytes(buffer->data(), 16); };
+    });
+    run("random-iv", "thread-drbg", 16, [] {
+        return [buffer = std::make_shared<std::vector<unsigned char>>(16)] {
+            VitalEdgeRandom::bytes(buffer->data(), 16);
+        };
+    });
+    run("random-key", "rand_priv_bytes", 32, [] {
+        return [buffer = std::make_shared<std::vector<unsigned char>>(32)] { RAND_priv_bytes(buffer->data(), 32); };
+    });
+    run("random-key", "thread-drbg", 32, [] {
+        return [buffer = std::make_shared<std::vector<unsigned char>>(32)] {
+            VitalEdgeRandom::privateBytes(buffer->data(), 32);
+        };
+    });
+
+    // Identifier tokenization, and lookups in a vault of a million tokens
+    auto wanted = [&](const std::string& name) { return name.find(options.filter) != std::string::npos; };
+    if (wanted("tokenize") || wanted("token-vault-find")) {
+        const size_t tokenCount = quick ? 100000 : 1000000;
+        const std::string vaultPath = "bench_tokens.vault";
+        std::remove(vaultPath.c_str());
+        VitalEdgeTokenVault vault(vaultPath, tokenCount * 2);
+        auto tokens = std::make_shared<std::vector<unsigned char>>(tokenCount * VitalEdgeCrypto::kTokenSize);
+        for (size_t i = 0; i < tokenCount; ++i) {
+            const std::string value = "MRN-" + std::to_string(10000000 + i);
+            unsigned char* token = tokens->data() + i * VitalEdgeCrypto::kTokenSize;
+            VitalEdgeCrypto::tokenize(value, *entry, "mrn", token);
+            vault.insert(token, value, *entry);
+        }
+
+        run("tokenize", "mrn", 12, [&] {
+            return [&, token = std::make_shared<std::vector<unsigned char>>(VitalEdgeCrypto::kTokenSize)] {
+                VitalEdgeCrypto::tokenize("MRN-10000042", *entry, "mrn", token->data());
+            };
+        });
+        run("token-vault-find", "tokens=" + std::to_string(tokenCount), 12, [&, tokens] {
+            return [&, tokens, value = std::make_shared<VitalEdgeCrypto::SecureString>(), next = std::make_shared<size_t>(0)] {
+                *next = (*next + 7919) % tokenCount;
+                vault.find(tokens->data() + *next * VitalEdgeCrypto::kTokenSize, *entry, *value);
+            };
+        });
+        std::remove(vaultPath.c_str());
+    }
+
+    // Signatures over a 1 KiB vitals payload with prepared keys, and verify batches
+    // of 256 items spread across the executor
+    if (wanted("sign") || wanted("verify")) {
+        EVP_PKEY* ed25519 = EVP_PKEY_Q_keygen(nullptr, nullptr, "ED25519");
+        const auto signer = VitalEdgeKeyCache::privateKey(pemFromKey(ed25519, true));
+        const auto verifier = VitalEdgeKeyCache::publicKey(pemFromKey(ed25519, false));
+        EVP_PKEY_free(ed25519);
+        const auto message = std::make_shared<const std::string>(payload(1024));
+        const std::string mac = VitalEdgeCrypto::signHMAC(*message, *entry);
+        const std::string signature = VitalEdgeCrypto::signEd25519(*message, *signer);
+
+        run("sign", "hmac-sha256", message->size(), [&, message] {
+            return [&, message] { VitalEdgeCrypto::signHMAC(*message, *entry); };
+        });
+        run("verify", "hmac-sha256", message->size(), [&, message] {
+            return [&, message] { VitalEdgeCrypto::verifyHMAC(*message, mac, *entry); };
+        });
+        run("sign", "ed25519", message->size(), [&, message] {
+            return [&, message] { VitalEdgeCrypto::signEd25519(*message, *signer); };
+        });
+        run("verify", "ed25519", message->size(), [&, message] {
+            return [&, message] { VitalEdgeCrypto::verifyEd25519(*message, signature, *verifier); };
+        });
+        const VitalEdgeCrypto::VerifyItem hmacItem{*message, mac, entry.get(), nullptr};
+        const VitalEdgeCrypto::VerifyItem ed25519Item{*message, signature, nullptr, verifier.get()};
+        for (const auto& item : {hmacItem, ed25519Item}) {
+            auto items = std::make_shared<std::vector<VitalEdgeCrypto::VerifyItem>>(256, item);
+            run("verify-batch", item.hmacKey ? "hmac-sha256-items=256" : "ed25519-items=256",
+                message->size() * items->size(), [items] {
+                return [items] { VitalEdgeCrypto::verifyBatch(items->data(), items->size()); };
+            });
+        }
+    }
+
+    // Compress-then-encrypt on vitals time series against plain encryption; the
+    // variant carries the ciphertext size as a fraction of the plain one
+    if (wanted("vitals")) {
+        for (size_t size : {size_t(4096), size_t(65536), size_t(1) << 20}) {
+            const auto vitals = std::make_shared<const std::string>(vitalsPayload(size));
+            const std::string label = std::to_string(size >> 10) + "k";
+            const size_t plainSize = VitalEdgeCrypto::encryptAES(*vitals, *entry, iv).size();
+            run("vitals-encrypt", label + "-plain", vitals->size(), [&, vitals] {
+                return [&, vitals, out = std::make_shared<VitalEdgeCrypto::SecureString>()] {
+                    VitalEdgeCrypto::encryptAES(*vitals, *entry, iv, *out);
+                };
+            });
+            for (int level : {1, 3, 9}) {
+                VitalEdgeCrypto::SecureString sealed;
+                VitalEdgeCrypto::encryptAESCompressed(*vitals, *entry, iv, level, sealed);
+                char ratio[32];
+                std::snprintf(ratio, sizeof(ratio), "-zstd%d-x%.2f", level, double(sealed.size()) / plainSize);
+                const auto sealedCopy = std::make_shared<const std::string>(sealed.data(), sealed.size());
+                run("vitals-encrypt", label + ratio, vitals->size(), [&, vitals, level] {
+                    return [&, vitals, level, out = std::make_shared<VitalEdgeCrypto::SecureString>()] {
+                        VitalEdgeCrypto::encryptAESCompressed(*vitals, *entry, iv, level, *out);
+                    };
+                });
+                run("vitals-decrypt", label + ratio, vitals->size(), [&, sealedCopy] {
+                    return [&, sealedCopy, out = std::make_shared<VitalEdgeCrypto::SecureString>()] {
+                        VitalEdgeCrypto::decryptAESCompressed(*sealedCopy, *entry, iv, *out);
+                    };
+                });
+            }
+            const auto plain = std::make_shared<const std::string>(VitalEdgeCrypto::encryptAES(*vitals, *entry, iv));
+            run("vitals-decrypt", label + "-plain", vitals->size(), [&, plain] {
+                return [&, plain, out = std::make_shared<VitalEdgeCrypto::SecureString>()] {
+                    VitalEdgeCrypto::decryptAES(*plain, *entry, iv, *out);
+                };
+            });
+        }
+    }
+
+    // Session handshakes (paid once per session) and the lookup every request
+    // under a session makes; compare with rsa-decrypt per message below
+    if (wanted("session")) {
+        EVP_PKEY* client = EVP_PKEY_Q_keygen(nullptr, nullptr, "X25519");
+        std::string clientPublic(VitalEdgeSession::kPublicKeySize, '\0');
+        size_t publicLen = clientPublic.size();
+        EVP_PKEY_get_raw_public_key(client, (unsigned char*)&clientPublic[0], &publicLen);
+        EVP_PKEY_free(client);
+
+        VitalEdgeSession::setCapacity(size_t(1) << 24);
+        run("session-establish", "x25519-hkdf", 0, [&] {
+            return [&] { VitalEdgeSession::establish(clientPublic); };
+        });
+        const std::string sessionId = VitalEdgeSession::establish(clientPublic).sessionId;
+        run("session-find", "sessions=" + std::to_string(VitalEdgeSession::size()), 0, [&] {
+            return [&] { VitalEdgeSession::find(sessionId); };
+        });
+        VitalEdgeSession::clear();
+    }
+
+    for (size_t bits : options.rsaBits) {
+        EVP_PKEY* rsa = EVP_RSA_gen((unsigned int)bits);
+        const std::string publicKey = pemFromKey(rsa, false);
+        const std::string privateKey = pemFromKey(rsa, true);
+        EVP_PKEY_free(rsa);
+        const std::string variant = "rsa-" + std::to_string(bits);
+
+        const std::string secret = VitalEdgeCrypto::generateRandomKey(32);
+        const std::vector<uint8_t> wrapped = VitalEdgeCrypto::encryptRSA(secret, publicKey);
+        run("rsa-encrypt", variant, secret.size(), [&] {
+            return [&] { VitalEdgeCrypto::encryptRSA(secret, publicKey); };
+        });
+        run("rsa-decrypt", variant, secret.size(), [&] {
+            return [&] { VitalEdgeCrypto::decryptRSA(wrapped, privateKey); };
+        });
+
+        // Envelopes at one small and one large payload: the RSA share and the AES share
+        for (size_t size : {size_t(1024), size_t(1) << 20}) {
+            const auto data = std::make_shared<const std::string>(payload(size));
+            const auto envelope = std::make_shared<const std::string>(
+                VitalEdgeCrypto::encryptEnvelope(*data, publicKey));
+            run("envelope-seal", variant, size, [&, data] {
+                return [&, data] { VitalEdgeCrypto::encryptEnvelope(*data, publicKey); };
+            });
+            run("envelope-open", variant + "-cached", size, [&, envelope] {
+                return [&, envelope] { VitalEdgeCrypto::decryptEnvelope(*envelope, privateKey); };
+            });
+            run("envelope-open", variant + "-uncached", size, [&, envelope] {
+                return [&, envelope] {
+                    VitalEdgeEnvelope::clearCache();
+                    VitalEdgeCrypto::decryptEnvelope(*envelope, privateKey);
+                };
+            });
+        }
+    }
+    return 0;
+}
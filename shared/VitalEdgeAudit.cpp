@@ -0,0 +1,523 @@
+#include "VitalEdgeAudit.h"
+#include <fcntl.h>
+#include <nmmintrin.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using Record = VitalEdgeAudit::Record;
+
+static constexpr char kFileMagic[8] = {'V', 'E', 'A', 'U', 'D', 'I', 'T', '1'};
+static constexpr uint32_t kBlockMagic = 0x42414556; // "VEAB"
+static constexpr uint32_t kVersion = 1;
+
+// Records per block; also bounds what the reader accepts
+static constexpr uint32_t kMaxBlockRecords = 4096;
+
+namespace {
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t created;
+    uint64_t reserved;
+};
+static_assert(sizeof(FileHeader) == 32, "file header is 32 bytes");
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t firstSequence;
+    uint32_t previousCrc;
+    uint32_t crc;
+    uint64_t reserved;
+};
+static_assert(sizeof(BlockHeader) == 32, "block header is 32 bytes");
+
+// CRC-32C (Castagnoli): the SSE4.2 instruction where available, else a table
+uint32_t crc32cTable(uint32_t crc, const unsigned char* data, size_t length) {
+    static const auto table = [] {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) value = (value >> 1) ^ (0x82F63B78 & (0 - (value & 1)));
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    for (size_t i = 0; i < length; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+__attribute__((target("sse4.2"))) uint32_t crc32cHardware(uint32_t crc, const unsigned char* data, size_t length) {
+    uint64_t value = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        value = _mm_crc32_u64(value, word);
+    }
+    crc = uint32_t(value);
+    for (; length > 0; ++data, --length) crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+
+// Chainable: crc32c(b, crc32c(a)) == crc32c(a followed by b)
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0) {
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    crc = ~crc;
+    crc = hardware ? crc32cHardware(crc, (const unsigned char*)data, length)
+                   : crc32cTable(crc, (const unsigned char*)data, length);
+    return ~crc;
+}
+
+uint32_t blockCrc(BlockHeader header, const Record* records) {
+    header.crc = 0;
+    return crc32c(records, sizeof(Record) * header.count, crc32c(&header, sizeof(header)));
+}
+
+// One thread's queue of records. The owning thread is the only producer and
+// the writer the only consumer, so head and tail each have a single writer.
+struct Ring {
+    Ring(size_t capacity, uint32_t number) : slots(new Record[capacity]), mask(capacity - 1), number(number) {}
+
+    std::unique_ptr<Record[]> slots;
+    const uint64_t mask;
+    const uint32_t number;
+
+    alignas(64) std::atomic<uint64_t> head{0}; // next slot to fill
+    uint64_t cachedTail = 0;                   // producer's last look at tail
+    std::atomic<uint64_t> dropped{0};          // written by the producer only
+
+    alignas(64) std::atomic<uint64_t> tail{0}; // next slot to drain
+    uint64_t reportedDrops = 0;                // writer's count of drops already logged
+    std::atomic<bool> retired{false};          // owning thread has exited
+};
+
+struct AuditState {
+    std::mutex mutex; // guards everything below except the atomics
+    std::condition_variable wake;    // the writer sleeps here between drains
+    std::condition_variable durable; // flush() waits here
+    std::vector<std::shared_ptr<Ring>> rings;
+    VitalEdgeAudit::Options options;
+    std::thread writer;
+    int fd = -1;
+    bool stopping = false;
+    bool failed = false;
+    uint64_t flushRequested = 0;
+    uint64_t flushCompleted = 0;
+    uint64_t nextSequence = 0;
+    uint32_t lastCrc = 0;
+    uint32_t nextRingNumber = 0;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> pressure{false};     // a producer is waiting for ring space
+    std::atomic<uint64_t> generation{0};   // bumped by start(); threads then take a new ring
+    std::atomic<uint64_t> dropped{0};
+};
+
+AuditState& state() {
+    static AuditState* audit = new AuditState(); // outlives thread_local destructors
+    return *audit;
+}
+
+// The calling thread's ring for the current start() generation
+struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+    uint64_t generation = 0;
+
+    ~ThreadRing() {
+        if (ring) ring->retired.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadRing threadRing;
+
+uint64_t wallClockNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void copyField(char* field, size_t size, std::string_view value) {
+    const size_t length = std::min(value.size(), size - 1);
+    std::memcpy(field, value.data(), length);
+    std::memset(field + length, 0, size - length);
+}
+
+bool writeAll(int fd, struct iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = ::writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count > 0 && size_t(written) >= parts->iov_len) {
+            written -= parts->iov_len;
+            ++parts;
+            --count;
+        }
+        if (count > 0) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Writer side: append records as one block, numbering them
+bool writeBlock(AuditState& audit, Record* records, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) records[i].sequence = audit.nextSequence + i;
+
+    BlockHeader header{kBlockMagic, count, audit.nextSequence, audit.lastCrc, 0, 0};
+    header.crc = blockCrc(header, records);
+
+    struct iovec parts[2] = {{&header, sizeof(header)}, {records, sizeof(Record) * count}};
+    if (!writeAll(audit.fd, parts, 2)) return false;
+    audit.nextSequence += count;
+    audit.lastCrc = header.crc;
+    return true;
+}
+
+// Move everything queued in the rings into batch, plus a Dropped record per ring
+// that lost records since the last drain
+void drain(const std::vector<std::shared_ptr<Ring>>& rings, std::vector<Record>& batch) {
+    for (const auto& ring : rings) {
+        const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i < head; ++i) batch.push_back(ring->slots[i & ring->mask]);
+        ring->tail.store(head, std::memory_order_release);
+
+        const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->reportedDrops) {
+            Record lost{};
+            lost.timestamp = wallClockNanos();
+            lost.bytes = dropped - ring->reportedDrops;
+            lost.thread = ring->number;
+            lost.operation = uint16_t(VitalEdgeAudit::Operation::Dropped);
+            batch.push_back(lost);
+            ring->reportedDrops = dropped;
+        }
+    }
+}
+
+void writerLoop() {
+    AuditState& audit = state();
+    std::vector<Record> batch;
+    std::vector<std::shared_ptr<Ring>> rings;
+    auto lastSync = std::chrono::steady_clock::now();
+    bool dirty = false;
+
+    for (;;) {
+        uint64_t ticket;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(audit.mutex);
+            audit.wake.wait_for(lock, std::chrono::milliseconds(audit.options.flushIntervalMillis), [&] {
+                return audit.stopping || audit.flushRequested > audit.flushCompleted ||
+                       audit.pressure.load(std::memory_order_relaxed);
+            });
+            audit.pressure.store(false, std::memory_order_relaxed);
+            ticket = audit.flushRequested;
+            stopping = audit.stopping;
+            rings = audit.rings;
+        }
+
+        batch.clear();
+        drain(rings, batch);
+        bool ok = true;
+        for (size_t offset = 0; ok && offset < batch.size(); offset += kMaxBlockRecords) {
+            const uint32_t count = uint32_t(std::min<size_t>(kMaxBlockRecords, batch.size() - offset));
+            ok = writeBlock(audit, &batch[offset], count);
+            dirty = true;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool syncDue = stopping || ticket > audit.flushCompleted || audit.options.syncIntervalMillis == 0 ||
+                             now - lastSync >= std::chrono::milliseconds(audit.options.syncIntervalMillis);
+        if (ok && dirty && syncDue) {
+            ok = ::fdatasync(audit.fd) == 0;
+            lastSync = now;
+            dirty = false;
+        }
+
+        std::lock_guard<std::mutex> lock(audit.mutex);
+        if (!ok) {
+            // The trail can no longer be guaranteed: stop accepting records
+            std::cerr << "Audit log write failed: " << std::strerror(errno) << std::endl;
+            audit.failed = true;
+            audit.running.store(false);
+        }
+        if (!dirty || !ok) audit.flushCompleted = std::max(audit.flushCompleted, ticket);
+        audit.durable.notify_all();
+
+        // Forget rings whose threads have exited once they are empty
+        audit.rings.erase(std::remove_if(audit.rings.begin(), audit.rings.end(), [](const std::shared_ptr<Ring>& ring) {
+            return ring->retired.load(std::memory_order_acquire) &&
+                   ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+        }), audit.rings.end());
+
+        if (stopping || !ok) return;
+    }
+}
+
+Ring& threadLocalRing(AuditState& audit) {
+    ThreadRing& local = threadRing;
+    const uint64_t generation = audit.generation.load(std::memory_order_acquire);
+    if (!local.ring || local.generation != generation) {
+        std::lock_guard<std::mutex> lock(audit.mutex);
+        if (local.ring) local.ring->retired.store(true, std::memory_order_release);
+        local.ring = std::make_shared<Ring>(audit.options.ringCapacity, audit.nextRingNumber++);
+        local.generation = generation;
+        audit.rings.push_back(local.ring);
+    }
+    return *local.ring;
+}
+
+} // namespace
+
+const char* VitalEdgeAudit::operationName(Operation operation) {
+    switch (operation) {
+        case Operation::Dropped: return "dropped";
+        case Operation::Encrypt: return "encrypt";
+        case Operation::Decrypt: return "decrypt";
+        case Operation::EncryptBatch: return "encrypt-batch";
+        case Operation::DecryptBatch: return "decrypt-batch";
+        case Operation::EncryptStream: return "encrypt-stream";
+        case Operation::EnvelopeEncrypt: return "envelope-encrypt";
+        case Operation::EnvelopeDecrypt: return "envelope-decrypt";
+        case Operation::Obfuscate: return "obfuscate";
+        case Operation::Deobfuscate: return "deobfuscate";
+        case Operation::EncryptFields: return "encrypt-fields";
+        case Operation::DecryptFields: return "decrypt-fields";
+        case Operation::Tokenize: return "tokenize";
+        case Operation::Detokenize: return "detokenize";
+        case Operation::GenerateKeys: return "generate-keys";
+        case Operation::RotateKey: return "rotate-key";
+        case Operation::Sign: return "sign";
+        case Operation::Verify: return "verify";
+        case Operation::SignBatch: return "sign-batch";
+        case Operation::VerifyBatch: return "verify-batch";
+        case Operation::OpenSession: return "open-session";
+        case Operation::CloseSession: return "close-session";
+    }
+    return "unknown";
+}
+
+void VitalEdgeAudit::start(const Options& options) {
+    AuditState& audit = state();
+    std::lock_guard<std::mutex> lock(audit.mutex);
+    if (audit.writer.joinable()) throw std::runtime_error("Audit log already started");
+
+    // Resume after the last intact block of an existing log
+    ReadResult existing = read(options.path, nullptr);
+    if (!existing.complete && !existing.tornTail && existing.validBytes > 0) {
+        throw std::runtime_error("Audit log " + options.path + " is damaged: " + existing.error);
+    }
+    if (!existing.complete && existing.validBytes == 0 && existing.error != "missing") {
+        throw std::runtime_error("Not an audit log: " + options.path + " (" + existing.error + ")");
+    }
+
+    int fd = ::open(options.path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::runtime_error("Unable to open audit log " + options.path + ": " + std::strerror(errno));
+
+    bool ok = true;
+    if (existing.validBytes == 0) {
+        FileHeader header{};
+        std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+        header.version = kVersion;
+        header.recordSize = sizeof(Record);
+        header.created = wallClockNanos();
+        struct iovec part = {&header, sizeof(header)};
+        ok = ::ftruncate(fd, 0) == 0 && writeAll(fd, &part, 1) && ::fsync(fd) == 0;
+        existing.validBytes = sizeof(header);
+    } else {
+        // Drop a torn tail, then append from the end of what remains
+        ok = ::ftruncate(fd, existing.validBytes) == 0 && ::lseek(fd, 0, SEEK_END) >= 0;
+    }
+    if (!ok) {
+        const std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Unable to prepare audit log " + options.path + ": " + reason);
+    }
+
+    size_t capacity = 1;
+    while (capacity < std::max<size_t>(options.ringCapacity, 2)) capacity <<= 1;
+
+    audit.options = options;
+    audit.options.ringCapacity = capacity;
+    audit.options.flushIntervalMillis = std::max(1u, options.flushIntervalMillis);
+    audit.fd = fd;
+    audit.stopping = false;
+    audit.failed = false;
+    audit.flushRequested = audit.flushCompleted = 0;
+    audit.nextSequence = existing.nextSequence;
+    audit.lastCrc = existing.lastCrc;
+    audit.rings.clear();
+    audit.dropped.store(0);
+    audit.generation.fetch_add(1, std::memory_order_release);
+    audit.running.store(true, std::memory_order_release);
+    audit.writer = std::thread(writerLoop);
+}
+
+void VitalEdgeAudit::stop() {
+    AuditState& audit = state();
+    {
+        std::lock_guard<std::mutex> lock(audit.mutex);
+        if (!audit.writer.joinable()) return;
+        audit.running.store(false);
+        audit.stopping = true;
+    }
+    audit.wake.notify_all();
+    audit.writer.join();
+
+    std::lock_guard<std::mutex> lock(audit.mutex);
+    ::close(audit.fd);
+    audit.fd = -1;
+    audit.rings.clear();
+    audit.durable.notify_all();
+}
+
+bool VitalEdgeAudit::running() {
+    return state().running.load(std::memory_order_acquire);
+}
+
+bool VitalEdgeAudit::record(Operation operation, std::string_view keyId, size_t bytes, std::string_view caller,
+                            bool ok) {
+    AuditState& audit = state();
+    if (!audit.running.load(std::memory_order_acquire)) return false;
+    Ring& ring = threadLocalRing(audit);
+
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.cachedTail > ring.mask) {
+        ring.cachedTail = ring.tail.load(std::memory_order_acquire);
+        for (unsigned spins = 0; head - ring.cachedTail > ring.mask; ++spins) {
+            if (audit.options.backpressure == Backpressure::Drop) {
+                ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                audit.dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (!audit.running.load(std::memory_order_acquire)) return false;
+            audit.pressure.store(true, std::memory_order_relaxed);
+            audit.wake.notify_one();
+            if (spins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            ring.cachedTail = ring.tail.load(std::memory_order_acquire);
+        }
+    }
+
+    Record& slot = ring.slots[head & ring.mask];
+    slot.sequence = 0;
+    slot.timestamp = wallClockNanos();
+    slot.bytes = bytes;
+    slot.thread = ring.number;
+    slot.operation = uint16_t(operation);
+    slot.ok = ok ? 1 : 0;
+    slot.reserved = 0;
+    copyField(slot.keyId, kKeyIdSize, keyId);
+    copyField(slot.caller, kCallerSize, caller);
+    ring.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool VitalEdgeAudit::flush() {
+    AuditState& audit = state();
+    std::unique_lock<std::mutex> lock(audit.mutex);
+    if (!audit.writer.joinable() || audit.failed) return false;
+    const uint64_t ticket = ++audit.flushRequested;
+    audit.wake.notify_all();
+    audit.durable.wait(lock, [&] { return audit.flushCompleted >= ticket || audit.failed || !audit.writer.joinable(); });
+    return audit.flushCompleted >= ticket && !audit.failed;
+}
+
+uint64_t VitalEdgeAudit::droppedCount() {
+    return state().dropped.load(std::memory_order_relaxed);
+}
+
+VitalEdgeAudit::ReadResult VitalEdgeAudit::read(const std::string& path,
+                                                const std::function<void(const Record&)>& visit) {
+    ReadResult result;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        result.complete = false;
+        result.error = "missing";
+        return result;
+    }
+
+    FileHeader fileHeader;
+    if (!file.read((char*)&fileHeader, sizeof(fileHeader))) {
+        // An empty file is treated like a new one
+        result.complete = file.gcount() == 0;
+        result.error = result.complete ? "" : "truncated file header";
+        return result;
+    }
+    if (std::memcmp(fileHeader.magic, kFileMagic, sizeof(kFileMagic)) != 0 || fileHeader.version != kVersion ||
+        fileHeader.recordSize != sizeof(Record)) {
+        result.complete = false;
+        result.error = "bad file header";
+        return result;
+    }
+    result.validBytes = sizeof(fileHeader);
+
+    std::vector<Record> records;
+    for (;;) {
+        BlockHeader header;
+        if (!file.read((char*)&header, sizeof(header))) {
+            if (file.gcount() != 0) {
+                result.complete = false;
+                result.tornTail = true;
+                result.error = "truncated block header";
+            }
+            return result;
+        }
+        if (header.magic != kBlockMagic || header.count == 0 || header.count > kMaxBlockRecords) {
+            result.complete = false;
+            result.error = "bad block header at offset " + std::to_string(result.validBytes);
+            return result;
+        }
+
+        records.resize(header.count);
+        if (!file.read((char*)records.data(), sizeof(Record) * header.count)) {
+            result.complete = false;
+            result.tornTail = true;
+            result.error = "truncated block at offset " + std::to_string(result.validBytes);
+            return result;
+        }
+        if (blockCrc(header, records.data()) != header.crc) {
+            // Even in the last block this is not treated as torn: truncating it on
+            // restart would let an edit to the newest records go unnoticed
+            result.complete = false;
+            result.error = "checksum mismatch at offset " + std::to_string(result.validBytes);
+            return result;
+        }
+        if (header.previousCrc != result.lastCrc || header.firstSequence != result.nextSequence) {
+            result.complete = false;
+            result.error = "block out of sequence at offset " + std::to_string(result.validBytes);
+            return result;
+        }
+
+        if (visit) {
+            for (const Record& record : records) visit(record);
+        }
+        result.records += header.count;
+        result.blocks++;
+        result.validBytes += sizeof(header) + sizeof(Record) * header.count;
+        result.nextSequence += header.count;
+        result.lastCrc = header.crc;
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef VITALEDGE_AUDIT_H
+#define VITALEDGE_AUDIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Audit trail of cryptographic operations. Request threads copy a fixed-size
+// record into their own lock-free ring (no allocation, no syscall); a background
+// writer drains the rings in batches into an append-only binary log of
+// checksummed blocks and fsyncs in groups. Records carry the operation, key_id,
+// payload size, caller and time - never key material or payload bytes.
+//
+// Log layout (little-endian):
+//   file header   "VEAUDIT1" | version u32 | record size u32 | created ns u64 | reserved u64
+//   block header  "VEAB" | count u32 | first sequence u64 | previous block crc u32 | crc u32 | reserved u64
+//   records       count x Record
+// Each block's CRC-32C covers its header (crc field zeroed) and records, and
+// chains to the previous block, so a dropped, reordered or edited block is
+// detected. A torn block at the end of the file (crash mid-write) is truncated
+// when the log is reopened.
+class VitalEdgeAudit {
+public:
+    enum class Operation : uint16_t {
+        Dropped = 0, // written by the writer: 'bytes' records lost to a full ring
+        Encrypt,
+        Decrypt,
+        EncryptBatch,
+        DecryptBatch,
+        EncryptStream,
+        EnvelopeEncrypt,
+        EnvelopeDecrypt,
+        Obfuscate,
+        Deobfuscate,
+        EncryptFields,
+        DecryptFields,
+        Tokenize,
+        Detokenize,
+        GenerateKeys,
+        RotateKey,
+        Sign,
+        Verify,
+        SignBatch,
+        VerifyBatch,
+        OpenSession,
+        CloseSession,
+    };
+    static const char* operationName(Operation operation);
+
+    static constexpr size_t kKeyIdSize = 48;
+    static constexpr size_t kCallerSize = 48;
+
+    // One audit record, 128 bytes on disk. Strings are NUL-padded and truncated.
+    struct Record {
+        uint64_t sequence;  // assigned by the writer, gapless within a log
+        uint64_t timestamp; // ns since the Unix epoch
+        uint64_t bytes;     // payload size
+        uint32_t thread;    // recording thread's ring number
+        uint16_t operation;
+        uint8_t ok;         // 1 if the operation succeeded
+        uint8_t reserved;
+        char keyId[kKeyIdSize];   // empty when the request sent a raw key
+        char caller[kCallerSize]; // peer address
+    };
+    static_assert(sizeof(Record) == 128, "audit records are 128 bytes on disk");
+
+    // What a request thread does when its ring is full
+    enum class Backpressure {
+        Block, // wait for the writer: no operation goes unaudited
+        Drop,  // discard the record and count it; the log gets a Dropped record
+    };
+
+    struct Options {
+        std::string path;
+        size_t ringCapacity = 4096; // records per thread (512 KiB), rounded up to a power of two
+        Backpressure backpressure = Backpressure::Block;
+        unsigned flushIntervalMillis = 2; // how often the writer drains the rings
+        unsigned syncIntervalMillis = 10; // group fsync period; 0 syncs every batch
+    };
+
+    // Open (or create and recover) the log and start the writer. Throws
+    // std::runtime_error if the log cannot be opened or is corrupt.
+    static void start(const Options& options);
+
+    // Drain every ring, fsync and stop the writer; records are ignored until the next start()
+    static void stop();
+
+    static bool running();
+
+    // Queue a record from the calling thread. Returns false if it was dropped
+    // (Drop policy with a full ring) or the logger is not running.
+    static bool record(Operation operation, std::string_view keyId, size_t bytes, std::string_view caller, bool ok);
+
+    // Wait until every record queued before the call is written and fsynced.
+    // Returns false if the logger is not running or the writer hit an I/O error.
+    static bool flush();
+
+    // Records discarded under the Drop policy since start()
+    static uint64_t droppedCount();
+
+    struct ReadResult {
+        uint64_t records = 0;
+        uint64_t blocks = 0;
+        uint64_t validBytes = 0;   // length of the intact prefix of the file
+        uint64_t nextSequence = 0; // sequence the next record appended would get
+        uint32_t lastCrc = 0;      // CRC of the last intact block
+        bool complete = true;      // false if reading stopped before the end of the file
+        bool tornTail = false;     // the only damage is an unfinished last block
+        std::string error;         // why reading stopped early
+    };
+
+    // Verify a log and pass each record to visit (which may be empty). Stops at
+    // the first damaged block; the records before it are still delivered.
+    static ReadResult read(const std::string& path, const std::function<void(const Record&)>& visit);
+};
+
+#endif // VITALEDGE_AUDIT_H
@@ -0,0 +1,310 @@
+#include "VitalEdgeBase64.h"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define VITALEDGE_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Sextet value of each character, or 0xFF for characters outside the alphabet
+struct DecodeTable {
+    uint8_t values[256];
+    DecodeTable() {
+        for (auto& value : values) value = 0xFF;
+        for (uint8_t i = 0; i < 64; ++i) values[(unsigned char)kAlphabet[i]] = i;
+    }
+};
+static const DecodeTable kDecode;
+
+// A bulk kernel handles whole blocks from the front of the input and returns how
+// much it consumed (a multiple of 3 bytes when encoding, 4 characters when
+// decoding); the scalar code finishes the rest. Decode kernels stop at the first
+// block holding a character outside the alphabet so the scalar pass rejects it.
+namespace {
+
+struct Kernel {
+    const char* name;
+    size_t (*encode)(const unsigned char* in, size_t length, char* out);
+    size_t (*decode)(const char* in, size_t length, unsigned char* out);
+};
+
+} // namespace
+
+static size_t encodeNone(const unsigned char*, size_t, char*) { return 0; }
+static size_t decodeNone(const char*, size_t, unsigned char*) { return 0; }
+
+#ifdef VITALEDGE_BASE64_X86
+
+// 12 input bytes (of the 16 loaded) to 16 characters, per 128-bit lane
+__attribute__((target("ssse3"))) static inline __m128i encodeLane(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    // Offset from sextet to ASCII, looked up by range: 0-25, 26-51, 52-61, 62, 63
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+__attribute__((target("avx2"))) static inline __m256i encodeLanes(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                     _mm256_set1_epi8(13)));
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+}
+
+// Each step reads 16 bytes but consumes 12, so it stops while 16 remain readable.
+// Inlined into the AVX2 kernel as well, so its tail stays VEX-encoded and does
+// not pay an SSE/AVX transition.
+__attribute__((target("ssse3"))) static inline size_t encodeBlocks(const unsigned char* in, size_t length, char* out) {
+    size_t i = 0;
+    for (; length - i >= 16; i += 12, out += 16) {
+        _mm_storeu_si128((__m128i*)out, encodeLane(_mm_loadu_si128((const __m128i*)(in + i))));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) static size_t encodeSSSE3(const unsigned char* in, size_t length, char* out) {
+    return encodeBlocks(in, length, out);
+}
+
+// Two overlapping 16-byte loads put 12 input bytes in each lane
+__attribute__((target("avx2"))) static size_t encodeAVX2(const unsigned char* in, size_t length, char* out) {
+    size_t i = 0;
+    for (; length - i >= 28; i += 24, out += 32) {
+        const __m128i lo = _mm_loadu_si128((const __m128i*)(in + i));
+        const __m128i hi = _mm_loadu_si128((const __m128i*)(in + i + 12));
+        const __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)out, encodeLanes(block));
+    }
+    return i + encodeBlocks(in + i, length - i, out);
+}
+
+// Mask of characters in [lo, hi]; all ranges are ASCII, so signed compares work
+__attribute__((target("ssse3"))) static inline __m128i inRange(__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), c));
+}
+
+__attribute__((target("avx2"))) static inline __m256i inRange(__m256i c, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), c));
+}
+
+// Characters to sextets; false if any character is outside the alphabet
+__attribute__((target("ssse3"))) static inline bool decodeLane(__m128i& chars) {
+    const __m128i upper = inRange(chars, 'A', 'Z');
+    const __m128i lower = inRange(chars, 'a', 'z');
+    const __m128i digit = inRange(chars, '0', '9');
+    const __m128i plus = _mm_cmpeq_epi8(chars, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'));
+
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+    chars = _mm_add_epi8(chars, shift);
+    return true;
+}
+
+// 16 sextets to 12 bytes at the bottom of the register
+__attribute__((target("ssse3"))) static inline __m128i packLane(__m128i sextets) {
+    const __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("avx2"))) static inline bool decodeLanes(__m256i& chars) {
+    const __m256i upper = inRange(chars, 'A', 'Z');
+    const __m256i lower = inRange(chars, 'a', 'z');
+    const __m256i digit = inRange(chars, '0', '9');
+    const __m256i plus = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('+'));
+    const __m256i slash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/'));
+
+    const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                          _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+    if (_mm256_movemask_epi8(valid) != -1) return false;
+
+    __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')));
+    chars = _mm256_add_epi8(chars, shift);
+    return true;
+}
+
+// Each step stores 16 bytes but produces 12. Running only while 24 characters
+// remain keeps that store inside the output (and off any trailing padding).
+__attribute__((target("ssse3"))) static inline size_t decodeBlocks(const char* in, size_t length, unsigned char* out) {
+    size_t i = 0;
+    for (; length - i >= 24; i += 16, out += 12) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)(in + i));
+        if (!decodeLane(chars)) break;
+        _mm_storeu_si128((__m128i*)out, packLane(chars));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) static size_t decodeSSSE3(const char* in, size_t length, unsigned char* out) {
+    return decodeBlocks(in, length, out);
+}
+
+// As above with 32 characters to 24 bytes per step (and a 32-byte store)
+__attribute__((target("avx2"))) static size_t decodeAVX2(const char* in, size_t length, unsigned char* out) {
+    size_t i = 0;
+    for (; length - i >= 48; i += 32, out += 24) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)(in + i));
+        if (!decodeLanes(chars)) return i;
+
+        const __m256i pairs = _mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140));
+        const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        const __m256i packed = _mm256_shuffle_epi8(words, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // Close the gap between the two lanes' 12-byte results
+        _mm256_storeu_si256((__m256i*)out,
+                            _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7)));
+    }
+    return i + decodeBlocks(in + i, length - i, out);
+}
+
+static const Kernel kSSSE3 = {"ssse3", encodeSSSE3, decodeSSSE3};
+static const Kernel kAVX2 = {"avx2", encodeAVX2, decodeAVX2};
+
+#endif // VITALEDGE_BASE64_X86
+
+static const Kernel kScalar = {"scalar", encodeNone, decodeNone};
+
+static const Kernel* kernelFor(std::string_view name) {
+#ifdef VITALEDGE_BASE64_X86
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) return &kAVX2;
+    if (name == "ssse3" && __builtin_cpu_supports("ssse3")) return &kSSSE3;
+#endif
+    return name == "scalar" ? &kScalar : nullptr;
+}
+
+static const Kernel* detectKernel() {
+    for (const char* name : {"avx2", "ssse3"}) {
+        if (const Kernel* kernel = kernelFor(name)) return kernel;
+    }
+    return &kScalar;
+}
+
+static std::atomic<const Kernel*> activeKernel{detectKernel()};
+
+size_t VitalEdgeBase64::encode(const unsigned char* in, size_t length, char* out) {
+    size_t i = activeKernel.load(std::memory_order_relaxed)->encode(in, length, out);
+    char* o = out + i / 3 * 4;
+
+    for (; length - i >= 3; i += 3, o += 4) {
+        const uint32_t triple = uint32_t(in[i]) << 16 | uint32_t(in[i + 1]) << 8 | in[i + 2];
+        o[0] = kAlphabet[triple >> 18];
+        o[1] = kAlphabet[(triple >> 12) & 0x3F];
+        o[2] = kAlphabet[(triple >> 6) & 0x3F];
+        o[3] = kAlphabet[triple & 0x3F];
+    }
+    if (length - i == 1) {
+        o[0] = kAlphabet[in[i] >> 2];
+        o[1] = kAlphabet[(in[i] & 0x03) << 4];
+        o[2] = o[3] = '=';
+    } else if (length - i == 2) {
+        o[0] = kAlphabet[in[i] >> 2];
+        o[1] = kAlphabet[(in[i] & 0x03) << 4 | in[i + 1] >> 4];
+        o[2] = kAlphabet[(in[i + 1] & 0x0F) << 2];
+        o[3] = '=';
+    }
+    return encodedSize(length);
+}
+
+bool VitalEdgeBase64::decode(const char* in, size_t length, unsigned char* out, size_t* outLength) {
+    // Padding only on a full final quad, at most two characters of it
+    size_t body = length;
+    if (length % 4 == 0) {
+        while (body > 0 && length - body < 2 && in[body - 1] == '=') --body;
+    }
+    if (body % 4 == 1) return false;
+
+    size_t i = activeKernel.load(std::memory_order_relaxed)->decode(in, body, out);
+    unsigned char* o = out + i / 4 * 3;
+
+    const uint8_t* values = kDecode.values;
+    for (; body - i >= 4; i += 4, o += 3) {
+        const uint8_t a = values[(unsigned char)in[i]], b = values[(unsigned char)in[i + 1]];
+        const uint8_t c = values[(unsigned char)in[i + 2]], d = values[(unsigned char)in[i + 3]];
+        if ((a | b | c | d) & 0x80) return false;
+        const uint32_t triple = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6 | d;
+        o[0] = (unsigned char)(triple >> 16);
+        o[1] = (unsigned char)(triple >> 8);
+        o[2] = (unsigned char)triple;
+    }
+
+    // A 2- or 3-character tail; its unused low bits must be zero
+    const size_t tail = body - i;
+    if (tail > 0) {
+        const uint8_t a = values[(unsigned char)in[i]], b = values[(unsigned char)in[i + 1]];
+        const uint8_t c = tail == 3 ? values[(unsigned char)in[i + 2]] : 0;
+        if ((a | b | c) & 0x80) return false;
+        if (tail == 2 && (b & 0x0F)) return false;
+        if (tail == 3 && (c & 0x03)) return false;
+        *o++ = (unsigned char)(a << 2 | b >> 4);
+        if (tail == 3) *o++ = (unsigned char)(b << 4 | c >> 2);
+    }
+
+    *outLength = o - out;
+    return true;
+}
+
+std::string VitalEdgeBase64::encode(std::string_view data) {
+    std::string encoded(encodedSize(data.size()), '\0');
+    encode((const unsigned char*)data.data(), data.size(), &encoded[0]);
+    return encoded;
+}
+
+std::string VitalEdgeBase64::decode(std::string_view encoded) {
+    std::string decoded(maxDecodedSize(encoded.size()), '\0');
+    size_t length = 0;
+    if (!decode(encoded.data(), encoded.size(), (unsigned char*)&decoded[0], &length)) {
+        throw std::invalid_argument("Invalid base64 input");
+    }
+    decoded.resize(length);
+    return decoded;
+}
+
+const char* VitalEdgeBase64::implementation() {
+    return activeKernel.load()->name;
+}
+
+bool VitalEdgeBase64::useImplementation(std::string_view name) {
+    const Kernel* kernel = kernelFor(name);
+    if (!kernel) return false;
+    activeKernel.store(kernel);
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef VITALEDGE_BASE64_H
+#define VITALEDGE_BASE64_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Standard base64 (RFC 4648 alphabet, '=' padding, no line breaks) shared by
+// every encode/decode in the service.
+//
+// AVX2 and SSSE3 kernels handle the bulk of the input and a scalar loop the
+// tail; the widest kernel the CPU supports is picked once at startup. Decoding
+// validates every character and rejects malformed padding. Both directions
+// write straight into a caller-provided buffer sized with encodedSize() or
+// maxDecodedSize().
+class VitalEdgeBase64 {
+public:
+    static constexpr size_t encodedSize(size_t length) { return (length + 2) / 3 * 4; }
+    static constexpr size_t maxDecodedSize(size_t length) { return (length + 3) / 4 * 3; }
+
+    // Writes exactly encodedSize(length) characters and returns that count
+    static size_t encode(const unsigned char* in, size_t length, char* out);
+
+    // Writes at most maxDecodedSize(length) bytes. Returns false if the input is
+    // not valid base64; padding may be omitted but not misplaced.
+    static bool decode(const char* in, size_t length, unsigned char* out, size_t* outLength);
+
+    static std::string encode(std::string_view data);
+    // Throws std::invalid_argument on invalid input
+    static std::string decode(std::string_view encoded);
+
+    // Kernel in use: "avx2", "ssse3" or "scalar"
+    static const char* implementation();
+    // Switch kernels (for tests and benchmarks); false if the CPU lacks it
+    static bool useImplementation(std::string_view name);
+};
+
+#endif // VITALEDGE_BASE64_H
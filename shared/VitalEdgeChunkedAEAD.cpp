@@ -0,0 +1,197 @@
+#include "VitalEdgeChunkedAEAD.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeRandom.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+static constexpr unsigned char kMagic[4] = {'V', 'E', 'C', '1'};
+static constexpr unsigned char kVersion = 1;
+static constexpr size_t kNonceSize = 12;
+
+static const EVP_CIPHER* gcmCipher() {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-GCM");
+    return cipher;
+}
+
+static void storeLE(unsigned char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t loadLE(const unsigned char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= uint64_t(in[i]) << (8 * i);
+    return value;
+}
+
+namespace {
+
+struct Header {
+    size_t segmentSize;
+    uint64_t plaintextSize;
+    size_t segments;
+    const unsigned char* bytes; // the raw header, authenticated by every segment
+};
+
+} // namespace
+
+static size_t segmentCountFor(uint64_t plaintextSize, size_t segmentSize) {
+    return plaintextSize == 0 ? 1 : size_t((plaintextSize + segmentSize - 1) / segmentSize);
+}
+
+static Header parseHeader(const unsigned char* sealed, size_t sealedLen) {
+    if (sealedLen < VitalEdgeChunkedAEAD::kHeaderSize || std::memcmp(sealed, kMagic, sizeof(kMagic)) != 0) {
+        throw std::invalid_argument("Not a chunked AEAD container");
+    }
+    if (sealed[4] != kVersion) {
+        throw std::invalid_argument("Unsupported chunked AEAD version");
+    }
+
+    Header header;
+    header.segmentSize = (size_t)loadLE(sealed + 8, 4);
+    header.plaintextSize = loadLE(sealed + 12, 8);
+    header.bytes = sealed;
+    if (header.segmentSize == 0) {
+        throw std::invalid_argument("Chunked AEAD segment size is zero");
+    }
+    // Checked in this order so a forged plaintext size cannot overflow the arithmetic
+    if (header.plaintextSize > sealedLen) {
+        throw std::invalid_argument("Chunked AEAD container is truncated");
+    }
+    header.segments = segmentCountFor(header.plaintextSize, header.segmentSize);
+    if (VitalEdgeChunkedAEAD::sealedSize(header.plaintextSize, header.segmentSize) != sealedLen) {
+        throw std::invalid_argument("Chunked AEAD container size does not match its header");
+    }
+    return header;
+}
+
+// Base nonce with the segment index XORed into its last 8 bytes
+static std::string segmentNonce(const unsigned char* baseNonce, uint64_t index) {
+    std::string nonce((const char*)baseNonce, kNonceSize);
+    for (size_t i = 0; i < 8; ++i) nonce[kNonceSize - 1 - i] ^= (char)(index >> (8 * i));
+    return nonce;
+}
+
+// One segment's AEAD under a raw key or a keyring key's precomputed schedules
+static void sealSegment(std::string_view key, std::string_view nonce, std::string_view aad,
+                        const unsigned char* in, size_t length, unsigned char* out) {
+    VitalEdgeCipherEngine::encryptAEAD(gcmCipher(), key, nonce, aad, in, length, out, out + length);
+}
+
+static void sealSegment(const VitalEdgeKeyring::Entry& key, std::string_view nonce, std::string_view aad,
+                        const unsigned char* in, size_t length, unsigned char* out) {
+    VitalEdgeCipherEngine::encryptAEAD(key.gcm(true), nonce, aad, in, length, out, out + length);
+}
+
+static void openSegment(std::string_view key, std::string_view nonce, std::string_view aad,
+                        const unsigned char* in, size_t length, unsigned char* out) {
+    VitalEdgeCipherEngine::decryptAEAD(gcmCipher(), key, nonce, aad, in, length, out, in + length);
+}
+
+static void openSegment(const VitalEdgeKeyring::Entry& key, std::string_view nonce, std::string_view aad,
+                        const unsigned char* in, size_t length, unsigned char* out) {
+    VitalEdgeCipherEngine::decryptAEAD(key.gcm(false), nonce, aad, in, length, out, in + length);
+}
+
+template <typename Key>
+static void openSegmentInto(const Header& header, const unsigned char* sealed, const Key& key,
+                            size_t index, unsigned char* out) {
+    const uint64_t offset = uint64_t(index) * header.segmentSize;
+    const size_t length = (size_t)std::min<uint64_t>(header.segmentSize, header.plaintextSize - offset);
+    const unsigned char* segment = sealed + VitalEdgeChunkedAEAD::kHeaderSize +
+                                   size_t(index) * (header.segmentSize + VitalEdgeChunkedAEAD::kTagSize);
+
+    std::string_view aad((const char*)header.bytes, VitalEdgeChunkedAEAD::kHeaderSize);
+    openSegment(key, segmentNonce(header.bytes + 20, index), aad, segment, length, out);
+}
+
+size_t VitalEdgeChunkedAEAD::sealedSize(uint64_t plaintextSize, size_t segmentSize) {
+    if (segmentSize == 0 || segmentSize > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("Chunked AEAD segment size must be between 1 and 2^32 - 1");
+    }
+    return kHeaderSize + (size_t)plaintextSize + segmentCountFor(plaintextSize, segmentSize) * kTagSize;
+}
+
+template <typename Key>
+static void sealWith(const unsigned char* in, size_t inLen, const Key& key, size_t segmentSize, unsigned char* out) {
+    VitalEdgeChunkedAEAD::sealedSize(inLen, segmentSize); // validates segmentSize
+
+    std::memcpy(out, kMagic, sizeof(kMagic));
+    out[4] = kVersion;
+    out[5] = out[6] = out[7] = 0;
+    storeLE(out + 8, segmentSize, 4);
+    storeLE(out + 12, inLen, 8);
+    VitalEdgeRandom::bytes(out + 20, kNonceSize);
+
+    const size_t segments = segmentCountFor(inLen, segmentSize);
+    std::string_view aad((const char*)out, VitalEdgeChunkedAEAD::kHeaderSize);
+    VitalEdgeExecutor::instance().parallelFor(segments, [&](size_t index) {
+        const size_t offset = index * segmentSize;
+        const size_t length = std::min(segmentSize, inLen - offset);
+        unsigned char* segment = out + VitalEdgeChunkedAEAD::kHeaderSize +
+                                 index * (segmentSize + VitalEdgeChunkedAEAD::kTagSize);
+        sealSegment(key, segmentNonce(out + 20, index), aad, in + offset, length, segment);
+    });
+}
+
+void VitalEdgeChunkedAEAD::seal(const unsigned char* in, size_t inLen, std::string_view key, size_t segmentSize,
+                                unsigned char* out) {
+    sealWith(in, inLen, key, segmentSize, out);
+}
+
+void VitalEdgeChunkedAEAD::seal(const unsigned char* in, size_t inLen, const VitalEdgeKeyring::Entry& key,
+                                size_t segmentSize, unsigned char* out) {
+    sealWith(in, inLen, key, segmentSize, out);
+}
+
+std::string VitalEdgeChunkedAEAD::seal(std::string_view plaintext, std::string_view key, size_t segmentSize) {
+    std::string sealed(sealedSize(plaintext.size(), segmentSize), '\0');
+    seal((const unsigned char*)plaintext.data(), plaintext.size(), key, segmentSize, (unsigned char*)&sealed[0]);
+    return sealed;
+}
+
+uint64_t VitalEdgeChunkedAEAD::openedSize(const unsigned char* sealed, size_t sealedLen) {
+    return parseHeader(sealed, sealedLen).plaintextSize;
+}
+
+template <typename Key>
+static void openWith(const unsigned char* sealed, size_t sealedLen, const Key& key, unsigned char* out) {
+    const Header header = parseHeader(sealed, sealedLen);
+    VitalEdgeExecutor::instance().parallelFor(header.segments, [&](size_t index) {
+        openSegmentInto(header, sealed, key, index, out + index * header.segmentSize);
+    });
+}
+
+void VitalEdgeChunkedAEAD::open(const unsigned char* sealed, size_t sealedLen, std::string_view key,
+                                unsigned char* out) {
+    openWith(sealed, sealedLen, key, out);
+}
+
+void VitalEdgeChunkedAEAD::open(const unsigned char* sealed, size_t sealedLen, const VitalEdgeKeyring::Entry& key,
+                                unsigned char* out) {
+    openWith(sealed, sealedLen, key, out);
+}
+
+std::string VitalEdgeChunkedAEAD::open(std::string_view sealed, std::string_view key) {
+    const unsigned char* in = (const unsigned char*)sealed.data();
+    std::string plaintext((size_t)openedSize(in, sealed.size()), '\0');
+    open(in, sealed.size(), key, (unsigned char*)&plaintext[0]);
+    return plaintext;
+}
+
+size_t VitalEdgeChunkedAEAD::segmentCount(std::string_view sealed) {
+    return parseHeader((const unsigned char*)sealed.data(), sealed.size()).segments;
+}
+
+std::string VitalEdgeChunkedAEAD::openSegment(std::string_view sealed, std::string_view key, size_t index) {
+    const unsigned char* in = (const unsigned char*)sealed.data();
+    const Header header = parseHeader(in, sealed.size());
+    if (index >= header.segments) throw std::out_of_range("Chunked AEAD segment index out of range");
+
+    const uint64_t offset = uint64_t(index) * header.segmentSize;
+    std::string plaintext((size_t)std::min<uint64_t>(header.segmentSize, header.plaintextSize - offset), '\0');
+    openSegmentInto(header, in, key, index, (unsigned char*)&plaintext[0]);
+    return plaintext;
+}
@@ -0,0 +1,60 @@
+#ifndef VITALEDGE_CHUNKEDAEAD_H
+#define VITALEDGE_CHUNKEDAEAD_H
+
+#include "VitalEdgeKeyring.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Segmented AES-256-GCM container for large payloads.
+//
+// The plaintext is split into fixed-size segments that are sealed independently,
+// so segments are encrypted and decrypted in parallel on VitalEdgeExecutor and a
+// single segment can be opened without touching the rest.
+//
+// Layout (integers little-endian):
+//   header  "VEC1" | version u8 | reserved u8[3] | segment size u32 |
+//           plaintext size u64 | base nonce u8[12]                    (32 bytes)
+//   then for each segment: ciphertext (segment size, the last one shorter) | tag u8[16]
+//
+// Segment i uses the base nonce with i XORed into its last 8 bytes, and every
+// segment authenticates the whole header. Reordering, truncation, or changing a
+// size therefore fails authentication. An empty payload still has one empty
+// segment, so the header is always verified.
+class VitalEdgeChunkedAEAD {
+public:
+    static constexpr size_t kHeaderSize = 32;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kDefaultSegmentSize = size_t(1) << 20;
+
+    // Size of the sealed container for a payload of plaintextSize bytes
+    static size_t sealedSize(uint64_t plaintextSize, size_t segmentSize = kDefaultSegmentSize);
+
+    // Seal into out, which must hold sealedSize(inLen, segmentSize) bytes. A fresh
+    // random base nonce is drawn for every call.
+    static void seal(const unsigned char* in, size_t inLen, std::string_view key, size_t segmentSize,
+                     unsigned char* out);
+    static std::string seal(std::string_view plaintext, std::string_view key,
+                            size_t segmentSize = kDefaultSegmentSize);
+    // Same, with a keyring key's precomputed GCM schedules
+    static void seal(const unsigned char* in, size_t inLen, const VitalEdgeKeyring::Entry& key, size_t segmentSize,
+                     unsigned char* out);
+
+    // Validate the header and return the plaintext size it declares; throws
+    // std::invalid_argument if the container is malformed
+    static uint64_t openedSize(const unsigned char* sealed, size_t sealedLen);
+
+    // Open into out, which must hold openedSize() bytes; throws std::runtime_error
+    // if any segment fails authentication
+    static void open(const unsigned char* sealed, size_t sealedLen, std::string_view key, unsigned char* out);
+    static void open(const unsigned char* sealed, size_t sealedLen, const VitalEdgeKeyring::Entry& key,
+                     unsigned char* out);
+    static std::string open(std::string_view sealed, std::string_view key);
+
+    // Random access: number of segments, and the plaintext of one of them
+    static size_t segmentCount(std::string_view sealed);
+    static std::string openSegment(std::string_view sealed, std::string_view key, size_t index);
+};
+
+#endif // VITALEDGE_CHUNKEDAEAD_H
@@ -0,0 +1,302 @@
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeSecureMemory.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// EVP_*Update takes an int length, so long inputs are fed in slices of this size
+static constexpr size_t kMaxUpdateSize = size_t(1) << 30;
+
+namespace {
+
+// Matched by scheduleId for keyring schedules, otherwise (scheduleId 0) by
+// cipher, direction and key bytes
+struct CachedContext {
+    uint64_t scheduleId = 0;
+    const EVP_CIPHER* cipher = nullptr;
+    bool encrypt = false;
+    VitalEdgeSecureMemory::String key;
+    EVP_CIPHER_CTX* ctx = nullptr;
+    uint64_t lastUse = 0;
+};
+
+// Per-thread LRU of keyed contexts; small enough that a linear scan beats hashing
+struct ThreadCache {
+    std::vector<CachedContext> entries;
+    uint64_t tick = 0;
+
+    ~ThreadCache() { clear(); }
+
+    static void release(CachedContext& entry) {
+        EVP_CIPHER_CTX_free(entry.ctx);
+        OPENSSL_cleanse(&entry.key[0], entry.key.size());
+        entry.ctx = nullptr;
+        entry.key.clear();
+        entry.cipher = nullptr;
+        entry.scheduleId = 0;
+    }
+
+    void clear() {
+        for (auto& entry : entries) release(entry);
+        entries.clear();
+    }
+
+    // A free slot, or the least recently used one after releasing it
+    CachedContext& slot() {
+        if (entries.size() < VitalEdgeCipherEngine::kThreadCacheSize) {
+            entries.emplace_back();
+            return entries.back();
+        }
+        CachedContext* oldest = &entries.front();
+        for (auto& candidate : entries) {
+            if (candidate.lastUse < oldest->lastUse) oldest = &candidate;
+        }
+        release(*oldest);
+        return *oldest;
+    }
+};
+
+thread_local ThreadCache threadCache;
+
+// Never reused, so a thread cache entry can't match a schedule that replaced a freed one
+std::atomic<uint64_t> nextScheduleId{1};
+
+} // namespace
+
+static void checkKey(const EVP_CIPHER* cipher, std::string_view key) {
+    const size_t keyLen = EVP_CIPHER_get_key_length(cipher);
+    if (key.size() < keyLen) {
+        throw std::invalid_argument("Key must be " + std::to_string(keyLen) + " bytes");
+    }
+}
+
+static void checkIV(const EVP_CIPHER* cipher, std::string_view iv) {
+    const size_t ivLen = EVP_CIPHER_get_iv_length(cipher);
+    if (iv.size() < ivLen) {
+        throw std::invalid_argument("IV must be " + std::to_string(ivLen) + " bytes");
+    }
+}
+
+// Re-arming with only an IV keeps the key schedule and resets the stream state
+static void rearm(EVP_CIPHER_CTX* ctx, std::string_view iv, bool encrypt) {
+    if (!EVP_CipherInit_ex2(ctx, nullptr, nullptr, (const unsigned char*)iv.data(), encrypt ? 1 : 0, nullptr)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to reset cipher context");
+    }
+}
+
+VitalEdgeCipherEngine::KeySchedule::KeySchedule(const EVP_CIPHER* cipher, std::string_view key, bool encrypt)
+    : ctx_(nullptr), id_(nextScheduleId.fetch_add(1)), encrypt_(encrypt) {
+    checkKey(cipher, key);
+    ctx_ = EVP_CIPHER_CTX_new();
+    if (!ctx_ || !EVP_CipherInit_ex2(ctx_, cipher, (const unsigned char*)key.data(), nullptr,
+                                     encrypt ? 1 : 0, nullptr)) {
+        EVP_CIPHER_CTX_free(ctx_);
+        VitalEdgeUtils::throwOpenSSLError("Unable to expand key schedule");
+    }
+}
+
+VitalEdgeCipherEngine::KeySchedule::~KeySchedule() {
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+const EVP_CIPHER* VitalEdgeCipherEngine::fetchCipher(const char* name) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, EVP_CIPHER*> ciphers;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ciphers.find(name);
+    if (it != ciphers.end()) return it->second;
+
+    EVP_CIPHER* cipher = EVP_CIPHER_fetch(nullptr, name, nullptr);
+    if (!cipher) VitalEdgeUtils::throwOpenSSLError("Unable to fetch cipher");
+
+    // Held for the lifetime of the process
+    ciphers.emplace(name, cipher);
+    return cipher;
+}
+
+EVP_CIPHER_CTX* VitalEdgeCipherEngine::acquire(const EVP_CIPHER* cipher, std::string_view key,
+                                               std::string_view iv, bool encrypt) {
+    checkKey(cipher, key);
+    checkIV(cipher, iv);
+    const size_t keyLen = EVP_CIPHER_get_key_length(cipher);
+
+    ThreadCache& cache = threadCache;
+    CachedContext* entry = nullptr;
+    for (auto& candidate : cache.entries) {
+        if (candidate.scheduleId == 0 && candidate.cipher == cipher && candidate.encrypt == encrypt &&
+            candidate.key.size() == keyLen && CRYPTO_memcmp(candidate.key.data(), key.data(), keyLen) == 0) {
+            entry = &candidate;
+            break;
+        }
+    }
+
+    if (!entry) {
+        entry = &cache.slot();
+        entry->ctx = EVP_CIPHER_CTX_new();
+        if (!entry->ctx) VitalEdgeUtils::throwOpenSSLError("Unable to allocate cipher context");
+        entry->cipher = cipher;
+        entry->encrypt = encrypt;
+        entry->key.assign(key.data(), keyLen);
+
+        // Full init once: this is where the key schedule is expanded
+        if (!EVP_CipherInit_ex2(entry->ctx, cipher, (const unsigned char*)key.data(),
+                                (const unsigned char*)iv.data(), encrypt ? 1 : 0, nullptr)) {
+            ThreadCache::release(*entry);
+            VitalEdgeUtils::throwOpenSSLError("Unable to initialise cipher");
+        }
+    } else {
+        rearm(entry->ctx, iv, encrypt);
+    }
+
+    entry->lastUse = ++cache.tick;
+    return entry->ctx;
+}
+
+EVP_CIPHER_CTX* VitalEdgeCipherEngine::acquire(const KeySchedule& schedule, std::string_view iv) {
+    checkIV(EVP_CIPHER_CTX_get0_cipher(schedule.context()), iv);
+
+    ThreadCache& cache = threadCache;
+    CachedContext* entry = nullptr;
+    for (auto& candidate : cache.entries) {
+        if (candidate.scheduleId == schedule.id()) {
+            entry = &candidate;
+            break;
+        }
+    }
+
+    if (!entry) {
+        // Copying the schedule's context carries the expanded key with it
+        entry = &cache.slot();
+        entry->ctx = EVP_CIPHER_CTX_new();
+        if (!entry->ctx || !EVP_CIPHER_CTX_copy(entry->ctx, schedule.context())) {
+            ThreadCache::release(*entry);
+            VitalEdgeUtils::throwOpenSSLError("Unable to copy key schedule");
+        }
+        entry->scheduleId = schedule.id();
+    }
+    rearm(entry->ctx, iv, schedule.encrypting());
+
+    entry->lastUse = ++cache.tick;
+    return entry->ctx;
+}
+
+EVP_CIPHER_CTX* VitalEdgeCipherEngine::newContext(const EVP_CIPHER* cipher, std::string_view key,
+                                                  std::string_view iv, bool encrypt) {
+    EVP_CIPHER_CTX* cached = acquire(cipher, key, iv, encrypt);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx || !EVP_CIPHER_CTX_copy(ctx, cached)) {
+        EVP_CIPHER_CTX_free(ctx);
+        VitalEdgeUtils::throwOpenSSLError("Unable to copy cipher context");
+    }
+    return ctx;
+}
+
+static size_t updateCipher(EVP_CIPHER_CTX* ctx, const unsigned char* in, size_t inLen, unsigned char* out) {
+    size_t total = 0;
+    int len = 0;
+    while (inLen > 0) {
+        const size_t slice = inLen < kMaxUpdateSize ? inLen : kMaxUpdateSize;
+        if (!EVP_CipherUpdate(ctx, out + total, &len, in, (int)slice)) {
+            VitalEdgeUtils::throwOpenSSLError("Cipher update failed");
+        }
+        total += len;
+        in += slice;
+        inLen -= slice;
+    }
+    return total;
+}
+
+static size_t runCipher(EVP_CIPHER_CTX* ctx, const unsigned char* in, size_t inLen, unsigned char* out) {
+    size_t total = updateCipher(ctx, in, inLen, out);
+    int len = 0;
+    if (!EVP_CipherFinal_ex(ctx, out + total, &len)) {
+        VitalEdgeUtils::throwOpenSSLError("Cipher finalisation failed");
+    }
+    return total + len;
+}
+
+// Feed additional authenticated data ahead of the payload
+static void updateAAD(EVP_CIPHER_CTX* ctx, std::string_view aad) {
+    int len = 0;
+    if (!aad.empty() && !EVP_CipherUpdate(ctx, nullptr, &len, (const unsigned char*)aad.data(), (int)aad.size())) {
+        VitalEdgeUtils::throwOpenSSLError("Cipher AAD update failed");
+    }
+}
+
+static size_t sealAEAD(EVP_CIPHER_CTX* ctx, std::string_view aad, const unsigned char* in, size_t inLen,
+                       unsigned char* out, unsigned char* tag) {
+    updateAAD(ctx, aad);
+    size_t total = runCipher(ctx, in, inLen, out);
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, (int)VitalEdgeCipherEngine::kAEADTagSize, tag)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to read authentication tag");
+    }
+    return total;
+}
+
+static size_t openAEAD(EVP_CIPHER_CTX* ctx, std::string_view aad, const unsigned char* in, size_t inLen,
+                       unsigned char* out, const unsigned char* tag) {
+    updateAAD(ctx, aad);
+    size_t total = updateCipher(ctx, in, inLen, out);
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, (int)VitalEdgeCipherEngine::kAEADTagSize, (void*)tag)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to set authentication tag");
+    }
+
+    int len = 0;
+    if (EVP_CipherFinal_ex(ctx, out + total, &len) <= 0) {
+        ERR_clear_error();
+        throw std::runtime_error("Authentication failed");
+    }
+    return total + len;
+}
+
+size_t VitalEdgeCipherEngine::encrypt(const EVP_CIPHER* cipher, std::string_view key, std::string_view iv,
+                                      const unsigned char* in, size_t inLen, unsigned char* out) {
+    return runCipher(acquire(cipher, key, iv, true), in, inLen, out);
+}
+
+size_t VitalEdgeCipherEngine::decrypt(const EVP_CIPHER* cipher, std::string_view key, std::string_view iv,
+                                      const unsigned char* in, size_t inLen, unsigned char* out) {
+    return runCipher(acquire(cipher, key, iv, false), in, inLen, out);
+}
+
+size_t VitalEdgeCipherEngine::crypt(const KeySchedule& schedule, std::string_view iv,
+                                    const unsigned char* in, size_t inLen, unsigned char* out) {
+    return runCipher(acquire(schedule, iv), in, inLen, out);
+}
+
+size_t VitalEdgeCipherEngine::encryptAEAD(const EVP_CIPHER* cipher, std::string_view key, std::string_view nonce,
+                                          std::string_view aad, const unsigned char* in, size_t inLen,
+                                          unsigned char* out, unsigned char* tag) {
+    return sealAEAD(acquire(cipher, key, nonce, true), aad, in, inLen, out, tag);
+}
+
+size_t VitalEdgeCipherEngine::decryptAEAD(const EVP_CIPHER* cipher, std::string_view key, std::string_view nonce,
+                                          std::string_view aad, const unsigned char* in, size_t inLen,
+                                          unsigned char* out, const unsigned char* tag) {
+    return openAEAD(acquire(cipher, key, nonce, false), aad, in, inLen, out, tag);
+}
+
+size_t VitalEdgeCipherEngine::encryptAEAD(const KeySchedule& schedule, std::string_view nonce, std::string_view aad,
+                                          const unsigned char* in, size_t inLen, unsigned char* out,
+                                          unsigned char* tag) {
+    if (!schedule.encrypting()) throw std::logic_error("Key schedule is for decryption");
+    return sealAEAD(acquire(schedule, nonce), aad, in, inLen, out, tag);
+}
+
+size_t VitalEdgeCipherEngine::decryptAEAD(const KeySchedule& schedule, std::string_view nonce, std::string_view aad,
+                                          const unsigned char* in, size_t inLen, unsigned char* out,
+                                          const unsigned char* tag) {
+    if (schedule.encrypting()) throw std::logic_error("Key schedule is for encryption");
+    return openAEAD(acquire(schedule, nonce), aad, in, inLen, out, tag);
+}
+
+void VitalEdgeCipherEngine::clearThreadCache() {
+    threadCache.clear();
+}
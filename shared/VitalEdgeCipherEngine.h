@@ -0,0 +1,91 @@
+#ifndef VITALEDGE_CIPHERENGINE_H
+#define VITALEDGE_CIPHERENGINE_H
+
+#include <openssl/evp.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Reusable cipher state behind the symmetric paths of VitalEdgeCrypto.
+//
+// Ciphers are fetched once per process (EVP_CIPHER_fetch) and each thread keeps
+// a small LRU of contexts that already hold the expanded key schedule for a
+// (cipher, key, direction) triple. A call only re-arms the IV on a cached context
+// instead of allocating a context and running the key schedule again.
+class VitalEdgeCipherEngine {
+public:
+    // A key expanded once for one cipher and direction, for keys that live longer
+    // than a request (keyring entries). Threads copy it into their own cache the
+    // first time they use it, matching by id() rather than comparing key bytes.
+    class KeySchedule {
+    public:
+        KeySchedule(const EVP_CIPHER* cipher, std::string_view key, bool encrypt);
+        ~KeySchedule();
+        KeySchedule(const KeySchedule&) = delete;
+        KeySchedule& operator=(const KeySchedule&) = delete;
+
+        const EVP_CIPHER_CTX* context() const { return ctx_; }
+        uint64_t id() const { return id_; }
+        bool encrypting() const { return encrypt_; }
+
+    private:
+        EVP_CIPHER_CTX* ctx_;
+        uint64_t id_;
+        bool encrypt_;
+    };
+
+    // Process-wide cipher handle for an OpenSSL name such as "AES-256-CBC"
+    static const EVP_CIPHER* fetchCipher(const char* name);
+
+    // Thread-local context keyed for (cipher, key, encrypt) and reset to iv.
+    // The context remains owned by the engine and is only valid until the next
+    // acquire() on the same thread.
+    static EVP_CIPHER_CTX* acquire(const EVP_CIPHER* cipher, std::string_view key,
+                                   std::string_view iv, bool encrypt);
+
+    // Same, for a precomputed key schedule; the direction is the schedule's
+    static EVP_CIPHER_CTX* acquire(const KeySchedule& schedule, std::string_view iv);
+
+    // Context owned by the caller (free with EVP_CIPHER_CTX_free), copied from the
+    // thread's keyed context so it skips the key schedule too. For work that
+    // outlives a single call, such as a stream spread over many callbacks.
+    static EVP_CIPHER_CTX* newContext(const EVP_CIPHER* cipher, std::string_view key,
+                                      std::string_view iv, bool encrypt);
+
+    // One-shot encryption/decryption into a caller-provided buffer. The output
+    // buffer must hold inLen + block size bytes; returns the bytes written.
+    static size_t encrypt(const EVP_CIPHER* cipher, std::string_view key, std::string_view iv,
+                          const unsigned char* in, size_t inLen, unsigned char* out);
+    static size_t decrypt(const EVP_CIPHER* cipher, std::string_view key, std::string_view iv,
+                          const unsigned char* in, size_t inLen, unsigned char* out);
+
+    // Run a precomputed key schedule in its direction (encrypt or decrypt)
+    static size_t crypt(const KeySchedule& schedule, std::string_view iv,
+                        const unsigned char* in, size_t inLen, unsigned char* out);
+
+    // One-shot AEAD (e.g. "AES-256-GCM") with a 16-byte tag. The output buffer must
+    // hold inLen bytes. decryptAEAD throws std::runtime_error if the tag does not
+    // verify, and the output must then be discarded.
+    static size_t encryptAEAD(const EVP_CIPHER* cipher, std::string_view key, std::string_view nonce,
+                              std::string_view aad, const unsigned char* in, size_t inLen,
+                              unsigned char* out, unsigned char* tag);
+    static size_t decryptAEAD(const EVP_CIPHER* cipher, std::string_view key, std::string_view nonce,
+                              std::string_view aad, const unsigned char* in, size_t inLen,
+                              unsigned char* out, const unsigned char* tag);
+
+    static size_t encryptAEAD(const KeySchedule& schedule, std::string_view nonce, std::string_view aad,
+                              const unsigned char* in, size_t inLen, unsigned char* out, unsigned char* tag);
+    static size_t decryptAEAD(const KeySchedule& schedule, std::string_view nonce, std::string_view aad,
+                              const unsigned char* in, size_t inLen, unsigned char* out, const unsigned char* tag);
+
+    static constexpr size_t kAEADTagSize = 16;
+
+    // Free the calling thread's cached contexts and wipe their key copies
+    static void clearThreadCache();
+
+    // Number of contexts cached per thread before the least recently used is evicted
+    static constexpr size_t kThreadCacheSize = 16;
+};
+
+#endif // VITALEDGE_CIPHERENGINE_H
@@ -0,0 +1,73 @@
+#include "VitalEdgeCompression.h"
+#include "VitalEdgeMetrics.h"
+#include <zstd.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct ThreadContexts {
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> compress{nullptr, ZSTD_freeCCtx};
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> decompress{nullptr, ZSTD_freeDCtx};
+};
+
+thread_local ThreadContexts contexts;
+
+ZSTD_CCtx* compressContext() {
+    if (!contexts.compress) contexts.compress.reset(ZSTD_createCCtx());
+    if (!contexts.compress) throw std::bad_alloc();
+    return contexts.compress.get();
+}
+
+ZSTD_DCtx* decompressContext() {
+    if (!contexts.decompress) contexts.decompress.reset(ZSTD_createDCtx());
+    if (!contexts.decompress) throw std::bad_alloc();
+    return contexts.decompress.get();
+}
+
+} // namespace
+
+int VitalEdgeCompression::minLevel() {
+    return ZSTD_minCLevel();
+}
+
+int VitalEdgeCompression::maxLevel() {
+    return ZSTD_maxCLevel();
+}
+
+size_t VitalEdgeCompression::bound(size_t size) {
+    return ZSTD_compressBound(size);
+}
+
+size_t VitalEdgeCompression::compress(std::string_view data, int level, char* out) {
+    static const VitalEdgeMetrics::Timer timer("op", "compress");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, data.size());
+    if (level < minLevel() || level > maxLevel() || level == 0) {
+        throw std::invalid_argument("Compression level must be " + std::to_string(minLevel()) + " to " +
+                                    std::to_string(maxLevel()) + ", and not 0");
+    }
+    const size_t written =
+        ZSTD_compressCCtx(compressContext(), out, bound(data.size()), data.data(), data.size(), level);
+    if (ZSTD_isError(written)) {
+        throw std::runtime_error(std::string("Compression failed: ") + ZSTD_getErrorName(written));
+    }
+    return written;
+}
+
+size_t VitalEdgeCompression::decompressedSize(std::string_view frame, size_t maxSize) {
+    const unsigned long long size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        throw std::invalid_argument("Compressed data is not a valid frame");
+    }
+    if (size > maxSize) throw std::invalid_argument("Compressed data expands past the size limit");
+    return size_t(size);
+}
+
+size_t VitalEdgeCompression::decompress(std::string_view frame, char* out, size_t capacity) {
+    static const VitalEdgeMetrics::Timer timer("op", "decompress");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, capacity);
+    const size_t written = ZSTD_decompressDCtx(decompressContext(), out, capacity, frame.data(), frame.size());
+    if (ZSTD_isError(written)) throw std::invalid_argument("Compressed data is corrupt");
+    return written;
+}
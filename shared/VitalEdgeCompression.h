@@ -0,0 +1,38 @@
+#ifndef VITALEDGE_COMPRESSION_H
+#define VITALEDGE_COMPRESSION_H
+
+#include <cstddef>
+#include <string_view>
+
+// zstd compression for the compress-then-encrypt paths of VitalEdgeCrypto.
+//
+// Each thread keeps one compression and one decompression context, created on
+// first use and reused by every later call, so compressing a request allocates
+// no zstd state. Output goes to caller buffers, which on the crypto paths are
+// secure memory: compressed plaintext is still plaintext.
+class VitalEdgeCompression {
+public:
+    static constexpr int kDefaultLevel = 3;
+
+    // Levels compress() accepts: negative levels trade ratio for speed, the
+    // highest ones speed for ratio
+    static int minLevel();
+    static int maxLevel();
+
+    // Most bytes compress() writes for an input of size bytes
+    static size_t bound(size_t size);
+
+    // Compress data as one zstd frame that records its decompressed size. out
+    // needs bound(data.size()) bytes; returns the number written. Throws
+    // std::invalid_argument for a level outside minLevel()..maxLevel().
+    static size_t compress(std::string_view data, int level, char* out);
+
+    // Size a frame decompresses to. Throws std::invalid_argument when it is not
+    // a zstd frame, does not record its size, or would exceed maxSize.
+    static size_t decompressedSize(std::string_view frame, size_t maxSize);
+    // Decompress a frame into out, which holds decompressedSize() bytes; returns
+    // the number written. Throws std::invalid_argument for a corrupt frame.
+    static size_t decompress(std::string_view frame, char* out, size_t capacity);
+};
+
+#endif // VITALEDGE_COMPRESSION_H
@@ -1,24 +1,27 @@
 #include "VitalEdgeCrypto.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeCompression.h"
+#include "VitalEdgeEnvelope.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeMetrics.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeUtils.h"
 #include <openssl/bio.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
 #include <openssl/evp.h>
-#include <openssl/rand.h>
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
-#include <openssl/err.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 #include <fstream>
 #include <sstream>
 
-// Helper to handle OpenSSL errors
-static void handleOpenSSLErrors() {
-    unsigned long errCode;
-    while ((errCode = ERR_get_error())) {
-        char *err = ERR_error_string(errCode, nullptr);
-        throw std::runtime_error(err);
-    }
-}
-
 // Save key to file
 void VitalEdgeCrypto::KeyManager::saveKeyToFile(const std::string& key, const std::string& filepath) {
     std::ofstream file(filepath);
@@ -41,63 +44,567 @@ std::string VitalEdgeCrypto::KeyManager::loadKeyFromFile(const std::string& file
     return buffer.str();
 }
 
+// Load every key in a keyring file
+size_t VitalEdgeCrypto::KeyManager::loadKeyring(const std::string& filepath) {
+    return VitalEdgeKeyring::loadFile(filepath);
+}
+
+// Keyring lookup by key_id, or nullptr
+VitalEdgeKeyring::EntryPtr VitalEdgeCrypto::KeyManager::findKey(const std::string& keyId) {
+    return VitalEdgeKeyring::find(keyId);
+}
+
+VitalEdgeKeyring::EntryPtr VitalEdgeCrypto::KeyManager::findKey(const std::string& keyId, uint32_t version) {
+    return VitalEdgeKeyring::find(keyId, version);
+}
+
+// Signing keys share VitalEdgeKeyCache's pinned registry, so they are parsed once
+VitalEdgeKeyCache::KeyPtr VitalEdgeCrypto::KeyManager::registerSigningKey(const std::string& keyId,
+                                                                         const std::string& pem) {
+    const bool isPrivate = pem.find("PRIVATE KEY") != std::string::npos;
+    VitalEdgeKeyCache::KeyPtr key = isPrivate ? VitalEdgeKeyCache::privateKey(pem) : VitalEdgeKeyCache::publicKey(pem);
+    if (!key->isEd25519()) throw std::invalid_argument("Signing key " + keyId + " is not an Ed25519 key");
+    return VitalEdgeKeyCache::registerKey(keyId, pem, isPrivate);
+}
+
+VitalEdgeKeyCache::KeyPtr VitalEdgeCrypto::KeyManager::findSigningKey(const std::string& keyId) {
+    VitalEdgeKeyCache::KeyPtr key = VitalEdgeKeyCache::findKey(keyId);
+    return key && key->isEd25519() ? key : nullptr;
+}
+
+size_t VitalEdgeCrypto::KeyManager::loadSigningKeys(const std::string& filepath) {
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open signing key list: " + filepath);
+    }
+    size_t count = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string keyId, pemPath;
+        if (!(fields >> keyId) || keyId[0] == '#') continue;
+        if (!(fields >> pemPath)) throw std::invalid_argument("Signing key " + keyId + " has no PEM file");
+        registerSigningKey(keyId, loadKeyFromFile(pemPath));
+        ++count;
+    }
+    return count;
+}
+
+// Rotations are serialised so the version written to the file is the one added
+VitalEdgeKeyring::EntryPtr VitalEdgeCrypto::KeyManager::rotateKey(const std::string& keyId,
+                                                                  const std::string& keyringFile) {
+    if (!VitalEdgeKeyring::validKeyId(keyId)) {
+        throw std::invalid_argument("Invalid key_id: use 1 to 128 letters, digits, '.', '_' or '-'");
+    }
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    VitalEdgeKeyring::EntryPtr current = VitalEdgeKeyring::find(keyId);
+    const uint32_t version = current ? current->version() + 1 : 1;
+    SecureString key = generateSecureKey(VitalEdgeKeyring::Entry::kKeySize);
+    if (!keyringFile.empty()) VitalEdgeKeyring::appendToFile(keyringFile, keyId, key, version);
+    return VitalEdgeKeyring::add(keyId, key, version);
+}
+
+// AES-256-CBC, fetched once for the process
+static const EVP_CIPHER* aesCipher() {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-CBC");
+    return cipher;
+}
+
 // Symmetric encryption (AES)
 std::string VitalEdgeCrypto::encryptAES(const std::string& plaintext, const std::string& key, const std::string& iv) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) handleOpenSSLErrors();
+    std::string ciphertext(plaintext.size() + kAESBlockSize, '\0');
+    ciphertext.resize(encryptAES(std::string_view(plaintext), key, iv, &ciphertext[0]));
+    return ciphertext;
+}
+
+std::string VitalEdgeCrypto::decryptAES(const std::string& ciphertext, const std::string& key, const std::string& iv) {
+    std::string plaintext(ciphertext.size() + kAESBlockSize, '\0');
+    plaintext.resize(decryptAES(std::string_view(ciphertext), key, iv, &plaintext[0]));
+    return plaintext;
+}
+
+std::string VitalEdgeCrypto::encryptAES(const std::string& plaintext, const VitalEdgeKeyring::Entry& key,
+                                        const std::string& iv) {
+    std::string ciphertext(plaintext.size() + kAESBlockSize, '\0');
+    ciphertext.resize(encryptAES(std::string_view(plaintext), key, iv, &ciphertext[0]));
+    return ciphertext;
+}
+
+std::string VitalEdgeCrypto::decryptAES(const std::string& ciphertext, const VitalEdgeKeyring::Entry& key,
+                                        const std::string& iv) {
+    std::string plaintext(ciphertext.size() + kAESBlockSize, '\0');
+    plaintext.resize(decryptAES(std::string_view(ciphertext), key, iv, &plaintext[0]));
+    return plaintext;
+}
+
+size_t VitalEdgeCrypto::encryptAES(std::string_view plaintext, std::string_view key, std::string_view iv, char* out) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptAES");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    return VitalEdgeCipherEngine::encrypt(aesCipher(), key, iv, (const unsigned char*)plaintext.data(),
+                                          plaintext.size(), (unsigned char*)out);
+}
+
+size_t VitalEdgeCrypto::decryptAES(std::string_view ciphertext, std::string_view key, std::string_view iv, char* out) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptAES");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, ciphertext.size());
+    return VitalEdgeCipherEngine::decrypt(aesCipher(), key, iv, (const unsigned char*)ciphertext.data(),
+                                          ciphertext.size(), (unsigned char*)out);
+}
+
+size_t VitalEdgeCrypto::encryptAES(std::string_view plaintext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                                   char* out) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptAES");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    return VitalEdgeCipherEngine::crypt(key.cbc(true), iv, (const unsigned char*)plaintext.data(), plaintext.size(),
+                                        (unsigned char*)out);
+}
+
+size_t VitalEdgeCrypto::decryptAES(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                                   char* out) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptAES");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, ciphertext.size());
+    return VitalEdgeCipherEngine::crypt(key.cbc(false), iv, (const unsigned char*)ciphertext.data(),
+                                        ciphertext.size(), (unsigned char*)out);
+}
 
-    const EVP_CIPHER* cipher = EVP_aes_256_cbc();
-    if (!EVP_EncryptInit_ex(ctx, cipher, nullptr, (const unsigned char*)key.data(), (const unsigned char*)iv.data())) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+// Grow out to hold an output of up to maxLength, run write into it and trim to
+// what was written
+template <typename Write>
+static void writeInto(VitalEdgeCrypto::SecureString& out, size_t maxLength, Write&& write) {
+    out.resize(maxLength);
+    out.resize(write(&out[0]));
+}
+
+void VitalEdgeCrypto::encryptAES(std::string_view plaintext, std::string_view key, std::string_view iv,
+                                 SecureString& out) {
+    writeInto(out, plaintext.size() + kAESBlockSize, [&](char* buffer) {
+        return encryptAES(plaintext, key, iv, buffer);
+    });
+}
+
+void VitalEdgeCrypto::decryptAES(std::string_view ciphertext, std::string_view key, std::string_view iv,
+                                 SecureString& out) {
+    writeInto(out, ciphertext.size() + kAESBlockSize, [&](char* buffer) {
+        return decryptAES(ciphertext, key, iv, buffer);
+    });
+}
+
+void VitalEdgeCrypto::encryptAES(std::string_view plaintext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                                 SecureString& out) {
+    writeInto(out, plaintext.size() + kAESBlockSize, [&](char* buffer) {
+        return encryptAES(plaintext, key, iv, buffer);
+    });
+}
+
+void VitalEdgeCrypto::decryptAES(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key,
+                                 std::string_view iv, SecureString& out) {
+    writeInto(out, ciphertext.size() + kAESBlockSize, [&](char* buffer) {
+        return decryptAES(ciphertext, key, iv, buffer);
+    });
+}
+
+// Headers of compress-then-encrypt frames
+static constexpr char kFrameStored = '\xF0';
+static constexpr char kFrameZstd = '\xF1';
+
+bool VitalEdgeCrypto::isCompressed(std::string_view ciphertext) {
+    return ciphertext.size() % kAESBlockSize == kCompressedPrefixSize &&
+           ciphertext.compare(0, kCompressedPrefixSize, kCompressedPrefix) == 0;
+}
+
+template <typename Key>
+static void encryptFramed(std::string_view plaintext, const Key& key, std::string_view iv, int level,
+                          VitalEdgeCrypto::SecureString& out) {
+    VitalEdgeCrypto::SecureString frame;
+    if (level != 0) {
+        frame.resize(1 + VitalEdgeCompression::bound(plaintext.size()));
+        const size_t written = VitalEdgeCompression::compress(plaintext, level, &frame[1]);
+        frame[0] = kFrameZstd;
+        frame.resize(written < plaintext.size() ? 1 + written : 0);
+    }
+    if (frame.empty()) {
+        frame.reserve(1 + plaintext.size());
+        frame.push_back(kFrameStored);
+        frame.append(plaintext);
     }
+    // Ciphertext goes straight in behind the prefix
+    const size_t prefix = VitalEdgeCrypto::kCompressedPrefixSize;
+    out.resize(prefix + frame.size() + VitalEdgeCrypto::kAESBlockSize);
+    std::memcpy(&out[0], VitalEdgeCrypto::kCompressedPrefix, prefix);
+    out.resize(prefix + VitalEdgeCrypto::encryptAES(std::string_view(frame), key, iv, &out[prefix]));
+}
 
-    std::vector<unsigned char> ciphertext(plaintext.size() + EVP_CIPHER_block_size(cipher));
-    int len = 0, ciphertextLen = 0;
+template <typename Key>
+static void decryptFramed(std::string_view ciphertext, const Key& key, std::string_view iv,
+                          VitalEdgeCrypto::SecureString& out, size_t maxSize) {
+    if (!VitalEdgeCrypto::isCompressed(ciphertext)) {
+        throw std::invalid_argument("Ciphertext is not compressed ciphertext");
+    }
+    VitalEdgeCrypto::SecureString frame;
+    VitalEdgeCrypto::decryptAES(ciphertext.substr(VitalEdgeCrypto::kCompressedPrefixSize), key, iv, frame);
+    const std::string_view body = frame.empty() ? std::string_view() : std::string_view(frame).substr(1);
+    if (!frame.empty() && frame[0] == kFrameStored) {
+        if (body.size() > maxSize) throw std::invalid_argument("Compressed data expands past the size limit");
+        out.assign(body.data(), body.size());
+    } else if (!frame.empty() && frame[0] == kFrameZstd) {
+        out.resize(VitalEdgeCompression::decompressedSize(body, maxSize));
+        out.resize(VitalEdgeCompression::decompress(body, &out[0], out.size()));
+    } else {
+        throw std::invalid_argument("Decrypted data is not a compressed frame");
+    }
+}
+
+void VitalEdgeCrypto::encryptAESCompressed(std::string_view plaintext, std::string_view key, std::string_view iv,
+                                           int level, SecureString& out) {
+    encryptFramed(plaintext, key, iv, level, out);
+}
+
+void VitalEdgeCrypto::encryptAESCompressed(std::string_view plaintext, const VitalEdgeKeyring::Entry& key,
+                                           std::string_view iv, int level, SecureString& out) {
+    encryptFramed(plaintext, key, iv, level, out);
+}
+
+void VitalEdgeCrypto::decryptAESCompressed(std::string_view ciphertext, std::string_view key, std::string_view iv,
+                                           SecureString& out, size_t maxSize) {
+    decryptFramed(ciphertext, key, iv, out, maxSize);
+}
+
+void VitalEdgeCrypto::decryptAESCompressed(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key,
+                                           std::string_view iv, SecureString& out, size_t maxSize) {
+    decryptFramed(ciphertext, key, iv, out, maxSize);
+}
 
-    if (!EVP_EncryptUpdate(ctx, ciphertext.data(), &len, (const unsigned char*)plaintext.data(), plaintext.size())) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+// AES-256-GCM, fetched once for the process
+static const EVP_CIPHER* gcmCipher() {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-GCM");
+    return cipher;
+}
+
+// Authenticated symmetric encryption (AES-GCM)
+std::string VitalEdgeCrypto::encryptGCM(const std::string& plaintext, const std::string& key, const std::string& nonce,
+                                        const std::string& aad) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptGCM");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    std::string sealed(plaintext.size() + tagSize, '\0');
+    unsigned char* out = (unsigned char*)&sealed[0];
+    VitalEdgeCipherEngine::encryptAEAD(gcmCipher(), key, nonce, aad,
+                                       (const unsigned char*)plaintext.data(), plaintext.size(),
+                                       out, out + plaintext.size());
+    return sealed;
+}
+
+std::string VitalEdgeCrypto::decryptGCM(const std::string& sealed, const std::string& key, const std::string& nonce,
+                                        const std::string& aad) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptGCM");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, sealed.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    if (sealed.size() < tagSize) throw std::invalid_argument("Ciphertext is shorter than the GCM tag");
+
+    const size_t ciphertextLen = sealed.size() - tagSize;
+    std::string plaintext(ciphertextLen, '\0');
+    const unsigned char* in = (const unsigned char*)sealed.data();
+    VitalEdgeCipherEngine::decryptAEAD(gcmCipher(), key, nonce, aad, in, ciphertextLen,
+                                       (unsigned char*)&plaintext[0], in + ciphertextLen);
+    return plaintext;
+}
+
+std::string VitalEdgeCrypto::encryptGCM(const std::string& plaintext, const VitalEdgeKeyring::Entry& key,
+                                        const std::string& nonce, const std::string& aad) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptGCM");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    std::string sealed(plaintext.size() + tagSize, '\0');
+    unsigned char* out = (unsigned char*)&sealed[0];
+    VitalEdgeCipherEngine::encryptAEAD(key.gcm(true), nonce, aad,
+                                       (const unsigned char*)plaintext.data(), plaintext.size(),
+                                       out, out + plaintext.size());
+    return sealed;
+}
+
+std::string VitalEdgeCrypto::decryptGCM(const std::string& sealed, const VitalEdgeKeyring::Entry& key,
+                                        const std::string& nonce, const std::string& aad) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptGCM");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, sealed.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    if (sealed.size() < tagSize) throw std::invalid_argument("Ciphertext is shorter than the GCM tag");
+
+    const size_t ciphertextLen = sealed.size() - tagSize;
+    std::string plaintext(ciphertextLen, '\0');
+    const unsigned char* in = (const unsigned char*)sealed.data();
+    VitalEdgeCipherEngine::decryptAEAD(key.gcm(false), nonce, aad, in, ciphertextLen,
+                                       (unsigned char*)&plaintext[0], in + ciphertextLen);
+    return plaintext;
+}
+
+// Sealed field bytes before base64, reused by each thread
+static thread_local std::string fieldScratch;
+
+// Key version in front of a sealed field's nonce (little-endian)
+static constexpr size_t kFieldVersionSize = 4;
+
+std::string VitalEdgeCrypto::encryptField(std::string_view plaintext, const VitalEdgeKeyring::Entry& key,
+                                          std::string_view path) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptField");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    std::string& raw = fieldScratch;
+    raw.resize(kFieldVersionSize + kFieldNonceSize + plaintext.size() + tagSize);
+    for (size_t i = 0; i < kFieldVersionSize; ++i) raw[i] = char(key.version() >> (8 * i));
+    unsigned char* nonce = (unsigned char*)&raw[kFieldVersionSize];
+    VitalEdgeRandom::bytes(nonce, kFieldNonceSize);
+
+    unsigned char* out = nonce + kFieldNonceSize;
+    VitalEdgeCipherEngine::encryptAEAD(key.gcm(true), std::string_view((const char*)nonce, kFieldNonceSize), path,
+                                       (const unsigned char*)plaintext.data(), plaintext.size(),
+                                       out, out + plaintext.size());
+    return VitalEdgeBase64::encode(raw);
+}
+
+std::string VitalEdgeCrypto::decryptField(std::string_view sealed, const VitalEdgeKeyring::Entry& key,
+                                          std::string_view path) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptField");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, sealed.size());
+    const size_t tagSize = VitalEdgeCipherEngine::kAEADTagSize;
+    std::string& raw = fieldScratch;
+    raw.resize(VitalEdgeBase64::maxDecodedSize(sealed.size()));
+    size_t rawLength = 0;
+    if (!VitalEdgeBase64::decode(sealed.data(), sealed.size(), (unsigned char*)&raw[0], &rawLength) ||
+        rawLength < kFieldVersionSize + kFieldNonceSize + tagSize) {
+        throw std::invalid_argument("Field value is not an encrypted value");
     }
-    ciphertextLen += len;
 
-    if (!EVP_EncryptFinal_ex(ctx, ciphertext.data() + ciphertextLen, &len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+    // Values sealed before a rotation name an older version of the same key_id
+    uint32_t version = 0;
+    for (size_t i = 0; i < kFieldVersionSize; ++i) version |= uint32_t((unsigned char)raw[i]) << (8 * i);
+    VitalEdgeKeyring::EntryPtr older;
+    const VitalEdgeKeyring::Entry* entry = &key;
+    if (version != key.version()) {
+        older = VitalEdgeKeyring::find(key.id(), version);
+        if (!older) throw std::invalid_argument("Field value names unknown key version " + std::to_string(version));
+        entry = older.get();
     }
-    ciphertextLen += len;
 
-    EVP_CIPHER_CTX_free(ctx);
-    return std::string(ciphertext.begin(), ciphertext.begin() + ciphertextLen);
+    const char* nonce = raw.data() + kFieldVersionSize;
+    const unsigned char* in = (const unsigned char*)nonce + kFieldNonceSize;
+    const size_t ciphertextLen = rawLength - kFieldVersionSize - kFieldNonceSize - tagSize;
+    std::string plaintext(ciphertextLen, '\0');
+    try {
+        VitalEdgeCipherEngine::decryptAEAD(entry->gcm(false), std::string_view(nonce, kFieldNonceSize), path,
+                                           in, ciphertextLen, (unsigned char*)&plaintext[0], in + ciphertextLen);
+    } catch (const std::runtime_error&) {
+        // Wrong key, wrong path or an edited value: the caller's input, not a server fault
+        throw std::invalid_argument("Field value failed authentication");
+    }
+    return plaintext;
 }
 
-std::string VitalEdgeCrypto::decryptAES(const std::string& ciphertext, const std::string& key, const std::string& iv) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) handleOpenSSLErrors();
+// Domain label for token MACs, so a token never equals an HMAC of the same input
+// computed for another purpose under the same key
+static constexpr char kTokenLabel[] = "vitaledge-token";
 
-    const EVP_CIPHER* cipher = EVP_aes_256_cbc();
-    if (!EVP_DecryptInit_ex(ctx, cipher, nullptr, (const unsigned char*)key.data(), (const unsigned char*)iv.data())) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+// Token MAC input (label, context, value), reused by each thread. It holds the
+// value in the clear, so it lives in secure memory.
+static thread_local VitalEdgeCrypto::SecureString tokenScratch;
+
+void VitalEdgeCrypto::tokenize(std::string_view value, const VitalEdgeKeyring::Entry& key, std::string_view context,
+                               unsigned char* token) {
+    if (context.find('\0') != std::string_view::npos) {
+        throw std::invalid_argument("Token context must not contain NUL characters.");
     }
+    SecureString& input = tokenScratch;
+    input.assign(kTokenLabel, sizeof(kTokenLabel)); // includes the NUL separator
+    input.append(context).push_back('\0');
+    input.append(value);
+    unsigned char mac[VitalEdgeKeyring::Entry::kMacSize];
+    key.hmac((const unsigned char*)input.data(), input.size(), mac);
+    std::memcpy(token, mac, kTokenSize);
+}
 
-    std::vector<unsigned char> plaintext(ciphertext.size());
-    int len = 0, plaintextLen = 0;
+std::string VitalEdgeCrypto::tokenize(std::string_view value, const VitalEdgeKeyring::Entry& key,
+                                      std::string_view context) {
+    unsigned char token[kTokenSize];
+    tokenize(value, key, context, token);
+    return tokenToHex(token);
+}
 
-    if (!EVP_DecryptUpdate(ctx, plaintext.data(), &len, (const unsigned char*)ciphertext.data(), ciphertext.size())) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+std::string VitalEdgeCrypto::tokenToHex(const unsigned char* token) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(kTokenSize * 2, '\0');
+    for (size_t i = 0; i < kTokenSize; ++i) {
+        hex[2 * i] = digits[token[i] >> 4];
+        hex[2 * i + 1] = digits[token[i] & 0xF];
     }
-    plaintextLen += len;
+    return hex;
+}
 
-    if (!EVP_DecryptFinal_ex(ctx, plaintext.data() + plaintextLen, &len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        handleOpenSSLErrors();
+bool VitalEdgeCrypto::tokenFromHex(std::string_view hex, unsigned char* token) {
+    if (hex.size() != kTokenSize * 2) return false;
+    auto nibble = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < kTokenSize; ++i) {
+        const int high = nibble(hex[2 * i]);
+        const int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return false;
+        token[i] = (unsigned char)(high << 4 | low);
     }
-    plaintextLen += len;
+    return true;
+}
+
+// Domain label for signature MACs; the NUL keeps it from running into the message
+static constexpr std::string_view kSignLabel("vitaledge-sign", sizeof("vitaledge-sign"));
 
-    EVP_CIPHER_CTX_free(ctx);
-    return std::string(plaintext.begin(), plaintext.begin() + plaintextLen);
+std::string VitalEdgeCrypto::signHMAC(std::string_view message, const VitalEdgeKeyring::Entry& key) {
+    static const VitalEdgeMetrics::Timer timer("op", "signHMAC");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, message.size());
+    std::string mac(kHMACSize, '\0');
+    key.hmac(kSignLabel, (const unsigned char*)message.data(), message.size(), (unsigned char*)&mac[0]);
+    return mac;
+}
+
+bool VitalEdgeCrypto::verifyHMAC(std::string_view message, std::string_view mac, const VitalEdgeKeyring::Entry& key) {
+    static const VitalEdgeMetrics::Timer timer("op", "verifyHMAC");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, message.size());
+    if (mac.size() != kHMACSize) return false;
+    unsigned char expected[kHMACSize];
+    key.hmac(kSignLabel, (const unsigned char*)message.data(), message.size(), expected);
+    return CRYPTO_memcmp(expected, mac.data(), kHMACSize) == 0;
+}
+
+// Digest context reused by each thread; Ed25519 has no digest state worth
+// keeping between messages, so it is re-initialised with the already parsed key
+static EVP_MD_CTX* ed25519Context() {
+    static thread_local std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!ctx) VitalEdgeUtils::throwOpenSSLError("Unable to create signature context");
+    return ctx.get();
+}
+
+std::string VitalEdgeCrypto::signEd25519(std::string_view message, const VitalEdgeKeyCache::CachedKey& privateKey) {
+    static const VitalEdgeMetrics::Timer timer("op", "signEd25519");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, message.size());
+    if (!privateKey.isEd25519()) throw std::invalid_argument("Key is not an Ed25519 key");
+    if (!privateKey.isPrivate()) throw std::invalid_argument("Ed25519 signing needs a private key");
+
+    EVP_MD_CTX* ctx = ed25519Context();
+    std::string signature(kEd25519SignatureSize, '\0');
+    size_t signatureLen = signature.size();
+    if (EVP_DigestSignInit_ex(ctx, nullptr, nullptr, nullptr, nullptr, privateKey.key(), nullptr) <= 0 ||
+        EVP_DigestSign(ctx, (unsigned char*)&signature[0], &signatureLen,
+                       (const unsigned char*)message.data(), message.size()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("Ed25519 signing failed");
+    }
+    signature.resize(signatureLen);
+    return signature;
+}
+
+bool VitalEdgeCrypto::verifyEd25519(std::string_view message, std::string_view signature,
+                                    const VitalEdgeKeyCache::CachedKey& key) {
+    static const VitalEdgeMetrics::Timer timer("op", "verifyEd25519");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, message.size());
+    if (!key.isEd25519()) throw std::invalid_argument("Key is not an Ed25519 key");
+    if (signature.size() != kEd25519SignatureSize) return false;
+
+    EVP_MD_CTX* ctx = ed25519Context();
+    if (EVP_DigestVerifyInit_ex(ctx, nullptr, nullptr, nullptr, nullptr, key.key(), nullptr) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("Ed25519 verification failed");
+    }
+    const int result = EVP_DigestVerify(ctx, (const unsigned char*)signature.data(), signature.size(),
+                                        (const unsigned char*)message.data(), message.size());
+    ERR_clear_error(); // a bad signature leaves an error on the thread's queue
+    return result == 1;
+}
+
+static bool verifyItem(const VitalEdgeCrypto::VerifyItem& item) {
+    try {
+        if (item.hmacKey) return VitalEdgeCrypto::verifyHMAC(item.message, item.signature, *item.hmacKey);
+        if (item.ed25519Key) return VitalEdgeCrypto::verifyEd25519(item.message, item.signature, *item.ed25519Key);
+    } catch (const std::exception&) {
+    }
+    return false;
+}
+
+std::vector<uint8_t> VitalEdgeCrypto::verifyBatch(const VerifyItem* items, size_t count) {
+    static const VitalEdgeMetrics::Timer timer("op", "verifyBatch");
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) bytes += items[i].message.size();
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, bytes);
+
+    std::vector<uint8_t> valid(count);
+    if (count <= kParallelVerifyItems) {
+        for (size_t i = 0; i < count; ++i) valid[i] = verifyItem(items[i]);
+        return valid;
+    }
+    // Whole chunks per task, so a batch of cheap HMACs is not swamped by task overhead
+    const size_t chunks = (count + kParallelVerifyItems - 1) / kParallelVerifyItems;
+    VitalEdgeExecutor::instance().parallelFor(chunks, [&](size_t chunk) {
+        const size_t end = std::min(count, (chunk + 1) * kParallelVerifyItems);
+        for (size_t i = chunk * kParallelVerifyItems; i < end; ++i) valid[i] = verifyItem(items[i]);
+    });
+    return valid;
+}
+
+// Run one cipher direction over a batch; every item gets a slot of data + block bytes
+// in a single buffer allocated before the first item is processed
+static VitalEdgeCrypto::BatchResult runAESBatch(const VitalEdgeCrypto::BatchItem* items, size_t count, bool encrypt) {
+    const EVP_CIPHER* cipher = aesCipher();
+    const size_t blockSize = EVP_CIPHER_get_block_size(cipher);
+
+    VitalEdgeCrypto::BatchResult result;
+    result.offsets.resize(count);
+    result.lengths.resize(count);
+    result.errors.resize(count);
+
+    size_t capacity = 0;
+    for (size_t i = 0; i < count; ++i) {
+        result.offsets[i] = capacity;
+        capacity += items[i].data.size() + blockSize;
+    }
+    result.buffer.resize(capacity);
+
+    unsigned char* out = (unsigned char*)&result.buffer[0];
+    for (size_t i = 0; i < count; ++i) {
+        const auto& item = items[i];
+        try {
+            const unsigned char* in = (const unsigned char*)item.data.data();
+            unsigned char* itemOut = out + result.offsets[i];
+            if (item.entry) {
+                result.lengths[i] = VitalEdgeCipherEngine::crypt(item.entry->cbc(encrypt), item.iv,
+                                                                 in, item.data.size(), itemOut);
+            } else {
+                result.lengths[i] = encrypt
+                    ? VitalEdgeCipherEngine::encrypt(cipher, item.key, item.iv, in, item.data.size(), itemOut)
+                    : VitalEdgeCipherEngine::decrypt(cipher, item.key, item.iv, in, item.data.size(), itemOut);
+            }
+        } catch (const std::exception& e) {
+            result.lengths[i] = 0;
+            result.errors[i] = e.what();
+        }
+    }
+    return result;
+}
+
+// Payload bytes of a batch, for its metrics size bucket
+static size_t batchBytes(const VitalEdgeCrypto::BatchItem* items, size_t count) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) bytes += items[i].data.size();
+    return bytes;
+}
+
+VitalEdgeCrypto::BatchResult VitalEdgeCrypto::encryptAESBatch(const BatchItem* items, size_t count) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptAESBatch");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, batchBytes(items, count));
+    return runAESBatch(items, count, true);
+}
+
+VitalEdgeCrypto::BatchResult VitalEdgeCrypto::decryptAESBatch(const BatchItem* items, size_t count) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptAESBatch");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, batchBytes(items, count));
+    return runAESBatch(items, count, false);
 }
 
 // // Asymmetric encryption (RSA)
@@ -139,94 +646,101 @@ std::string VitalEdgeCrypto::decryptAES(const std::string& ciphertext, const std
 
 // RSA Encryption
 std::vector<uint8_t> VitalEdgeCrypto::encryptRSA(const std::string& plaintext, const std::string& publicKey) {
-    BIO* keyBio = BIO_new_mem_buf(publicKey.data(), -1);
-    if (!keyBio) handleOpenSSLErrors();
-
-    EVP_PKEY* evpKey = PEM_read_bio_PUBKEY(keyBio, nullptr, nullptr, nullptr);
-    BIO_free(keyBio);
-    if (!evpKey) handleOpenSSLErrors();
-
-    RSA* rsa = EVP_PKEY_get1_RSA(evpKey);
-    EVP_PKEY_free(evpKey);
-    if (!rsa) handleOpenSSLErrors();
+    return encryptRSA(plaintext, *VitalEdgeKeyCache::publicKey(publicKey));
+}
 
-    std::vector<uint8_t> ciphertext(RSA_size(rsa));
-    int result = RSA_public_encrypt(plaintext.size(),
-                                     (const unsigned char*)plaintext.data(),
-                                     ciphertext.data(), rsa, RSA_PKCS1_OAEP_PADDING);
+std::vector<uint8_t> VitalEdgeCrypto::encryptRSA(std::string_view plaintext, const VitalEdgeKeyCache::CachedKey& publicKey) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptRSA");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    if (publicKey.isPrivate()) throw std::invalid_argument("RSA encryption needs a public key");
 
-    RSA_free(rsa);
-    if (result == -1) handleOpenSSLErrors();
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(publicKey.newContext(), EVP_PKEY_CTX_free);
+    size_t ciphertextLen = 0;
+    if (EVP_PKEY_encrypt(ctx.get(), nullptr, &ciphertextLen,
+                         (const unsigned char*)plaintext.data(), plaintext.size()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("RSA encryption failed");
+    }
 
+    std::vector<uint8_t> ciphertext(ciphertextLen);
+    if (EVP_PKEY_encrypt(ctx.get(), ciphertext.data(), &ciphertextLen,
+                         (const unsigned char*)plaintext.data(), plaintext.size()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("RSA encryption failed");
+    }
+    ciphertext.resize(ciphertextLen);
     return ciphertext;
 }
 
 // RSA Decryption
 std::string VitalEdgeCrypto::decryptRSA(const std::vector<uint8_t>& ciphertext, const std::string& privateKey) {
-    BIO* keyBio = BIO_new_mem_buf(privateKey.data(), -1);
-    if (!keyBio) handleOpenSSLErrors();
+    return decryptRSA(ciphertext, *VitalEdgeKeyCache::privateKey(privateKey));
+}
 
-    EVP_PKEY* evpKey = PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr);
-    BIO_free(keyBio);
-    if (!evpKey) handleOpenSSLErrors();
+std::string VitalEdgeCrypto::decryptRSA(const std::vector<uint8_t>& ciphertext, const VitalEdgeKeyCache::CachedKey& privateKey) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptRSA");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, ciphertext.size());
+    if (!privateKey.isPrivate()) throw std::invalid_argument("RSA decryption needs a private key");
 
-    RSA* rsa = EVP_PKEY_get1_RSA(evpKey);
-    EVP_PKEY_free(evpKey);
-    if (!rsa) handleOpenSSLErrors();
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(privateKey.newContext(), EVP_PKEY_CTX_free);
+    size_t plaintextLen = 0;
+    if (EVP_PKEY_decrypt(ctx.get(), nullptr, &plaintextLen, ciphertext.data(), ciphertext.size()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("RSA decryption failed");
+    }
 
-    std::vector<uint8_t> plaintext(RSA_size(rsa));
-    int result = RSA_private_decrypt(ciphertext.size(),
-                                     ciphertext.data(),
-                                     plaintext.data(), rsa, RSA_PKCS1_OAEP_PADDING);
+    std::string plaintext(plaintextLen, '\0');
+    if (EVP_PKEY_decrypt(ctx.get(), (unsigned char*)&plaintext[0], &plaintextLen,
+                         ciphertext.data(), ciphertext.size()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("RSA decryption failed");
+    }
+    plaintext.resize(plaintextLen);
+    return plaintext;
+}
 
-    RSA_free(rsa);
-    if (result == -1) handleOpenSSLErrors();
+// Envelope Encryption
+std::string VitalEdgeCrypto::encryptEnvelope(const std::string& plaintext, const std::string& publicKey,
+                                             bool shareDataKey) {
+    static const VitalEdgeMetrics::Timer timer("op", "encryptEnvelope");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, plaintext.size());
+    if (shareDataKey) return VitalEdgeEnvelope::sealShared(plaintext, VitalEdgeKeyCache::publicKey(publicKey));
+    return VitalEdgeEnvelope::seal(plaintext, publicKey);
+}
 
-    return std::string(plaintext.begin(), plaintext.begin() + result);
+// Envelope Decryption
+std::string VitalEdgeCrypto::decryptEnvelope(const std::string& envelope, const std::string& privateKey) {
+    static const VitalEdgeMetrics::Timer timer("op", "decryptEnvelope");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, envelope.size());
+    return VitalEdgeEnvelope::open(envelope, privateKey);
 }
 
 // Utility: Generate random key
 std::string VitalEdgeCrypto::generateRandomKey(size_t length) {
     std::string key(length, '\0');
-    if (!RAND_bytes((unsigned char*)key.data(), length)) handleOpenSSLErrors();
+    VitalEdgeRandom::privateBytes((unsigned char*)&key[0], length);
+    return key;
+}
+
+VitalEdgeCrypto::SecureString VitalEdgeCrypto::generateSecureKey(size_t length) {
+    SecureString key(length, '\0');
+    VitalEdgeRandom::privateBytes((unsigned char*)&key[0], length);
     return key;
 }
 
 // Utility: Generate random IV
 std::string VitalEdgeCrypto::generateRandomIV(size_t length) {
-    return generateRandomKey(length); // Same as key generation
+    std::string iv(length, '\0');
+    VitalEdgeRandom::bytes((unsigned char*)&iv[0], length);
+    return iv;
 }
 
 // Obfuscate (Base64 Encode)
 std::string VitalEdgeCrypto::obfuscate(const std::string& data) {
-    BIO* bio = BIO_new(BIO_s_mem());
-    BIO* b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL); // No newlines in output
-    BIO_write(bio, data.data(), data.size());
-    BIO_flush(bio);
-
-    char* encoded;
-    long encodedLength = BIO_get_mem_data(bio, &encoded);
-    std::string result(encoded, encodedLength);
-
-    BIO_free_all(bio);
-    return result;
+    static const VitalEdgeMetrics::Timer timer("op", "obfuscate");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, data.size());
+    return VitalEdgeBase64::encode(data);
 }
 
 // Deobfuscate (Base64 Decode)
 std::string VitalEdgeCrypto::deobfuscate(const std::string& obfuscatedData) {
-    BIO* bio = BIO_new_mem_buf(obfuscatedData.data(), obfuscatedData.size());
-    BIO* b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL); // No newlines in input
-
-    std::vector<char> buffer(obfuscatedData.size());
-    int length = BIO_read(bio, buffer.data(), buffer.size());
-    if (length < 0) handleOpenSSLErrors();
-
-    BIO_free_all(bio);
-    return std::string(buffer.begin(), buffer.begin() + length);
+    static const VitalEdgeMetrics::Timer timer("op", "deobfuscate");
+    VitalEdgeMetrics::Scope scope(timer, VitalEdgeMetrics::Phase::Total, obfuscatedData.size());
+    return VitalEdgeBase64::decode(obfuscatedData);
 }
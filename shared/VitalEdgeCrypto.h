@@ -1,7 +1,13 @@
 #ifndef VITALEDGE_CRYPTO_H
 #define VITALEDGE_CRYPTO_H
 
+#include "VitalEdgeKeyCache.h"
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeSecureMemory.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class VitalEdgeCrypto {
@@ -10,12 +16,172 @@ public:
     static std::string encryptAES(const std::string& plaintext, const std::string& key, const std::string& iv);
     static std::string decryptAES(const std::string& ciphertext, const std::string& key, const std::string& iv);
 
-    // Asymmetric encryption (RSA)
+    // Same, with a keyring key: no key bytes are copied or expanded per call
+    static std::string encryptAES(const std::string& plaintext, const VitalEdgeKeyring::Entry& key, const std::string& iv);
+    static std::string decryptAES(const std::string& ciphertext, const VitalEdgeKeyring::Entry& key, const std::string& iv);
+
+    // Same, from and into caller buffers (for the binary wire format, which
+    // encrypts straight into the response body). out needs room for the input plus
+    // kAESBlockSize bytes; returns the number of bytes written.
+    static constexpr size_t kAESBlockSize = 16;
+    static size_t encryptAES(std::string_view plaintext, std::string_view key, std::string_view iv, char* out);
+    static size_t decryptAES(std::string_view ciphertext, std::string_view key, std::string_view iv, char* out);
+    static size_t encryptAES(std::string_view plaintext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                             char* out);
+    static size_t decryptAES(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                             char* out);
+
+    // Same, into a locked, zeroed-on-free buffer (see VitalEdgeSecureMemory). The
+    // buffer is resized to the output; one kept across calls stops reallocating
+    // once it has grown to the largest payload.
+    using SecureString = VitalEdgeSecureMemory::String;
+    static void encryptAES(std::string_view plaintext, std::string_view key, std::string_view iv, SecureString& out);
+    static void decryptAES(std::string_view ciphertext, std::string_view key, std::string_view iv, SecureString& out);
+    static void encryptAES(std::string_view plaintext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                           SecureString& out);
+    static void decryptAES(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key, std::string_view iv,
+                           SecureString& out);
+
+    // Compress-then-encrypt (AES-256-CBC). Before encryption the plaintext becomes
+    // a frame: a one-byte header, then the plaintext compressed at level (see
+    // VitalEdgeCompression), or as is when level is 0 or compression would not
+    // shrink it. The ciphertext starts with the visible prefix "VEZ1", which
+    // leaves its length 4 past a block multiple, so isCompressed tells it from
+    // plain CBC ciphertext without decrypting. Decryption reads the frame header
+    // back and inflates, refusing frames that expand past maxSize; ciphertext
+    // without the prefix, or a plaintext without a frame header, throws
+    // std::invalid_argument.
+    //
+    // The ciphertext length reveals how well the plaintext compressed. When a
+    // plaintext mixes secrets with content an attacker can influence, repeated
+    // requests can recover the secrets from lengths alone (CRIME/BREACH), so
+    // compress only plaintexts with no attacker-influenced content.
+    static constexpr size_t kMaxDecompressedSize = size_t(64) << 20;
+    static constexpr char kCompressedPrefix[] = "VEZ1";
+    static constexpr size_t kCompressedPrefixSize = sizeof(kCompressedPrefix) - 1;
+    static bool isCompressed(std::string_view ciphertext);
+    static void encryptAESCompressed(std::string_view plaintext, std::string_view key, std::string_view iv, int level,
+                                     SecureString& out);
+    static void encryptAESCompressed(std::string_view plaintext, const VitalEdgeKeyring::Entry& key,
+                                     std::string_view iv, int level, SecureString& out);
+    static void decryptAESCompressed(std::string_view ciphertext, std::string_view key, std::string_view iv,
+                                     SecureString& out, size_t maxSize = kMaxDecompressedSize);
+    static void decryptAESCompressed(std::string_view ciphertext, const VitalEdgeKeyring::Entry& key,
+                                     std::string_view iv, SecureString& out, size_t maxSize = kMaxDecompressedSize);
+
+    // Authenticated symmetric encryption (AES-256-GCM, 12-byte nonce). The result is
+    // the ciphertext followed by the 16-byte tag; decryption throws unless the tag
+    // verifies against the key, nonce and aad. Never reuse a nonce under one key.
+    static std::string encryptGCM(const std::string& plaintext, const std::string& key, const std::string& nonce,
+                                  const std::string& aad = "");
+    static std::string decryptGCM(const std::string& sealed, const std::string& key, const std::string& nonce,
+                                  const std::string& aad = "");
+    static std::string encryptGCM(const std::string& plaintext, const VitalEdgeKeyring::Entry& key,
+                                  const std::string& nonce, const std::string& aad = "");
+    static std::string decryptGCM(const std::string& sealed, const VitalEdgeKeyring::Entry& key,
+                                  const std::string& nonce, const std::string& aad = "");
+
+    // Field-level encryption for values inside JSON documents: AES-256-GCM under a
+    // fresh random nonce, with the field's concrete path in its document (member
+    // names and actual array indices, e.g. "contacts[2].phone") as AAD, so a sealed
+    // value only opens where it was sealed and cannot be moved to another element. The result, base64(key version u32 | nonce |
+    // ciphertext | tag), is a drop-in JSON string. decryptField opens a value under
+    // the version of key's key_id that it names, so values sealed before a
+    // rotation still open; it throws std::invalid_argument for a value that is
+    // malformed, names an unknown version or fails authentication.
+    static constexpr size_t kFieldNonceSize = 12;
+    static std::string encryptField(std::string_view plaintext, const VitalEdgeKeyring::Entry& key,
+                                    std::string_view path);
+    static std::string decryptField(std::string_view sealed, const VitalEdgeKeyring::Entry& key,
+                                    std::string_view path);
+
+    // Deterministic tokenization: the same value, key and context always give the
+    // same token, so tokens work for equality lookups and joins without revealing
+    // the value. A token is HMAC-SHA256 under the key's MAC key over a domain
+    // label, the context and the value, truncated to kTokenSize bytes; the string
+    // form is its lowercase hex. Different contexts (e.g. "mrn", "ssn") give
+    // unrelated tokens for the same value.
+    static constexpr size_t kTokenSize = 16;
+    static void tokenize(std::string_view value, const VitalEdgeKeyring::Entry& key, std::string_view context,
+                         unsigned char* token);
+    static std::string tokenize(std::string_view value, const VitalEdgeKeyring::Entry& key,
+                                std::string_view context = "");
+    static std::string tokenToHex(const unsigned char* token);
+    // Parses kTokenSize * 2 hex characters; returns false for anything else
+    static bool tokenFromHex(std::string_view hex, unsigned char* token);
+
+    // Message signatures. HMAC-SHA256 runs on a keyring key's precomputed HMAC
+    // state (see VitalEdgeKeyring::Entry::hmac) over a signing label and the
+    // message, so a request only hashes. Ed25519 keys are parsed once into
+    // VitalEdgeKeyCache (by key_id through KeyManager::registerSigningKey, or by PEM
+    // fingerprint). Verification compares in constant time and returns false for
+    // a signature of the wrong length; an Ed25519 key of another type throws
+    // std::invalid_argument.
+    static constexpr size_t kHMACSize = 32;
+    static constexpr size_t kEd25519SignatureSize = 64;
+    static std::string signHMAC(std::string_view message, const VitalEdgeKeyring::Entry& key);
+    static bool verifyHMAC(std::string_view message, std::string_view mac, const VitalEdgeKeyring::Entry& key);
+    static std::string signEd25519(std::string_view message, const VitalEdgeKeyCache::CachedKey& privateKey);
+    static bool verifyEd25519(std::string_view message, std::string_view signature,
+                              const VitalEdgeKeyCache::CachedKey& key);
+
+    // Batch verification with one result per item (1 valid, 0 not). An item uses
+    // hmacKey, or ed25519Key when that is set instead; an item with neither is
+    // invalid. Batches larger than kParallelVerifyItems are split across
+    // VitalEdgeExecutor.
+    struct VerifyItem {
+        std::string_view message;
+        std::string_view signature;
+        const VitalEdgeKeyring::Entry* hmacKey = nullptr;
+        const VitalEdgeKeyCache::CachedKey* ed25519Key = nullptr;
+    };
+    static constexpr size_t kParallelVerifyItems = 16;
+    static std::vector<uint8_t> verifyBatch(const VerifyItem* items, size_t count);
+
+    // Batch symmetric encryption (AES). Items share the calling thread's cipher
+    // contexts and write into one buffer sized for the whole batch up front.
+    struct BatchItem {
+        std::string_view data;
+        std::string_view key;
+        std::string_view iv;
+        const VitalEdgeKeyring::Entry* entry = nullptr; // used instead of key when set
+    };
+
+    // Outputs of a batch, packed back to back in one buffer. A failed item has an
+    // error message and an empty output; it does not affect the rest of the batch.
+    struct BatchResult {
+        std::string buffer;
+        std::vector<size_t> offsets;
+        std::vector<size_t> lengths;
+        std::vector<std::string> errors;
+
+        size_t size() const { return offsets.size(); }
+        bool ok(size_t i) const { return errors[i].empty(); }
+        std::string_view output(size_t i) const { return std::string_view(buffer.data() + offsets[i], lengths[i]); }
+    };
+
+    static BatchResult encryptAESBatch(const BatchItem* items, size_t count);
+    static BatchResult decryptAESBatch(const BatchItem* items, size_t count);
+
+    // Asymmetric encryption (RSA-OAEP). PEM keys are parsed once and served from
+    // VitalEdgeKeyCache afterwards; callers holding a cached key can pass it directly.
     static std::vector<uint8_t> encryptRSA(const std::string& plaintext, const std::string& publicKey);
     static std::string decryptRSA(const std::vector<uint8_t>& ciphertext, const std::string& privateKey);
+    static std::vector<uint8_t> encryptRSA(std::string_view plaintext, const VitalEdgeKeyCache::CachedKey& publicKey);
+    static std::string decryptRSA(const std::vector<uint8_t>& ciphertext, const VitalEdgeKeyCache::CachedKey& privateKey);
+
+    // Envelope encryption: AES-256-GCM under a fresh data key wrapped with RSA-OAEP
+    // (see VitalEdgeEnvelope). Any payload size; unwrapped data keys are cached.
+    // With shareDataKey the data key is the one currently shared by every envelope
+    // sealed to publicKey (VitalEdgeEnvelope::sealShared).
+    static std::string encryptEnvelope(const std::string& plaintext, const std::string& publicKey,
+                                       bool shareDataKey = false);
+    static std::string decryptEnvelope(const std::string& envelope, const std::string& privateKey);
 
     // Utility functions for key/IV generation
     static std::string generateRandomKey(size_t length);
+    // Key material that never leaves locked memory
+    static SecureString generateSecureKey(size_t length);
     static std::string generateRandomIV(size_t length);
 
     // Obfuscation and De-Obfuscation
@@ -26,6 +192,24 @@ public:
     public:
         static void saveKeyToFile(const std::string& key, const std::string& filepath);
         static std::string loadKeyFromFile(const std::string& filepath);
+
+        // Keyring: keys loaded once (see VitalEdgeKeyring::loadFile) and looked up by key_id
+        static size_t loadKeyring(const std::string& filepath);
+        static VitalEdgeKeyring::EntryPtr findKey(const std::string& keyId);
+        static VitalEdgeKeyring::EntryPtr findKey(const std::string& keyId, uint32_t version);
+
+        // Generate a new AES-256 key as the next version of key_id, which becomes
+        // current; older versions stay available for decryption. If keyringFile is
+        // given the key is appended to it first, so the rotation survives a restart.
+        // Throws std::invalid_argument unless VitalEdgeKeyring::validKeyId(keyId).
+        static VitalEdgeKeyring::EntryPtr rotateKey(const std::string& keyId, const std::string& keyringFile = "");
+
+        // Ed25519 signing keys by key_id, parsed once from PEM (a private key also
+        // verifies). loadSigningKeys reads "key_id path-to-pem" lines ('#' starts a
+        // comment) and returns the number of keys registered.
+        static VitalEdgeKeyCache::KeyPtr registerSigningKey(const std::string& keyId, const std::string& pem);
+        static VitalEdgeKeyCache::KeyPtr findSigningKey(const std::string& keyId);
+        static size_t loadSigningKeys(const std::string& filepath);
 };
 
 
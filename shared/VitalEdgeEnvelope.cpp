@@ -0,0 +1,239 @@
+#include "VitalEdgeEnvelope.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/crypto.h>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+static constexpr unsigned char kMagic[4] = {'V', 'E', 'E', '1'};
+static constexpr unsigned char kVersion = 1;
+static constexpr size_t kFixedHeaderSize = 8;
+
+namespace {
+
+// An unwrapped data key, remembered together with the private key that unwrapped
+// it. The EVP_PKEY is referenced so its address cannot be reused by another key.
+struct UnwrappedKey {
+    EVP_PKEY* privateKey;
+    VitalEdgeKeyring::EntryPtr key;
+
+    UnwrappedKey(EVP_PKEY* pkey, VitalEdgeKeyring::EntryPtr dataKey) : privateKey(pkey), key(std::move(dataKey)) {
+        EVP_PKEY_up_ref(privateKey);
+    }
+    ~UnwrappedKey() { EVP_PKEY_free(privateKey); }
+    UnwrappedKey(const UnwrappedKey&) = delete;
+    UnwrappedKey& operator=(const UnwrappedKey&) = delete;
+};
+
+struct UnwrapCache {
+    std::mutex mutex;
+    size_t capacity = 1024;
+    std::list<std::string> lru; // most recently used first
+    std::unordered_map<std::string, std::pair<std::shared_ptr<UnwrappedKey>, std::list<std::string>::iterator>> entries;
+
+    void trim() {
+        while (entries.size() > capacity) {
+            entries.erase(lru.back());
+            lru.pop_back();
+        }
+    }
+};
+
+UnwrapCache& unwrapCache() {
+    static UnwrapCache cache;
+    return cache;
+}
+
+// The data key sealShared() uses for one public key. The KeyPtr keeps the parsed
+// key, and so the address it is found by, alive.
+struct SharedKey {
+    VitalEdgeKeyCache::KeyPtr publicKey;
+    std::shared_ptr<const VitalEdgeEnvelope::DataKey> dataKey;
+    uint64_t messages = 0;
+    std::chrono::steady_clock::time_point expires;
+};
+
+struct SharedKeys {
+    static constexpr size_t kCapacity = 1024;
+    std::mutex mutex;
+    std::unordered_map<const VitalEdgeKeyCache::CachedKey*, SharedKey> keys;
+};
+
+SharedKeys& sharedKeys() {
+    static SharedKeys shared;
+    return shared;
+}
+
+} // namespace
+
+static std::string wrappedDigest(std::string_view wrapped) {
+    static EVP_MD* sha256 = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    if (!sha256 || !EVP_Digest(wrapped.data(), wrapped.size(), digest, &digestLen, sha256, nullptr)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to digest wrapped key");
+    }
+    return std::string((const char*)digest, digestLen);
+}
+
+// Data key for a wrapped key, from the cache or with one RSA private operation
+static VitalEdgeKeyring::EntryPtr unwrap(std::string_view wrapped, const VitalEdgeKeyCache::CachedKey& privateKey) {
+    if (!privateKey.isPrivate()) throw std::invalid_argument("Envelope decryption needs a private key");
+
+    UnwrapCache& cache = unwrapCache();
+    std::string id = wrappedDigest(wrapped);
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.entries.find(id);
+        if (it != cache.entries.end() && it->second.first->privateKey == privateKey.key()) {
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second.second);
+            return it->second.first->key;
+        }
+    }
+
+    // RSA outside the lock so a miss does not stall hits on other envelopes
+    std::string dataKey = VitalEdgeCrypto::decryptRSA(std::vector<uint8_t>(wrapped.begin(), wrapped.end()), privateKey);
+    if (dataKey.size() != VitalEdgeEnvelope::kDataKeySize) {
+        OPENSSL_cleanse(&dataKey[0], dataKey.size());
+        throw std::runtime_error("Envelope data key has the wrong size");
+    }
+    auto key = std::make_shared<const VitalEdgeKeyring::Entry>(std::string(), dataKey);
+    OPENSSL_cleanse(&dataKey[0], dataKey.size());
+
+    auto unwrapped = std::make_shared<UnwrappedKey>(privateKey.key(), key);
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.entries.find(id);
+    if (it != cache.entries.end()) {
+        // Another thread won the race, or the entry belongs to a different private key
+        it->second.first = unwrapped;
+        cache.lru.splice(cache.lru.begin(), cache.lru, it->second.second);
+    } else {
+        cache.lru.push_front(id);
+        cache.entries.emplace(id, std::make_pair(unwrapped, cache.lru.begin()));
+        cache.trim();
+    }
+    return key;
+}
+
+VitalEdgeEnvelope::DataKey::DataKey(const VitalEdgeKeyCache::CachedKey& publicKey) {
+    // Zeroed when it goes out of scope, however this returns
+    const VitalEdgeCrypto::SecureString dataKey = VitalEdgeCrypto::generateSecureKey(kDataKeySize);
+    std::vector<uint8_t> wrapped = VitalEdgeCrypto::encryptRSA(dataKey, publicKey);
+    if (wrapped.size() > 0xFFFF) throw std::invalid_argument("RSA key is too large for an envelope");
+    wrapped_.assign(wrapped.begin(), wrapped.end());
+    key_ = std::make_shared<const VitalEdgeKeyring::Entry>(std::string(), dataKey);
+}
+
+std::string VitalEdgeEnvelope::seal(std::string_view plaintext, const DataKey& dataKey) {
+    const std::string& wrapped = dataKey.wrapped();
+    const size_t aadSize = kFixedHeaderSize + wrapped.size();
+
+    std::string envelope(aadSize + kNonceSize + plaintext.size() + kTagSize, '\0');
+    unsigned char* out = (unsigned char*)&envelope[0];
+    std::memcpy(out, kMagic, sizeof(kMagic));
+    out[4] = kVersion;
+    out[5] = 0;
+    out[6] = (unsigned char)wrapped.size();
+    out[7] = (unsigned char)(wrapped.size() >> 8);
+    std::memcpy(out + kFixedHeaderSize, wrapped.data(), wrapped.size());
+
+    unsigned char* nonce = out + aadSize;
+    VitalEdgeRandom::bytes(nonce, kNonceSize);
+
+    unsigned char* ciphertext = nonce + kNonceSize;
+    VitalEdgeCipherEngine::encryptAEAD(dataKey.key().gcm(true), std::string_view((const char*)nonce, kNonceSize),
+                                       std::string_view(envelope.data(), aadSize),
+                                       (const unsigned char*)plaintext.data(), plaintext.size(),
+                                       ciphertext, ciphertext + plaintext.size());
+    return envelope;
+}
+
+std::string VitalEdgeEnvelope::seal(std::string_view plaintext, const VitalEdgeKeyCache::CachedKey& publicKey) {
+    return seal(plaintext, DataKey(publicKey));
+}
+
+std::string VitalEdgeEnvelope::seal(std::string_view plaintext, const std::string& publicKeyPem) {
+    return seal(plaintext, *VitalEdgeKeyCache::publicKey(publicKeyPem));
+}
+
+std::string VitalEdgeEnvelope::sealShared(std::string_view plaintext, const VitalEdgeKeyCache::KeyPtr& publicKey) {
+    using Clock = std::chrono::steady_clock;
+    SharedKeys& shared = sharedKeys();
+    std::shared_ptr<const DataKey> dataKey;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        auto it = shared.keys.find(publicKey.get());
+        if (it != shared.keys.end() && it->second.messages < kSharedKeyMessages && Clock::now() < it->second.expires) {
+            ++it->second.messages;
+            dataKey = it->second.dataKey;
+        }
+    }
+
+    if (!dataKey) {
+        // RSA outside the lock; if two threads both replace the key, the last one stays
+        dataKey = std::make_shared<const DataKey>(*publicKey);
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (shared.keys.size() >= SharedKeys::kCapacity && !shared.keys.count(publicKey.get())) {
+            shared.keys.erase(shared.keys.begin());
+        }
+        shared.keys[publicKey.get()] = SharedKey{publicKey, dataKey, 1, Clock::now() + kSharedKeyLifetime};
+    }
+    return seal(plaintext, *dataKey);
+}
+
+std::string VitalEdgeEnvelope::open(std::string_view envelope, const VitalEdgeKeyCache::CachedKey& privateKey) {
+    const unsigned char* in = (const unsigned char*)envelope.data();
+    if (envelope.size() < kFixedHeaderSize || std::memcmp(in, kMagic, sizeof(kMagic)) != 0) {
+        throw std::invalid_argument("Not an envelope");
+    }
+    if (in[4] != kVersion) throw std::invalid_argument("Unsupported envelope version");
+
+    const size_t wrappedSize = size_t(in[6]) | size_t(in[7]) << 8;
+    const size_t aadSize = kFixedHeaderSize + wrappedSize;
+    if (envelope.size() < aadSize + kNonceSize + kTagSize) throw std::invalid_argument("Envelope is truncated");
+
+    VitalEdgeKeyring::EntryPtr key = unwrap(envelope.substr(kFixedHeaderSize, wrappedSize), privateKey);
+
+    const size_t ciphertextSize = envelope.size() - aadSize - kNonceSize - kTagSize;
+    const unsigned char* ciphertext = in + aadSize + kNonceSize;
+    std::string plaintext(ciphertextSize, '\0');
+    VitalEdgeCipherEngine::decryptAEAD(key->gcm(false), envelope.substr(aadSize, kNonceSize),
+                                       envelope.substr(0, aadSize), ciphertext, ciphertextSize,
+                                       (unsigned char*)&plaintext[0], ciphertext + ciphertextSize);
+    return plaintext;
+}
+
+std::string VitalEdgeEnvelope::open(std::string_view envelope, const std::string& privateKeyPem) {
+    return open(envelope, *VitalEdgeKeyCache::privateKey(privateKeyPem));
+}
+
+void VitalEdgeEnvelope::setCacheCapacity(size_t capacity) {
+    UnwrapCache& cache = unwrapCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.capacity = capacity;
+    cache.trim();
+}
+
+size_t VitalEdgeEnvelope::cacheSize() {
+    UnwrapCache& cache = unwrapCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.entries.size();
+}
+
+void VitalEdgeEnvelope::clearCache() {
+    {
+        UnwrapCache& cache = unwrapCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.entries.clear();
+        cache.lru.clear();
+    }
+    SharedKeys& shared = sharedKeys();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.keys.clear();
+}
@@ -0,0 +1,72 @@
+#ifndef VITALEDGE_ENVELOPE_H
+#define VITALEDGE_ENVELOPE_H
+
+#include "VitalEdgeKeyCache.h"
+#include "VitalEdgeKeyring.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Envelope (hybrid) encryption: the payload is sealed with AES-256-GCM under a
+// random data key, and the data key is wrapped with RSA-OAEP for the recipient.
+// There is no limit on the payload size and only the 32-byte data key goes
+// through RSA.
+//
+// Layout (integers little-endian):
+//   "VEE1" | version u8 | reserved u8 | wrapped key length u16 | wrapped key |
+//   nonce u8[12] | ciphertext | tag u8[16]
+// Everything before the nonce is authenticated as AAD.
+//
+// Unwrapped data keys are cached (bounded LRU) by the SHA-256 of the wrapped key,
+// so messages that share one data key cost a single RSA private-key operation.
+// sealShared() makes independent callers share data keys, so that the cache is
+// also hit by envelopes that did not come from one DataKey.
+class VitalEdgeEnvelope {
+public:
+    static constexpr size_t kDataKeySize = 32;
+    static constexpr size_t kNonceSize = 12;
+    static constexpr size_t kTagSize = 16;
+
+    // Bounds on one shared data key: messages sealed under it, and its lifetime
+    static constexpr uint64_t kSharedKeyMessages = 1 << 20;
+    static constexpr std::chrono::seconds kSharedKeyLifetime{300};
+
+    // A data key and its wrapped form, for sealing several messages under one
+    // RSA operation. Each message still gets a fresh random nonce, so keep the
+    // number of messages per data key well below 2^32.
+    class DataKey {
+    public:
+        explicit DataKey(const VitalEdgeKeyCache::CachedKey& publicKey);
+
+        const std::string& wrapped() const { return wrapped_; }
+        const VitalEdgeKeyring::Entry& key() const { return *key_; }
+
+    private:
+        std::string wrapped_;
+        std::shared_ptr<const VitalEdgeKeyring::Entry> key_;
+    };
+
+    static std::string seal(std::string_view plaintext, const DataKey& dataKey);
+    static std::string seal(std::string_view plaintext, const VitalEdgeKeyCache::CachedKey& publicKey);
+    static std::string seal(std::string_view plaintext, const std::string& publicKeyPem);
+    // Seal under the data key currently shared by everything sealed to publicKey,
+    // replaced after kSharedKeyMessages messages or kSharedKeyLifetime. Whoever
+    // holds the private key opens the whole run with one RSA operation.
+    static std::string sealShared(std::string_view plaintext, const VitalEdgeKeyCache::KeyPtr& publicKey);
+
+    // Throws std::invalid_argument for a malformed envelope and std::runtime_error
+    // if the data key does not unwrap or the payload fails authentication
+    static std::string open(std::string_view envelope, const VitalEdgeKeyCache::CachedKey& privateKey);
+    static std::string open(std::string_view envelope, const std::string& privateKeyPem);
+
+    // Unwrapped data key cache (default 1024 keys). clearCache() also drops the
+    // shared sealing keys.
+    static void setCacheCapacity(size_t capacity);
+    static size_t cacheSize();
+    static void clearCache();
+};
+
+#endif // VITALEDGE_ENVELOPE_H
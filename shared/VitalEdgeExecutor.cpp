@@ -0,0 +1,161 @@
+#include "VitalEdgeExecutor.h"
+#include <algorithm>
+#include <exception>
+
+// Pool and worker slot of the current thread, so tasks submitted from inside the
+// pool go to the submitting worker's own deque
+static thread_local VitalEdgeExecutor* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+VitalEdgeExecutor::VitalEdgeExecutor(size_t threads, ThreadStart onStart) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i, onStart] { workerLoop(i, onStart); });
+    }
+}
+
+VitalEdgeExecutor::~VitalEdgeExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) thread.join();
+}
+
+void VitalEdgeExecutor::submit(std::function<void()> task) {
+    size_t index = currentPool == this ? currentWorker : nextWorker_.fetch_add(1) % workers_.size();
+    {
+        // Counted before it can be popped, so a thief's decrement never runs first
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        pending_.fetch_add(1);
+        try {
+            workers_[index]->tasks.push_back(std::move(task));
+        } catch (...) {
+            pending_.fetch_sub(1);
+            throw;
+        }
+    }
+
+    // Taking the sleep lock orders this wake-up after any worker's predicate check
+    { std::lock_guard<std::mutex> lock(sleepMutex_); }
+    wake_.notify_one();
+}
+
+bool VitalEdgeExecutor::popLocal(size_t index, std::function<void()>& task) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool VitalEdgeExecutor::steal(size_t index, std::function<void()>& task) {
+    for (size_t offset = 1; offset < workers_.size(); ++offset) {
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void VitalEdgeExecutor::workerLoop(size_t index, const ThreadStart& onStart) {
+    currentPool = this;
+    currentWorker = index;
+    if (onStart) {
+        try {
+            onStart(index);
+        } catch (...) {
+            // A worker that could not be set up still runs tasks
+        }
+    }
+
+    std::function<void()> task;
+    while (true) {
+        if (popLocal(index, task) || steal(index, task)) {
+            pending_.fetch_sub(1);
+            try {
+                task();
+            } catch (...) {
+                // Tasks report their own failures; keep the worker alive
+            }
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_.load() > 0; });
+        if (stopping_ && pending_.load() == 0) return;
+    }
+}
+
+void VitalEdgeExecutor::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+
+    struct State {
+        const std::function<void(size_t)>* fn;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->fn = &fn;
+    state->count = count;
+
+    // Helpers that start after every index is claimed return without touching fn,
+    // so fn only has to outlive this call
+    auto drain = [](State& s) {
+        size_t i;
+        while ((i = s.next.fetch_add(1)) < s.count) {
+            if (!s.failed.load()) {
+                try {
+                    (*s.fn)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    if (!s.error) s.error = std::current_exception();
+                    s.failed = true;
+                }
+            }
+            if (s.done.fetch_add(1) + 1 == s.count) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min(count - 1, workers_.size());
+    for (size_t h = 0; h < helpers; ++h) {
+        submit([state, drain] { drain(*state); });
+    }
+    drain(*state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done.load() == state->count; });
+    if (state->error) std::rethrow_exception(state->error);
+}
+
+static std::atomic<size_t> configuredThreads{0};
+static VitalEdgeExecutor::ThreadStart configuredStart;
+
+void VitalEdgeExecutor::configure(size_t threads, ThreadStart onStart) {
+    configuredThreads = threads;
+    configuredStart = std::move(onStart);
+}
+
+VitalEdgeExecutor& VitalEdgeExecutor::instance() {
+    static VitalEdgeExecutor pool(configuredThreads.load(), configuredStart);
+    return pool;
+}
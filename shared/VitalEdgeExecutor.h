@@ -0,0 +1,68 @@
+#ifndef VITALEDGE_EXECUTOR_H
+#define VITALEDGE_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for crypto work that is too heavy to run inline on
+// a network event loop (RSA private operations, multi-MB payloads, big batches).
+//
+// Each worker owns a deque: it pops its own newest task first and, when empty,
+// steals the oldest task from another worker. Tasks submitted from outside the
+// pool are spread round-robin across the workers.
+class VitalEdgeExecutor {
+public:
+    // Runs on each worker thread, with its index, before it takes any task
+    using ThreadStart = std::function<void(size_t)>;
+
+    // threads == 0 sizes the pool to the number of hardware threads
+    explicit VitalEdgeExecutor(size_t threads = 0, ThreadStart onStart = nullptr);
+    ~VitalEdgeExecutor();
+
+    VitalEdgeExecutor(const VitalEdgeExecutor&) = delete;
+    VitalEdgeExecutor& operator=(const VitalEdgeExecutor&) = delete;
+
+    // Queue a task; exceptions escaping it are swallowed, so report errors from inside
+    void submit(std::function<void()> task);
+
+    // Run fn(0) .. fn(count - 1) across the pool and wait for all of them. The
+    // calling thread takes part, so this is safe to call from a pool worker.
+    // The first exception thrown by fn is rethrown here.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    size_t threadCount() const { return workers_.size(); }
+
+    // Process-wide pool. configure() must run before the first instance() call to
+    // take effect; later calls are ignored.
+    static void configure(size_t threads, ThreadStart onStart = nullptr);
+    static VitalEdgeExecutor& instance();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index, const ThreadStart& onStart);
+    bool popLocal(size_t index, std::function<void()>& task);
+    bool steal(size_t index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> nextWorker_{0};
+
+    // Idle workers sleep here; pending_ counts queued tasks not yet picked up
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_{0};
+    bool stopping_ = false;
+};
+
+#endif // VITALEDGE_EXECUTOR_H
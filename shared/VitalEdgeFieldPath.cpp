@@ -0,0 +1,124 @@
+#include "VitalEdgeFieldPath.h"
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+// Paths a thread keeps in front of the shared cache
+static constexpr size_t kThreadCacheSize = 256;
+
+namespace {
+
+using PathMap = std::unordered_map<std::string, VitalEdgeFieldPath::Ptr>;
+
+struct CacheState {
+    std::mutex mutex;
+    size_t capacity = 4096;
+    PathMap paths;
+    std::atomic<uint64_t> generation{0}; // bumped by clearCache() to drop thread caches
+};
+
+CacheState& state() {
+    static CacheState cache;
+    return cache;
+}
+
+struct ThreadCache {
+    uint64_t generation = 0;
+    PathMap paths;
+};
+
+thread_local ThreadCache threadCache;
+
+} // namespace
+
+VitalEdgeFieldPath::VitalEdgeFieldPath(std::string_view text) : text_(text) {
+    auto invalid = [&](const char* why) {
+        return std::invalid_argument("Invalid field path '" + text_ + "': " + why + ".");
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == '[') {
+            const size_t close = text.find(']', i);
+            if (close == std::string_view::npos) throw invalid("unclosed '['");
+            std::string_view inside = text.substr(i + 1, close - i - 1);
+            Segment segment;
+            if (inside == "*") {
+                segment.kind = Segment::Kind::Wildcard;
+            } else {
+                if (inside.empty() || inside.size() > 9) throw invalid("array index must be a number or '*'");
+                segment.kind = Segment::Kind::Index;
+                for (char c : inside) {
+                    if (c < '0' || c > '9') throw invalid("array index must be a number or '*'");
+                    segment.index = segment.index * 10 + size_t(c - '0');
+                }
+            }
+            segments_.push_back(std::move(segment));
+            i = close + 1;
+            if (i < text.size() && text[i] != '[' && text[i] != '.') throw invalid("expected '.' or '[' after ']'");
+        } else {
+            if (text[i] == '.') {
+                if (segments_.empty()) throw invalid("empty member name");
+                ++i;
+            }
+            const size_t end = text.find_first_of(".[]", i);
+            std::string_view name = text.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i);
+            if (name.empty()) throw invalid("empty member name");
+            if (end != std::string_view::npos && text[end] == ']') throw invalid("unexpected ']'");
+            segments_.push_back(Segment{Segment::Kind::Member, std::string(name)});
+            i += name.size();
+        }
+    }
+    if (segments_.empty()) throw invalid("empty path");
+}
+
+VitalEdgeFieldPath::Ptr VitalEdgeFieldPath::compile(std::string_view text) {
+    CacheState& cache = state();
+    ThreadCache& local = threadCache;
+    const uint64_t generation = cache.generation.load(std::memory_order_acquire);
+    if (local.generation != generation) {
+        local.paths.clear();
+        local.generation = generation;
+    }
+
+    std::string key(text);
+    auto found = local.paths.find(key);
+    if (found != local.paths.end()) return found->second;
+
+    Ptr path;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto shared = cache.paths.find(key);
+        if (shared != cache.paths.end()) path = shared->second;
+    }
+    if (!path) {
+        path = std::make_shared<const VitalEdgeFieldPath>(text);
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.paths.size() >= cache.capacity) cache.paths.clear();
+        cache.paths.emplace(key, path);
+    }
+
+    if (local.paths.size() >= kThreadCacheSize) local.paths.clear();
+    local.paths.emplace(std::move(key), path);
+    return path;
+}
+
+void VitalEdgeFieldPath::setCapacity(size_t capacity) {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.capacity = capacity > 0 ? capacity : 1;
+}
+
+size_t VitalEdgeFieldPath::cacheSize() {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.paths.size();
+}
+
+void VitalEdgeFieldPath::clearCache() {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.paths.clear();
+    cache.generation.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,45 @@
+#ifndef VITALEDGE_FIELDPATH_H
+#define VITALEDGE_FIELDPATH_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A path naming fields of a JSON document for field-level encryption:
+// dot-separated member names with optional array steps, e.g. "mrn",
+// "address.zip", "contacts[*].phone" (every element) or "visits[0].notes".
+//
+// Paths are compiled once and cached process-wide. Each thread also keeps its
+// own small cache in front, so a request repeating known paths takes no lock.
+class VitalEdgeFieldPath {
+public:
+    struct Segment {
+        enum class Kind { Member, Index, Wildcard };
+        Kind kind;
+        std::string name; // Member
+        size_t index = 0; // Index
+    };
+    using Ptr = std::shared_ptr<const VitalEdgeFieldPath>;
+
+    // Compiled path, from the cache when this text was seen before. Throws
+    // std::invalid_argument for a malformed path.
+    static Ptr compile(std::string_view text);
+
+    const std::string& text() const { return text_; }
+    const std::vector<Segment>& segments() const { return segments_; }
+
+    // Paths kept in the shared cache (default 4096); a full cache starts over
+    static void setCapacity(size_t capacity);
+    static size_t cacheSize();
+    static void clearCache();
+
+    explicit VitalEdgeFieldPath(std::string_view text); // parses; use compile()
+
+private:
+    std::string text_;
+    std::vector<Segment> segments_;
+};
+
+#endif // VITALEDGE_FIELDPATH_H
@@ -0,0 +1,157 @@
+#include "VitalEdgeFileCrypt.h"
+#include "VitalEdgeExecutor.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+static constexpr char kPartialSuffix[] = ".partial";
+
+namespace {
+
+std::runtime_error fileError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + ": " + path + ": " + std::strerror(errno));
+}
+
+// A file descriptor and, once mapped, the whole file. Empty files are not mapped.
+struct MappedFile {
+    int fd = -1;
+    unsigned char* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data) munmap(data, size);
+        if (fd >= 0) ::close(fd);
+    }
+
+    void map(int protection, const std::string& path) {
+        if (size == 0) return;
+        void* base = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) throw fileError("Unable to map", path);
+        data = (unsigned char*)base;
+    }
+};
+
+// Output of an unfinished job, never an input
+bool isPartial(const std::string& path) {
+    const size_t length = sizeof(kPartialSuffix) - 1;
+    return path.size() >= length && path.compare(path.size() - length, length, kPartialSuffix) == 0;
+}
+
+struct FileResult {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+};
+
+FileResult cryptFile(const std::string& inputPath, const std::string& outputPath,
+                     const VitalEdgeFileCrypt::Key& key, bool encrypt, size_t segmentSize) {
+    MappedFile in;
+    struct stat info;
+    in.fd = ::open(inputPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in.fd < 0 || fstat(in.fd, &info) != 0) throw fileError("Unable to open", inputPath);
+    in.size = size_t(info.st_size);
+    in.map(PROT_READ, inputPath);
+    if (in.data) madvise(in.data, in.size, MADV_SEQUENTIAL);
+
+    size_t outputSize = 0;
+    try {
+        outputSize = encrypt ? VitalEdgeChunkedAEAD::sealedSize(in.size, segmentSize)
+                             : (size_t)VitalEdgeChunkedAEAD::openedSize(in.data, in.size);
+    } catch (const std::invalid_argument& e) {
+        if (encrypt) throw;
+        throw std::runtime_error(inputPath + ": " + e.what());
+    }
+
+    // Blocks are allocated up front so page faults on the output only map them
+    const std::string partial = outputPath + kPartialSuffix;
+    MappedFile out;
+    out.fd = ::open(partial.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out.fd < 0) throw fileError("Unable to create", partial);
+    try {
+        if (ftruncate(out.fd, off_t(outputSize)) != 0) throw fileError("Unable to size", partial);
+        if (outputSize > 0) posix_fallocate(out.fd, 0, off_t(outputSize));
+        out.size = outputSize;
+        out.map(PROT_READ | PROT_WRITE, partial);
+
+        if (encrypt) {
+            key.entry ? VitalEdgeChunkedAEAD::seal(in.data, in.size, *key.entry, segmentSize, out.data)
+                      : VitalEdgeChunkedAEAD::seal(in.data, in.size, key.raw, segmentSize, out.data);
+        } else {
+            try {
+                key.entry ? VitalEdgeChunkedAEAD::open(in.data, in.size, *key.entry, out.data)
+                          : VitalEdgeChunkedAEAD::open(in.data, in.size, key.raw, out.data);
+            } catch (const std::runtime_error& e) {
+                throw std::runtime_error(inputPath + ": " + e.what());
+            }
+        }
+
+        if (fsync(out.fd) != 0 || fchmod(out.fd, info.st_mode & 07777) != 0) {
+            throw fileError("Unable to sync", partial);
+        }
+        if (std::rename(partial.c_str(), outputPath.c_str()) != 0) throw fileError("Unable to rename", partial);
+    } catch (...) {
+        std::remove(partial.c_str());
+        throw;
+    }
+    return FileResult{in.size, outputSize};
+}
+
+VitalEdgeFileCrypt::Report run(const std::string& input, const std::string& output,
+                               const VitalEdgeFileCrypt::Key& key, bool encrypt, size_t segmentSize) {
+    namespace fs = std::filesystem;
+    if (!key.entry && key.raw.size() != VitalEdgeKeyring::Entry::kKeySize) {
+        throw std::invalid_argument("File encryption needs a 32-byte AES-256 key");
+    }
+    VitalEdgeFileCrypt::Report report;
+    const auto started = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<std::string, std::string>> files;
+    if (fs::is_directory(input)) {
+        for (const auto& item : fs::recursive_directory_iterator(input)) {
+            const std::string path = item.path().string();
+            if (!item.is_regular_file() || isPartial(path)) continue;
+            const fs::path target = fs::path(output) / fs::relative(item.path(), input);
+            files.emplace_back(path, target.string());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) fs::create_directories(fs::path(file.second).parent_path());
+    } else {
+        files.emplace_back(input, output);
+    }
+
+    // Small files keep every thread busy side by side; a large one spreads its own
+    // segments over the pool
+    std::vector<FileResult> results(files.size());
+    VitalEdgeExecutor::instance().parallelFor(files.size(), [&](size_t i) {
+        results[i] = cryptFile(files[i].first, files[i].second, key, encrypt, segmentSize);
+    });
+
+    for (const FileResult& result : results) {
+        report.bytesIn += result.bytesIn;
+        report.bytesOut += result.bytesOut;
+    }
+    report.files = files.size();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+} // namespace
+
+VitalEdgeFileCrypt::Report VitalEdgeFileCrypt::encrypt(const std::string& input, const std::string& output,
+                                                       const Key& key, size_t segmentSize) {
+    VitalEdgeChunkedAEAD::sealedSize(0, segmentSize); // validates segmentSize before any file is touched
+    return run(input, output, key, true, segmentSize);
+}
+
+VitalEdgeFileCrypt::Report VitalEdgeFileCrypt::decrypt(const std::string& input, const std::string& output,
+                                                       const Key& key) {
+    return run(input, output, key, false, 0);
+}
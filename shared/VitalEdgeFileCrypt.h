@@ -0,0 +1,47 @@
+#ifndef VITALEDGE_FILECRYPT_H
+#define VITALEDGE_FILECRYPT_H
+
+#include "VitalEdgeChunkedAEAD.h"
+#include "VitalEdgeKeyring.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Offline encryption of files and directory trees into VitalEdgeChunkedAEAD
+// containers, for bulk jobs that should not go through the HTTP API.
+//
+// Input and output are memory-mapped: segments are sealed or opened in parallel
+// on VitalEdgeExecutor straight from the input pages into the output pages, with
+// no read/write copies or intermediate buffers, so a job is bound by memory or
+// disk bandwidth rather than by the service. Output is written to
+// "<output>.partial" (preallocated) and renamed into place once complete, so a
+// failed or interrupted job never leaves a truncated file under the final name.
+// A directory is processed file by file into a mirrored tree, with files run
+// concurrently on the executor alongside their own segments.
+class VitalEdgeFileCrypt {
+public:
+    // A raw key, or a keyring entry used instead when set
+    struct Key {
+        std::string_view raw;
+        const VitalEdgeKeyring::Entry* entry = nullptr;
+    };
+
+    struct Report {
+        size_t files = 0;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        double seconds = 0;
+        double megabytesPerSecond() const { return seconds > 0 ? bytesIn / seconds / 1e6 : 0; }
+    };
+
+    // Seal input (a file or directory) into output. Throws std::invalid_argument for
+    // a bad key or segment size and std::runtime_error for I/O errors.
+    static Report encrypt(const std::string& input, const std::string& output, const Key& key,
+                          size_t segmentSize = VitalEdgeChunkedAEAD::kDefaultSegmentSize);
+    // Open containers made by encrypt(); also throws std::runtime_error if one fails
+    // authentication, leaving no output for it
+    static Report decrypt(const std::string& input, const std::string& output, const Key& key);
+};
+
+#endif // VITALEDGE_FILECRYPT_H
@@ -0,0 +1,164 @@
+#include "VitalEdgeKeyCache.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/bio.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+VitalEdgeKeyCache::CachedKey::CachedKey(EVP_PKEY* key, bool isPrivate)
+    : key_(key), template_(nullptr), isPrivate_(isPrivate) {
+    if (!EVP_PKEY_is_a(key_, "RSA")) return; // only RSA keys encrypt
+    template_ = EVP_PKEY_CTX_new_from_pkey(nullptr, key_, nullptr);
+    bool ok = template_ != nullptr;
+    ok = ok && (isPrivate_ ? EVP_PKEY_decrypt_init(template_) : EVP_PKEY_encrypt_init(template_)) > 0;
+    ok = ok && EVP_PKEY_CTX_set_rsa_padding(template_, RSA_PKCS1_OAEP_PADDING) > 0;
+    if (!ok) {
+        // The key stays with the caller when construction fails
+        EVP_PKEY_CTX_free(template_);
+        VitalEdgeUtils::throwOpenSSLError("Unable to prepare RSA-OAEP context");
+    }
+}
+
+VitalEdgeKeyCache::CachedKey::~CachedKey() {
+    EVP_PKEY_CTX_free(template_);
+    EVP_PKEY_free(key_);
+}
+
+bool VitalEdgeKeyCache::CachedKey::isEd25519() const {
+    return EVP_PKEY_is_a(key_, "ED25519");
+}
+
+EVP_PKEY_CTX* VitalEdgeKeyCache::CachedKey::newContext() const {
+    if (!template_) throw std::invalid_argument("Key is not an RSA key");
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_dup(template_);
+    if (!ctx) VitalEdgeUtils::throwOpenSSLError("Unable to duplicate RSA-OAEP context");
+    return ctx;
+}
+
+namespace {
+
+struct CacheState {
+    std::mutex mutex;
+    size_t capacity = 64;
+    std::list<std::string> lru; // most recently used first
+    std::unordered_map<std::string, std::pair<VitalEdgeKeyCache::KeyPtr, std::list<std::string>::iterator>> entries;
+    std::unordered_map<std::string, VitalEdgeKeyCache::KeyPtr> pinned;
+};
+
+CacheState& state() {
+    static CacheState cache;
+    return cache;
+}
+
+} // namespace
+
+// SHA-256 of the PEM text, tagged with the key type so a public and a private
+// key can never collide
+static std::string fingerprint(const std::string& pem, bool isPrivate) {
+    static EVP_MD* sha256 = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    if (!sha256 || !EVP_Digest(pem.data(), pem.size(), digest, &digestLen, sha256, nullptr)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to fingerprint key");
+    }
+    std::string result(1, isPrivate ? 'S' : 'P');
+    result.append((const char*)digest, digestLen);
+    return result;
+}
+
+static VitalEdgeKeyCache::KeyPtr parseKey(const std::string& pem, bool isPrivate) {
+    BIO* keyBio = BIO_new_mem_buf(pem.data(), (int)pem.size());
+    if (!keyBio) VitalEdgeUtils::throwOpenSSLError("Unable to read key");
+
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> evpKey(
+        isPrivate ? PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr)
+                  : PEM_read_bio_PUBKEY(keyBio, nullptr, nullptr, nullptr),
+        EVP_PKEY_free);
+    BIO_free(keyBio);
+    if (!evpKey) VitalEdgeUtils::throwOpenSSLError("Unable to parse PEM key");
+
+    // The guard keeps the key until the entry owns it, so a failed allocation
+    // or context setup does not leak it
+    auto key = std::make_shared<const VitalEdgeKeyCache::CachedKey>(evpKey.get(), isPrivate);
+    evpKey.release();
+    return key;
+}
+
+static VitalEdgeKeyCache::KeyPtr lookup(const std::string& pem, bool isPrivate) {
+    CacheState& cache = state();
+    std::string id = fingerprint(pem, isPrivate);
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.entries.find(id);
+        if (it != cache.entries.end()) {
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second.second);
+            return it->second.first;
+        }
+    }
+
+    // Parse outside the lock so a miss does not stall hits on other keys
+    VitalEdgeKeyCache::KeyPtr key = parseKey(pem, isPrivate);
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.entries.find(id);
+    if (it != cache.entries.end()) return it->second.first; // another thread won the race
+
+    cache.lru.push_front(id);
+    cache.entries.emplace(id, std::make_pair(key, cache.lru.begin()));
+    while (cache.entries.size() > cache.capacity) {
+        cache.entries.erase(cache.lru.back());
+        cache.lru.pop_back();
+    }
+    return key;
+}
+
+VitalEdgeKeyCache::KeyPtr VitalEdgeKeyCache::publicKey(const std::string& pem) {
+    return lookup(pem, false);
+}
+
+VitalEdgeKeyCache::KeyPtr VitalEdgeKeyCache::privateKey(const std::string& pem) {
+    return lookup(pem, true);
+}
+
+VitalEdgeKeyCache::KeyPtr VitalEdgeKeyCache::registerKey(const std::string& keyId, const std::string& pem, bool isPrivate) {
+    KeyPtr key = parseKey(pem, isPrivate);
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.pinned[keyId] = key;
+    return key;
+}
+
+VitalEdgeKeyCache::KeyPtr VitalEdgeKeyCache::findKey(const std::string& keyId) {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.pinned.find(keyId);
+    return it == cache.pinned.end() ? nullptr : it->second;
+}
+
+void VitalEdgeKeyCache::setCapacity(size_t capacity) {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.capacity = capacity;
+    while (cache.entries.size() > cache.capacity) {
+        cache.entries.erase(cache.lru.back());
+        cache.lru.pop_back();
+    }
+}
+
+size_t VitalEdgeKeyCache::size() {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.entries.size();
+}
+
+void VitalEdgeKeyCache::clear() {
+    CacheState& cache = state();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+    cache.lru.clear();
+    cache.pinned.clear();
+}
@@ -0,0 +1,57 @@
+#ifndef VITALEDGE_KEYCACHE_H
+#define VITALEDGE_KEYCACHE_H
+
+#include <openssl/evp.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Cache of parsed asymmetric keys for the RSA and Ed25519 paths of VitalEdgeCrypto.
+//
+// PEM strings are looked up by their SHA-256 fingerprint, so repeated calls with
+// the same key skip PEM parsing entirely. Each RSA entry carries an EVP_PKEY_CTX
+// template already initialised for RSA-OAEP; operations duplicate the template
+// rather than re-running EVP_PKEY_*_init. Entries are shared through shared_ptr,
+// so an evicted key stays valid for calls still using it.
+class VitalEdgeKeyCache {
+public:
+    class CachedKey {
+    public:
+        // Takes ownership of key once constructed; throws without taking it
+        CachedKey(EVP_PKEY* key, bool isPrivate);
+        ~CachedKey();
+        CachedKey(const CachedKey&) = delete;
+        CachedKey& operator=(const CachedKey&) = delete;
+
+        EVP_PKEY* key() const { return key_; }
+        bool isPrivate() const { return isPrivate_; }
+        bool isRSA() const { return template_ != nullptr; }
+        bool isEd25519() const;
+
+        // Fresh OAEP context for this key (encrypt for public keys, decrypt for
+        // private keys); the caller frees it with EVP_PKEY_CTX_free. Throws
+        // std::invalid_argument for a key that is not RSA.
+        EVP_PKEY_CTX* newContext() const;
+
+    private:
+        EVP_PKEY* key_;
+        EVP_PKEY_CTX* template_;
+        bool isPrivate_;
+    };
+    using KeyPtr = std::shared_ptr<const CachedKey>;
+
+    // Parsed key for a PEM string, parsing and caching it on a miss
+    static KeyPtr publicKey(const std::string& pem);
+    static KeyPtr privateKey(const std::string& pem);
+
+    // Keys registered under a key_id are pinned: they are never evicted
+    static KeyPtr registerKey(const std::string& keyId, const std::string& pem, bool isPrivate);
+    static KeyPtr findKey(const std::string& keyId);
+
+    // Maximum number of PEM-fingerprint entries kept (default 64)
+    static void setCapacity(size_t capacity);
+    static size_t size();
+    static void clear();
+};
+
+#endif // VITALEDGE_KEYCACHE_H
@@ -1,12 +1,17 @@
 #include "VitalEdgeKeyManager.h"
-#include <openssl/rand.h>
+#include "VitalEdgeRandom.h"
 #include <stdexcept>
 
 std::string VitalEdgeKeyManager::generateKey(const std::string& algorithm) {
-    if (algorithm != "AES") {
+    size_t length = 0;
+    if (algorithm == "AES" || algorithm == "AES-256") {
+        length = 32; // AES-256, the cipher every AES path uses
+    } else if (algorithm == "AES-128") {
+        length = 16;
+    } else {
         throw std::invalid_argument("Unsupported algorithm");
     }
-    std::string key(16, '\0'); // 16 bytes for AES-128
-    RAND_bytes(reinterpret_cast<unsigned char*>(&key[0]), key.size());
+    std::string key(length, '\0');
+    VitalEdgeRandom::privateBytes(reinterpret_cast<unsigned char*>(&key[0]), key.size());
     return key;
 }
@@ -0,0 +1,394 @@
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeSecureMemory.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Context string for deriving an entry's MAC key from its AES key
+static constexpr char kMacKeyLabel[] = "VitalEdge HMAC-SHA256 key";
+
+// Number of HMAC contexts cached per thread before the least recently used is evicted
+static constexpr size_t kThreadMacCacheSize = 16;
+
+namespace {
+
+// Zeroes a buffer on every way out of a scope
+struct Cleanse {
+    void* data;
+    size_t size;
+    ~Cleanse() { OPENSSL_cleanse(data, size); }
+};
+
+} // namespace
+
+static const EVP_CIPHER* cbcCipher() {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-CBC");
+    return cipher;
+}
+
+static const EVP_CIPHER* gcmCipher() {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-GCM");
+    return cipher;
+}
+
+static EVP_MAC* hmacAlgorithm() {
+    static EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    if (!mac) VitalEdgeUtils::throwOpenSSLError("Unable to fetch HMAC");
+    return mac;
+}
+
+namespace {
+
+// Every version of each key_id, in ascending version order; the last is current
+using Versions = std::vector<VitalEdgeKeyring::EntryPtr>;
+using Table = std::unordered_map<std::string, Versions>;
+
+struct KeyringState {
+    std::mutex mutex; // serialises writers and snapshot refreshes
+    std::shared_ptr<const Table> table = std::make_shared<const Table>();
+    std::atomic<uint64_t> version{1};
+};
+
+KeyringState& state() {
+    static KeyringState keyring;
+    return keyring;
+}
+
+// This thread's copy of the table pointer and the version it was taken at
+struct Snapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const Table> table;
+};
+
+thread_local Snapshot snapshot;
+
+// Per-thread HMAC contexts duplicated from entries' templates, matched by serial
+struct CachedMac {
+    uint64_t serial = 0;
+    EVP_MAC_CTX* ctx = nullptr;
+    uint64_t lastUse = 0;
+};
+
+struct MacCache {
+    std::vector<CachedMac> entries;
+    uint64_t tick = 0;
+
+    ~MacCache() {
+        for (auto& entry : entries) EVP_MAC_CTX_free(entry.ctx);
+    }
+};
+
+thread_local MacCache macCache;
+
+std::atomic<uint64_t> nextSerial{1};
+
+} // namespace
+
+// Copy the table, let update() change the copy, and publish it as a new version
+static void publish(const std::function<void(Table&)>& update) {
+    KeyringState& keyring = state();
+    std::lock_guard<std::mutex> lock(keyring.mutex);
+    auto table = std::make_shared<Table>(*keyring.table);
+    update(*table);
+    keyring.table = std::move(table);
+    keyring.version.fetch_add(1, std::memory_order_release);
+}
+
+// This thread's snapshot, refreshed if a writer has published since. Returned by
+// reference so readers do not touch the shared table's reference count.
+static const Table& currentTable() {
+    KeyringState& keyring = state();
+    const uint64_t version = keyring.version.load(std::memory_order_acquire);
+    if (snapshot.version != version) {
+        std::lock_guard<std::mutex> lock(keyring.mutex);
+        snapshot.table = keyring.table;
+        snapshot.version = keyring.version.load(std::memory_order_relaxed);
+    }
+    return *snapshot.table;
+}
+
+// Add entry to its key_id's versions, replacing an entry with the same version
+static void insertVersion(Table& table, const VitalEdgeKeyring::EntryPtr& entry) {
+    Versions& versions = table[entry->id()];
+    auto it = std::lower_bound(versions.begin(), versions.end(), entry->version(),
+                               [](const VitalEdgeKeyring::EntryPtr& e, uint32_t version) { return e->version() < version; });
+    if (it != versions.end() && (*it)->version() == entry->version()) {
+        *it = entry;
+    } else {
+        versions.insert(it, entry);
+    }
+}
+
+static uint32_t currentVersion(const Table& table, const std::string& keyId) {
+    auto it = table.find(keyId);
+    return it == table.end() || it->second.empty() ? 0 : it->second.back()->version();
+}
+
+static std::string_view checkedKey(std::string_view key) {
+    if (key.size() != VitalEdgeKeyring::Entry::kKeySize) {
+        throw std::invalid_argument("Keyring keys must be " + std::to_string(VitalEdgeKeyring::Entry::kKeySize) +
+                                    " bytes");
+    }
+    return key;
+}
+
+VitalEdgeKeyring::Entry::Entry(std::string keyId, std::string_view key, uint32_t version)
+    : id_(std::move(keyId)),
+      version_(version),
+      serial_(nextSerial.fetch_add(1)),
+      cbcEncrypt_(cbcCipher(), checkedKey(key), true),
+      cbcDecrypt_(cbcCipher(), key, false),
+      gcmEncrypt_(gcmCipher(), key, true),
+      gcmDecrypt_(gcmCipher(), key, false),
+      mac_(nullptr) {
+    unsigned char macKey[kMacSize];
+    size_t macKeyLen = 0;
+    if (!EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA256", nullptr, key.data(), key.size(),
+                   (const unsigned char*)kMacKeyLabel, sizeof(kMacKeyLabel) - 1, macKey, sizeof(macKey), &macKeyLen)) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to derive MAC key");
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0),
+        OSSL_PARAM_construct_end(),
+    };
+    mac_ = EVP_MAC_CTX_new(hmacAlgorithm());
+    const bool ok = mac_ && EVP_MAC_init(mac_, macKey, macKeyLen, params);
+    OPENSSL_cleanse(macKey, sizeof(macKey));
+    if (!ok) {
+        EVP_MAC_CTX_free(mac_);
+        VitalEdgeUtils::throwOpenSSLError("Unable to initialise HMAC");
+    }
+}
+
+VitalEdgeKeyring::Entry::~Entry() {
+    EVP_MAC_CTX_free(mac_);
+}
+
+void VitalEdgeKeyring::Entry::hmac(const unsigned char* data, size_t length, unsigned char* out) const {
+    hmac(std::string_view(), data, length, out);
+}
+
+void VitalEdgeKeyring::Entry::hmac(std::string_view label, const unsigned char* data, size_t length,
+                                   unsigned char* out) const {
+    MacCache& cache = macCache;
+    CachedMac* entry = nullptr;
+    for (auto& candidate : cache.entries) {
+        if (candidate.serial == serial_) {
+            entry = &candidate;
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (cache.entries.size() < kThreadMacCacheSize) {
+            cache.entries.emplace_back();
+            entry = &cache.entries.back();
+        } else {
+            entry = &cache.entries.front();
+            for (auto& candidate : cache.entries) {
+                if (candidate.lastUse < entry->lastUse) entry = &candidate;
+            }
+            EVP_MAC_CTX_free(entry->ctx);
+        }
+        entry->serial = serial_;
+        entry->ctx = EVP_MAC_CTX_dup(mac_);
+        if (!entry->ctx) {
+            entry->serial = 0;
+            VitalEdgeUtils::throwOpenSSLError("Unable to duplicate HMAC context");
+        }
+    } else if (!EVP_MAC_init(entry->ctx, nullptr, 0, nullptr)) {
+        // A null key restarts HMAC with the key already set
+        VitalEdgeUtils::throwOpenSSLError("Unable to reset HMAC context");
+    }
+    entry->lastUse = ++cache.tick;
+
+    size_t outLen = 0;
+    if (!EVP_MAC_update(entry->ctx, (const unsigned char*)label.data(), label.size()) ||
+        !EVP_MAC_update(entry->ctx, data, length) || !EVP_MAC_final(entry->ctx, out, &outLen, kMacSize)) {
+        VitalEdgeUtils::throwOpenSSLError("HMAC computation failed");
+    }
+}
+
+std::string VitalEdgeKeyring::Entry::hmac(std::string_view data) const {
+    std::string mac(kMacSize, '\0');
+    hmac((const unsigned char*)data.data(), data.size(), (unsigned char*)&mac[0]);
+    return mac;
+}
+
+VitalEdgeKeyring::EntryPtr VitalEdgeKeyring::add(const std::string& keyId, std::string_view key, uint32_t version) {
+    // Key schedules are expanded before the writer lock is taken. For the next
+    // version, that means guessing it first and trying again if another writer
+    // took it in the meantime.
+    for (;;) {
+        const uint32_t expected = version ? 0 : currentVersion(currentTable(), keyId);
+        EntryPtr entry = std::make_shared<const Entry>(keyId, key, version ? version : expected + 1);
+        bool added = false;
+        publish([&](Table& table) {
+            if (version || currentVersion(table, keyId) == expected) {
+                insertVersion(table, entry);
+                added = true;
+            }
+        });
+        if (added) return entry;
+    }
+}
+
+bool VitalEdgeKeyring::remove(const std::string& keyId) {
+    bool removed = false;
+    publish([&](Table& table) { removed = table.erase(keyId) > 0; });
+    return removed;
+}
+
+bool VitalEdgeKeyring::remove(const std::string& keyId, uint32_t version) {
+    bool removed = false;
+    publish([&](Table& table) {
+        auto it = table.find(keyId);
+        if (it == table.end()) return;
+        Versions& versions = it->second;
+        auto entry = std::find_if(versions.begin(), versions.end(),
+                                  [&](const EntryPtr& e) { return e->version() == version; });
+        if (entry == versions.end()) return;
+        versions.erase(entry);
+        if (versions.empty()) table.erase(it);
+        removed = true;
+    });
+    return removed;
+}
+
+VitalEdgeKeyring::EntryPtr VitalEdgeKeyring::find(const std::string& keyId) {
+    const Table& table = currentTable();
+    auto it = table.find(keyId);
+    return it == table.end() ? nullptr : it->second.back();
+}
+
+VitalEdgeKeyring::EntryPtr VitalEdgeKeyring::find(const std::string& keyId, uint32_t version) {
+    const Table& table = currentTable();
+    auto it = table.find(keyId);
+    if (it == table.end()) return nullptr;
+    for (const EntryPtr& entry : it->second) {
+        if (entry->version() == version) return entry;
+    }
+    return nullptr;
+}
+
+size_t VitalEdgeKeyring::loadFile(const std::string& filepath) {
+    // The file's Base64 keys pass through the stream buffer and each line: both
+    // are zeroed on every way out, and lines are split in place, never copied
+    char buffer[4096];
+    const Cleanse bufferGuard{buffer, sizeof(buffer)};
+    std::ifstream file;
+    file.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+    file.open(filepath);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open keyring file: " + filepath);
+    }
+
+    std::vector<EntryPtr> entries;
+    VitalEdgeSecureMemory::String line;
+    for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        const Cleanse lineGuard{&line[0], line.size()};
+        std::string_view rest(line.data(), line.size());
+        rest = rest.substr(0, rest.find('#'));
+        auto field = [&rest] {
+            static constexpr char kSpace[] = " \t\r\v\f";
+            const size_t begin = std::min(rest.find_first_not_of(kSpace), rest.size());
+            const size_t end = std::min(rest.find_first_of(kSpace, begin), rest.size());
+            const std::string_view token = rest.substr(begin, end - begin);
+            rest.remove_prefix(end);
+            return token;
+        };
+        const std::string_view keyId = field();
+        if (keyId.empty()) continue;
+        const std::string_view encoded = field();
+        const std::string_view versionText = field();
+        if (encoded.empty() || !field().empty()) {
+            throw std::invalid_argument(filepath + ":" + std::to_string(lineNumber) +
+                                        ": expected 'key_id base64-key [version]'");
+        }
+        uint32_t version = 1;
+        if (!versionText.empty()) {
+            const std::string text(versionText);
+            char* end = nullptr;
+            const unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+            if (*end || parsed == 0 || parsed > UINT32_MAX || text[0] == '-') {
+                throw std::invalid_argument(filepath + ":" + std::to_string(lineNumber) +
+                                            ": version must be a positive integer");
+            }
+            version = uint32_t(parsed);
+        }
+
+        // Decoded straight into secure memory, which zeroes it on every way out
+        VitalEdgeSecureMemory::Bytes key(VitalEdgeBase64::maxDecodedSize(encoded.size()));
+        size_t keyLength = 0;
+        try {
+            if (!VitalEdgeBase64::decode(encoded.data(), encoded.size(), key.data(), &keyLength)) {
+                throw std::invalid_argument("Invalid base64 input");
+            }
+            entries.push_back(std::make_shared<const Entry>(std::string(keyId),
+                                                            std::string_view((const char*)key.data(), keyLength),
+                                                            version));
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(filepath + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+
+    // One new version for the whole file
+    publish([&](Table& table) {
+        for (auto& entry : entries) insertVersion(table, entry);
+    });
+    return entries.size();
+}
+
+void VitalEdgeKeyring::appendToFile(const std::string& filepath, const std::string& keyId, std::string_view key,
+                                    uint32_t version) {
+    int fd = ::open(filepath.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::runtime_error("Unable to open keyring file: " + filepath + ": " + std::strerror(errno));
+
+    // Start on a fresh line if the file does not end with one
+    std::string line;
+    const off_t size = lseek(fd, 0, SEEK_END);
+    char last = '\n';
+    if (size > 0 && pread(fd, &last, 1, size - 1) == 1 && last != '\n') line += '\n';
+    std::string encoded = VitalEdgeBase64::encode(key);
+    line += keyId + " " + encoded + " " + std::to_string(version) + "\n";
+    OPENSSL_cleanse(&encoded[0], encoded.size());
+
+    const bool written = ::write(fd, line.data(), line.size()) == ssize_t(line.size()) && fsync(fd) == 0;
+    const int error = errno;
+    OPENSSL_cleanse(&line[0], line.size());
+    ::close(fd);
+    if (!written) {
+        throw std::runtime_error("Unable to write keyring file: " + filepath + ": " + std::strerror(error));
+    }
+}
+
+bool VitalEdgeKeyring::validKeyId(std::string_view keyId) {
+    if (keyId.empty() || keyId.size() > 128) return false;
+    return std::all_of(keyId.begin(), keyId.end(), [](char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '_' ||
+               c == '-';
+    });
+}
+
+size_t VitalEdgeKeyring::size() {
+    return currentTable().size();
+}
+
+void VitalEdgeKeyring::clear() {
+    publish([](Table& table) { table.clear(); });
+}
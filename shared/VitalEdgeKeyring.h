@@ -0,0 +1,94 @@
+#ifndef VITALEDGE_KEYRING_H
+#define VITALEDGE_KEYRING_H
+
+#include "VitalEdgeCipherEngine.h"
+#include <openssl/evp.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// In-memory symmetric keys addressed by key_id, so requests name a key instead
+// of carrying it.
+//
+// A key_id can hold several versions of its key. The highest version is current
+// and used for new encryption; older versions stay available to decrypt what was
+// encrypted before a rotation, until they are removed.
+//
+// Each entry expands its AES-256 key schedules (CBC and GCM, both directions) and
+// an HMAC-SHA256 context once, when the key is added. The table is read-mostly:
+// writers copy it and publish a new version, and readers keep a per-thread
+// snapshot that they only refresh when the version changes, so find() takes no
+// lock on the request path.
+class VitalEdgeKeyring {
+public:
+    class Entry {
+    public:
+        static constexpr size_t kKeySize = 32;
+        static constexpr size_t kMacSize = 32;
+
+        // key must be kKeySize bytes
+        Entry(std::string keyId, std::string_view key, uint32_t version = 1);
+        ~Entry();
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        const std::string& id() const { return id_; }
+        uint32_t version() const { return version_; }
+
+        // AES-256-CBC and AES-256-GCM schedules for one direction
+        const VitalEdgeCipherEngine::KeySchedule& cbc(bool encrypt) const { return encrypt ? cbcEncrypt_ : cbcDecrypt_; }
+        const VitalEdgeCipherEngine::KeySchedule& gcm(bool encrypt) const { return encrypt ? gcmEncrypt_ : gcmDecrypt_; }
+
+        // HMAC-SHA256 of data under a MAC key derived from this entry's key (the
+        // AES key itself is never used as a MAC key). out must hold kMacSize bytes.
+        void hmac(const unsigned char* data, size_t length, unsigned char* out) const;
+        std::string hmac(std::string_view data) const;
+        // Same over label followed by data, without joining them first; a distinct
+        // label per use keeps MACs made for one purpose from passing for another
+        void hmac(std::string_view label, const unsigned char* data, size_t length, unsigned char* out) const;
+
+    private:
+        std::string id_;
+        uint32_t version_;
+        uint64_t serial_;
+        VitalEdgeCipherEngine::KeySchedule cbcEncrypt_;
+        VitalEdgeCipherEngine::KeySchedule cbcDecrypt_;
+        VitalEdgeCipherEngine::KeySchedule gcmEncrypt_;
+        VitalEdgeCipherEngine::KeySchedule gcmDecrypt_;
+        EVP_MAC_CTX* mac_;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // Add a key as the given version of key_id, replacing that version if present;
+    // version 0 means the next one (1 for a new key_id), which becomes current.
+    // Requests already holding a replaced entry finish with it.
+    static EntryPtr add(const std::string& keyId, std::string_view key, uint32_t version = 0);
+    // Remove every version of key_id, or just one
+    static bool remove(const std::string& keyId);
+    static bool remove(const std::string& keyId, uint32_t version);
+
+    // Current entry for a key_id, or a given version of it, or nullptr. Lock-free
+    // unless the keyring changed since this thread last looked.
+    static EntryPtr find(const std::string& keyId);
+    static EntryPtr find(const std::string& keyId, uint32_t version);
+
+    // Read "key_id base64-key [version]" lines ('#' starts a comment; a missing
+    // version means 1) and add every key. Returns the number of keys loaded;
+    // throws on an unreadable file or bad line.
+    static size_t loadFile(const std::string& filepath);
+    // Append one key line in that format and fsync, so a rotation survives restarts
+    static void appendToFile(const std::string& filepath, const std::string& keyId, std::string_view key,
+                             uint32_t version);
+
+    // Whether keyId is 1 to 128 of [A-Za-z0-9._-], the key_ids a rotation may
+    // create: anything else could break a keyring file line
+    static bool validKeyId(std::string_view keyId);
+
+    // Number of key_ids (not versions)
+    static size_t size();
+    static void clear();
+};
+
+#endif // VITALEDGE_KEYRING_H
@@ -0,0 +1,371 @@
+#include "VitalEdgeMetrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Log-linear buckets: values below 8 ns get one bucket each, then every power of
+// two is split into 8 equal sub-buckets (12.5% resolution) up to ~9 minutes
+constexpr unsigned kSubBucketBits = 3;
+constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+constexpr size_t kBucketCount = 38 * kSubBuckets;
+
+constexpr size_t kSlotsPerTimer = VitalEdgeMetrics::kPhaseCount * VitalEdgeMetrics::kSizeBucketCount;
+constexpr size_t kSlotCount = VitalEdgeMetrics::kMaxTimers * kSlotsPerTimer;
+
+constexpr const char* kPhaseNames[VitalEdgeMetrics::kPhaseCount] = {"total", "queue", "parse", "decode", "crypto",
+                                                                     "encode"};
+constexpr size_t kSizeLimits[VitalEdgeMetrics::kSizeBucketCount - 1] = {256, 4096, 65536, 1 << 20, 1 << 24};
+constexpr const char* kSizeNames[VitalEdgeMetrics::kSizeBucketCount] = {"256", "4096", "65536", "1048576",
+                                                                         "16777216", "+Inf"};
+
+// Exported histogram boundaries in seconds; the internal buckets are summed into these
+constexpr double kExportBounds[] = {1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3,
+                                    5e-3, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+size_t bucketIndex(uint64_t nanos) {
+    if (nanos < kSubBuckets) return nanos;
+    const unsigned exponent = 63 - __builtin_clzll(nanos);
+    const size_t index = (exponent - kSubBucketBits + 1) * kSubBuckets +
+                         ((nanos >> (exponent - kSubBucketBits)) & (kSubBuckets - 1));
+    return std::min(index, kBucketCount - 1);
+}
+
+// Exclusive upper bound of a bucket in nanoseconds
+uint64_t bucketLimit(size_t index) {
+    if (index < kSubBuckets) return index + 1;
+    const unsigned exponent = unsigned(index / kSubBuckets) + kSubBucketBits - 1;
+    return (uint64_t(kSubBuckets + index % kSubBuckets) + 1) << (exponent - kSubBucketBits);
+}
+
+// Counters have a single writer (the owning thread), so an increment is a relaxed
+// load and store rather than a locked read-modify-write
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[kBucketCount] = {};
+    std::atomic<uint64_t> sum{0};
+};
+
+// One thread's series, allocated as they are first used
+struct ThreadMetrics {
+    std::atomic<Histogram*> slots[kSlotCount] = {};
+    std::atomic<uint64_t> errors[VitalEdgeMetrics::kMaxTimers] = {};
+    std::atomic<uint64_t> bytes[VitalEdgeMetrics::kMaxTimers] = {};
+
+    ~ThreadMetrics() {
+        for (auto& slot : slots) delete slot.load(std::memory_order_relaxed);
+    }
+
+    Histogram& histogram(size_t slot) {
+        Histogram* histogram = slots[slot].load(std::memory_order_relaxed);
+        if (!histogram) {
+            histogram = new Histogram();
+            slots[slot].store(histogram, std::memory_order_release);
+        }
+        return *histogram;
+    }
+
+    // Add another thread's counts into this one (called under the registry lock)
+    void absorb(const ThreadMetrics& other) {
+        for (size_t slot = 0; slot < kSlotCount; ++slot) {
+            const Histogram* from = other.slots[slot].load(std::memory_order_acquire);
+            if (!from) continue;
+            Histogram& to = histogram(slot);
+            for (size_t i = 0; i < kBucketCount; ++i) bump(to.buckets[i], from->buckets[i].load(std::memory_order_relaxed));
+            bump(to.sum, from->sum.load(std::memory_order_relaxed));
+        }
+        for (size_t id = 0; id < VitalEdgeMetrics::kMaxTimers; ++id) {
+            bump(errors[id], other.errors[id].load(std::memory_order_relaxed));
+            bump(bytes[id], other.bytes[id].load(std::memory_order_relaxed));
+        }
+    }
+};
+
+struct Registry {
+    std::mutex mutex; // guards the lists below; never taken while recording
+    std::vector<ThreadMetrics*> threads;
+    ThreadMetrics retired; // counts of threads that have exited
+    std::vector<std::pair<std::string, std::string>> timers;
+    std::atomic<bool> enabled{true};
+};
+
+// Never destroyed: threads may still retire their counts during static destruction
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+// Registers this thread's metrics on first use and folds them into the retired
+// totals when the thread exits
+struct ThreadHandle {
+    ThreadMetrics* metrics = nullptr;
+
+    ThreadMetrics& get() {
+        if (!metrics) {
+            auto* created = new ThreadMetrics();
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.threads.push_back(created);
+            metrics = created;
+        }
+        return *metrics;
+    }
+
+    ~ThreadHandle() {
+        if (!metrics) return;
+        Registry& reg = registry();
+        {
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.retired.absorb(*metrics);
+            reg.threads.erase(std::find(reg.threads.begin(), reg.threads.end(), metrics));
+        }
+        delete metrics;
+    }
+};
+
+thread_local ThreadHandle threadHandle;
+
+// A series summed over every thread (called under the registry lock)
+struct Merged {
+    uint64_t buckets[kBucketCount] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void add(const ThreadMetrics& metrics, size_t slot) {
+        const Histogram* histogram = metrics.slots[slot].load(std::memory_order_acquire);
+        if (!histogram) return;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            const uint64_t n = histogram->buckets[i].load(std::memory_order_relaxed);
+            buckets[i] += n;
+            count += n;
+        }
+        sum += histogram->sum.load(std::memory_order_relaxed);
+    }
+
+    void add(const Merged& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) buckets[i] += other.buckets[i];
+        count += other.count;
+        sum += other.sum;
+    }
+
+    uint64_t quantile(double q) const {
+        if (count == 0) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) return bucketLimit(i);
+        }
+        return bucketLimit(kBucketCount - 1);
+    }
+};
+
+Merged mergeSlot(Registry& reg, size_t slot) {
+    Merged merged;
+    merged.add(reg.retired, slot);
+    for (ThreadMetrics* metrics : reg.threads) merged.add(*metrics, slot);
+    return merged;
+}
+
+using CounterArray = std::atomic<uint64_t>[VitalEdgeMetrics::kMaxTimers];
+
+uint64_t mergeCounter(Registry& reg, CounterArray ThreadMetrics::*counters, size_t id) {
+    uint64_t total = (reg.retired.*counters)[id].load(std::memory_order_relaxed);
+    for (ThreadMetrics* metrics : reg.threads) total += (metrics->*counters)[id].load(std::memory_order_relaxed);
+    return total;
+}
+
+// Label values are route paths and operation names; escape them anyway
+std::string escapeLabel(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string& out, const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+} // namespace
+
+size_t VitalEdgeMetrics::sizeBucket(size_t bytes) {
+    size_t bucket = 0;
+    while (bucket < kSizeBucketCount - 1 && bytes > kSizeLimits[bucket]) ++bucket;
+    return bucket;
+}
+
+VitalEdgeMetrics::Timer::Timer(const std::string& kind, const std::string& name) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto existing = std::find(reg.timers.begin(), reg.timers.end(), std::make_pair(kind, name));
+    if (existing != reg.timers.end()) {
+        id_ = uint32_t(existing - reg.timers.begin());
+        return;
+    }
+    if (reg.timers.size() == kMaxTimers) {
+        throw std::runtime_error("Too many metrics timers (limit " + std::to_string(kMaxTimers) + ")");
+    }
+    id_ = uint32_t(reg.timers.size());
+    reg.timers.emplace_back(kind, name);
+}
+
+void VitalEdgeMetrics::Timer::record(Phase phase, size_t bytes, uint64_t nanos) const {
+    if (!enabled()) return;
+    ThreadMetrics& metrics = threadHandle.get();
+    const size_t slot = (id_ * kPhaseCount + size_t(phase)) * kSizeBucketCount + sizeBucket(bytes);
+    Histogram& histogram = metrics.histogram(slot);
+    bump(histogram.buckets[bucketIndex(nanos)], 1);
+    bump(histogram.sum, nanos);
+    if (phase == Phase::Total) bump(metrics.bytes[id_], bytes);
+}
+
+void VitalEdgeMetrics::Timer::recordError() const {
+    if (!enabled()) return;
+    bump(threadHandle.get().errors[id_], 1);
+}
+
+VitalEdgeMetrics::Scope::Scope(const Timer& timer, Phase phase, size_t bytes)
+    : timer_(timer), phase_(phase), bytes_(bytes), start_(enabled() ? now() : 0),
+      exceptions_(std::uncaught_exceptions()) {}
+
+VitalEdgeMetrics::Scope::~Scope() {
+    if (!start_) return;
+    timer_.record(phase_, bytes_, now() - start_);
+    if (phase_ == Phase::Total && std::uncaught_exceptions() > exceptions_) timer_.recordError();
+}
+
+uint64_t VitalEdgeMetrics::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void VitalEdgeMetrics::setEnabled(bool enabled) {
+    registry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool VitalEdgeMetrics::enabled() {
+    return registry().enabled.load(std::memory_order_relaxed);
+}
+
+std::string VitalEdgeMetrics::render() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::string histograms, quantiles, counters;
+    for (size_t id = 0; id < reg.timers.size(); ++id) {
+        const std::string labels = "kind=\"" + escapeLabel(reg.timers[id].first) + "\",name=\"" +
+                                   escapeLabel(reg.timers[id].second) + "\"";
+
+        for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+            Merged allSizes;
+            for (size_t size = 0; size < kSizeBucketCount; ++size) {
+                const Merged merged = mergeSlot(reg, (id * kPhaseCount + phase) * kSizeBucketCount + size);
+                if (merged.count == 0) continue;
+                allSizes.add(merged);
+
+                const std::string series = labels + ",phase=\"" + kPhaseNames[phase] + "\",size=\"" +
+                                           kSizeNames[size] + "\"";
+                size_t bucket = 0;
+                uint64_t cumulative = 0;
+                for (double bound : kExportBounds) {
+                    // A bucket counts toward a bound only if it lies wholly below it
+                    const uint64_t limit = (uint64_t)std::llround(bound * 1e9);
+                    while (bucket < kBucketCount && bucketLimit(bucket) <= limit) cumulative += merged.buckets[bucket++];
+                    appendf(histograms, "vitaledge_duration_seconds_bucket{%s,le=\"%g\"} %llu\n", series.c_str(),
+                            bound, (unsigned long long)cumulative);
+                }
+                appendf(histograms, "vitaledge_duration_seconds_bucket{%s,le=\"+Inf\"} %llu\n", series.c_str(),
+                        (unsigned long long)merged.count);
+                appendf(histograms, "vitaledge_duration_seconds_sum{%s} %.9f\n", series.c_str(), merged.sum / 1e9);
+                appendf(histograms, "vitaledge_duration_seconds_count{%s} %llu\n", series.c_str(),
+                        (unsigned long long)merged.count);
+            }
+
+            // Quantiles across all sizes, at the histograms' full resolution
+            if (allSizes.count == 0) continue;
+            for (double q : {0.5, 0.99, 0.999}) {
+                appendf(quantiles, "vitaledge_duration_quantile_seconds{%s,phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                        labels.c_str(), kPhaseNames[phase], q, allSizes.quantile(q) / 1e9);
+            }
+        }
+
+        const uint64_t bytes = mergeCounter(reg, &ThreadMetrics::bytes, id);
+        const uint64_t errors = mergeCounter(reg, &ThreadMetrics::errors, id);
+        if (bytes) appendf(counters, "vitaledge_bytes_total{%s} %llu\n", labels.c_str(), (unsigned long long)bytes);
+        if (errors) appendf(counters, "vitaledge_errors_total{%s} %llu\n", labels.c_str(), (unsigned long long)errors);
+    }
+
+    return "# HELP vitaledge_duration_seconds Time per request or operation, by phase and payload size.\n"
+           "# TYPE vitaledge_duration_seconds histogram\n" + histograms +
+           "# HELP vitaledge_duration_quantile_seconds Latency quantiles over all payload sizes.\n"
+           "# TYPE vitaledge_duration_quantile_seconds gauge\n" + quantiles +
+           "# HELP vitaledge_bytes_total Payload bytes processed.\n"
+           "# TYPE vitaledge_bytes_total counter\n"
+           "# HELP vitaledge_errors_total Requests or operations that failed.\n"
+           "# TYPE vitaledge_errors_total counter\n" + counters;
+}
+
+VitalEdgeMetrics::Summary VitalEdgeMetrics::summary(const std::string& kind, const std::string& name, Phase phase) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    Summary result;
+    auto timer = std::find(reg.timers.begin(), reg.timers.end(), std::make_pair(kind, name));
+    if (timer == reg.timers.end()) return result;
+    const size_t id = timer - reg.timers.begin();
+
+    Merged allSizes;
+    for (size_t size = 0; size < kSizeBucketCount; ++size) {
+        allSizes.add(mergeSlot(reg, (id * kPhaseCount + size_t(phase)) * kSizeBucketCount + size));
+    }
+    result.count = allSizes.count;
+    result.sumNanos = allSizes.sum;
+    result.errors = mergeCounter(reg, &ThreadMetrics::errors, id);
+    result.bytes = mergeCounter(reg, &ThreadMetrics::bytes, id);
+    result.p50 = allSizes.quantile(0.5);
+    result.p99 = allSizes.quantile(0.99);
+    result.p999 = allSizes.quantile(0.999);
+    return result;
+}
+
+void VitalEdgeMetrics::reset() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto clear = [](ThreadMetrics& metrics) {
+        for (auto& slot : metrics.slots) {
+            if (Histogram* histogram = slot.load(std::memory_order_acquire)) {
+                for (auto& bucket : histogram->buckets) bucket.store(0, std::memory_order_relaxed);
+                histogram->sum.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto& counter : metrics.errors) counter.store(0, std::memory_order_relaxed);
+        for (auto& counter : metrics.bytes) counter.store(0, std::memory_order_relaxed);
+    };
+    clear(reg.retired);
+    for (ThreadMetrics* metrics : reg.threads) clear(*metrics);
+}
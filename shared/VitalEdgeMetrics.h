@@ -0,0 +1,83 @@
+#ifndef VITALEDGE_METRICS_H
+#define VITALEDGE_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Latency histograms and counters for routes and library operations, exported
+// in the Prometheus text format. Each thread records into its own log-linear
+// (HDR-style) histograms with plain relaxed stores, so the hot path takes no
+// locks and shares no cache lines; a scrape sums every thread's copy.
+class VitalEdgeMetrics {
+public:
+    // Where the time of a request or operation went
+    enum class Phase : uint8_t { Total, Queue, Parse, Decode, Crypto, Encode };
+    static constexpr size_t kPhaseCount = 6;
+
+    // Payload sizes are bucketed at 256 B, 4 KiB, 64 KiB, 1 MiB, 16 MiB and above
+    static constexpr size_t kSizeBucketCount = 6;
+    static size_t sizeBucket(size_t bytes);
+
+    // Largest number of distinct timers in a process
+    static constexpr size_t kMaxTimers = 128;
+
+    // A named route or operation, e.g. ("route", "/decrypt") or ("op", "encryptAES").
+    // Registration takes a lock, so create timers once (function-local statics).
+    class Timer {
+    public:
+        Timer(const std::string& kind, const std::string& name);
+
+        // Add one sample; bytes picks the size bucket and, for Phase::Total, is
+        // added to the timer's byte counter
+        void record(Phase phase, size_t bytes, uint64_t nanos) const;
+        void recordError() const;
+
+    private:
+        uint32_t id_;
+    };
+
+    // Times its own lifetime as one phase. A Total scope left by an exception
+    // also counts an error.
+    class Scope {
+    public:
+        Scope(const Timer& timer, Phase phase, size_t bytes);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const Timer& timer_;
+        Phase phase_;
+        size_t bytes_;
+        uint64_t start_;
+        int exceptions_;
+    };
+
+    // Monotonic clock in nanoseconds
+    static uint64_t now();
+
+    // Recording is on by default; when off, timers and scopes do nothing
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+    // Prometheus text exposition of every series with samples
+    static std::string render();
+
+    // One series summed over all threads, for tests and benchmarks. Quantiles are
+    // bucket upper bounds in nanoseconds (within 12.5% of the true value).
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t sumNanos = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        uint64_t p50 = 0, p99 = 0, p999 = 0;
+    };
+    static Summary summary(const std::string& kind, const std::string& name, Phase phase);
+
+    // Zero every series; only meaningful while nothing is recording
+    static void reset();
+};
+
+#endif // VITALEDGE_METRICS_H
@@ -0,0 +1,164 @@
+#include "VitalEdgePlacement.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeSecureMemory.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+// Nodes a memory policy mask can name
+static constexpr int kMaxNodes = 1024;
+
+namespace {
+
+std::vector<int> allowedCpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool setAffinity(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool setMemoryPolicy(int mode, int node) {
+    unsigned long mask[kMaxNodes / (8 * sizeof(unsigned long))] = {};
+    if (node >= 0) mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_set_mempolicy, mode, node >= 0 ? mask : nullptr, node >= 0 ? kMaxNodes + 1 : 0) == 0;
+}
+
+} // namespace
+
+std::vector<VitalEdgePlacement::Node> VitalEdgePlacement::topology() {
+    namespace fs = std::filesystem;
+    const std::vector<int> allowed = allowedCpus();
+    std::vector<Node> nodes;
+
+    std::error_code error;
+    for (fs::directory_iterator it("/sys/devices/system/node", error), end; !error && it != end; it.increment(error)) {
+        const std::string name = it->path().filename().string();
+        if (name.size() < 5 || name.compare(0, 4, "node") != 0 ||
+            name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+        std::ifstream file(it->path() / "cpulist");
+        std::string list;
+        std::getline(file, list);
+        Node node{std::atoi(name.c_str() + 4), {}};
+        try {
+            for (int cpu : parseCpus(list)) {
+                if (std::binary_search(allowed.begin(), allowed.end(), cpu)) node.cpus.push_back(cpu);
+            }
+        } catch (const std::invalid_argument&) {
+            continue;
+        }
+        // Memory-only nodes and nodes outside the affinity mask run none of our threads
+        if (!node.cpus.empty()) nodes.push_back(std::move(node));
+    }
+
+    if (nodes.empty()) return {Node{0, allowed}};
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    return nodes;
+}
+
+int VitalEdgePlacement::nodeOf(const std::vector<Node>& nodes, int cpu) {
+    for (const Node& node : nodes) {
+        if (std::binary_search(node.cpus.begin(), node.cpus.end(), cpu)) return node.id;
+    }
+    return -1;
+}
+
+std::vector<int> VitalEdgePlacement::workerCpus(const std::vector<Node>& nodes, size_t worker, size_t workers) {
+    std::vector<int> all;
+    for (const Node& node : nodes) all.insert(all.end(), node.cpus.begin(), node.cpus.end());
+    if (all.empty() || workers == 0) return all;
+    if (workers >= all.size()) return {all[worker % all.size()]};
+    return std::vector<int>(all.begin() + worker * all.size() / workers,
+                            all.begin() + (worker + 1) * all.size() / workers);
+}
+
+VitalEdgePlacement::Plan VitalEdgePlacement::plan(const std::vector<int>& cpus, size_t ioThreads,
+                                                  size_t cryptoThreads) {
+    Plan plan;
+    if (cpus.empty()) return plan;
+    for (size_t i = 0; i < ioThreads; ++i) plan.ioCpus.push_back(cpus[i % cpus.size()]);
+    for (size_t i = 0; i < cryptoThreads; ++i) plan.cryptoCpus.push_back(cpus[(ioThreads + i) % cpus.size()]);
+    return plan;
+}
+
+bool VitalEdgePlacement::confineCurrentThread(const std::vector<int>& cpus) {
+    return setAffinity(cpus);
+}
+
+bool VitalEdgePlacement::preferNode(int node) {
+    return node >= 0 && node < kMaxNodes && setMemoryPolicy(MPOL_PREFERRED, node);
+}
+
+bool VitalEdgePlacement::pinCurrentThread(int cpu) {
+    if (!setAffinity({cpu})) return false;
+    // Local allocation overrides an inherited preference or interleave policy;
+    // kernels without NUMA support refuse it, which changes nothing
+    setMemoryPolicy(MPOL_LOCAL, -1);
+
+    // The DRBG and the first secure memory region are created now, from this CPU
+    unsigned char warm[16];
+    VitalEdgeRandom::bytes(warm, sizeof(warm));
+    VitalEdgeSecureMemory::deallocate(VitalEdgeSecureMemory::allocate(sizeof(warm)), sizeof(warm));
+    return true;
+}
+
+std::vector<int> VitalEdgePlacement::parseCpus(std::string_view list) {
+    std::vector<int> cpus;
+    while (!list.empty() && (list.back() == '\n' || list.back() == ' ')) list.remove_suffix(1);
+
+    auto number = [&](std::string_view text) {
+        if (text.empty() || text.size() > 6 || text.find_first_not_of("0123456789") != std::string_view::npos) {
+            throw std::invalid_argument("Malformed CPU list: " + std::string(list));
+        }
+        return std::stoi(std::string(text));
+    };
+
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        const std::string_view range = list.substr(0, comma);
+        const size_t dash = range.find('-');
+        const int first = number(range.substr(0, dash));
+        const int last = dash == std::string_view::npos ? first : number(range.substr(dash + 1));
+        if (last < first) throw std::invalid_argument("Malformed CPU list: " + std::string(list));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+        if (list.empty()) throw std::invalid_argument("Malformed CPU list: trailing comma");
+    }
+    return cpus;
+}
+
+std::string VitalEdgePlacement::formatCpus(const std::vector<int>& cpus) {
+    std::string list;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t last = i;
+        while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) ++last;
+        if (!list.empty()) list += ',';
+        list += std::to_string(cpus[i]);
+        if (last > i) list += '-' + std::to_string(cpus[last]);
+        i = last + 1;
+    }
+    return list;
+}
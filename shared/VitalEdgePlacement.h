@@ -0,0 +1,58 @@
+#ifndef VITALEDGE_PLACEMENT_H
+#define VITALEDGE_PLACEMENT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// CPU and NUMA placement of the server's processes and threads.
+//
+// The topology comes from sysfs (/sys/devices/system/node), limited to the CPUs
+// the process may run on, so no libnuma is needed. A pinned thread prefers
+// memory from its own node and creates its per-thread state (DRBG, secure memory
+// arena) right after pinning; as that memory is touched first from the pinned
+// CPU, it is allocated on the thread's node and stays there.
+class VitalEdgePlacement {
+public:
+    struct Node {
+        int id;
+        std::vector<int> cpus; // ascending
+    };
+
+    // NUMA nodes holding CPUs this process may run on, in node order. Without
+    // NUMA information there is one node 0 with every allowed CPU.
+    static std::vector<Node> topology();
+    // Node of a CPU, or -1 when it is not in nodes
+    static int nodeOf(const std::vector<Node>& nodes, int cpu);
+
+    // CPUs of worker process `worker` of `workers`: the CPUs of all nodes in
+    // order, cut into equal contiguous slices, so a slice stays on one node when
+    // workers is a multiple of the node count. With more workers than CPUs,
+    // workers share single CPUs round-robin.
+    static std::vector<int> workerCpus(const std::vector<Node>& nodes, size_t worker, size_t workers);
+
+    // CPU for each IO thread, then each crypto thread: the threads take cpus in
+    // order, wrapping around when there are more threads than CPUs
+    struct Plan {
+        std::vector<int> ioCpus;
+        std::vector<int> cryptoCpus;
+    };
+    static Plan plan(const std::vector<int>& cpus, size_t ioThreads, size_t cryptoThreads);
+
+    // Keep the calling thread, and threads it creates later, on cpus
+    static bool confineCurrentThread(const std::vector<int>& cpus);
+    // Make the calling thread, and threads it creates later, prefer memory from node
+    static bool preferNode(int node);
+    // Pin the calling thread to one CPU, allocate its memory on that CPU's node
+    // and create its per-thread crypto state there. Returns false if the CPU
+    // could not be set.
+    static bool pinCurrentThread(int cpu);
+
+    // "0-3,8,10-11" <-> {0, 1, 2, 3, 8, 10, 11}; parseCpus throws
+    // std::invalid_argument for a malformed list
+    static std::vector<int> parseCpus(std::string_view list);
+    static std::string formatCpus(const std::vector<int>& cpus);
+};
+
+#endif // VITALEDGE_PLACEMENT_H
@@ -0,0 +1,121 @@
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+// Public bytes pre-generated per thread, and the largest request served from them
+static constexpr size_t kBufferSize = 4096;
+static constexpr size_t kMaxBuffered = 256;
+
+// Most a CTR-DRBG returns from one generate call
+static constexpr size_t kMaxRequest = 1 << 16;
+
+static constexpr unsigned int kStrength = 256;
+
+namespace {
+
+// Bumped in every forked child, so threads there drop state copied from the parent
+std::atomic<uint64_t> forkGeneration{0};
+
+void watchForks() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        pthread_atfork(nullptr, nullptr, [] { forkGeneration.fetch_add(1, std::memory_order_relaxed); });
+    });
+}
+
+// nullptr when the provider has no CTR-DRBG; threads then use RAND_bytes
+EVP_RAND* ctrDrbg() {
+    static EVP_RAND* rand = EVP_RAND_fetch(nullptr, "CTR-DRBG", nullptr);
+    return rand;
+}
+
+struct ThreadRandom {
+    EVP_RAND_CTX* drbg = nullptr;
+    bool ready = false;
+    uint64_t generation = 0;
+    size_t used = kBufferSize;
+    unsigned char buffer[kBufferSize];
+
+    ~ThreadRandom() { reset(); }
+
+    void reset() {
+        EVP_RAND_CTX_free(drbg);
+        drbg = nullptr;
+        ready = false;
+        OPENSSL_cleanse(buffer, sizeof(buffer));
+        used = kBufferSize;
+    }
+
+    // Instantiate the DRBG on first use, and again after a fork
+    void prepare() {
+        const uint64_t current = forkGeneration.load(std::memory_order_relaxed);
+        if (ready && generation == current) return;
+        reset();
+        watchForks();
+        generation = current;
+        if (EVP_RAND* rand = ctrDrbg()) {
+            EVP_RAND_CTX* ctx = EVP_RAND_CTX_new(rand, RAND_get0_primary(nullptr));
+            if (!ctx) VitalEdgeUtils::throwOpenSSLError("Unable to create DRBG");
+            OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_utf8_string(OSSL_DRBG_PARAM_CIPHER, (char*)"AES-256-CTR", 0),
+                OSSL_PARAM_construct_end(),
+            };
+            if (!EVP_RAND_instantiate(ctx, kStrength, 0, nullptr, 0, params)) {
+                EVP_RAND_CTX_free(ctx);
+                VitalEdgeUtils::throwOpenSSLError("Unable to instantiate DRBG");
+            }
+            drbg = ctx;
+        }
+        ready = true;
+    }
+
+    void generate(unsigned char* out, size_t length, bool secret) {
+        if (!drbg) {
+            if ((secret ? RAND_priv_bytes(out, length) : RAND_bytes(out, length)) != 1) {
+                VitalEdgeUtils::throwOpenSSLError("Unable to generate random bytes");
+            }
+            return;
+        }
+        while (length > 0) {
+            const size_t chunk = std::min(length, kMaxRequest);
+            if (!EVP_RAND_generate(drbg, out, chunk, kStrength, 0, nullptr, 0)) {
+                VitalEdgeUtils::throwOpenSSLError("Unable to generate random bytes");
+            }
+            out += chunk;
+            length -= chunk;
+        }
+    }
+};
+
+thread_local ThreadRandom threadRandom;
+
+} // namespace
+
+void VitalEdgeRandom::bytes(unsigned char* out, size_t length) {
+    ThreadRandom& random = threadRandom;
+    random.prepare();
+    if (length > kMaxBuffered) {
+        random.generate(out, length, false);
+        return;
+    }
+    if (kBufferSize - random.used < length) {
+        random.generate(random.buffer, kBufferSize, false);
+        random.used = 0;
+    }
+    std::memcpy(out, random.buffer + random.used, length);
+    random.used += length;
+}
+
+void VitalEdgeRandom::privateBytes(unsigned char* out, size_t length) {
+    ThreadRandom& random = threadRandom;
+    random.prepare();
+    random.generate(out, length, true);
+}
@@ -0,0 +1,24 @@
+#ifndef VITALEDGE_RANDOM_H
+#define VITALEDGE_RANDOM_H
+
+#include <cstddef>
+
+// Random bytes for IVs, nonces and keys without going through a shared DRBG on
+// every call.
+//
+// Each thread owns an AES-256 CTR-DRBG (OpenSSL EVP_RAND) seeded from, and
+// periodically reseeded by, OpenSSL's primary DRBG. Public randomness (IVs,
+// nonces) is handed out from a 4 KiB buffer the thread's DRBG refills when it
+// runs dry, so an IV costs a memcpy. Private randomness (keys) is generated
+// straight into the caller's buffer and never sits in a shared buffer. A forked
+// child discards its copy of the buffer and instantiates a fresh DRBG, so it
+// never repeats its parent's output.
+class VitalEdgeRandom {
+public:
+    // Public bytes, e.g. IVs and nonces
+    static void bytes(unsigned char* out, size_t length);
+    // Secret bytes, e.g. keys
+    static void privateBytes(unsigned char* out, size_t length);
+};
+
+#endif // VITALEDGE_RANDOM_H
@@ -0,0 +1,86 @@
+#include "VitalEdgeRecord.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeRandom.h"
+#include <cstring>
+#include <stdexcept>
+
+static constexpr unsigned char kMagic[4] = {'V', 'E', 'R', '1'};
+
+static void storeLE(unsigned char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t loadLE(const unsigned char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= uint64_t(in[i]) << (8 * i);
+    return value;
+}
+
+// Header and key_id, authenticated with every record. Reused by each thread.
+static std::string_view associatedData(const unsigned char* header, const std::string& keyId) {
+    static thread_local std::string aad;
+    aad.assign((const char*)header, VitalEdgeRecord::kHeaderSize);
+    aad.append(keyId);
+    return aad;
+}
+
+VitalEdgeRecord::Header VitalEdgeRecord::parseHeader(const unsigned char* in, size_t available) {
+    if (available < kHeaderSize || std::memcmp(in, kMagic, sizeof(kMagic)) != 0) {
+        throw std::invalid_argument("Not an encrypted record");
+    }
+    Header header;
+    header.keyVersion = (uint32_t)loadLE(in + 4, 4);
+    header.length = (uint32_t)loadLE(in + 8, 4);
+    if (header.keyVersion == 0) throw std::invalid_argument("Encrypted record has key version 0");
+    if (available - kHeaderSize < uint64_t(header.length) + kTagSize) {
+        throw std::invalid_argument("Encrypted record is truncated");
+    }
+    return header;
+}
+
+void VitalEdgeRecord::seal(const unsigned char* in, size_t length, const VitalEdgeKeyring::Entry& key,
+                           unsigned char* out) {
+    if (length > kMaxPlaintextSize) throw std::invalid_argument("Record plaintext is larger than 4 GiB");
+    std::memcpy(out, kMagic, sizeof(kMagic));
+    storeLE(out + 4, key.version(), 4);
+    storeLE(out + 8, length, 4);
+    unsigned char* nonce = out + 12;
+    VitalEdgeRandom::bytes(nonce, kNonceSize);
+
+    unsigned char* ciphertext = out + kHeaderSize;
+    VitalEdgeCipherEngine::encryptAEAD(key.gcm(true), std::string_view((const char*)nonce, kNonceSize),
+                                       associatedData(out, key.id()), in, length, ciphertext, ciphertext + length);
+}
+
+std::string VitalEdgeRecord::seal(std::string_view plaintext, const VitalEdgeKeyring::Entry& key) {
+    std::string record(sealedSize(plaintext.size()), '\0');
+    seal((const unsigned char*)plaintext.data(), plaintext.size(), key, (unsigned char*)&record[0]);
+    return record;
+}
+
+void VitalEdgeRecord::open(const unsigned char* record, size_t available, const VitalEdgeKeyring::Entry& key,
+                           unsigned char* out) {
+    const Header header = parseHeader(record, available);
+    if (header.keyVersion != key.version()) {
+        throw std::invalid_argument("Encrypted record is under key version " + std::to_string(header.keyVersion));
+    }
+    const unsigned char* ciphertext = record + kHeaderSize;
+    try {
+        VitalEdgeCipherEngine::decryptAEAD(key.gcm(false), std::string_view((const char*)record + 12, kNonceSize),
+                                           associatedData(record, key.id()), ciphertext, header.length, out,
+                                           ciphertext + header.length);
+    } catch (const std::runtime_error&) {
+        throw std::invalid_argument("Encrypted record failed authentication");
+    }
+}
+
+std::string VitalEdgeRecord::open(std::string_view record, const std::string& keyId) {
+    const Header header = parseHeader((const unsigned char*)record.data(), record.size());
+    VitalEdgeKeyring::EntryPtr key = VitalEdgeKeyring::find(keyId, header.keyVersion);
+    if (!key) {
+        throw std::invalid_argument("Unknown key version " + std::to_string(header.keyVersion) + " of " + keyId);
+    }
+    std::string plaintext(header.length, '\0');
+    open((const unsigned char*)record.data(), record.size(), *key, (unsigned char*)&plaintext[0]);
+    return plaintext;
+}
@@ -0,0 +1,56 @@
+#ifndef VITALEDGE_RECORD_H
+#define VITALEDGE_RECORD_H
+
+#include "VitalEdgeKeyring.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Ciphertext record tagged with the version of the keyring key that sealed it, so
+// data written before a rotation still opens, and a re-encryption job can tell
+// which records are already under the new key (see VitalEdgeReencrypt). Records
+// are written back to back to form a record file.
+//
+// Layout (integers little-endian):
+//   header  "VER1" | key version u32 | plaintext length u32 | nonce u8[12]  (24 bytes)
+//   then    ciphertext (plaintext length) | tag u8[16]
+//
+// AES-256-GCM under a fresh random nonce, authenticating the header and the
+// key_id, so a record does not open under another key_id or with its version
+// field rewritten. A sealed record is the same size under every key version.
+class VitalEdgeRecord {
+public:
+    static constexpr size_t kHeaderSize = 24;
+    static constexpr size_t kNonceSize = 12;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kMaxPlaintextSize = UINT32_MAX;
+
+    struct Header {
+        uint32_t keyVersion;
+        uint32_t length; // plaintext bytes
+        size_t sealedSize() const { return kHeaderSize + length + kTagSize; }
+    };
+
+    static size_t sealedSize(size_t plaintextSize) { return kHeaderSize + plaintextSize + kTagSize; }
+
+    // Parse the header of the record at the start of in. Throws
+    // std::invalid_argument if it is not a record or the record runs past
+    // available bytes.
+    static Header parseHeader(const unsigned char* in, size_t available);
+
+    // Seal under key's version into out, which must hold sealedSize(length) bytes
+    static void seal(const unsigned char* in, size_t length, const VitalEdgeKeyring::Entry& key,
+                     unsigned char* out);
+    static std::string seal(std::string_view plaintext, const VitalEdgeKeyring::Entry& key);
+
+    // Open into out, which must hold the header's length; key must be the version
+    // named in the header. Throws std::invalid_argument if the record is malformed
+    // or fails authentication.
+    static void open(const unsigned char* record, size_t available, const VitalEdgeKeyring::Entry& key,
+                     unsigned char* out);
+    // Open with whichever version of key_id the record names
+    static std::string open(std::string_view record, const std::string& keyId);
+};
+
+#endif // VITALEDGE_RECORD_H
@@ -0,0 +1,335 @@
+#include "VitalEdgeReencrypt.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeRecord.h"
+#include "VitalEdgeSecureMemory.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
+
+static constexpr char kTempSuffix[] = ".reencrypt";
+static constexpr char kCheckpointSuffix[] = ".reencrypt.checkpoint";
+static constexpr size_t kPageSize = 4096;
+
+namespace {
+
+std::runtime_error fileError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + ": " + path + ": " + std::strerror(errno));
+}
+
+// A file descriptor and, once mapped, the whole file
+struct MappedFile {
+    int fd = -1;
+    unsigned char* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data) munmap(data, size);
+        if (fd >= 0) ::close(fd);
+    }
+
+    void map(int protection, const std::string& path) {
+        void* base = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) throw fileError("Unable to map", path);
+        data = (unsigned char*)base;
+    }
+};
+
+// How far the rewrite of a file of `size` bytes to `version` has got
+struct Checkpoint {
+    uint64_t size = 0;
+    uint64_t offset = 0;
+    uint32_t version = 0;
+};
+
+bool readCheckpoint(const std::string& path, Checkpoint& checkpoint) {
+    std::ifstream file(path);
+    return bool(file >> checkpoint.size >> checkpoint.offset >> checkpoint.version) &&
+           checkpoint.offset <= checkpoint.size;
+}
+
+// Written to a temporary file and renamed over the old checkpoint, so a crash
+// leaves either checkpoint whole
+void writeCheckpoint(const std::string& path, const Checkpoint& checkpoint) {
+    const std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) throw fileError("Unable to write checkpoint", temp);
+    const std::string line = std::to_string(checkpoint.size) + " " + std::to_string(checkpoint.offset) + " " +
+                             std::to_string(checkpoint.version) + "\n";
+    const bool written = ::write(fd, line.data(), line.size()) == ssize_t(line.size()) && fsync(fd) == 0;
+    ::close(fd);
+    if (!written || std::rename(temp.c_str(), path.c_str()) != 0) {
+        throw fileError("Unable to write checkpoint", path);
+    }
+}
+
+void syncDirectory(const std::string& path) {
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+}
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The job's own temporary files are never inputs
+bool isJobFile(const std::string& path) {
+    return endsWith(path, kTempSuffix) || endsWith(path, kCheckpointSuffix) ||
+           endsWith(path, std::string(kCheckpointSuffix) + ".tmp");
+}
+
+std::vector<std::string> expandPaths(const std::vector<std::string>& paths) {
+    std::vector<std::string> files;
+    for (const std::string& path : paths) {
+        if (!std::filesystem::is_directory(path)) {
+            files.push_back(path);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto& item : std::filesystem::recursive_directory_iterator(path)) {
+            if (item.is_regular_file() && !isJobFile(item.path().string())) found.push_back(item.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+// Plaintext of the record being re-encrypted, reused by each thread
+thread_local VitalEdgeSecureMemory::Bytes plaintextScratch;
+
+struct Record {
+    uint64_t offset;
+    const VitalEdgeKeyring::Entry* key; // version it is under now
+};
+
+class FileJob {
+public:
+    FileJob(const std::string& path, const VitalEdgeKeyring::Entry& target,
+            const VitalEdgeReencrypt::Options& options, VitalEdgeReencrypt::Report& report)
+        : path_(path), target_(target), options_(options), report_(report) {}
+
+    void run();
+
+private:
+    const VitalEdgeKeyring::Entry* keyFor(uint32_t version);
+    VitalEdgeRecord::Header header(uint64_t offset) const;
+    bool needsRewrite() const;
+    uint64_t resumeOffset();
+    uint64_t nextWindow(uint64_t begin, std::vector<Record>& records);
+    void reencrypt(const std::vector<Record>& records);
+
+    const std::string& path_;
+    const VitalEdgeKeyring::Entry& target_;
+    const VitalEdgeReencrypt::Options& options_;
+    VitalEdgeReencrypt::Report& report_;
+    MappedFile in_;
+    MappedFile out_;
+    std::unordered_map<uint32_t, VitalEdgeKeyring::EntryPtr> keys_;
+};
+
+VitalEdgeRecord::Header FileJob::header(uint64_t offset) const {
+    try {
+        return VitalEdgeRecord::parseHeader(in_.data + offset, in_.size - offset);
+    } catch (const std::invalid_argument& e) {
+        throw std::runtime_error(path_ + ": offset " + std::to_string(offset) + ": " + e.what());
+    }
+}
+
+const VitalEdgeKeyring::Entry* FileJob::keyFor(uint32_t version) {
+    VitalEdgeKeyring::EntryPtr& key = keys_[version];
+    if (!key) key = VitalEdgeKeyring::find(target_.id(), version);
+    if (!key) {
+        throw std::runtime_error(path_ + ": records use version " + std::to_string(version) + " of " +
+                                 target_.id() + ", which is not in the keyring");
+    }
+    return key.get();
+}
+
+// Header scan only; stops at the first record under another version
+bool FileJob::needsRewrite() const {
+    for (uint64_t offset = 0; offset < in_.size;) {
+        const VitalEdgeRecord::Header record = header(offset);
+        if (record.keyVersion != target_.version()) return true;
+        offset += record.sealedSize();
+    }
+    return false;
+}
+
+// Open the output, continuing a matching checkpointed run if there is one
+uint64_t FileJob::resumeOffset() {
+    const std::string temp = path_ + kTempSuffix;
+    Checkpoint checkpoint;
+    struct stat info;
+    if (options_.resume && readCheckpoint(path_ + kCheckpointSuffix, checkpoint) && checkpoint.size == in_.size &&
+        checkpoint.version == target_.version() && stat(temp.c_str(), &info) == 0 &&
+        uint64_t(info.st_size) == in_.size) {
+        out_.fd = ::open(temp.c_str(), O_RDWR | O_CLOEXEC);
+        if (out_.fd >= 0) {
+            // A checkpoint always falls on a record boundary; anything else is stale
+            try {
+                if (checkpoint.offset < in_.size) header(checkpoint.offset);
+                return checkpoint.offset;
+            } catch (const std::runtime_error&) {
+                ::close(out_.fd);
+                out_.fd = -1;
+            }
+        }
+    }
+    out_.fd = ::open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out_.fd < 0 || ftruncate(out_.fd, off_t(in_.size)) != 0) throw fileError("Unable to create", temp);
+    return 0;
+}
+
+// Records from begin up to windowBytes (at least one); returns the window's end
+uint64_t FileJob::nextWindow(uint64_t begin, std::vector<Record>& records) {
+    records.clear();
+    uint64_t offset = begin;
+    while (offset < in_.size && (records.empty() || offset - begin < options_.windowBytes)) {
+        const VitalEdgeRecord::Header record = header(offset);
+        const VitalEdgeKeyring::Entry* key = record.keyVersion == target_.version() ? &target_
+                                                                                    : keyFor(record.keyVersion);
+        records.push_back(Record{offset, key});
+        offset += record.sealedSize();
+    }
+    return offset;
+}
+
+void FileJob::reencrypt(const std::vector<Record>& records) {
+    VitalEdgeExecutor& executor = VitalEdgeExecutor::instance();
+    // A few tasks per thread (the caller included) evens out records of mixed sizes
+    const size_t tasks = std::min(records.size(), (executor.threadCount() + 1) * 4);
+    executor.parallelFor(tasks, [&](size_t task) {
+        const size_t first = records.size() * task / tasks;
+        const size_t last = records.size() * (task + 1) / tasks;
+        VitalEdgeSecureMemory::Bytes& plaintext = plaintextScratch;
+        for (size_t i = first; i < last; ++i) {
+            const unsigned char* in = in_.data + records[i].offset;
+            unsigned char* out = out_.data + records[i].offset;
+            const size_t available = in_.size - records[i].offset;
+            const VitalEdgeRecord::Header record = VitalEdgeRecord::parseHeader(in, available);
+            if (records[i].key == &target_) {
+                std::memcpy(out, in, record.sealedSize());
+                continue;
+            }
+            plaintext.resize(std::max<size_t>(record.length, 1));
+            try {
+                VitalEdgeRecord::open(in, available, *records[i].key, plaintext.data());
+            } catch (const std::invalid_argument& e) {
+                throw std::runtime_error(path_ + ": offset " + std::to_string(records[i].offset) + ": " + e.what());
+            }
+            VitalEdgeRecord::seal(plaintext.data(), record.length, target_, out);
+        }
+    });
+}
+
+void FileJob::run() {
+    const std::string temp = path_ + kTempSuffix;
+    const std::string checkpointPath = path_ + kCheckpointSuffix;
+    in_.fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (in_.fd < 0 || fstat(in_.fd, &info) != 0) throw fileError("Unable to open", path_);
+    in_.size = size_t(info.st_size);
+    if (in_.size == 0) {
+        ++report_.skippedFiles;
+        return;
+    }
+    in_.map(PROT_READ, path_);
+    if (!needsRewrite()) {
+        // Nothing to do, including for an interrupted run that is now moot
+        std::remove(temp.c_str());
+        std::remove(checkpointPath.c_str());
+        ++report_.skippedFiles;
+        return;
+    }
+    madvise(in_.data, in_.size, MADV_SEQUENTIAL);
+
+    const uint64_t start = resumeOffset();
+    out_.size = in_.size;
+    out_.map(PROT_READ | PROT_WRITE, temp);
+
+    // Pipeline: read ahead window n + 1, re-encrypt window n, flush and checkpoint
+    // window n - 1 on its own thread
+    std::vector<Record> records;
+    std::future<void> flushing;
+    uint64_t flushed = start;
+    auto finishFlush = [&](uint64_t end) {
+        if (!flushing.valid()) return;
+        flushing.get();
+        flushed = end;
+        if (options_.progress) options_.progress(VitalEdgeReencrypt::Progress{path_, flushed, in_.size});
+    };
+
+    uint64_t offset = start;
+    uint64_t pendingEnd = start;
+    while (offset < in_.size) {
+        const uint64_t end = nextWindow(offset, records);
+        const uint64_t ahead = std::min<uint64_t>(options_.windowBytes, in_.size - end);
+        if (ahead > 0) {
+            const uint64_t from = end & ~uint64_t(kPageSize - 1);
+            madvise(in_.data + from, end + ahead - from, MADV_WILLNEED);
+        }
+        reencrypt(records);
+        for (const Record& record : records) report_.reencrypted += record.key != &target_;
+        report_.records += records.size();
+
+        finishFlush(pendingEnd);
+        const uint64_t from = offset & ~uint64_t(kPageSize - 1);
+        unsigned char* base = out_.data;
+        const Checkpoint checkpoint{in_.size, end, target_.version()};
+        flushing = std::async(std::launch::async, [base, from, end, checkpoint, &checkpointPath, &temp] {
+            if (msync(base + from, end - from, MS_SYNC) != 0) throw fileError("Unable to flush", temp);
+            writeCheckpoint(checkpointPath, checkpoint);
+        });
+        pendingEnd = end;
+        offset = end;
+    }
+    finishFlush(pendingEnd);
+
+    // Count records a resumed run had already done, so the report covers the file
+    for (uint64_t done = 0; done < start;) {
+        done += header(done).sealedSize();
+        ++report_.records;
+    }
+
+    if (fsync(out_.fd) != 0 || fchmod(out_.fd, info.st_mode & 07777) != 0) throw fileError("Unable to sync", temp);
+    if (std::rename(temp.c_str(), path_.c_str()) != 0) throw fileError("Unable to replace", path_);
+    syncDirectory(path_);
+    std::remove(checkpointPath.c_str());
+    ++report_.files;
+    report_.bytes += in_.size - start;
+}
+
+} // namespace
+
+VitalEdgeReencrypt::Report VitalEdgeReencrypt::run(const std::vector<std::string>& paths, const Options& options) {
+    VitalEdgeKeyring::EntryPtr target = options.toVersion ? VitalEdgeKeyring::find(options.keyId, options.toVersion)
+                                                          : VitalEdgeKeyring::find(options.keyId);
+    if (!target) {
+        throw std::invalid_argument("Unknown key: " + options.keyId +
+                                    (options.toVersion ? " version " + std::to_string(options.toVersion) : ""));
+    }
+    if (options.windowBytes == 0) throw std::invalid_argument("Re-encryption window must not be empty");
+
+    Report report;
+    const auto started = std::chrono::steady_clock::now();
+    for (const std::string& path : expandPaths(paths)) {
+        FileJob(path, *target, options, report).run();
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
@@ -0,0 +1,55 @@
+#ifndef VITALEDGE_REENCRYPT_H
+#define VITALEDGE_REENCRYPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Bulk re-encryption of record files (see VitalEdgeRecord) after a key rotation:
+// every record under an older version of a key_id is opened and sealed again under
+// the target version in one pass, without the data going through the HTTP API.
+//
+// A file is memory-mapped and rewritten into "<file>.reencrypt", which replaces it
+// atomically once complete; a file whose records are all at the target version
+// is left untouched. Work proceeds in windows of records as a pipeline: while the
+// executor's threads re-encrypt one window, the previous window is flushed to disk
+// and checkpointed to "<file>.reencrypt.checkpoint", and the next one is read
+// ahead. A job that stops (crash, kill, an error) resumes from its last
+// checkpoint when run again with the same target version.
+class VitalEdgeReencrypt {
+public:
+    struct Progress {
+        const std::string& path;
+        uint64_t done; // bytes re-encrypted and checkpointed
+        uint64_t size;
+    };
+
+    struct Options {
+        std::string keyId;
+        uint32_t toVersion = 0;            // 0 means the key_id's current version
+        size_t windowBytes = 64 << 20;     // records per window, by size
+        bool resume = true;                // continue from a checkpoint if one matches
+        // Called after every checkpoint; throwing stops the job, which stays resumable
+        std::function<void(const Progress&)> progress;
+    };
+
+    struct Report {
+        size_t files = 0;        // files rewritten
+        size_t skippedFiles = 0; // already entirely at the target version
+        uint64_t records = 0;    // records in rewritten files
+        uint64_t reencrypted = 0; // of those, records that were under another version
+        uint64_t bytes = 0;      // bytes rewritten
+        double seconds = 0;
+        double megabytesPerSecond() const { return seconds > 0 ? bytes / seconds / 1e6 : 0; }
+    };
+
+    // Re-encrypt files and, recursively, the files inside directories, on
+    // VitalEdgeExecutor::instance(). Throws std::invalid_argument if the target key
+    // is not in the keyring, and std::runtime_error for an unreadable or malformed
+    // file or a record under a version the keyring does not hold.
+    static Report run(const std::vector<std::string>& paths, const Options& options);
+};
+
+#endif // VITALEDGE_REENCRYPT_H
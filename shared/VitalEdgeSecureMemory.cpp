@@ -0,0 +1,217 @@
+#include "VitalEdgeSecureMemory.h"
+#include <openssl/crypto.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// Blocks are power-of-two sizes, header included: class c holds 1 << c bytes
+static constexpr uint32_t kMinClass = 5;       // 32 bytes, 16 usable
+static constexpr uint32_t kMaxRegionClass = 14; // 16 KiB; larger blocks get their own mapping
+static constexpr uint32_t kMaxClass = 22;       // 4 MiB; larger blocks are not kept for reuse
+static constexpr uint32_t kHugeClass = kMaxClass + 1;
+static constexpr size_t kRegionSize = 256 * 1024;
+static constexpr size_t kRetainedBytes = 4 * 1024 * 1024; // mapped blocks a thread keeps
+static constexpr size_t kPageSize = 4096;
+
+namespace {
+
+struct Arena;
+
+// In front of every block. While a block is free, the first word after the header
+// links it into a free list.
+struct alignas(16) Header {
+    Arena* owner;      // arena whose free lists the block returns to
+    uint32_t sizeClass;
+    uint32_t locked;   // mlock succeeded for the memory holding it
+};
+static_assert(sizeof(Header) == 16, "secure block header is 16 bytes");
+
+struct Arena {
+    Header* freeLists[kHugeClass] = {};
+    size_t retained = 0; // bytes of mapped blocks on the free lists
+    char* bump = nullptr; // unused tail of the current region
+    char* bumpEnd = nullptr;
+    uint32_t bumpLocked = 0;
+    std::atomic<Header*> remoteFrees{nullptr}; // blocks freed by other threads
+    unsigned node = 0; // NUMA node of the thread that created it, where its first region lives
+};
+
+struct State {
+    std::mutex mutex;
+    std::vector<Arena*> idle; // arenas of exited threads
+    std::atomic<size_t> lockedBytes{0};
+    std::atomic<size_t> unlockedBytes{0};
+    std::atomic<size_t> arenas{0};
+};
+
+State& state() {
+    static State* memory = new State; // outlives thread_local destructors at exit
+    return *memory;
+}
+
+Header*& nextFree(Header* block) {
+    return *(Header**)(block + 1);
+}
+
+// Anonymous memory locked into RAM and kept out of core dumps
+void* mapLocked(size_t length, uint32_t& locked) {
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_DONTDUMP
+    madvise(base, length, MADV_DONTDUMP);
+#endif
+    locked = mlock(base, length) == 0;
+    (locked ? state().lockedBytes : state().unlockedBytes).fetch_add(length, std::memory_order_relaxed);
+    return base;
+}
+
+void unmap(void* base, size_t length, uint32_t locked) {
+    munmap(base, length);
+    (locked ? state().lockedBytes : state().unlockedBytes).fetch_sub(length, std::memory_order_relaxed);
+}
+
+// The calling thread's arena. Trivially destructible so it can still be read from
+// other thread_local destructors; ArenaRelease hands the arena on at thread exit.
+thread_local Arena* threadArena = nullptr;
+
+struct ArenaRelease {
+    bool armed = false;
+    ~ArenaRelease() {
+        if (!threadArena) return;
+        std::lock_guard<std::mutex> lock(state().mutex);
+        state().idle.push_back(threadArena);
+        threadArena = nullptr;
+    }
+};
+thread_local ArenaRelease arenaRelease;
+
+Arena* currentArena() {
+    if (threadArena) return threadArena;
+    unsigned cpu = 0, node = 0;
+    getcpu(&cpu, &node);
+    {
+        // An idle arena from this thread's node keeps its memory local
+        State& global = state();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        if (!global.idle.empty()) {
+            auto it = std::find_if(global.idle.rbegin(), global.idle.rend(),
+                                   [node](const Arena* arena) { return arena->node == node; });
+            auto chosen = it == global.idle.rend() ? global.idle.end() - 1 : std::next(it).base();
+            threadArena = *chosen;
+            global.idle.erase(chosen);
+        }
+    }
+    if (!threadArena) {
+        threadArena = new Arena;
+        threadArena->node = node;
+        state().arenas.fetch_add(1, std::memory_order_relaxed);
+    }
+    arenaRelease.armed = true;
+    return threadArena;
+}
+
+// Move blocks other threads freed onto the arena's own free lists
+void drainRemote(Arena& arena) {
+    Header* block = arena.remoteFrees.exchange(nullptr, std::memory_order_acquire);
+    while (block) {
+        Header* next = nextFree(block);
+        nextFree(block) = arena.freeLists[block->sizeClass];
+        arena.freeLists[block->sizeClass] = block;
+        block = next;
+    }
+}
+
+uint32_t classFor(size_t blockSize) {
+    uint32_t sizeClass = kMinClass;
+    while ((size_t(1) << sizeClass) < blockSize) ++sizeClass;
+    return sizeClass;
+}
+
+} // namespace
+
+void* VitalEdgeSecureMemory::allocate(size_t size) {
+    const size_t blockSize = size + sizeof(Header);
+    if (size > (size_t(1) << kMaxClass) - sizeof(Header)) {
+        if (size > SIZE_MAX - sizeof(Header) - kPageSize) throw std::bad_alloc();
+        uint32_t locked = 0;
+        Header* block = (Header*)mapLocked((blockSize + kPageSize - 1) & ~(kPageSize - 1), locked);
+        *block = Header{nullptr, kHugeClass, locked};
+        return block + 1;
+    }
+
+    const uint32_t sizeClass = classFor(blockSize);
+    Arena& arena = *currentArena();
+    Header* block = arena.freeLists[sizeClass];
+    if (!block && sizeClass <= kMaxRegionClass && arena.remoteFrees.load(std::memory_order_relaxed)) {
+        drainRemote(arena);
+        block = arena.freeLists[sizeClass];
+    }
+    if (block) {
+        arena.freeLists[sizeClass] = nextFree(block);
+        nextFree(block) = nullptr; // the rest was zeroed when it was freed
+        if (sizeClass > kMaxRegionClass) arena.retained -= size_t(1) << sizeClass;
+        block->owner = &arena;
+        return block + 1;
+    }
+
+    const size_t length = size_t(1) << sizeClass;
+    if (sizeClass > kMaxRegionClass) {
+        uint32_t locked = 0;
+        block = (Header*)mapLocked(length, locked);
+        *block = Header{&arena, sizeClass, locked};
+        return block + 1;
+    }
+    if (size_t(arena.bumpEnd - arena.bump) < length) {
+        // What is left of the old region is too small for this class and stays unused
+        arena.bump = (char*)mapLocked(kRegionSize, arena.bumpLocked);
+        arena.bumpEnd = arena.bump + kRegionSize;
+    }
+    block = (Header*)arena.bump;
+    arena.bump += length;
+    *block = Header{&arena, sizeClass, arena.bumpLocked};
+    return block + 1;
+}
+
+void VitalEdgeSecureMemory::deallocate(void* memory, size_t size) {
+    if (!memory) return;
+    Header* block = (Header*)memory - 1;
+    OPENSSL_cleanse(memory, size);
+
+    if (block->sizeClass == kHugeClass) {
+        unmap(block, (size + sizeof(Header) + kPageSize - 1) & ~(kPageSize - 1), block->locked);
+        return;
+    }
+
+    Arena* arena = threadArena;
+    const size_t length = size_t(1) << block->sizeClass;
+    if (block->sizeClass > kMaxRegionClass) {
+        // A mapped block joins whichever thread frees it, if that thread has room
+        if (!arena || arena->retained + length > kRetainedBytes) {
+            unmap(block, length, block->locked);
+            return;
+        }
+        arena->retained += length;
+        block->owner = arena;
+    }
+
+    if (block->owner == arena) {
+        nextFree(block) = arena->freeLists[block->sizeClass];
+        arena->freeLists[block->sizeClass] = block;
+        return;
+    }
+    std::atomic<Header*>& remote = block->owner->remoteFrees;
+    Header* head = remote.load(std::memory_order_relaxed);
+    do {
+        nextFree(block) = head;
+    } while (!remote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+VitalEdgeSecureMemory::Stats VitalEdgeSecureMemory::stats() {
+    State& global = state();
+    return Stats{global.lockedBytes.load(std::memory_order_relaxed), global.unlockedBytes.load(std::memory_order_relaxed),
+                 global.arenas.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,60 @@
+#ifndef VITALEDGE_SECUREMEMORY_H
+#define VITALEDGE_SECUREMEMORY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Memory for keys and plaintext: locked into RAM (mlock) so it is never written
+// to swap, left out of core dumps, and zeroed when freed.
+//
+// Each thread allocates from its own arena without locks or system calls once
+// warm: blocks up to 16 KiB are power-of-two size classes carved from 256 KiB
+// locked regions, and larger blocks (up to 4 MiB) are mapped once and then kept
+// for reuse, up to 4 MiB per thread. Anything bigger is mapped and unmapped per
+// use. A block freed by another thread goes back to its owner's arena; arenas
+// of exited threads are handed to new ones, preferably on the same NUMA node.
+// Regions are never returned to the system, so locked memory stays at its peak.
+//
+// If the process may not lock more memory (RLIMIT_MEMLOCK), allocations still
+// succeed and are still zeroed, but stats() reports the bytes left unlocked.
+class VitalEdgeSecureMemory {
+public:
+    // Zeroed memory with 16-byte alignment. Throws std::bad_alloc when out of memory.
+    static void* allocate(size_t size);
+    // Zero and release a block; size must be the one passed to allocate()
+    static void deallocate(void* block, size_t size);
+
+    struct Stats {
+        size_t lockedBytes;   // mapped and locked
+        size_t unlockedBytes; // mapped, but mlock was refused
+        size_t arenas;        // thread arenas created so far
+    };
+    static Stats stats();
+
+    // Standard allocator over the arenas, for containers holding secrets
+    template <typename T>
+    struct Allocator {
+        static_assert(alignof(T) <= 16, "secure blocks are 16-byte aligned");
+        using value_type = T;
+
+        Allocator() noexcept = default;
+        template <typename U>
+        Allocator(const Allocator<U>&) noexcept {}
+
+        T* allocate(size_t n) { return (T*)VitalEdgeSecureMemory::allocate(n * sizeof(T)); }
+        void deallocate(T* p, size_t n) noexcept { VitalEdgeSecureMemory::deallocate(p, n * sizeof(T)); }
+
+        template <typename U>
+        bool operator==(const Allocator<U>&) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const Allocator<U>&) const noexcept { return false; }
+    };
+
+    // Note that String keeps up to 15 bytes inside the object itself (the small
+    // string optimisation), outside the arena; use Bytes for shorter secrets.
+    using String = std::basic_string<char, std::char_traits<char>, Allocator<char>>;
+    using Bytes = std::vector<unsigned char, Allocator<unsigned char>>;
+};
+
+#endif // VITALEDGE_SECUREMEMORY_H
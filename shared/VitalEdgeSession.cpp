@@ -0,0 +1,246 @@
+#include "VitalEdgeSession.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeUtils.h"
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+
+// Independent locks; a power of two so the shard is a mask of the id
+static constexpr size_t kShards = 16;
+
+// Random bytes behind a session id
+static constexpr size_t kIdBytes = VitalEdgeSession::kIdSize / 2;
+
+namespace {
+
+// Session ids are kept as their 16 random bytes, so lookups hash two words and
+// never allocate
+struct SessionId {
+    uint64_t high;
+    uint64_t low;
+    bool operator==(const SessionId& other) const { return high == other.high && low == other.low; }
+};
+
+struct SessionIdHash {
+    size_t operator()(const SessionId& id) const { return size_t(id.high ^ (id.low * 0x9E3779B97F4A7C15ull)); }
+};
+
+struct Session {
+    VitalEdgeKeyring::EntryPtr key;
+    Clock::time_point expires;
+};
+
+struct Shard {
+    std::mutex mutex;
+    std::unordered_map<SessionId, Session, SessionIdHash> sessions;
+    Clock::time_point nextSweep;
+};
+
+struct Table {
+    Shard shards[kShards];
+    std::atomic<int64_t> ttlMs{15 * 60 * 1000};
+    std::atomic<size_t> capacity{100000};
+};
+
+Table& table() {
+    static Table sessions;
+    return sessions;
+}
+
+Shard& shardOf(const SessionId& id) {
+    return table().shards[id.low & (kShards - 1)];
+}
+
+bool parseId(std::string_view hex, SessionId& id) {
+    if (hex.size() != VitalEdgeSession::kIdSize) return false;
+    unsigned char bytes[kIdBytes];
+    for (size_t i = 0; i < kIdBytes; ++i) {
+        int value = 0;
+        for (char c : {hex[2 * i], hex[2 * i + 1]}) {
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else return false;
+        }
+        bytes[i] = (unsigned char)value;
+    }
+    std::memcpy(&id.high, bytes, 8);
+    std::memcpy(&id.low, bytes + 8, 8);
+    return true;
+}
+
+std::string formatId(const unsigned char* bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(VitalEdgeSession::kIdSize, '\0');
+    for (size_t i = 0; i < kIdBytes; ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0xF];
+    }
+    return hex;
+}
+
+// Drop a shard's expired sessions; the caller holds its lock
+void sweep(Shard& shard, Clock::time_point now) {
+    for (auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+        it = it->second.expires <= now ? shard.sessions.erase(it) : std::next(it);
+    }
+}
+
+using PKeyPtr = std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+
+// X25519 with an ephemeral server key; fills the server's public key and the
+// shared secret
+void agree(std::string_view clientPublicKey, unsigned char* serverPublicKey, unsigned char* secret) {
+    PKeyPtr peer(EVP_PKEY_new_raw_public_key_ex(nullptr, "X25519", nullptr,
+                                                (const unsigned char*)clientPublicKey.data(), clientPublicKey.size()),
+                 EVP_PKEY_free);
+    if (!peer) throw std::invalid_argument("Session public key is not a valid X25519 key");
+    PKeyPtr server(EVP_PKEY_Q_keygen(nullptr, nullptr, "X25519"), EVP_PKEY_free);
+    if (!server) VitalEdgeUtils::throwOpenSSLError("Unable to generate session key");
+
+    size_t publicLen = VitalEdgeSession::kPublicKeySize;
+    if (EVP_PKEY_get_raw_public_key(server.get(), serverPublicKey, &publicLen) != 1) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to read session public key");
+    }
+
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+        EVP_PKEY_CTX_new_from_pkey(nullptr, server.get(), nullptr), EVP_PKEY_CTX_free);
+    size_t secretLen = VitalEdgeKeyring::Entry::kKeySize;
+    if (!ctx || EVP_PKEY_derive_init(ctx.get()) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to start key agreement");
+    }
+    // A low-order client key leaves an all-zero secret, which OpenSSL refuses here
+    if (EVP_PKEY_derive_set_peer(ctx.get(), peer.get()) <= 0 ||
+        EVP_PKEY_derive(ctx.get(), secret, &secretLen) <= 0) {
+        ERR_clear_error();
+        throw std::invalid_argument("Session public key yields no shared secret");
+    }
+}
+
+// HKDF-SHA256 of the shared secret into the session key
+void deriveKey(const unsigned char* secret, std::string_view clientPublicKey, const unsigned char* serverPublicKey,
+               unsigned char* key) {
+    static EVP_KDF* hkdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+    std::unique_ptr<EVP_KDF_CTX, decltype(&EVP_KDF_CTX_free)> ctx(hkdf ? EVP_KDF_CTX_new(hkdf) : nullptr,
+                                                                  EVP_KDF_CTX_free);
+    unsigned char salt[2 * VitalEdgeSession::kPublicKeySize];
+    std::memcpy(salt, clientPublicKey.data(), VitalEdgeSession::kPublicKeySize);
+    std::memcpy(salt + VitalEdgeSession::kPublicKeySize, serverPublicKey, VitalEdgeSession::kPublicKeySize);
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char*)"SHA256", 0),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, (void*)secret, VitalEdgeKeyring::Entry::kKeySize),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, salt, sizeof(salt)),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, (void*)VitalEdgeSession::kInfo,
+                                          sizeof(VitalEdgeSession::kInfo) - 1),
+        OSSL_PARAM_construct_end(),
+    };
+    if (!ctx || EVP_KDF_derive(ctx.get(), key, VitalEdgeKeyring::Entry::kKeySize, params) <= 0) {
+        VitalEdgeUtils::throwOpenSSLError("Unable to derive session key");
+    }
+}
+
+} // namespace
+
+VitalEdgeSession::Handshake VitalEdgeSession::establish(std::string_view clientPublicKey) {
+    if (clientPublicKey.size() != kPublicKeySize) {
+        throw std::invalid_argument("Session public key must be a 32-byte X25519 key");
+    }
+    unsigned char serverPublicKey[kPublicKeySize];
+    unsigned char secret[VitalEdgeKeyring::Entry::kKeySize];
+    unsigned char key[VitalEdgeKeyring::Entry::kKeySize];
+    VitalEdgeKeyring::EntryPtr entry;
+    try {
+        agree(clientPublicKey, serverPublicKey, secret);
+        deriveKey(secret, clientPublicKey, serverPublicKey, key);
+        entry = std::make_shared<const VitalEdgeKeyring::Entry>("session",
+                                                                std::string_view((const char*)key, sizeof(key)));
+    } catch (...) {
+        OPENSSL_cleanse(secret, sizeof(secret));
+        OPENSSL_cleanse(key, sizeof(key));
+        throw;
+    }
+    OPENSSL_cleanse(secret, sizeof(secret));
+    OPENSSL_cleanse(key, sizeof(key));
+
+    // The id is the only credential a session needs, so it comes from private randomness
+    unsigned char idBytes[kIdBytes];
+    VitalEdgeRandom::privateBytes(idBytes, sizeof(idBytes));
+    SessionId id;
+    std::memcpy(&id.high, idBytes, 8);
+    std::memcpy(&id.low, idBytes + 8, 8);
+
+    Table& sessions = table();
+    const auto ttl = std::chrono::milliseconds(sessions.ttlMs.load(std::memory_order_relaxed));
+    const size_t shardCapacity = (sessions.capacity.load(std::memory_order_relaxed) + kShards - 1) / kShards;
+    const Clock::time_point now = Clock::now();
+    Shard& shard = shardOf(id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (now >= shard.nextSweep || shard.sessions.size() >= shardCapacity) {
+            sweep(shard, now);
+            shard.nextSweep = now + std::max<Clock::duration>(ttl / 4, std::chrono::seconds(1));
+        }
+        if (shard.sessions.size() >= shardCapacity) throw std::runtime_error("Session table is full");
+        shard.sessions[id] = Session{std::move(entry), now + ttl};
+    }
+    return Handshake{formatId(idBytes), std::string((const char*)serverPublicKey, kPublicKeySize),
+                     uint64_t(std::chrono::duration_cast<std::chrono::seconds>(ttl).count())};
+}
+
+VitalEdgeKeyring::EntryPtr VitalEdgeSession::find(std::string_view sessionId) {
+    SessionId id;
+    if (!parseId(sessionId, id)) return nullptr;
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(id);
+    if (it == shard.sessions.end()) return nullptr;
+    if (it->second.expires <= Clock::now()) {
+        shard.sessions.erase(it);
+        return nullptr;
+    }
+    return it->second.key;
+}
+
+bool VitalEdgeSession::close(std::string_view sessionId) {
+    SessionId id;
+    if (!parseId(sessionId, id)) return false;
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.sessions.erase(id) > 0;
+}
+
+void VitalEdgeSession::setTTL(std::chrono::milliseconds ttl) {
+    table().ttlMs.store(ttl.count(), std::memory_order_relaxed);
+}
+
+void VitalEdgeSession::setCapacity(size_t capacity) {
+    table().capacity.store(capacity, std::memory_order_relaxed);
+}
+
+size_t VitalEdgeSession::size() {
+    size_t total = 0;
+    for (Shard& shard : table().shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.sessions.size();
+    }
+    return total;
+}
+
+void VitalEdgeSession::clear() {
+    for (Shard& shard : table().shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sessions.clear();
+        shard.nextSweep = Clock::time_point();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef VITALEDGE_SESSION_H
+#define VITALEDGE_SESSION_H
+
+#include "VitalEdgeKeyring.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Short-lived session keys agreed with clients over X25519, so a client pays for
+// one key agreement per session instead of sending key material (or needing an
+// RSA operation) with every request.
+//
+// The client sends a fresh X25519 public key and gets back the server's own
+// ephemeral public key and a session id. Both sides derive the AES-256 key as
+// HKDF-SHA256 of the shared secret, with the client's then the server's public
+// key as salt and kInfo as info. The key is held as a VitalEdgeKeyring::Entry
+// that is never added to the keyring, so a session encrypts with the same
+// prepared contexts as a key_id.
+//
+// Sessions live in a table split into shards, each under its own lock, and
+// expire a fixed time after the handshake. An expired session is dropped when it
+// is looked up, and swept from its shard as new sessions are added.
+class VitalEdgeSession {
+public:
+    static constexpr size_t kPublicKeySize = 32;
+    static constexpr size_t kIdSize = 32; // hex characters
+    static constexpr char kInfo[] = "vitaledge-session-v1";
+
+    struct Handshake {
+        std::string sessionId;
+        std::string publicKey; // the server's raw X25519 public key
+        uint64_t expiresIn;    // seconds
+    };
+
+    // Agree on a session key with a client's raw X25519 public key. Throws
+    // std::invalid_argument for a key of the wrong size or one that yields no
+    // shared secret, and std::runtime_error when the table is full.
+    static Handshake establish(std::string_view clientPublicKey);
+
+    // Key of a live session, or nullptr for an unknown or expired id
+    static VitalEdgeKeyring::EntryPtr find(std::string_view sessionId);
+    // End a session before it expires
+    static bool close(std::string_view sessionId);
+
+    // Lifetime of new sessions (default 15 minutes), and the most sessions held
+    // at once (default 100000)
+    static void setTTL(std::chrono::milliseconds ttl);
+    static void setCapacity(size_t capacity);
+    static size_t size();
+    static void clear();
+};
+
+#endif // VITALEDGE_SESSION_H
@@ -0,0 +1,54 @@
+#include "VitalEdgeStreamCipher.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeUtils.h"
+#include <stdexcept>
+
+// EVP_CipherUpdate takes an int length, so long chunks are fed in slices of this size
+static constexpr size_t kMaxUpdateSize = size_t(1) << 30;
+
+VitalEdgeStreamCipher::VitalEdgeStreamCipher(std::string_view key, std::string_view iv, bool encrypt) {
+    static const EVP_CIPHER* cipher = VitalEdgeCipherEngine::fetchCipher("AES-256-CBC");
+    ctx_ = VitalEdgeCipherEngine::newContext(cipher, key, iv, encrypt);
+}
+
+VitalEdgeStreamCipher::VitalEdgeStreamCipher(const VitalEdgeKeyring::Entry& key, std::string_view iv, bool encrypt) {
+    // Own a copy of the thread's context: the stream outlives this call
+    EVP_CIPHER_CTX* cached = VitalEdgeCipherEngine::acquire(key.cbc(encrypt), iv);
+    ctx_ = EVP_CIPHER_CTX_new();
+    if (!ctx_ || !EVP_CIPHER_CTX_copy(ctx_, cached)) {
+        EVP_CIPHER_CTX_free(ctx_);
+        VitalEdgeUtils::throwOpenSSLError("Unable to copy cipher context");
+    }
+}
+
+VitalEdgeStreamCipher::~VitalEdgeStreamCipher() {
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+size_t VitalEdgeStreamCipher::update(const unsigned char* in, size_t inLen, unsigned char* out) {
+    if (finished_) throw std::logic_error("Stream cipher already finished");
+
+    size_t total = 0;
+    int len = 0;
+    while (inLen > 0) {
+        const size_t slice = inLen < kMaxUpdateSize ? inLen : kMaxUpdateSize;
+        if (!EVP_CipherUpdate(ctx_, out + total, &len, in, (int)slice)) {
+            VitalEdgeUtils::throwOpenSSLError("Cipher update failed");
+        }
+        total += len;
+        in += slice;
+        inLen -= slice;
+    }
+    return total;
+}
+
+size_t VitalEdgeStreamCipher::finish(unsigned char* out) {
+    if (finished_) throw std::logic_error("Stream cipher already finished");
+    finished_ = true;
+
+    int len = 0;
+    if (!EVP_CipherFinal_ex(ctx_, out, &len)) {
+        VitalEdgeUtils::throwOpenSSLError("Cipher finalisation failed");
+    }
+    return len;
+}
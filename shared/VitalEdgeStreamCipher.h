@@ -0,0 +1,42 @@
+#ifndef VITALEDGE_STREAMCIPHER_H
+#define VITALEDGE_STREAMCIPHER_H
+
+#include "VitalEdgeKeyring.h"
+#include <openssl/evp.h>
+#include <cstddef>
+#include <string_view>
+
+// Incremental AES-256-CBC over caller-provided buffers, producing the same bytes
+// as VitalEdgeCrypto::encryptAES/decryptAES on the concatenated input. Memory use
+// is independent of the payload size: feed chunks to update() as they arrive and
+// call finish() once at the end.
+class VitalEdgeStreamCipher {
+public:
+    static constexpr size_t kBlockSize = 16;
+
+    VitalEdgeStreamCipher(std::string_view key, std::string_view iv, bool encrypt);
+    VitalEdgeStreamCipher(const VitalEdgeKeyring::Entry& key, std::string_view iv, bool encrypt);
+    ~VitalEdgeStreamCipher();
+    VitalEdgeStreamCipher(const VitalEdgeStreamCipher&) = delete;
+    VitalEdgeStreamCipher& operator=(const VitalEdgeStreamCipher&) = delete;
+
+    // Largest output update() can produce for inLen bytes of input
+    static size_t maxUpdateOutput(size_t inLen) { return inLen + kBlockSize; }
+
+    // Process the next chunk; out must hold maxUpdateOutput(inLen) bytes.
+    // Returns the bytes written, which may be fewer than inLen while a partial
+    // block is held back.
+    size_t update(const unsigned char* in, size_t inLen, unsigned char* out);
+
+    // Flush the final (padded) block; out must hold kBlockSize bytes. Decryption
+    // throws here if the padding is wrong. No further calls are allowed after.
+    size_t finish(unsigned char* out);
+
+    bool finished() const { return finished_; }
+
+private:
+    EVP_CIPHER_CTX* ctx_;
+    bool finished_ = false;
+};
+
+#endif // VITALEDGE_STREAMCIPHER_H
@@ -0,0 +1,295 @@
+#include "VitalEdgeTokenVault.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeRandom.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr char kMagic[8] = {'V', 'E', 'T', 'O', 'K', 'E', 'N', '1'};
+// Version 1 kept values in the clear
+static constexpr uint32_t kVersion = 2;
+
+// What sealing adds to each value
+static constexpr size_t kNonceSize = 12;
+static constexpr size_t kSealOverhead = kNonceSize + VitalEdgeCipherEngine::kAEADTagSize;
+
+// Average value size the heap is provisioned for when a vault is created
+static constexpr size_t kHeapBytesPerSlot = 32;
+
+namespace {
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint64_t slotCount;
+    uint64_t count;
+    uint64_t heapCapacity;
+    uint64_t heapUsed;
+    uint64_t reserved[2];
+};
+static_assert(sizeof(Header) == 64, "vault header is 64 bytes");
+
+struct Slot {
+    unsigned char token[VitalEdgeTokenVault::kTokenSize];
+    uint64_t valueOffset;
+    uint32_t valueLength;
+    uint32_t state; // 0 empty, 1 used; published last with a release store
+};
+static_assert(sizeof(Slot) == 32, "vault slots are 32 bytes");
+
+size_t fileSize(size_t slots, size_t heapCapacity) {
+    return sizeof(Header) + slots * sizeof(Slot) + heapCapacity;
+}
+
+// Tokens are HMAC output, so their first bytes are already a uniform hash
+uint64_t slotHash(const unsigned char* token) {
+    uint64_t hash;
+    std::memcpy(&hash, token, sizeof(hash));
+    return hash;
+}
+
+std::runtime_error systemError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+struct VitalEdgeTokenVault::Mapping {
+    char* base = nullptr;
+    size_t length = 0;
+
+    ~Mapping() {
+        if (base) munmap(base, length);
+    }
+
+    Header* header() const { return (Header*)base; }
+    Slot* slots() const { return (Slot*)(base + sizeof(Header)); }
+    char* heap() const { return base + sizeof(Header) + header()->slotCount * sizeof(Slot); }
+    uint64_t mask() const { return header()->slotCount - 1; }
+
+    // The slot holding token, or the empty slot where it would go
+    Slot* probe(const unsigned char* token) const {
+        Slot* table = slots();
+        for (uint64_t i = slotHash(token) & mask();; i = (i + 1) & mask()) {
+            Slot* slot = &table[i];
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == 0) return slot;
+            if (std::memcmp(slot->token, token, kTokenSize) == 0) return slot;
+        }
+    }
+};
+
+std::unique_ptr<VitalEdgeTokenVault::Mapping> VitalEdgeTokenVault::mapFile(int fd, size_t length,
+                                                                         const std::string& path) {
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) throw systemError("Unable to map token vault", path);
+    auto mapping = std::make_unique<VitalEdgeTokenVault::Mapping>();
+    mapping->base = (char*)base;
+    mapping->length = length;
+    return mapping;
+}
+
+VitalEdgeTokenVault::VitalEdgeTokenVault(const std::string& path, size_t initialSlots) : path_(path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        size_t slots = 1024;
+        while (slots < initialSlots) slots <<= 1;
+        mappings_.push_back(create(path, slots, slots * kHeapBytesPerSlot));
+        current_.store(mappings_.back().get(), std::memory_order_release);
+        return;
+    }
+    if (fd < 0) throw systemError("Unable to open token vault", path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw systemError("Unable to stat token vault", path);
+    }
+    if (size_t(info.st_size) < sizeof(Header)) {
+        ::close(fd);
+        throw std::runtime_error("Not a token vault: " + path);
+    }
+    auto mapping = mapFile(fd, size_t(info.st_size), path);
+    const Header* header = mapping->header();
+    const uint64_t slots = header->slotCount;
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == 1) {
+        throw std::runtime_error("Token vault " + path + " stores values unencrypted (version 1); create a new one");
+    }
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+        header->slotSize != sizeof(Slot) || slots == 0 || (slots & (slots - 1)) != 0 ||
+        slots > (size_t(info.st_size) - sizeof(Header)) / sizeof(Slot) ||
+        size_t(info.st_size) != fileSize(slots, header->heapCapacity) || header->heapUsed > header->heapCapacity) {
+        throw std::runtime_error("Not a token vault (or damaged): " + path);
+    }
+
+    // Lookups trust slots without checking them, so every one is checked here
+    uint64_t used = 0;
+    const Slot* table = mapping->slots();
+    for (uint64_t i = 0; i < slots; ++i) {
+        const Slot& slot = table[i];
+        if (slot.state == 0) continue;
+        if (slot.state != 1 || slot.valueOffset > header->heapUsed ||
+            slot.valueLength > header->heapUsed - slot.valueOffset || slot.valueLength < kSealOverhead) {
+            throw std::runtime_error("Token vault is damaged (slot " + std::to_string(i) + "): " + path);
+        }
+        ++used;
+    }
+    // A full index would leave probes for absent tokens running forever
+    if (used == slots) throw std::runtime_error("Token vault is damaged (index full): " + path);
+    // A crash between publishing a slot and counting it leaves count one short;
+    // the slots are what lookups see, so they decide
+    mapping->header()->count = used;
+    mappings_.push_back(std::move(mapping));
+    current_.store(mappings_.back().get(), std::memory_order_release);
+}
+
+VitalEdgeTokenVault::~VitalEdgeTokenVault() {
+    flush();
+}
+
+// A new, empty vault file of the given geometry (sparse until written)
+std::unique_ptr<VitalEdgeTokenVault::Mapping> VitalEdgeTokenVault::create(const std::string& path, size_t slots,
+                                                                        size_t heapCapacity) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) throw systemError("Unable to create token vault", path);
+    if (ftruncate(fd, fileSize(slots, heapCapacity)) != 0) {
+        ::close(fd);
+        throw systemError("Unable to size token vault", path);
+    }
+    auto mapping = mapFile(fd, fileSize(slots, heapCapacity), path);
+    Header* header = mapping->header();
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->version = kVersion;
+    header->slotSize = sizeof(Slot);
+    header->slotCount = slots;
+    header->heapCapacity = heapCapacity;
+    return mapping;
+}
+
+bool VitalEdgeTokenVault::insert(const unsigned char* token, std::string_view value,
+                                 const VitalEdgeKeyring::Entry& key) {
+    if (value.size() > UINT32_MAX - kSealOverhead) throw std::invalid_argument("Token vault values are limited to 4 GiB");
+    const size_t sealedSize = value.size() + kSealOverhead;
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    Mapping* mapping = current_.load(std::memory_order_relaxed);
+    if (mapping->probe(token)->state != 0) return false;
+
+    Header* header = mapping->header();
+    if ((header->count + 1) * 4 > header->slotCount * 3 || header->heapCapacity - header->heapUsed < sealedSize) {
+        grow(sealedSize);
+        mapping = current_.load(std::memory_order_relaxed);
+        header = mapping->header();
+    }
+
+    // Sealed value first, straight into the heap, then the heap mark, then the
+    // slot: a crash part-way only leaks heap space
+    Slot* slot = mapping->probe(token);
+    unsigned char* sealed = (unsigned char*)mapping->heap() + header->heapUsed;
+    VitalEdgeRandom::bytes(sealed, kNonceSize);
+    VitalEdgeCipherEngine::encryptAEAD(key.gcm(true), std::string_view((const char*)sealed, kNonceSize),
+                                       std::string_view((const char*)token, kTokenSize),
+                                       (const unsigned char*)value.data(), value.size(), sealed + kNonceSize,
+                                       sealed + kNonceSize + value.size());
+    const uint64_t offset = header->heapUsed;
+    header->heapUsed += sealedSize;
+    std::memcpy(slot->token, token, kTokenSize);
+    slot->valueOffset = offset;
+    slot->valueLength = uint32_t(sealedSize);
+    __atomic_store_n(&slot->state, 1u, __ATOMIC_RELEASE);
+    header->count++;
+    return true;
+}
+
+bool VitalEdgeTokenVault::find(const unsigned char* token, const VitalEdgeKeyring::Entry& key,
+                               VitalEdgeSecureMemory::String& value) const {
+    const Mapping* mapping = current_.load(std::memory_order_acquire);
+    const Slot* slot = mapping->probe(token);
+    if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == 0) return false;
+
+    const unsigned char* sealed = (const unsigned char*)mapping->heap() + slot->valueOffset;
+    const size_t length = slot->valueLength - kSealOverhead;
+    value.resize(length);
+    try {
+        VitalEdgeCipherEngine::decryptAEAD(key.gcm(false), std::string_view((const char*)sealed, kNonceSize),
+                                           std::string_view((const char*)token, kTokenSize), sealed + kNonceSize,
+                                           length, (unsigned char*)&value[0], sealed + kNonceSize + length);
+    } catch (const std::runtime_error&) {
+        // Another key's token, or a damaged value
+        value.clear();
+        return false;
+    }
+    return true;
+}
+
+// Rewrite the vault at double the size (or more heap if extraHeap needs it) into
+// a temporary file, rename it over the vault and publish it to readers
+void VitalEdgeTokenVault::grow(size_t extraHeap) {
+    const Mapping* old = current_.load(std::memory_order_relaxed);
+    const Header* oldHeader = old->header();
+
+    size_t slots = oldHeader->slotCount;
+    if ((oldHeader->count + 1) * 4 > slots * 3) slots *= 2;
+    size_t heapCapacity = oldHeader->heapCapacity;
+    while (heapCapacity - oldHeader->heapUsed < extraHeap || heapCapacity < slots * kHeapBytesPerSlot) {
+        heapCapacity *= 2;
+    }
+
+    const std::string tmpPath = path_ + ".grow";
+    auto mapping = create(tmpPath, slots, heapCapacity);
+    Header* header = mapping->header();
+    const Slot* oldSlots = old->slots();
+    for (uint64_t i = 0; i < oldHeader->slotCount; ++i) {
+        if (oldSlots[i].state == 0) continue;
+        Slot* slot = mapping->probe(oldSlots[i].token);
+        *slot = oldSlots[i];
+        slot->valueOffset = header->heapUsed;
+        std::memcpy(mapping->heap() + header->heapUsed, old->heap() + oldSlots[i].valueOffset,
+                    oldSlots[i].valueLength);
+        header->heapUsed += oldSlots[i].valueLength;
+        header->count++;
+    }
+
+    if (msync(mapping->base, mapping->length, MS_SYNC) != 0 || rename(tmpPath.c_str(), path_.c_str()) != 0) {
+        const auto error = systemError("Unable to replace token vault", path_);
+        unlink(tmpPath.c_str());
+        throw error;
+    }
+    mappings_.push_back(std::move(mapping));
+    current_.store(mappings_.back().get(), std::memory_order_release);
+}
+
+size_t VitalEdgeTokenVault::size() const {
+    return current_.load(std::memory_order_acquire)->header()->count;
+}
+
+size_t VitalEdgeTokenVault::capacity() const {
+    return current_.load(std::memory_order_acquire)->header()->slotCount;
+}
+
+void VitalEdgeTokenVault::flush() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    Mapping* mapping = current_.load(std::memory_order_relaxed);
+    if (mapping) msync(mapping->base, mapping->length, MS_SYNC);
+}
+
+static std::unique_ptr<VitalEdgeTokenVault>& processVault() {
+    static std::unique_ptr<VitalEdgeTokenVault> vault;
+    return vault;
+}
+
+void VitalEdgeTokenVault::open(const std::string& path, size_t initialSlots) {
+    processVault() = std::make_unique<VitalEdgeTokenVault>(path, initialSlots);
+}
+
+VitalEdgeTokenVault* VitalEdgeTokenVault::instance() {
+    return processVault().get();
+}
+
+void VitalEdgeTokenVault::close() {
+    processVault().reset();
+}
@@ -0,0 +1,85 @@
+#ifndef VITALEDGE_TOKENVAULT_H
+#define VITALEDGE_TOKENVAULT_H
+
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeSecureMemory.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Token -> value store for detokenization (see VitalEdgeCrypto::tokenize).
+//
+// The vault is an open-addressing hash index (linear probing over 32-byte slots)
+// plus a heap of values, both inside one memory-mapped file. Opening an existing
+// vault maps the file and checks every slot against the heap; nothing is rebuilt
+// or loaded. Lookups take no lock: a slot becomes visible only once its value is
+// written. Inserts are serialised; when the index passes 75% full or the heap
+// runs out, the vault is rewritten at double the size into a new file that
+// atomically replaces the old one.
+//
+// Values are never stored in the clear: each is sealed with AES-256-GCM under
+// the key that made its token, with the token as AAD, so the file alone reveals
+// nothing and a value opens only for its own key and token.
+//
+// File layout (integers little-endian):
+//   header  "VETOKEN1" | version u32 | slot size u32 | slot count u64 | count u64
+//           | heap capacity u64 | heap used u64 | reserved (16 bytes)
+//   slots   slot count x (token 16 bytes | value offset u64 | value length u32 | state u32)
+//   heap    sealed values back to back, each nonce (12 bytes) | ciphertext | tag (16 bytes)
+// Writes reach the file through the page cache, so they survive a process crash;
+// flush() makes them durable against power loss.
+class VitalEdgeTokenVault {
+public:
+    static constexpr size_t kTokenSize = 16;
+
+    // Open the vault at path, creating it with room for initialSlots tokens (rounded
+    // up to a power of two) if it does not exist. Throws std::runtime_error if the
+    // file cannot be mapped, is not a vault, or has a slot pointing outside its heap.
+    explicit VitalEdgeTokenVault(const std::string& path, size_t initialSlots = 1 << 16);
+    ~VitalEdgeTokenVault();
+
+    VitalEdgeTokenVault(const VitalEdgeTokenVault&) = delete;
+    VitalEdgeTokenVault& operator=(const VitalEdgeTokenVault&) = delete;
+
+    // Seal value under key, the key that made token, and store it. Returns false,
+    // leaving the vault unchanged, if the token is already present.
+    bool insert(const unsigned char* token, std::string_view value, const VitalEdgeKeyring::Entry& key);
+
+    // Open the value stored under token into value; false if there is none or it
+    // was not sealed under key
+    bool find(const unsigned char* token, const VitalEdgeKeyring::Entry& key, VitalEdgeSecureMemory::String& value) const;
+
+    size_t size() const;
+    size_t capacity() const;
+
+    // msync the mapping
+    void flush();
+
+    // Process-wide vault used by the tokenization routes. Open it at startup and
+    // close it at shutdown: neither is safe while requests are using it.
+    static void open(const std::string& path, size_t initialSlots = 1 << 16);
+    static VitalEdgeTokenVault* instance(); // nullptr until open()
+    static void close();
+
+private:
+    struct Mapping;
+
+    static std::unique_ptr<Mapping> mapFile(int fd, size_t length, const std::string& path);
+    static std::unique_ptr<Mapping> create(const std::string& path, size_t slots, size_t heapCapacity);
+    void grow(size_t extraHeap);
+
+    std::string path_;
+    std::mutex writeMutex_;
+    std::atomic<Mapping*> current_{nullptr};
+    // Superseded mappings stay mapped until the vault closes, so lock-free readers
+    // still using one are never left with a dangling pointer. Sizes double, so
+    // together they are smaller than the current mapping.
+    std::vector<std::unique_ptr<Mapping>> mappings_;
+};
+
+#endif // VITALEDGE_TOKENVAULT_H
@@ -1,31 +1,22 @@
 #include "VitalEdgeUtils.h"
-#include <openssl/bio.h>
+#include "VitalEdgeBase64.h"
+#include <openssl/err.h>
 #include <openssl/evp.h>
+#include <stdexcept>
 
 std::string VitalEdgeUtils::base64Encode(const std::string& data) {
-    BIO* bio = BIO_new(BIO_s_mem());
-    BIO* b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-
-    BIO_write(bio, data.data(), data.size());
-    BIO_flush(bio);
-
-    char* encoded;
-    long length = BIO_get_mem_data(bio, &encoded);
-    std::string result(encoded, length);
-
-    BIO_free_all(bio);
-    return result;
+    return VitalEdgeBase64::encode(data);
 }
 
 std::string VitalEdgeUtils::base64Decode(const std::string& base64Data) {
-    BIO* bio = BIO_new_mem_buf(base64Data.data(), base64Data.size());
-    BIO* b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-
-    std::vector<char> decoded(base64Data.size());
-    int length = BIO_read(bio, decoded.data(), base64Data.size());
+    return VitalEdgeBase64::decode(base64Data);
+}
 
-    BIO_free_all(bio);
-    return std::string(decoded.data(), length);
+void VitalEdgeUtils::throwOpenSSLError(const char* what) {
+    unsigned long errCode = ERR_get_error();
+    ERR_clear_error();
+    if (errCode) {
+        throw std::runtime_error(ERR_error_string(errCode, nullptr));
+    }
+    throw std::runtime_error(what);
 }
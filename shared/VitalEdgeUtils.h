@@ -5,8 +5,13 @@
 
 class VitalEdgeUtils {
 public:
+    // Base64 through VitalEdgeBase64; decoding throws std::invalid_argument on bad input
     static std::string base64Encode(const std::string& data);
     static std::string base64Decode(const std::string& base64Data);
+
+    // Throw the most recent OpenSSL error as std::runtime_error, or `what` when
+    // the error queue is empty (some EVP calls fail without queueing anything)
+    [[noreturn]] static void throwOpenSSLError(const char* what);
 };
 
 #endif
@@ -0,0 +1,119 @@
+#include "VitalEdgeWire.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static uint32_t readU32(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
+
+static void writeU32(char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = char(value >> (8 * i));
+}
+
+std::vector<VitalEdgeWire::Item> VitalEdgeWire::parseBatch(std::string_view body, size_t maxItems) {
+    std::vector<Item> items;
+    size_t offset = 0;
+    while (offset < body.size()) {
+        if (items.size() == maxItems) {
+            throw std::invalid_argument("Invalid request: at most " + std::to_string(maxItems) + " items per batch.");
+        }
+        if (body.size() - offset < kItemHeaderSize) {
+            throw std::invalid_argument("Invalid request: truncated item header.");
+        }
+        const char* header = body.data() + offset;
+        const size_t keyIdLength = (unsigned char)header[0];
+        const size_t keyLength = (unsigned char)header[1];
+        const size_t ivLength = (unsigned char)header[2];
+        const size_t dataLength = readU32(header + 4);
+        const uint32_t keyVersion = readU32(header + 8);
+        offset += kItemHeaderSize;
+        if (body.size() - offset < keyIdLength + keyLength + ivLength + dataLength) {
+            throw std::invalid_argument("Invalid request: truncated item.");
+        }
+        if ((keyIdLength == 0) == (keyLength == 0)) {
+            throw std::invalid_argument("Invalid request: each item needs either a key_id or a key.");
+        }
+        if (keyVersion != 0 && keyIdLength == 0) {
+            throw std::invalid_argument("Invalid request: a key version needs a key_id.");
+        }
+
+        Item item;
+        item.keyId = body.substr(offset, keyIdLength);
+        offset += keyIdLength;
+        item.key = body.substr(offset, keyLength);
+        offset += keyLength;
+        item.iv = body.substr(offset, ivLength);
+        offset += ivLength;
+        item.data = body.substr(offset, dataLength);
+        offset += dataLength;
+        item.keyVersion = keyVersion;
+        items.push_back(item);
+    }
+    return items;
+}
+
+void VitalEdgeWire::appendItem(std::string& body, const Item& item) {
+    if (item.keyId.size() > 0xFF || item.key.size() > 0xFF || item.iv.size() > 0xFF ||
+        item.data.size() > 0xFFFFFFFFu) {
+        throw std::invalid_argument("Item field too long for the wire format.");
+    }
+    char header[kItemHeaderSize] = {char(item.keyId.size()), char(item.key.size()), char(item.iv.size()), 0};
+    writeU32(header + 4, uint32_t(item.data.size()));
+    writeU32(header + 8, item.keyVersion);
+    body.append(header, kItemHeaderSize);
+    body.append(item.keyId).append(item.key).append(item.iv).append(item.data);
+}
+
+VitalEdgeWire::BatchWriter::BatchWriter(size_t reserve) {
+    body_.resize(reserve);
+}
+
+char* VitalEdgeWire::BatchWriter::output(size_t maxLength) {
+    // Only error messages longer than their item's reservation make this grow
+    const size_t needed = size_ + kItemHeaderSize + maxLength;
+    if (body_.size() < needed) body_.resize(std::max(needed, body_.size() * 2));
+    return &body_[size_ + kItemHeaderSize];
+}
+
+void VitalEdgeWire::BatchWriter::commit(size_t length, uint32_t keyVersion) {
+    writeHeader(Status::Ok, length, keyVersion);
+}
+
+void VitalEdgeWire::BatchWriter::fail(std::string_view message) {
+    std::memcpy(output(message.size()), message.data(), message.size());
+    writeHeader(Status::Error, message.size(), 0);
+}
+
+void VitalEdgeWire::BatchWriter::writeHeader(Status status, size_t length, uint32_t keyVersion) {
+    char* header = &body_[size_];
+    header[0] = char(status);
+    header[1] = header[2] = header[3] = 0;
+    writeU32(header + 4, uint32_t(length));
+    writeU32(header + 8, keyVersion);
+    size_ += kItemHeaderSize + length;
+}
+
+std::string VitalEdgeWire::BatchWriter::take() {
+    body_.resize(size_);
+    size_ = 0;
+    return std::move(body_);
+}
+
+std::vector<VitalEdgeWire::Result> VitalEdgeWire::parseBatchResponse(std::string_view body) {
+    std::vector<Result> results;
+    size_t offset = 0;
+    while (offset < body.size()) {
+        if (body.size() - offset < kItemHeaderSize) throw std::invalid_argument("Truncated result header.");
+        const char* header = body.data() + offset;
+        const size_t length = readU32(header + 4);
+        offset += kItemHeaderSize;
+        if (body.size() - offset < length || (unsigned char)header[0] > uint8_t(Status::Error)) {
+            throw std::invalid_argument("Malformed result.");
+        }
+        results.push_back(Result{Status(header[0]), body.substr(offset, length), readU32(header + 8)});
+        offset += length;
+    }
+    return results;
+}
@@ -0,0 +1,80 @@
+#ifndef VITALEDGE_WIRE_H
+#define VITALEDGE_WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary wire format for the AES routes, used instead of JSON when a request's
+// Content-Type is application/octet-stream. Payloads travel as raw bytes: no
+// base64, no JSON escaping, and the route reads them in place from the request
+// body and encrypts or decrypts straight into the response body.
+//
+// Single-item routes (/encrypt, /decrypt) take the payload as the whole body and
+// the parameters in headers, as /encrypt/stream does. The batch routes frame
+// each item with a fixed header (integers little-endian):
+//   request item   key_id length u8 | key length u8 | iv length u8 | reserved u8 | data length u32
+//                  | key version u32 | key_id | key | iv | data
+//   response item  status u8 (0 ok, 1 error) | reserved u8 x3 | length u32 | key version u32
+//                  | output or error message
+// An item names its key with key_id or carries it raw in key, not both. A key
+// version of 0 asks for the key_id's current version; a response names the
+// version it used, or 0 for a raw key or an error.
+class VitalEdgeWire {
+public:
+    static constexpr size_t kItemHeaderSize = 12;
+
+    enum class Status : uint8_t { Ok = 0, Error = 1 };
+
+    // One request item; every field is a view into the request body
+    struct Item {
+        std::string_view keyId;
+        std::string_view key;
+        std::string_view iv;
+        std::string_view data;
+        uint32_t keyVersion = 0;
+    };
+
+    // Split a batch request body into items. Throws std::invalid_argument if the
+    // framing is malformed or there are more than maxItems items.
+    static std::vector<Item> parseBatch(std::string_view body, size_t maxItems);
+
+    // Append one request item (for clients, tests and benchmarks)
+    static void appendItem(std::string& body, const Item& item);
+
+    // Builds a batch response in one buffer sized up front. Each item's output is
+    // written by the caller directly at its final position, after its header.
+    class BatchWriter {
+    public:
+        // reserve: the largest total of output() sizes the items will ask for
+        explicit BatchWriter(size_t reserve);
+
+        // Room for the next item's output, at most maxLength bytes; finish it with
+        // commit() or fail()
+        char* output(size_t maxLength);
+        void commit(size_t length, uint32_t keyVersion = 0);
+        void fail(std::string_view message);
+
+        // The response body; the writer is empty afterwards
+        std::string take();
+
+    private:
+        void writeHeader(Status status, size_t length, uint32_t keyVersion);
+
+        std::string body_;
+        size_t size_ = 0;
+    };
+
+    // Walk a batch response body (for clients, tests and benchmarks). Throws
+    // std::invalid_argument if the framing is malformed.
+    struct Result {
+        Status status;
+        std::string_view output; // the error message when status is Error
+        uint32_t keyVersion;
+    };
+    static std::vector<Result> parseBatchResponse(std::string_view body);
+};
+
+#endif // VITALEDGE_WIRE_H
@@ -0,0 +1,100 @@
+#include "cli.h"
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeFileCrypt.h"
+#include <openssl/crypto.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+static void usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s encrypt-file|decrypt-file [--keyring <file>] (--key-id <id> | --key-file <file>)\n"
+                 "       [--segment-kb <n>] [--threads <n>] [--json] <input> <output>\n"
+                 "\n"
+                 "Encrypts a file, or every file under a directory into a mirrored tree, as\n"
+                 "AES-256-GCM segmented containers; decrypt-file reverses it. The keyring\n"
+                 "defaults to $VITALEDGE_KEYRING and the thread count to $VITALEDGE_CRYPTO_THREADS.\n",
+                 program);
+}
+
+bool isCommand(int argc, char** argv) {
+    return argc > 1 && (std::strcmp(argv[1], "encrypt-file") == 0 || std::strcmp(argv[1], "decrypt-file") == 0);
+}
+
+int runCommand(int argc, char** argv) {
+    const bool encrypt = std::strcmp(argv[1], "encrypt-file") == 0;
+    const char* keyring = std::getenv("VITALEDGE_KEYRING");
+    const char* threadsSetting = std::getenv("VITALEDGE_CRYPTO_THREADS");
+    const char* keyId = nullptr;
+    const char* keyFile = nullptr;
+    size_t segmentSize = VitalEdgeChunkedAEAD::kDefaultSegmentSize;
+    size_t threads = threadsSetting && *threadsSetting ? std::strtoul(threadsSetting, nullptr, 10) : 0;
+    bool json = false;
+    const char* paths[2] = {nullptr, nullptr};
+    size_t pathCount = 0;
+    for (int i = 2; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--keyring") == 0 && hasValue) {
+            keyring = argv[++i];
+        } else if (std::strcmp(argv[i], "--key-id") == 0 && hasValue) {
+            keyId = argv[++i];
+        } else if (std::strcmp(argv[i], "--key-file") == 0 && hasValue) {
+            keyFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--segment-kb") == 0 && hasValue) {
+            segmentSize = size_t(std::strtoul(argv[++i], nullptr, 10)) * 1024;
+        } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = size_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (argv[i][0] != '-' && pathCount < 2) {
+            paths[pathCount++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (pathCount != 2 || !keyId == !keyFile || (keyId && !keyring)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    VitalEdgeFileCrypt::Report report;
+    std::string rawKey;
+    try {
+        VitalEdgeExecutor::configure(threads);
+        VitalEdgeFileCrypt::Key key;
+        VitalEdgeKeyring::EntryPtr entry;
+        if (keyId) {
+            VitalEdgeCrypto::KeyManager::loadKeyring(keyring);
+            entry = VitalEdgeCrypto::KeyManager::findKey(keyId);
+            if (!entry) throw std::invalid_argument(std::string("Unknown key_id: ") + keyId);
+            key.entry = entry.get();
+        } else {
+            rawKey = VitalEdgeCrypto::KeyManager::loadKeyFromFile(keyFile);
+            key.raw = rawKey;
+        }
+        report = encrypt ? VitalEdgeFileCrypt::encrypt(paths[0], paths[1], key, segmentSize)
+                         : VitalEdgeFileCrypt::decrypt(paths[0], paths[1], key);
+    } catch (const std::exception& e) {
+        OPENSSL_cleanse(&rawKey[0], rawKey.size());
+        std::fprintf(stderr, "%s %s: %s\n", argv[0], argv[1], e.what());
+        return 1;
+    }
+    OPENSSL_cleanse(&rawKey[0], rawKey.size());
+
+    const size_t threadCount = VitalEdgeExecutor::instance().threadCount();
+    if (json) {
+        std::printf("{\"files\":%zu,\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64
+                    ",\"seconds\":%.3f,\"mb_per_second\":%.1f,\"threads\":%zu}\n",
+                    report.files, report.bytesIn, report.bytesOut, report.seconds, report.megabytesPerSecond(),
+                    threadCount);
+    } else {
+        std::printf("%s %zu files: %.1f MB in %.3f s, %.1f MB/s on %zu threads\n", encrypt ? "Encrypted" : "Decrypted",
+                    report.files, report.bytesIn / 1e6, report.seconds, report.megabytesPerSecond(), threadCount);
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+// Offline commands of the vitaledge-crypt binary, run instead of the server when
+// it is started with a command name.
+#ifndef VITALEDGE_CLI_H
+#define VITALEDGE_CLI_H
+
+// True if argv names a command (e.g. "encrypt-file") rather than starting the server
+bool isCommand(int argc, char** argv);
+
+// Run the command and return the process exit status
+int runCommand(int argc, char** argv);
+
+#endif // VITALEDGE_CLI_H
@@ -1,156 +1,140 @@
+#include "cli.h"
+#include "routes.h"
+#include "scaling.h"
+#include "VitalEdgeAudit.h"
 #include "VitalEdgeCrypto.h"
+#include "VitalEdgeMetrics.h"
+#include "VitalEdgeSession.h"
+#include "VitalEdgeTokenVault.h"
 #include <drogon/drogon.h>
-#include <drogon/utils/Utilities.h>  // Include Drogon's utility header
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
 
 using namespace drogon;
 
-int main() {
-    // Route: /encrypt (AES Encryption)
-    app().registerHandler("/encrypt",
-        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
-            auto json = req->getJsonObject();
-            if (!json || !json->isMember("data") || !json->isMember("key") || !json->isMember("iv")) {
-                Json::Value jsonResp;
-                jsonResp["error"] = "Invalid request: 'data', 'key', and 'iv' are required.";
-                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-                resp->setStatusCode(HttpStatusCode::k400BadRequest);
-                callback(resp);
-                return;
-            }
-
-            try {
-                std::string encrypted = VitalEdgeCrypto::encryptAES(
-                    (*json)["data"].asString(),
-                    (*json)["key"].asString(),
-                    (*json)["iv"].asString()
-                );
-                Json::Value jsonResp;
-                jsonResp["encrypted"] = encrypted;
-                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-                callback(resp);
-            } catch (const std::exception& e) {
-                Json::Value jsonResp;
-                jsonResp["error"] = e.what();
-                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-                resp->setStatusCode(HttpStatusCode::k500InternalServerError);
-                callback(resp);
-            }
-        },
-        {Post});
-
-    // Route: /decrypt (AES Decryption)
-    // app().registerHandler("/decrypt",
-    //     [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
-    //         auto json = req->getJsonObject();
-    //         if (!json || !json->isMember("data") || !json->isMember("key") || !json->isMember("iv")) {
-    //             Json::Value jsonResp;
-    //             jsonResp["error"] = "Invalid request: 'data', 'key', and 'iv' are required.";
-    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-    //             resp->setStatusCode(HttpStatusCode::k400BadRequest);
-    //             callback(resp);
-    //             return;
-    //         }
-
-    //         try {
-    //             std::string decrypted = VitalEdgeCrypto::decryptAES(
-    //                 (*json)["data"].asString(),
-    //                 (*json)["key"].asString(),
-    //                 (*json)["iv"].asString()
-    //             );
-    //             Json::Value jsonResp;
-    //             jsonResp["decrypted"] = decrypted;
-    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-    //             callback(resp);
-    //         } catch (const std::exception& e) {
-    //             Json::Value jsonResp;
-    //             jsonResp["error"] = e.what();
-    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-    //             resp->setStatusCode(HttpStatusCode::k500InternalServerError);
-    //             callback(resp);
-    //         }
-    //     },
-    //     {Post});
-app().registerHandler("/decrypt",
-    [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
-        auto json = req->getJsonObject();
-        if (!json || !json->isMember("data") || !json->isMember("key") || !json->isMember("iv")) {
-            Json::Value jsonResp;
-            jsonResp["error"] = "Invalid request: 'data', 'key', and 'iv' are required.";
-            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-            resp->setStatusCode(HttpStatusCode::k400BadRequest);
-            callback(resp);
-            return;
+// Numeric setting from the environment, or the fallback when unset. A value that
+// is not a non-negative integer stops the server with the variable's name.
+static size_t envSize(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) return fallback;
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long parsed = std::strtoull(value, &end, 10);
+    const bool digits = *value >= '0' && *value <= '9' && *end == '\0';
+    if (!digits || errno == ERANGE || parsed > std::numeric_limits<size_t>::max()) {
+        std::cerr << name << " must be a non-negative integer, not \"" << value << "\"" << std::endl;
+        std::exit(1);
+    }
+    return size_t(parsed);
+}
+
+int main(int argc, char** argv) {
+    // Offline commands (encrypt-file, decrypt-file) run without the server
+    if (isCommand(argc, argv)) return runCommand(argc, argv);
+
+    // Worker processes, event loop and crypto thread counts, and thread pinning
+    Scaling scaling;
+    try {
+        scaling.workers = workerCount(std::getenv("VITALEDGE_WORKERS"));
+        scaling.ioThreads = envSize("VITALEDGE_IO_THREADS", 1);
+        scaling.cryptoThreads = envSize("VITALEDGE_CRYPTO_THREADS", 0);
+        scaling.pinThreads = envSize("VITALEDGE_PIN_THREADS", 0) != 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid scaling settings: " << e.what() << std::endl;
+        return 1;
+    }
+    // Workers cannot share the vault's in-process locks
+    if (scaling.workers > 1 && std::getenv("VITALEDGE_TOKEN_VAULT")) {
+        std::cerr << "VITALEDGE_TOKEN_VAULT needs a single process; unset VITALEDGE_WORKERS" << std::endl;
+        return 1;
+    }
+
+    // In pre-fork mode this process only supervises; each worker runs the rest
+    int status = 0;
+    if (!startWorkers(scaling, status)) return status;
+    applyScaling(scaling);
+
+    // Payload size from which requests run on the crypto executor
+    setInlineThreshold(envSize("VITALEDGE_INLINE_THRESHOLD", 64 * 1024));
+
+    // Latency histograms for /metrics, on unless VITALEDGE_METRICS=0
+    VitalEdgeMetrics::setEnabled(envSize("VITALEDGE_METRICS", 1) != 0);
+
+    // Lifetime (seconds) and number of /session keys held at once
+    VitalEdgeSession::setTTL(std::chrono::seconds(envSize("VITALEDGE_SESSION_TTL", 15 * 60)));
+    VitalEdgeSession::setCapacity(envSize("VITALEDGE_SESSION_CAPACITY", 100000));
+
+    // Keys addressable by key_id, loaded once at startup
+    if (const char* keyring = std::getenv("VITALEDGE_KEYRING")) {
+        try {
+            size_t loaded = VitalEdgeCrypto::KeyManager::loadKeyring(keyring);
+            std::cout << "Loaded " << loaded << " keys from " << keyring << std::endl;
+            setKeyringFile(keyring);
+        } catch (const std::exception& e) {
+            std::cerr << "Unable to load keyring: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Ed25519 keys for /sign and /verify, parsed once at startup
+    if (const char* signingKeys = std::getenv("VITALEDGE_SIGNING_KEYS")) {
+        try {
+            size_t loaded = VitalEdgeCrypto::KeyManager::loadSigningKeys(signingKeys);
+            std::cout << "Loaded " << loaded << " signing keys from " << signingKeys << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Unable to load signing keys: " << e.what() << std::endl;
+            return 1;
         }
+    }
 
+    // Audit trail of every crypto operation, when VITALEDGE_AUDIT_LOG names a file
+    if (const char* auditLog = std::getenv("VITALEDGE_AUDIT_LOG")) {
+        VitalEdgeAudit::Options options;
+        options.path = auditLog;
+        // Each worker chains its own log
+        if (scaling.workers > 1) options.path += "." + std::to_string(scaling.worker);
+        const char* backpressure = std::getenv("VITALEDGE_AUDIT_BACKPRESSURE");
+        if (backpressure && std::string(backpressure) == "drop") {
+            options.backpressure = VitalEdgeAudit::Backpressure::Drop;
+        }
+        options.syncIntervalMillis = unsigned(envSize("VITALEDGE_AUDIT_SYNC_MS", options.syncIntervalMillis));
         try {
-            // Use Drogon's base64Decode
-            std::string ciphertext = drogon::utils::base64Decode((*json)["data"].asString());
-
-            // Perform AES decryption
-            std::string plaintext = VitalEdgeCrypto::decryptAES(
-                ciphertext,
-                (*json)["key"].asString(),
-                (*json)["iv"].asString()
-            );
-
-            Json::Value jsonResp;
-            jsonResp["decrypted"] = plaintext;
-            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-            callback(resp);
+            VitalEdgeAudit::start(options);
+            std::cout << "Writing audit log to " << options.path << std::endl;
         } catch (const std::exception& e) {
-            Json::Value jsonResp;
-            jsonResp["error"] = e.what();
-            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-            resp->setStatusCode(HttpStatusCode::k500InternalServerError);
-            callback(resp);
+            std::cerr << "Unable to start audit log: " << e.what() << std::endl;
+            return 1;
         }
-    },
-    {Post});
-
-    // Route: /obfuscate
-    app().registerHandler("/obfuscate",
-        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
-            auto json = req->getJsonObject();
-            if (!json || !json->isMember("data")) {
-                Json::Value jsonResp;
-                jsonResp["error"] = "Invalid request: 'data' is required.";
-                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-                resp->setStatusCode(HttpStatusCode::k400BadRequest);
-                callback(resp);
-                return;
-            }
-
-            std::string obfuscated = VitalEdgeCrypto::obfuscate((*json)["data"].asString());
-            Json::Value jsonResp;
-            jsonResp["obfuscated"] = obfuscated;
-            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-            callback(resp);
-        },
-        {Post});
-
-    // Route: /deobfuscate
-    app().registerHandler("/deobfuscate",
-        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
-            auto json = req->getJsonObject();
-            if (!json || !json->isMember("data")) {
-                Json::Value jsonResp;
-                jsonResp["error"] = "Invalid request: 'data' is required.";
-                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-                resp->setStatusCode(HttpStatusCode::k400BadRequest);
-                callback(resp);
-                return;
-            }
-
-            std::string deobfuscated = VitalEdgeCrypto::deobfuscate((*json)["data"].asString());
-            Json::Value jsonResp;
-            jsonResp["deobfuscated"] = deobfuscated;
-            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
-            callback(resp);
-        },
-        {Post});
+    }
+
+    // Token -> value store for /detokenize, mapped from VITALEDGE_TOKEN_VAULT
+    if (const char* tokenVault = std::getenv("VITALEDGE_TOKEN_VAULT")) {
+        try {
+            VitalEdgeTokenVault::open(tokenVault, envSize("VITALEDGE_TOKEN_VAULT_SLOTS", 1 << 16));
+            std::cout << "Mapped token vault " << tokenVault << " ("
+                      << VitalEdgeTokenVault::instance()->size() << " tokens)" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Unable to open token vault: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Routes keeping state in one process refuse requests when there are workers
+    setWorkerCount(scaling.workers);
+    registerRoutes();
+
+    // Bodies of stream routes are delivered in chunks instead of being buffered
+    app().enableRequestStream();
 
     // Run the Drogon application
     app().addListener("0.0.0.0", 8084).run();
 
+    // Write out and fsync whatever the request threads queued last
+    VitalEdgeAudit::stop();
+    VitalEdgeTokenVault::close();
+
     return 0;
 }
@@ -0,0 +1,1694 @@
+#include "routes.h"
+#include "VitalEdgeAudit.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeCrypto.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeFieldPath.h"
+#include "VitalEdgeKeyCache.h"
+#include "VitalEdgeMetrics.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeSecureMemory.h"
+#include "VitalEdgeSession.h"
+#include "VitalEdgeStreamCipher.h"
+#include "VitalEdgeTokenVault.h"
+#include "VitalEdgeWire.h"
+#include <drogon/drogon.h>
+#include <trantor/net/EventLoop.h>
+#include <trantor/net/TcpConnection.h>
+#include <openssl/crypto.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+using namespace drogon;
+
+// Largest number of items accepted by the batch routes
+static constexpr Json::ArrayIndex kMaxBatchItems = 10000;
+
+// JSON error body with the given status code
+static HttpResponsePtr errorResponse(HttpStatusCode code, const std::string& message) {
+    Json::Value jsonResp;
+    jsonResp["error"] = message;
+    auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+    resp->setStatusCode(code);
+    return resp;
+}
+
+// Requests whose crypto cost (payload bytes) reaches this threshold run on the
+// crypto executor instead of the event loop
+static size_t inlineThreshold = 64 * 1024;
+
+void setInlineThreshold(size_t bytes) {
+    inlineThreshold = bytes;
+}
+
+static std::string keyringFile;
+
+void setKeyringFile(const std::string& path) {
+    keyringFile = path;
+}
+
+static size_t workerProcesses = 1;
+
+void setWorkerCount(size_t workers) {
+    workerProcesses = workers;
+}
+
+// Answer a request to a route whose state lives in a single process, when
+// several workers share the port; false if the route may run
+static bool refuseInWorkers(const char* route, std::function<void(const HttpResponsePtr&)>& callback) {
+    if (workerProcesses <= 1) return false;
+    callback(errorResponse(HttpStatusCode::k503ServiceUnavailable,
+                           std::string(route) + " needs a single process; unset VITALEDGE_WORKERS."));
+    return true;
+}
+
+// Timing of one request for /metrics: the route's timer, the body size that picks
+// the size bucket, and when the handler started
+struct RequestMetrics {
+    const VitalEdgeMetrics::Timer* route;
+    size_t bytes;
+    uint64_t start;
+};
+
+static RequestMetrics startRequest(const VitalEdgeMetrics::Timer& route, const HttpRequestPtr& req) {
+    return RequestMetrics{&route, req->body().size(), VitalEdgeMetrics::now()};
+}
+
+// The request's JSON body; Drogon parses it on first access, so this times the parse
+static std::shared_ptr<Json::Value> parseJson(const RequestMetrics& metrics, const HttpRequestPtr& req) {
+    VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Parse, metrics.bytes);
+    return req->getJsonObject();
+}
+
+// Run one phase of a request's work under its timer
+template <typename F>
+static auto timePhase(const RequestMetrics& metrics, VitalEdgeMetrics::Phase phase, F&& f) {
+    VitalEdgeMetrics::Scope scope(*metrics.route, phase, metrics.bytes);
+    return f();
+}
+
+// What a request leaves in the audit log when it completes: never key material
+// or payload, only which key, how much, and for whom
+struct AuditEntry {
+    VitalEdgeAudit::Operation operation;
+    std::string keyId;
+    std::string caller;
+    size_t bytes;
+};
+
+// Audit entry for a request using the named key (empty for a raw key), or none
+// while the audit log is off
+static std::optional<AuditEntry> auditEntry(VitalEdgeAudit::Operation operation, const HttpRequestPtr& req,
+                                            std::string_view keyId, size_t bytes) {
+    if (!VitalEdgeAudit::running()) return std::nullopt;
+    return AuditEntry{operation, std::string(keyId), req->peerAddr().toIp(), bytes};
+}
+
+// Same, for a JSON request naming its key with 'key_id'
+static std::optional<AuditEntry> auditRequest(VitalEdgeAudit::Operation operation, const HttpRequestPtr& req,
+                                              const Json::Value& json, size_t bytes) {
+    if (!VitalEdgeAudit::running()) return std::nullopt;
+    const Json::Value* keyId = json.find("key_id", "key_id" + 6);
+    return auditEntry(operation, req, keyId && keyId->isString() ? keyId->asString() : std::string(), bytes);
+}
+
+static void recordAudit(const std::optional<AuditEntry>& audit, bool ok) {
+    if (audit) VitalEdgeAudit::record(audit->operation, audit->keyId, audit->bytes, audit->caller, ok);
+}
+
+// Build the response for a request with work(): inline when cost is under the
+// threshold, otherwise on the crypto executor with the response handed back to
+// the event loop that received the request. An exception from work() becomes a
+// 500 with its message, as the single-item routes always returned, or a 400 for
+// std::invalid_argument (malformed base64, wrong key or IV size). The request's
+// total time, and its wait in the executor queue, go to its metrics; its outcome
+// goes to the audit log when it has an audit entry.
+static void dispatchCrypto(const RequestMetrics& metrics, std::optional<AuditEntry> audit, size_t cost,
+                           std::function<HttpResponsePtr()> work,
+                           std::function<void(const HttpResponsePtr&)>&& callback) {
+    auto run = [metrics](const std::function<HttpResponsePtr()>& work) {
+        try {
+            return work();
+        } catch (const std::invalid_argument& e) {
+            metrics.route->recordError();
+            return errorResponse(HttpStatusCode::k400BadRequest, e.what());
+        } catch (const std::exception& e) {
+            metrics.route->recordError();
+            return errorResponse(HttpStatusCode::k500InternalServerError, e.what());
+        } catch (...) {
+            // Anything else would escape to the executor, which swallows it, and
+            // leave the connection without a response
+            metrics.route->recordError();
+            return errorResponse(HttpStatusCode::k500InternalServerError, "Internal error");
+        }
+    };
+    auto finish = [metrics, audit = std::move(audit)](const std::function<void(const HttpResponsePtr&)>& callback,
+                                                      const HttpResponsePtr& resp) {
+        metrics.route->record(VitalEdgeMetrics::Phase::Total, metrics.bytes, VitalEdgeMetrics::now() - metrics.start);
+        recordAudit(audit, resp->getStatusCode() == HttpStatusCode::k200OK);
+        callback(resp);
+    };
+
+    if (cost < inlineThreshold) {
+        finish(callback, run(work));
+        return;
+    }
+
+    trantor::EventLoop* loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+    const uint64_t queued = VitalEdgeMetrics::now();
+    VitalEdgeExecutor::instance().submit([run, finish, metrics, queued, work = std::move(work),
+                                          callback = std::move(callback), loop] {
+        metrics.route->record(VitalEdgeMetrics::Phase::Queue, metrics.bytes, VitalEdgeMetrics::now() - queued);
+        HttpResponsePtr resp = run(work);
+        if (loop) {
+            loop->queueInLoop([finish, callback, resp] { finish(callback, resp); });
+        } else {
+            finish(callback, resp);
+        }
+    });
+}
+
+// Length of a JSON string member, used as the crypto cost of a request
+static size_t stringLength(const Json::Value& value) {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    return value.isString() && value.getString(&begin, &end) ? size_t(end - begin) : 0;
+}
+
+// View a string member of a batch item without copying it out of the JSON document
+static bool stringMember(const Json::Value& item, const char* name, std::string_view& out) {
+    const Json::Value* member = item.find(name, name + strlen(name));
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    if (!member || !member->isString() || !member->getString(&begin, &end)) return false;
+    out = std::string_view(begin, end - begin);
+    return true;
+}
+
+// Answer a request naming a session that is unknown or has expired; the client
+// should run the handshake again
+static void unknownSession(const std::optional<AuditEntry>& audit,
+                           std::function<void(const HttpResponsePtr&)>& callback) {
+    recordAudit(audit, false);
+    callback(errorResponse(HttpStatusCode::k401Unauthorized, "Unknown or expired session_id."));
+}
+
+// Keyring entry named by a request's 'key_id' member, if it has one: the current
+// version, or the one in 'key_version'. Returns false after answering with a 400
+// (and auditing the failure) when that is not a known key. A 'session_id' names
+// the key of a live session instead (see VitalEdgeSession), or answers 401.
+static bool lookupKeyId(const Json::Value& json, VitalEdgeKeyring::EntryPtr& entry,
+                        const std::optional<AuditEntry>& audit,
+                        std::function<void(const HttpResponsePtr&)>& callback) {
+    std::string_view sessionId;
+    if (stringMember(json, "session_id", sessionId)) {
+        entry = VitalEdgeSession::find(sessionId);
+        if (!entry) unknownSession(audit, callback);
+        return entry != nullptr;
+    }
+    if (!json.isMember("key_id")) return true;
+    const Json::Value& version = json["key_version"];
+    if (version.isNull()) {
+        entry = VitalEdgeCrypto::KeyManager::findKey(json["key_id"].asString());
+    } else if (version.isUInt() && version.asUInt() > 0) {
+        entry = VitalEdgeCrypto::KeyManager::findKey(json["key_id"].asString(), version.asUInt());
+    }
+    if (!entry) {
+        recordAudit(audit, false);
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               version.isNull() ? "Unknown key_id." : "Unknown key_id or key_version."));
+        return false;
+    }
+    return true;
+}
+
+// Same, for the binary routes' X-VitalEdge-Key-Id and X-VitalEdge-Key-Version
+// headers, or X-VitalEdge-Session
+static bool lookupKeyHeaders(const HttpRequestPtr& req, VitalEdgeKeyring::EntryPtr& entry,
+                             const std::optional<AuditEntry>& audit,
+                             std::function<void(const HttpResponsePtr&)>& callback) {
+    const std::string& sessionId = req->getHeader("x-vitaledge-session");
+    if (!sessionId.empty()) {
+        entry = VitalEdgeSession::find(sessionId);
+        if (!entry) unknownSession(audit, callback);
+        return entry != nullptr;
+    }
+    const std::string& keyId = req->getHeader("x-vitaledge-key-id");
+    const std::string& version = req->getHeader("x-vitaledge-key-version");
+    if (version.empty()) {
+        entry = VitalEdgeCrypto::KeyManager::findKey(keyId);
+    } else {
+        char* end = nullptr;
+        const unsigned long parsed = std::strtoul(version.c_str(), &end, 10);
+        if (!*end && parsed > 0 && parsed <= UINT32_MAX && version[0] != '-') {
+            entry = VitalEdgeCrypto::KeyManager::findKey(keyId, uint32_t(parsed));
+        }
+    }
+    if (!entry) {
+        recordAudit(audit, false);
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               version.empty() ? "Unknown key_id." : "Unknown key_id or key_version."));
+        return false;
+    }
+    return true;
+}
+
+// True for requests in the binary wire format (see VitalEdgeWire)
+static bool isBinary(const HttpRequestPtr& req) {
+    return req->contentType() == CT_APPLICATION_OCTET_STREAM;
+}
+
+static HttpResponsePtr binaryResponse(std::string&& body) {
+    auto resp = HttpResponse::newHttpResponse();
+    resp->setContentTypeCode(CT_APPLICATION_OCTET_STREAM);
+    resp->setBody(std::move(body));
+    return resp;
+}
+
+// Binary /encrypt and /decrypt: the request body is the payload, with the IV in
+// the X-VitalEdge-IV header and the key named by X-VitalEdge-Key-Id (or given raw
+// in X-VitalEdge-Key), and the response body is the raw output. The cipher reads
+// the payload in place and writes straight into the response body.
+static void handleAESBinary(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                            std::function<void(const HttpResponsePtr&)>&& callback, bool encrypt) {
+    const std::string& keyId = req->getHeader("x-vitaledge-key-id");
+    auto audit = auditEntry(encrypt ? VitalEdgeAudit::Operation::Encrypt : VitalEdgeAudit::Operation::Decrypt,
+                            req, keyId, req->body().size());
+    VitalEdgeKeyring::EntryPtr key;
+    const bool session = !req->getHeader("x-vitaledge-session").empty();
+    if (!keyId.empty() || session) {
+        if (!lookupKeyHeaders(req, key, audit, callback)) return;
+    } else if (req->getHeader("x-vitaledge-key").empty()) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: 'X-VitalEdge-Key-Id' (or 'X-VitalEdge-Key') header is required."));
+        return;
+    }
+
+    // The work holds the request, so the body it reads stays alive when offloaded
+    dispatchCrypto(metrics, std::move(audit), req->body().size(), [metrics, req, key, session, encrypt] {
+        const std::string_view input = req->body();
+        const std::string& iv = req->getHeader("x-vitaledge-iv");
+        if (!encrypt && VitalEdgeCrypto::isCompressed(input)) {
+            // Inflated output has no size bound known up front, so it is not written in place
+            VitalEdgeCrypto::SecureString plaintext;
+            timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                const std::string& raw = req->getHeader("x-vitaledge-key");
+                key ? VitalEdgeCrypto::decryptAESCompressed(input, *key, iv, plaintext)
+                    : VitalEdgeCrypto::decryptAESCompressed(input, std::string_view(raw), iv, plaintext);
+            });
+            auto resp = binaryResponse(std::string(plaintext.data(), plaintext.size()));
+            if (key && !session) resp->addHeader("X-VitalEdge-Key-Version", std::to_string(key->version()));
+            return resp;
+        }
+        std::string output(input.size() + VitalEdgeCrypto::kAESBlockSize, '\0');
+        const size_t length = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            if (key) {
+                return encrypt ? VitalEdgeCrypto::encryptAES(input, *key, iv, &output[0])
+                               : VitalEdgeCrypto::decryptAES(input, *key, iv, &output[0]);
+            }
+            const std::string& raw = req->getHeader("x-vitaledge-key");
+            return encrypt ? VitalEdgeCrypto::encryptAES(input, std::string_view(raw), iv, &output[0])
+                           : VitalEdgeCrypto::decryptAES(input, std::string_view(raw), iv, &output[0]);
+        });
+        output.resize(length);
+        auto resp = binaryResponse(std::move(output));
+        if (key && !session) resp->addHeader("X-VitalEdge-Key-Version", std::to_string(key->version()));
+        return resp;
+    }, std::move(callback));
+}
+
+// Binary /encrypt/batch and /decrypt/batch: items framed as VitalEdgeWire
+// describes, each read in place from the request body and written in place into
+// the response body, with per-item errors as in the JSON form
+static void handleAESBatchBinary(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                                 std::function<void(const HttpResponsePtr&)>&& callback, bool encrypt) {
+    std::shared_ptr<std::vector<VitalEdgeWire::Item>> items;
+    try {
+        items = std::make_shared<std::vector<VitalEdgeWire::Item>>(
+            VitalEdgeWire::parseBatch(req->body(), kMaxBatchItems));
+    } catch (const std::invalid_argument& e) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, e.what()));
+        return;
+    }
+    size_t cost = 0;
+    for (const auto& item : *items) cost += item.data.size();
+
+    std::string caller = VitalEdgeAudit::running() ? req->peerAddr().toIp() : std::string();
+    dispatchCrypto(metrics, std::nullopt, cost, [metrics, req, items, caller, encrypt] {
+        size_t reserve = 0;
+        for (const auto& item : *items) {
+            reserve += VitalEdgeWire::kItemHeaderSize + item.data.size() + VitalEdgeCrypto::kAESBlockSize;
+        }
+        VitalEdgeWire::BatchWriter writer(reserve);
+        const bool auditing = VitalEdgeAudit::running();
+        const auto operation = encrypt ? VitalEdgeAudit::Operation::EncryptBatch
+                                       : VitalEdgeAudit::Operation::DecryptBatch;
+
+        VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Crypto, metrics.bytes);
+        std::string_view lastKeyId;
+        uint32_t lastVersion = 0;
+        VitalEdgeKeyring::EntryPtr key; // batches usually repeat one key_id
+        for (const auto& item : *items) {
+            bool ok = false;
+            try {
+                char* out = writer.output(item.data.size() + VitalEdgeCrypto::kAESBlockSize);
+                if (!item.keyId.empty()) {
+                    if (!key || item.keyId != lastKeyId || item.keyVersion != lastVersion) {
+                        const std::string keyId(item.keyId);
+                        key = item.keyVersion ? VitalEdgeCrypto::KeyManager::findKey(keyId, item.keyVersion)
+                                              : VitalEdgeCrypto::KeyManager::findKey(keyId);
+                        lastKeyId = item.keyId;
+                        lastVersion = item.keyVersion;
+                    }
+                    if (!key) throw std::invalid_argument("Unknown key_id or key version.");
+                    writer.commit(encrypt ? VitalEdgeCrypto::encryptAES(item.data, *key, item.iv, out)
+                                          : VitalEdgeCrypto::decryptAES(item.data, *key, item.iv, out),
+                                  key->version());
+                } else {
+                    writer.commit(encrypt ? VitalEdgeCrypto::encryptAES(item.data, item.key, item.iv, out)
+                                          : VitalEdgeCrypto::decryptAES(item.data, item.key, item.iv, out));
+                }
+                ok = true;
+            } catch (const std::exception& e) {
+                writer.fail(e.what());
+            }
+            if (auditing) VitalEdgeAudit::record(operation, item.keyId, item.data.size(), caller, ok);
+        }
+        return binaryResponse(writer.take());
+    }, std::move(callback));
+}
+
+// Shared body of /encrypt/batch and /decrypt/batch. Each entry of 'items' is an
+// object like the single-item routes take (a 'key_id', optionally with a
+// 'key_version', or a raw 'key'); results come back in the same order, with an
+// 'error' member for any item that failed and, for encryption under a key_id,
+// the 'key_version' used.
+static void handleAESBatch(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                           std::function<void(const HttpResponsePtr&)>&& callback, bool encrypt) {
+    auto json = parseJson(metrics, req);
+    if (!json || !json->isMember("items") || !(*json)["items"].isArray()) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, "Invalid request: 'items' array is required."));
+        return;
+    }
+    const Json::Value& items = (*json)["items"];
+    if (items.size() > kMaxBatchItems) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: at most " + std::to_string(kMaxBatchItems) + " items per batch."));
+        return;
+    }
+
+    // Items are views into the parsed document, which the work below keeps alive,
+    // and into keyring entries held by 'keys' for the same reason
+    auto batch = std::make_shared<std::vector<VitalEdgeCrypto::BatchItem>>(items.size());
+    auto keys = std::make_shared<std::vector<VitalEdgeKeyring::EntryPtr>>(items.size());
+    auto errors = std::make_shared<std::vector<const char*>>(items.size(), nullptr);
+    auto keyIds = std::make_shared<std::vector<std::string_view>>(items.size());
+    size_t cost = 0;
+    for (Json::ArrayIndex i = 0; i < items.size(); ++i) {
+        auto& item = (*batch)[i];
+        std::string_view& keyId = (*keyIds)[i];
+        bool valid = items[i].isObject() && stringMember(items[i], "data", item.data) &&
+                     stringMember(items[i], "iv", item.iv);
+        if (valid && stringMember(items[i], "key_id", keyId)) {
+            // As for /decrypt, 'key_version' names a version other than the current one
+            const Json::Value& version = items[i]["key_version"];
+            if (version.isNull()) {
+                (*keys)[i] = VitalEdgeCrypto::KeyManager::findKey(std::string(keyId));
+            } else if (version.isUInt() && version.asUInt() > 0) {
+                (*keys)[i] = VitalEdgeCrypto::KeyManager::findKey(std::string(keyId), version.asUInt());
+            }
+            item.entry = (*keys)[i].get();
+            if (!item.entry) (*errors)[i] = version.isNull() ? "Unknown key_id." : "Unknown key_id or key_version.";
+        } else if (!valid || !stringMember(items[i], "key", item.key)) {
+            (*errors)[i] = "Invalid item: 'data', 'iv', and 'key_id' (or 'key') strings are required.";
+        }
+        if ((*errors)[i]) item = VitalEdgeCrypto::BatchItem();
+        cost += item.data.size();
+    }
+
+    // Each item is audited on its own, with its own key_id and outcome
+    std::string caller = VitalEdgeAudit::running() ? req->peerAddr().toIp() : std::string();
+    dispatchCrypto(metrics, std::nullopt, cost, [metrics, json, batch, keys, errors, keyIds, caller, encrypt] {
+        std::vector<std::string> ciphertexts;
+        if (!encrypt) {
+            // Ciphertext arrives base64-encoded, as for /decrypt
+            VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Decode, metrics.bytes);
+            ciphertexts.reserve(batch->size());
+            for (size_t i = 0; i < batch->size(); ++i) {
+                if ((*errors)[i]) continue;
+                try {
+                    ciphertexts.push_back(VitalEdgeBase64::decode((*batch)[i].data));
+                } catch (const std::invalid_argument&) {
+                    (*errors)[i] = "Invalid item: 'data' is not valid base64.";
+                    (*batch)[i] = VitalEdgeCrypto::BatchItem();
+                    continue;
+                }
+                (*batch)[i].data = ciphertexts.back();
+            }
+        }
+
+        VitalEdgeCrypto::BatchResult result = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            return encrypt ? VitalEdgeCrypto::encryptAESBatch(batch->data(), batch->size())
+                           : VitalEdgeCrypto::decryptAESBatch(batch->data(), batch->size());
+        });
+        if (VitalEdgeAudit::running()) {
+            const auto operation = encrypt ? VitalEdgeAudit::Operation::EncryptBatch
+                                           : VitalEdgeAudit::Operation::DecryptBatch;
+            for (size_t i = 0; i < result.size(); ++i) {
+                VitalEdgeAudit::record(operation, (*keyIds)[i], (*batch)[i].data.size(), caller,
+                                       !(*errors)[i] && result.ok(i));
+            }
+        }
+
+        VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+        Json::Value results(Json::arrayValue);
+        for (size_t i = 0; i < result.size(); ++i) {
+            Json::Value entry;
+            if ((*errors)[i]) {
+                entry["error"] = (*errors)[i];
+            } else if (!result.ok(i)) {
+                entry["error"] = result.errors[i];
+            } else if (encrypt) {
+                std::string_view output = result.output(i);
+                entry["encrypted"] = VitalEdgeBase64::encode(output);
+                // Which version to ask for when decrypting after the key is rotated
+                if ((*keys)[i]) entry["key_version"] = (*keys)[i]->version();
+            } else {
+                std::string_view output = result.output(i);
+                entry["decrypted"] = Json::Value(output.data(), output.data() + output.size());
+            }
+            results.append(std::move(entry));
+        }
+
+        Json::Value jsonResp;
+        jsonResp["results"] = std::move(results);
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// One field selector of a /encrypt/fields or /decrypt/fields request: a compiled
+// path and the key for the values it selects
+struct FieldRule {
+    VitalEdgeFieldPath::Ptr path;
+    VitalEdgeKeyring::EntryPtr key;
+};
+
+// A value to seal or open, found by walking a document along a rule's path, and
+// where it sits in that document ("contacts[2].phone"), which it is sealed to
+struct FieldTarget {
+    Json::Value* value;
+    const FieldRule* rule;
+    std::string path;
+};
+
+// Fields handled per executor task when a large request fans out
+static constexpr size_t kFieldsPerTask = 64;
+
+// True if some document value could be selected by both paths, which would seal
+// it twice or seal a value inside another one being sealed
+static bool pathsOverlap(const VitalEdgeFieldPath& a, const VitalEdgeFieldPath& b) {
+    using Kind = VitalEdgeFieldPath::Segment::Kind;
+    const size_t common = std::min(a.segments().size(), b.segments().size());
+    for (size_t i = 0; i < common; ++i) {
+        const auto& x = a.segments()[i];
+        const auto& y = b.segments()[i];
+        if ((x.kind == Kind::Member) != (y.kind == Kind::Member)) return false;
+        if (x.kind == Kind::Member && x.name != y.name) return false;
+        if (x.kind == Kind::Index && y.kind == Kind::Index && x.index != y.index) return false;
+    }
+    return true;
+}
+
+// Compile a request's 'fields': each entry is a path string using the request's
+// 'key_id', or an object with its own 'path' and 'key_id'. Throws
+// std::invalid_argument naming the first bad entry.
+static std::vector<FieldRule> compileFieldRules(const Json::Value& json) {
+    const Json::Value& fields = json["fields"];
+    const Json::Value& defaultKeyId = json["key_id"];
+    std::vector<FieldRule> rules;
+    rules.reserve(fields.size());
+    for (const Json::Value& field : fields) {
+        const Json::Value& path = field.isObject() ? field["path"] : field;
+        const Json::Value& keyId = field.isObject() && field.isMember("key_id") ? field["key_id"] : defaultKeyId;
+        if (!path.isString() || !keyId.isString()) {
+            throw std::invalid_argument("Invalid request: each field needs a 'path' and a 'key_id'.");
+        }
+        FieldRule rule{VitalEdgeFieldPath::compile(path.asString()),
+                       VitalEdgeCrypto::KeyManager::findKey(keyId.asString())};
+        if (!rule.key) throw std::invalid_argument("Unknown key_id '" + keyId.asString() + "'.");
+        for (const FieldRule& other : rules) {
+            if (pathsOverlap(*rule.path, *other.path)) {
+                throw std::invalid_argument("Field paths '" + other.path->text() + "' and '" + rule.path->text() +
+                                            "' overlap.");
+            }
+        }
+        rules.push_back(std::move(rule));
+    }
+    return rules;
+}
+
+// Add every non-null value selected by rule's path, from segment 'depth' on, under
+// node, whose concrete path is 'path'. Members and elements that are absent are
+// skipped. Member names cannot hold '.', '[' or ']', so concrete paths are
+// unambiguous.
+static void collectFields(Json::Value& node, const FieldRule& rule, size_t depth, std::string& path,
+                          std::vector<FieldTarget>& out) {
+    using Kind = VitalEdgeFieldPath::Segment::Kind;
+    const auto& segments = rule.path->segments();
+    if (depth == segments.size()) {
+        if (!node.isNull()) out.push_back(FieldTarget{&node, &rule, path});
+        return;
+    }
+    const size_t length = path.size();
+    const auto& segment = segments[depth];
+    if (segment.kind == Kind::Member) {
+        if (!node.isObject()) return;
+        const Json::Value* child = node.find(segment.name.data(), segment.name.data() + segment.name.size());
+        if (!child) return;
+        if (!path.empty()) path += '.';
+        path += segment.name;
+        collectFields(const_cast<Json::Value&>(*child), rule, depth + 1, path, out);
+    } else if (node.isArray()) {
+        if (segment.kind == Kind::Index && segment.index >= node.size()) return;
+        const Json::ArrayIndex first = segment.kind == Kind::Index ? Json::ArrayIndex(segment.index) : 0;
+        const Json::ArrayIndex last = segment.kind == Kind::Index ? first + 1 : node.size();
+        for (Json::ArrayIndex i = first; i < last; ++i) {
+            path += '[' + std::to_string(i) + ']';
+            collectFields(node[i], rule, depth + 1, path, out);
+            path.resize(length);
+        }
+    }
+    path.resize(length);
+}
+
+// Sealed values carry a type byte so they open to the same JSON type: 's' for a
+// string (its raw bytes), 'j' for anything else (its compact JSON text)
+static void sealField(const FieldTarget& target) {
+    static const Json::StreamWriterBuilder compact = [] {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    std::string plaintext(1, 's');
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    if (target.value->getString(&begin, &end)) {
+        plaintext.append(begin, end);
+    } else {
+        plaintext[0] = 'j';
+        plaintext += Json::writeString(compact, *target.value);
+    }
+    *target.value = VitalEdgeCrypto::encryptField(plaintext, *target.rule->key, target.path);
+}
+
+static void openField(const FieldTarget& target) {
+    static const Json::CharReaderBuilder reader;
+    const std::string& path = target.path;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::string plaintext;
+    try {
+        if (!target.value->getString(&begin, &end)) throw std::invalid_argument("Field value is not a string");
+        plaintext = VitalEdgeCrypto::decryptField(std::string_view(begin, end - begin), *target.rule->key, path);
+    } catch (const std::invalid_argument& e) {
+        throw std::invalid_argument("Cannot decrypt '" + path + "': " + e.what() + ".");
+    }
+
+    if (!plaintext.empty() && plaintext[0] == 's') {
+        *target.value = Json::Value(plaintext.data() + 1, plaintext.data() + plaintext.size());
+        return;
+    }
+    Json::Value value;
+    std::string errors;
+    std::unique_ptr<Json::CharReader> parser(reader.newCharReader());
+    if (plaintext.empty() || plaintext[0] != 'j' || !parser->parse(plaintext.data() + 1, plaintext.data() + plaintext.size(), &value,
+                                              &errors)) {
+        throw std::invalid_argument("Cannot decrypt '" + path + "': unrecognised sealed value.");
+    }
+    *target.value = std::move(value);
+}
+
+// Shared body of /encrypt/fields and /decrypt/fields: seal or open the values at
+// each of 'fields' in 'document' (or in every one of 'documents') in place and
+// return the document(s). Requests large enough to be offloaded split their
+// fields across the crypto executor.
+static void handleFields(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                         std::function<void(const HttpResponsePtr&)>&& callback, bool encrypt) {
+    auto json = parseJson(metrics, req);
+    const char* member = json && json->isMember("documents") ? "documents" : "document";
+    if (!json || !(*json)["fields"].isArray() || (*json)["fields"].empty() ||
+        (strcmp(member, "documents") == 0 ? !(*json)[member].isArray() : !json->isMember(member))) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: 'fields' and 'document' (or a 'documents' array) are required."));
+        return;
+    }
+    if (strcmp(member, "documents") == 0 && (*json)[member].size() > kMaxBatchItems) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: at most " + std::to_string(kMaxBatchItems) + " documents per request."));
+        return;
+    }
+
+    auto audit = auditRequest(encrypt ? VitalEdgeAudit::Operation::EncryptFields
+                                      : VitalEdgeAudit::Operation::DecryptFields,
+                              req, *json, metrics.bytes);
+    std::shared_ptr<std::vector<FieldRule>> rules;
+    try {
+        rules = std::make_shared<std::vector<FieldRule>>(compileFieldRules(*json));
+    } catch (const std::invalid_argument& e) {
+        recordAudit(audit, false);
+        callback(errorResponse(HttpStatusCode::k400BadRequest, e.what()));
+        return;
+    }
+
+    const size_t cost = metrics.bytes;
+    dispatchCrypto(metrics, std::move(audit), cost, [metrics, json, rules, member, cost, encrypt] {
+        Json::Value& documents = (*json)[member];
+        std::vector<FieldTarget> targets;
+        auto collect = [&](Json::Value& document) {
+            std::string path;
+            for (const FieldRule& rule : *rules) collectFields(document, rule, 0, path, targets);
+        };
+        if (strcmp(member, "documents") == 0) {
+            for (Json::Value& document : documents) collect(document);
+        } else {
+            collect(documents);
+        }
+
+        timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            auto process = encrypt ? sealField : openField;
+            const size_t tasks = (targets.size() + kFieldsPerTask - 1) / kFieldsPerTask;
+            // Only requests already running on the executor fan out; inline ones
+            // must not park their event loop waiting for the pool
+            if (cost >= inlineThreshold && tasks > 1) {
+                VitalEdgeExecutor::instance().parallelFor(tasks, [&](size_t task) {
+                    const size_t end = std::min(targets.size(), (task + 1) * kFieldsPerTask);
+                    for (size_t i = task * kFieldsPerTask; i < end; ++i) process(targets[i]);
+                });
+            } else {
+                for (const FieldTarget& target : targets) process(target);
+            }
+        });
+
+        Json::Value jsonResp;
+        jsonResp[member].swap(documents);
+        jsonResp["fields"] = Json::UInt64(targets.size());
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// Shared body of /tokenize and /detokenize. Tokenize turns each of 'values' into
+// its deterministic token under 'key_id' and the optional 'context', storing the
+// pair in the token vault when one is open. Detokenize looks each of 'tokens' up
+// in the vault and returns the values in the same order, null for a token that
+// is unknown or was not made with this key and context.
+static void handleTokens(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                         std::function<void(const HttpResponsePtr&)>&& callback, bool tokenize) {
+    const char* member = tokenize ? "values" : "tokens";
+    auto json = parseJson(metrics, req);
+    if (!json || !(*json)["key_id"].isString() || !(*json)[member].isArray() ||
+        (json->isMember("context") && !(*json)["context"].isString())) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, std::string("Invalid request: 'key_id' and a '") +
+                                                                   member + "' array are required."));
+        return;
+    }
+    if ((*json)[member].size() > kMaxBatchItems) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, "Invalid request: at most " +
+                                                                   std::to_string(kMaxBatchItems) + " " + member +
+                                                                   " per request."));
+        return;
+    }
+    VitalEdgeTokenVault* vault = VitalEdgeTokenVault::instance();
+    if (!tokenize && !vault) {
+        callback(errorResponse(HttpStatusCode::k503ServiceUnavailable, "No token vault is configured."));
+        return;
+    }
+
+    auto audit = auditRequest(tokenize ? VitalEdgeAudit::Operation::Tokenize : VitalEdgeAudit::Operation::Detokenize,
+                              req, *json, metrics.bytes);
+    VitalEdgeKeyring::EntryPtr key;
+    if (!lookupKeyId(*json, key, audit, callback)) return;
+
+    dispatchCrypto(metrics, std::move(audit), metrics.bytes, [metrics, json, key, vault, member, tokenize] {
+        std::string_view context;
+        stringMember(*json, "context", context);
+        const Json::Value& items = (*json)[member];
+        Json::Value results(Json::arrayValue);
+        unsigned char token[VitalEdgeCrypto::kTokenSize];
+        unsigned char check[VitalEdgeCrypto::kTokenSize];
+        VitalEdgeCrypto::SecureString value;
+
+        VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Crypto, metrics.bytes);
+        for (const Json::Value& item : items) {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+            if (!item.getString(&begin, &end)) {
+                throw std::invalid_argument(std::string("Invalid request: '") + member + "' must all be strings.");
+            }
+            if (tokenize) {
+                std::string_view plaintext(begin, end - begin);
+                VitalEdgeCrypto::tokenize(plaintext, *key, context, token);
+                if (vault) vault->insert(token, plaintext, *key);
+                results.append(VitalEdgeCrypto::tokenToHex(token));
+                continue;
+            }
+            // Tokens of other keys or contexts share the vault: a value opens only
+            // under the key that sealed it, and is returned only for a token this
+            // request's context would have produced
+            if (VitalEdgeCrypto::tokenFromHex(std::string_view(begin, end - begin), token) &&
+                vault->find(token, *key, value)) {
+                VitalEdgeCrypto::tokenize(value, *key, context, check);
+                if (std::memcmp(token, check, sizeof(token)) == 0) {
+                    results.append(Json::Value(value.data(), value.data() + value.size()));
+                    continue;
+                }
+            }
+            results.append(Json::Value());
+        }
+
+        Json::Value jsonResp;
+        jsonResp[tokenize ? "tokens" : "values"] = std::move(results);
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// Key sizes /keys/generate accepts, in bytes
+static constexpr Json::UInt kMinGeneratedKey = 16;
+static constexpr Json::UInt kMaxGeneratedKey = 64;
+
+// /keys/generate: 'count' fresh random keys of 'length' bytes (default 1 of 32),
+// base64-encoded. All of them come from one call into the thread's DRBG.
+static void handleGenerateKeys(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                               std::function<void(const HttpResponsePtr&)>&& callback) {
+    auto json = parseJson(metrics, req);
+    const Json::Value& count = json ? (*json)["count"] : Json::Value::nullSingleton();
+    const Json::Value& length = json ? (*json)["length"] : Json::Value::nullSingleton();
+    if (!json || (!count.isNull() && !count.isUInt()) || (!length.isNull() && !length.isUInt())) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: 'count' and 'length' must be positive integers."));
+        return;
+    }
+    const Json::UInt keys = count.isNull() ? 1 : count.asUInt();
+    const Json::UInt keySize = length.isNull() ? 32 : length.asUInt();
+    if (keys == 0 || keys > kMaxBatchItems || keySize < kMinGeneratedKey || keySize > kMaxGeneratedKey) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: 'count' must be 1 to " + std::to_string(kMaxBatchItems) +
+                                   " and 'length' " + std::to_string(kMinGeneratedKey) + " to " +
+                                   std::to_string(kMaxGeneratedKey) + "."));
+        return;
+    }
+
+    const size_t cost = size_t(keys) * keySize;
+    auto audit = auditEntry(VitalEdgeAudit::Operation::GenerateKeys, req, "", cost);
+    dispatchCrypto(metrics, std::move(audit), cost, [metrics, keys, keySize, cost] {
+        VitalEdgeSecureMemory::Bytes material(cost);
+        timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            VitalEdgeRandom::privateBytes(material.data(), material.size());
+        });
+
+        VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+        Json::Value encoded(Json::arrayValue);
+        char key[VitalEdgeBase64::encodedSize(kMaxGeneratedKey)];
+        for (Json::UInt i = 0; i < keys; ++i) {
+            const size_t written = VitalEdgeBase64::encode(material.data() + size_t(i) * keySize, keySize, key);
+            encoded.append(Json::Value(key, key + written));
+        }
+        OPENSSL_cleanse(key, sizeof(key));
+
+        Json::Value jsonResp;
+        jsonResp["keys"] = std::move(encoded);
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// /keys/rotate: a fresh key becomes the next, current version of 'key_id' (which
+// may be new). Older versions stay loaded so existing ciphertexts still decrypt.
+static void handleRotateKey(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                            std::function<void(const HttpResponsePtr&)>&& callback) {
+    if (refuseInWorkers("/keys/rotate", callback)) return;
+    auto json = parseJson(metrics, req);
+    std::string_view keyId;
+    if (!json || !stringMember(*json, "key_id", keyId) || keyId.empty()) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, "Invalid request: 'key_id' is required."));
+        return;
+    }
+    if (!VitalEdgeKeyring::validKeyId(keyId)) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: 'key_id' must be 1 to 128 letters, digits, '.', '_' or '-'."));
+        return;
+    }
+
+    // Runs on the executor: the keyring file append is an fsync
+    auto audit = auditEntry(VitalEdgeAudit::Operation::RotateKey, req, keyId, 0);
+    dispatchCrypto(metrics, std::move(audit), inlineThreshold, [metrics, keyId = std::string(keyId)] {
+        VitalEdgeKeyring::EntryPtr key = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            return VitalEdgeCrypto::KeyManager::rotateKey(keyId, keyringFile);
+        });
+        Json::Value jsonResp;
+        jsonResp["key_id"] = keyId;
+        jsonResp["key_version"] = key->version();
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// /session: POST runs the key agreement for a client's Base64 X25519
+// 'public_key' and answers the session id, the server's public key and the
+// session lifetime; DELETE ends the session in 'session_id'.
+static void handleSession(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                          std::function<void(const HttpResponsePtr&)>&& callback) {
+    if (refuseInWorkers("/session", callback)) return;
+    auto json = parseJson(metrics, req);
+    if (req->method() == Delete) {
+        std::string_view sessionId;
+        if (!json || !stringMember(*json, "session_id", sessionId)) {
+            callback(errorResponse(HttpStatusCode::k400BadRequest, "Invalid request: 'session_id' is required."));
+            return;
+        }
+        auto audit = auditEntry(VitalEdgeAudit::Operation::CloseSession, req, "session", 0);
+        dispatchCrypto(metrics, std::move(audit), 0, [json, sessionId] {
+            Json::Value jsonResp;
+            jsonResp["closed"] = VitalEdgeSession::close(sessionId);
+            return HttpResponse::newHttpJsonResponse(jsonResp);
+        }, std::move(callback));
+        return;
+    }
+
+    std::string_view publicKey;
+    if (!json || !stringMember(*json, "public_key", publicKey)) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, "Invalid request: 'public_key' is required."));
+        return;
+    }
+
+    // Always offloaded: a key pair generation and an X25519 agreement
+    auto audit = auditEntry(VitalEdgeAudit::Operation::OpenSession, req, "session", 0);
+    dispatchCrypto(metrics, std::move(audit), inlineThreshold, [metrics, json, publicKey] {
+        std::string clientKey = timePhase(metrics, VitalEdgeMetrics::Phase::Decode, [&] {
+            return VitalEdgeBase64::decode(publicKey);
+        });
+        VitalEdgeSession::Handshake handshake = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+            return VitalEdgeSession::establish(clientKey);
+        });
+        Json::Value jsonResp;
+        jsonResp["session_id"] = handshake.sessionId;
+        jsonResp["public_key"] = VitalEdgeBase64::encode(handshake.publicKey);
+        jsonResp["expires_in"] = Json::UInt64(handshake.expiresIn);
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// Crypto cost of one Ed25519 item for dispatchCrypto: about what AES costs over
+// this many bytes, so a batch of signatures leaves the event loop
+static constexpr size_t kEd25519Cost = 16 * 1024;
+
+// The key of one /sign or /verify item, and the key_id it was named by
+struct SigningKey {
+    std::string_view keyId;
+    VitalEdgeKeyring::EntryPtr hmac;
+    VitalEdgeKeyCache::KeyPtr ed25519;
+};
+
+// Resolve an item's key: for 'algorithm' "hmac-sha256" (the default) the keyring
+// key 'key_id' (at 'key_version', if given); for "ed25519" the signing key
+// registered as 'key_id', or the PEM in 'private_key' (to sign) or 'public_key'
+// (to verify), parsed once per distinct PEM by VitalEdgeKeyCache. Returns the
+// item's error message, or nullptr.
+static const char* resolveSigningKey(const Json::Value& item, bool sign, SigningKey& key) {
+    std::string_view algorithm = "hmac-sha256";
+    if (item.isMember("algorithm") && !stringMember(item, "algorithm", algorithm)) {
+        return "Invalid item: 'algorithm' must be a string.";
+    }
+    stringMember(item, "key_id", key.keyId);
+    if (algorithm == "hmac-sha256") {
+        if (key.keyId.empty()) return "Invalid item: 'key_id' is required for hmac-sha256.";
+        const Json::Value& version = item["key_version"];
+        if (version.isNull()) {
+            key.hmac = VitalEdgeCrypto::KeyManager::findKey(std::string(key.keyId));
+        } else if (version.isUInt() && version.asUInt() > 0) {
+            key.hmac = VitalEdgeCrypto::KeyManager::findKey(std::string(key.keyId), version.asUInt());
+        }
+        return key.hmac ? nullptr : version.isNull() ? "Unknown key_id." : "Unknown key_id or key_version.";
+    }
+    if (algorithm != "ed25519") return "Invalid item: 'algorithm' must be \"hmac-sha256\" or \"ed25519\".";
+
+    std::string_view pem;
+    if (!key.keyId.empty()) {
+        key.ed25519 = VitalEdgeCrypto::KeyManager::findSigningKey(std::string(key.keyId));
+        if (!key.ed25519) return "Unknown signing key_id.";
+    } else if (stringMember(item, sign ? "private_key" : "public_key", pem)) {
+        try {
+            key.ed25519 = sign ? VitalEdgeKeyCache::privateKey(std::string(pem))
+                               : VitalEdgeKeyCache::publicKey(std::string(pem));
+        } catch (const std::exception&) {
+            return "Invalid item: the key is not a valid PEM key.";
+        }
+        if (!key.ed25519->isEd25519()) return "Invalid item: the key is not an Ed25519 key.";
+    } else {
+        return sign ? "Invalid item: 'key_id' or 'private_key' is required for ed25519."
+                    : "Invalid item: 'key_id' or 'public_key' is required for ed25519.";
+    }
+    if (sign && !key.ed25519->isPrivate()) return "Signing key_id has no private key.";
+    return nullptr;
+}
+
+// Shared body of /sign, /verify and their batch routes. A single request is one
+// item: the message in 'data' (signed as sent), its key as above and, to verify,
+// the base64 'signature'. It answers {"signature"} or {"valid"}, or 400 with the
+// item's error. A batch carries 'items' and answers 'results' in the same order,
+// with {"error"} for an item that could not be processed. Verifying more than
+// VitalEdgeCrypto::kParallelVerifyItems items always runs on the executor, which
+// spreads them across its threads.
+static void handleSignatures(const RequestMetrics& metrics, const HttpRequestPtr& req,
+                             std::function<void(const HttpResponsePtr&)>&& callback, bool sign, bool batch) {
+    auto json = parseJson(metrics, req);
+    if (!json || !json->isObject() || (batch && !(*json)["items"].isArray())) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest, batch ? "Invalid request: 'items' array is required."
+                                                                     : "Invalid request: a JSON object is required."));
+        return;
+    }
+    const Json::Value& items = batch ? (*json)["items"] : *json;
+    const size_t count = batch ? items.size() : 1;
+    if (count > kMaxBatchItems) {
+        callback(errorResponse(HttpStatusCode::k400BadRequest,
+                               "Invalid request: at most " + std::to_string(kMaxBatchItems) + " items per batch."));
+        return;
+    }
+
+    // Items are views into the parsed document, which the work below keeps alive
+    struct Item {
+        std::string_view data;
+        std::string_view signature;
+        SigningKey key;
+        const char* error = nullptr;
+    };
+    auto parsed = std::make_shared<std::vector<Item>>(count);
+    size_t cost = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const Json::Value& source = batch ? items[Json::ArrayIndex(i)] : items;
+        Item& item = (*parsed)[i];
+        if (!source.isObject() || !stringMember(source, "data", item.data) ||
+            (!sign && !stringMember(source, "signature", item.signature))) {
+            item.error = sign ? "Invalid item: 'data' string is required."
+                              : "Invalid item: 'data' and 'signature' strings are required.";
+        } else {
+            item.error = resolveSigningKey(source, sign, item.key);
+        }
+        cost += item.data.size() + (item.key.ed25519 ? kEd25519Cost : 0);
+    }
+
+    std::optional<AuditEntry> audit;
+    if (!batch) {
+        const Item& item = parsed->front();
+        audit = auditEntry(sign ? VitalEdgeAudit::Operation::Sign : VitalEdgeAudit::Operation::Verify, req,
+                           item.key.keyId, item.data.size());
+        if (item.error) {
+            recordAudit(audit, false);
+            callback(errorResponse(HttpStatusCode::k400BadRequest, item.error));
+            return;
+        }
+    } else if (!sign && count > VitalEdgeCrypto::kParallelVerifyItems) {
+        // Fanning out from the event loop would park it waiting for the pool
+        cost = std::max(cost, inlineThreshold);
+    }
+
+    // Batch items are audited on their own, with their own key_id and outcome
+    std::string caller = batch && VitalEdgeAudit::running() ? req->peerAddr().toIp() : std::string();
+    dispatchCrypto(metrics, std::move(audit), cost, [metrics, json, parsed, caller, sign, batch] {
+        std::vector<Item>& work = *parsed;
+        std::vector<std::string> signatures(work.size());
+        std::vector<uint8_t> valid;
+        if (sign) {
+            timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                for (size_t i = 0; i < work.size(); ++i) {
+                    const Item& item = work[i];
+                    if (item.error) continue;
+                    signatures[i] = item.key.hmac ? VitalEdgeCrypto::signHMAC(item.data, *item.key.hmac)
+                                                  : VitalEdgeCrypto::signEd25519(item.data, *item.key.ed25519);
+                }
+            });
+        } else {
+            timePhase(metrics, VitalEdgeMetrics::Phase::Decode, [&] {
+                for (size_t i = 0; i < work.size(); ++i) {
+                    if (work[i].error) continue;
+                    try {
+                        signatures[i] = VitalEdgeBase64::decode(work[i].signature);
+                    } catch (const std::invalid_argument&) {
+                        work[i].error = "Invalid item: 'signature' is not valid base64.";
+                    }
+                }
+            });
+            std::vector<VitalEdgeCrypto::VerifyItem> checks(work.size());
+            for (size_t i = 0; i < work.size(); ++i) {
+                if (work[i].error) continue;
+                checks[i] = {work[i].data, signatures[i], work[i].key.hmac.get(), work[i].key.ed25519.get()};
+            }
+            valid = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                return VitalEdgeCrypto::verifyBatch(checks.data(), checks.size());
+            });
+        }
+        if (!batch && work.front().error) throw std::invalid_argument(work.front().error);
+
+        if (batch && VitalEdgeAudit::running()) {
+            const auto operation = sign ? VitalEdgeAudit::Operation::SignBatch : VitalEdgeAudit::Operation::VerifyBatch;
+            for (const Item& item : work) {
+                VitalEdgeAudit::record(operation, item.key.keyId, item.data.size(), caller, !item.error);
+            }
+        }
+
+        VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+        Json::Value results(Json::arrayValue);
+        for (size_t i = 0; i < work.size(); ++i) {
+            Json::Value entry;
+            if (work[i].error) {
+                entry["error"] = work[i].error;
+            } else if (sign) {
+                entry["signature"] = VitalEdgeBase64::encode(signatures[i]);
+                if (work[i].key.hmac) entry["key_version"] = work[i].key.hmac->version();
+            } else {
+                entry["valid"] = valid[i] != 0;
+            }
+            if (!batch) return HttpResponse::newHttpJsonResponse(entry);
+            results.append(std::move(entry));
+        }
+
+        Json::Value jsonResp;
+        jsonResp["results"] = std::move(results);
+        return HttpResponse::newHttpJsonResponse(jsonResp);
+    }, std::move(callback));
+}
+
+// One /encrypt/stream request: request-body chunks are encrypted as they arrive
+// and forwarded to the streamed response, so memory stays bounded by the chunk
+// size rather than the payload. Both callbacks run on the request's event loop.
+//
+// A client that reads the response slower than it sends the body would leave the
+// ciphertext queued on the connection, so once kMaxUnsentBytes are waiting the
+// job stops reading the request and resumes when the queue has drained.
+class EncryptStreamJob : public std::enable_shared_from_this<EncryptStreamJob> {
+public:
+    static constexpr size_t kMaxUnsentBytes = 1 << 20;
+    static constexpr double kDrainPollSeconds = 0.005;
+
+    EncryptStreamJob(std::string_view key, std::string_view iv) : cipher_(key, iv, true) {}
+    EncryptStreamJob(const VitalEdgeKeyring::Entry& key, std::string_view iv) : cipher_(key, iv, true) {}
+
+    // Record the request in the audit log when it ends
+    void audit(AuditEntry entry) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        audit_ = std::move(entry);
+    }
+
+    // Pause reading the request body on connection while more than kMaxUnsentBytes
+    // of output wait to be written, and resume once half of it has drained. The
+    // connection's own callbacks belong to Drogon and stay untouched: unsent output
+    // is what this job queued minus what the connection has sent since, polled
+    // from its event loop while paused. Call before the body starts arriving.
+    void throttle(const trantor::TcpConnectionPtr& connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = connection;
+        sentAtStart_ = connection->bytesSent();
+    }
+
+    // Drogon opened the response: flush anything produced before it existed
+    void attach(ResponseStreamPtr response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_.empty()) {
+            response->send(pending_);
+            queued_ += pending_.size();
+            std::string().swap(pending_);
+        }
+        if (done_) {
+            response->close();
+        } else {
+            response_ = std::move(response);
+        }
+    }
+
+    void consume(const char* data, size_t length) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_) return;
+        scratch_.resize(VitalEdgeStreamCipher::maxUpdateOutput(length));
+        consumed_ += length;
+        try {
+            const uint64_t start = VitalEdgeMetrics::now();
+            size_t written = cipher_.update((const unsigned char*)data, length, (unsigned char*)&scratch_[0]);
+            timer().record(VitalEdgeMetrics::Phase::Crypto, length, VitalEdgeMetrics::now() - start);
+            emit(written);
+        } catch (const std::exception&) {
+            // Headers are already out: end the body early so the client sees a short read
+            close(true);
+        }
+    }
+
+    void finish(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_) return;
+        bool failed = bool(error);
+        if (!error) {
+            scratch_.resize(VitalEdgeStreamCipher::kBlockSize);
+            try {
+                emit(cipher_.finish((unsigned char*)&scratch_[0]));
+            } catch (const std::exception&) {
+                // Same as a failed update: the body just ends early
+                failed = true;
+            }
+        }
+        close(failed);
+    }
+
+private:
+    void emit(size_t length) {
+        if (length == 0) return;
+        if (response_) {
+            response_->send(scratch_.substr(0, length));
+            queued_ += length;
+        } else {
+            // Nothing drains this until the response opens; attach() sends it
+            pending_.append(scratch_, 0, length);
+        }
+        if (unsent() >= kMaxUnsentBytes) pause();
+    }
+
+    // Output not yet written to the socket. Response headers and chunk framing
+    // count as sent without having been queued here, which only errs towards
+    // resuming a little early.
+    size_t unsent() const {
+        auto connection = connection_.lock();
+        if (!connection) return 0;
+        const size_t sent = connection->bytesSent() - sentAtStart_;
+        return pending_.size() + (queued_ > sent ? queued_ - sent : 0);
+    }
+
+    // Both run on the connection's event loop with mutex_ held
+    void pause() {
+        if (paused_) return;
+        auto connection = connection_.lock();
+        if (!connection) return;
+        paused_ = true;
+        connection->stopRecv();
+        pollDrain(connection->getLoop());
+    }
+
+    void resume() {
+        if (!paused_) return;
+        paused_ = false;
+        if (auto connection = connection_.lock()) connection->startRecv();
+    }
+
+    void pollDrain(trantor::EventLoop* loop) {
+        std::weak_ptr<EncryptStreamJob> self = weak_from_this();
+        loop->runAfter(kDrainPollSeconds, [self, loop] {
+            auto job = self.lock();
+            if (!job) return;
+            std::lock_guard<std::mutex> lock(job->mutex_);
+            if (!job->paused_) return;
+            if (job->unsent() <= kMaxUnsentBytes / 2) {
+                job->resume();
+            } else {
+                job->pollDrain(loop);
+            }
+        });
+    }
+
+    static const VitalEdgeMetrics::Timer& timer() {
+        static const VitalEdgeMetrics::Timer streamTimer("route", "/encrypt/stream");
+        return streamTimer;
+    }
+
+    // Ends the response and records the request, sized by the body streamed so far
+    void close(bool failed) {
+        done_ = true;
+        timer().record(VitalEdgeMetrics::Phase::Total, consumed_, VitalEdgeMetrics::now() - start_);
+        if (failed) timer().recordError();
+        if (audit_) {
+            audit_->bytes = consumed_;
+            recordAudit(audit_, !failed);
+        }
+        if (response_) {
+            response_->close();
+            response_.reset();
+        }
+        // The connection outlives the request when kept alive: hand it back reading
+        resume();
+    }
+
+    std::mutex mutex_;
+    VitalEdgeStreamCipher cipher_;
+    ResponseStreamPtr response_;
+    std::string pending_;
+    std::string scratch_;
+    bool done_ = false;
+    size_t consumed_ = 0;
+    std::optional<AuditEntry> audit_;
+    const uint64_t start_ = VitalEdgeMetrics::now();
+    std::weak_ptr<trantor::TcpConnection> connection_;
+    size_t sentAtStart_ = 0;
+    size_t queued_ = 0;
+    bool paused_ = false;
+};
+
+void registerRoutes() {
+    // Route: /encrypt (AES Encryption)
+    app().registerHandler("/encrypt",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/encrypt");
+            const RequestMetrics metrics = startRequest(timer, req);
+            if (isBinary(req)) {
+                handleAESBinary(metrics, req, std::move(callback), true);
+                return;
+            }
+            auto json = parseJson(metrics, req);
+            if (!json || !json->isMember("data") || !json->isMember("iv") ||
+                (!json->isMember("key_id") && !json->isMember("key") && !json->isMember("session_id"))) {
+                Json::Value jsonResp;
+                jsonResp["error"] =
+                    "Invalid request: 'data', 'iv', and 'key_id' (or 'key' or 'session_id') are required.";
+                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+                resp->setStatusCode(HttpStatusCode::k400BadRequest);
+                callback(resp);
+                return;
+            }
+            const Json::Value& level = (*json)["compression_level"];
+            if (!level.isNull() && !level.isInt()) {
+                callback(errorResponse(HttpStatusCode::k400BadRequest,
+                                       "Invalid request: 'compression_level' must be an integer."));
+                return;
+            }
+            const size_t bytes = stringLength((*json)["data"]);
+            auto audit = auditRequest(VitalEdgeAudit::Operation::Encrypt, req, *json, bytes);
+            VitalEdgeKeyring::EntryPtr key;
+            if (!lookupKeyId(*json, key, audit, callback)) return;
+
+            dispatchCrypto(metrics, std::move(audit), bytes, [metrics, json, key] {
+                // The plaintext and a raw key are read in place from the document,
+                // never copied out into memory that is not zeroed
+                std::string_view data, rawKey, iv;
+                if (!stringMember(*json, "data", data) || !stringMember(*json, "iv", iv)) {
+                    throw std::invalid_argument("Invalid request: 'data' and 'iv' must be strings.");
+                }
+                stringMember(*json, "key", rawKey);
+                const Json::Value& level = (*json)["compression_level"];
+                VitalEdgeCrypto::SecureString encrypted;
+                timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                    if (!level.isNull()) {
+                        key ? VitalEdgeCrypto::encryptAESCompressed(data, *key, iv, level.asInt(), encrypted)
+                            : VitalEdgeCrypto::encryptAESCompressed(data, rawKey, iv, level.asInt(), encrypted);
+                        return;
+                    }
+                    key ? VitalEdgeCrypto::encryptAES(data, *key, iv, encrypted)
+                        : VitalEdgeCrypto::encryptAES(data, rawKey, iv, encrypted);
+                });
+                VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+                Json::Value jsonResp;
+                jsonResp["encrypted"] = VitalEdgeBase64::encode(encrypted);
+                // Which version to ask for when decrypting after the key is rotated
+                if (key && !json->isMember("session_id")) jsonResp["key_version"] = key->version();
+                return HttpResponse::newHttpJsonResponse(jsonResp);
+            }, std::move(callback));
+        },
+        {Post});
+
+    // Route: /decrypt (AES Decryption)
+    // app().registerHandler("/decrypt",
+    //     [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+    //         auto json = req->getJsonObject();
+    //         if (!json || !json->isMember("data") || !json->isMember("key") || !json->isMember("iv")) {
+    //             Json::Value jsonResp;
+    //             jsonResp["error"] = "Invalid request: 'data', 'key', and 'iv' are required.";
+    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+    //             resp->setStatusCode(HttpStatusCode::k400BadRequest);
+    //             callback(resp);
+    //             return;
+    //         }
+
+    //         try {
+    //             std::string decrypted = VitalEdgeCrypto::decryptAES(
+    //                 (*json)["data"].asString(),
+    //                 (*json)["key"].asString(),
+    //                 (*json)["iv"].asString()
+    //             );
+    //             Json::Value jsonResp;
+    //             jsonResp["decrypted"] = decrypted;
+    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+    //             callback(resp);
+    //         } catch (const std::exception& e) {
+    //             Json::Value jsonResp;
+    //             jsonResp["error"] = e.what();
+    //             auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+    //             resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+    //             callback(resp);
+    //         }
+    //     },
+    //     {Post});
+app().registerHandler("/decrypt",
+    [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        static const VitalEdgeMetrics::Timer timer("route", "/decrypt");
+        const RequestMetrics metrics = startRequest(timer, req);
+        if (isBinary(req)) {
+            handleAESBinary(metrics, req, std::move(callback), false);
+            return;
+        }
+        auto json = parseJson(metrics, req);
+        if (!json || !json->isMember("data") || !json->isMember("iv") ||
+            (!json->isMember("key_id") && !json->isMember("key") && !json->isMember("session_id"))) {
+            Json::Value jsonResp;
+            jsonResp["error"] =
+                "Invalid request: 'data', 'iv', and 'key_id' (or 'key' or 'session_id') are required.";
+            auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+            resp->setStatusCode(HttpStatusCode::k400BadRequest);
+            callback(resp);
+            return;
+        }
+        const size_t bytes = stringLength((*json)["data"]);
+        auto audit = auditRequest(VitalEdgeAudit::Operation::Decrypt, req, *json, bytes);
+        VitalEdgeKeyring::EntryPtr key;
+        if (!lookupKeyId(*json, key, audit, callback)) return;
+
+        dispatchCrypto(metrics, std::move(audit), bytes, [metrics, json, key] {
+            std::string ciphertext = timePhase(metrics, VitalEdgeMetrics::Phase::Decode, [&] {
+                return VitalEdgeBase64::decode((*json)["data"].asString());
+            });
+
+            // Perform AES decryption into secure memory; only the response holds a copy
+            std::string_view rawKey;
+            stringMember(*json, "key", rawKey);
+            const std::string iv = (*json)["iv"].asString();
+            VitalEdgeCrypto::SecureString plaintext;
+            timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                // Compressed ciphertext carries a visible prefix plain ciphertext cannot have
+                if (VitalEdgeCrypto::isCompressed(ciphertext)) {
+                    key ? VitalEdgeCrypto::decryptAESCompressed(ciphertext, *key, iv, plaintext)
+                        : VitalEdgeCrypto::decryptAESCompressed(ciphertext, rawKey, iv, plaintext);
+                    return;
+                }
+                key ? VitalEdgeCrypto::decryptAES(ciphertext, *key, iv, plaintext)
+                    : VitalEdgeCrypto::decryptAES(ciphertext, rawKey, iv, plaintext);
+            });
+
+            VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+            Json::Value jsonResp;
+            // The one copy outside secure memory: JsonCpp and the response body keep
+            // their strings on the ordinary heap, which is not zeroed when freed
+            jsonResp["decrypted"] = Json::Value(plaintext.data(), plaintext.data() + plaintext.size());
+            return HttpResponse::newHttpJsonResponse(jsonResp);
+        }, std::move(callback));
+    },
+    {Post});
+
+    // Route: /obfuscate
+    app().registerHandler("/obfuscate",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/obfuscate");
+            const RequestMetrics metrics = startRequest(timer, req);
+            auto json = parseJson(metrics, req);
+            if (!json || !json->isMember("data")) {
+                Json::Value jsonResp;
+                jsonResp["error"] = "Invalid request: 'data' is required.";
+                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+                resp->setStatusCode(HttpStatusCode::k400BadRequest);
+                callback(resp);
+                return;
+            }
+
+            const size_t bytes = stringLength((*json)["data"]);
+            dispatchCrypto(metrics, auditRequest(VitalEdgeAudit::Operation::Obfuscate, req, *json, bytes), bytes,
+                           [metrics, json] {
+                std::string obfuscated = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                    return VitalEdgeCrypto::obfuscate((*json)["data"].asString());
+                });
+                VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+                Json::Value jsonResp;
+                jsonResp["obfuscated"] = obfuscated;
+                return HttpResponse::newHttpJsonResponse(jsonResp);
+            }, std::move(callback));
+        },
+        {Post});
+
+    // Route: /deobfuscate
+    app().registerHandler("/deobfuscate",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/deobfuscate");
+            const RequestMetrics metrics = startRequest(timer, req);
+            auto json = parseJson(metrics, req);
+            if (!json || !json->isMember("data")) {
+                Json::Value jsonResp;
+                jsonResp["error"] = "Invalid request: 'data' is required.";
+                auto resp = HttpResponse::newHttpJsonResponse(jsonResp);
+                resp->setStatusCode(HttpStatusCode::k400BadRequest);
+                callback(resp);
+                return;
+            }
+
+            const size_t bytes = stringLength((*json)["data"]);
+            dispatchCrypto(metrics, auditRequest(VitalEdgeAudit::Operation::Deobfuscate, req, *json, bytes), bytes,
+                           [metrics, json] {
+                std::string deobfuscated = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                    return VitalEdgeCrypto::deobfuscate((*json)["data"].asString());
+                });
+                VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+                Json::Value jsonResp;
+                jsonResp["deobfuscated"] = deobfuscated;
+                return HttpResponse::newHttpJsonResponse(jsonResp);
+            }, std::move(callback));
+        },
+        {Post});
+
+    // Route: /envelope/encrypt (AES-256-GCM under an RSA-wrapped data key)
+    app().registerHandler("/envelope/encrypt",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/envelope/encrypt");
+            const RequestMetrics metrics = startRequest(timer, req);
+            auto json = parseJson(metrics, req);
+            if (!json || !json->isMember("data") || !json->isMember("public_key")) {
+                callback(errorResponse(HttpStatusCode::k400BadRequest,
+                                       "Invalid request: 'data' and 'public_key' are required."));
+                return;
+            }
+            const Json::Value& share = (*json)["share_data_key"];
+            if (!share.isNull() && !share.isBool()) {
+                callback(errorResponse(HttpStatusCode::k400BadRequest,
+                                       "Invalid request: 'share_data_key' must be a boolean."));
+                return;
+            }
+
+            const size_t bytes = stringLength((*json)["data"]);
+            dispatchCrypto(metrics, auditRequest(VitalEdgeAudit::Operation::EnvelopeEncrypt, req, *json, bytes),
+                           bytes, [metrics, json, shareDataKey = share.asBool()] {
+                std::string envelope = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                    // A fresh data key per envelope unless the client opts in to the one
+                    // shared by every envelope to this recipient (bounded by count and age)
+                    return VitalEdgeCrypto::encryptEnvelope((*json)["data"].asString(),
+                                                            (*json)["public_key"].asString(), shareDataKey);
+                });
+                VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+                Json::Value jsonResp;
+                jsonResp["envelope"] = VitalEdgeBase64::encode(envelope);
+                return HttpResponse::newHttpJsonResponse(jsonResp);
+            }, std::move(callback));
+        },
+        {Post});
+
+    // Route: /envelope/decrypt
+    app().registerHandler("/envelope/decrypt",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/envelope/decrypt");
+            const RequestMetrics metrics = startRequest(timer, req);
+            auto json = parseJson(metrics, req);
+            if (!json || !json->isMember("envelope") || !json->isMember("private_key")) {
+                callback(errorResponse(HttpStatusCode::k400BadRequest,
+                                       "Invalid request: 'envelope' and 'private_key' are required."));
+                return;
+            }
+
+            // Always offloaded: a data key missing from the unwrap cache costs an RSA private operation
+            const size_t bytes = stringLength((*json)["envelope"]);
+            dispatchCrypto(metrics, auditRequest(VitalEdgeAudit::Operation::EnvelopeDecrypt, req, *json, bytes),
+                           std::max(bytes, inlineThreshold), [metrics, json] {
+                std::string envelope = timePhase(metrics, VitalEdgeMetrics::Phase::Decode, [&] {
+                    return VitalEdgeBase64::decode((*json)["envelope"].asString());
+                });
+                std::string plaintext = timePhase(metrics, VitalEdgeMetrics::Phase::Crypto, [&] {
+                    return VitalEdgeCrypto::decryptEnvelope(envelope, (*json)["private_key"].asString());
+                });
+                VitalEdgeMetrics::Scope phase(*metrics.route, VitalEdgeMetrics::Phase::Encode, metrics.bytes);
+                Json::Value jsonResp;
+                jsonResp["decrypted"] = plaintext;
+                return HttpResponse::newHttpJsonResponse(jsonResp);
+            }, std::move(callback));
+        },
+        {Post});
+
+    // Route: /encrypt/batch (AES Encryption of many items per request)
+    app().registerHandler("/encrypt/batch",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/encrypt/batch");
+            if (isBinary(req)) {
+                handleAESBatchBinary(startRequest(timer, req), req, std::move(callback), true);
+                return;
+            }
+            handleAESBatch(startRequest(timer, req), req, std::move(callback), true);
+        },
+        {Post});
+
+    // Route: /decrypt/batch (AES Decryption of many items per request)
+    app().registerHandler("/decrypt/batch",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/decrypt/batch");
+            if (isBinary(req)) {
+                handleAESBatchBinary(startRequest(timer, req), req, std::move(callback), false);
+                return;
+            }
+            handleAESBatch(startRequest(timer, req), req, std::move(callback), false);
+        },
+        {Post});
+
+    // Route: /encrypt/fields (AES-256-GCM of selected fields of JSON documents)
+    app().registerHandler("/encrypt/fields",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/encrypt/fields");
+            handleFields(startRequest(timer, req), req, std::move(callback), true);
+        },
+        {Post});
+
+    // Route: /decrypt/fields
+    app().registerHandler("/decrypt/fields",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/decrypt/fields");
+            handleFields(startRequest(timer, req), req, std::move(callback), false);
+        },
+        {Post});
+
+    // Route: /keys/generate (bulk random key generation)
+    app().registerHandler("/keys/generate",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/keys/generate");
+            handleGenerateKeys(startRequest(timer, req), req, std::move(callback));
+        },
+        {Post});
+
+    // Route: /keys/rotate (new current version of a keyring key)
+    app().registerHandler("/keys/rotate",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/keys/rotate");
+            handleRotateKey(startRequest(timer, req), req, std::move(callback));
+        },
+        {Post});
+
+    // Route: /session (X25519 handshake for a session key; DELETE ends it)
+    app().registerHandler("/session",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/session");
+            handleSession(startRequest(timer, req), req, std::move(callback));
+        },
+        {Post, Delete});
+
+    // Route: /sign (HMAC-SHA256 or Ed25519 signature of a message)
+    app().registerHandler("/sign",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/sign");
+            handleSignatures(startRequest(timer, req), req, std::move(callback), true, false);
+        },
+        {Post});
+
+    // Route: /verify
+    app().registerHandler("/verify",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/verify");
+            handleSignatures(startRequest(timer, req), req, std::move(callback), false, false);
+        },
+        {Post});
+
+    // Route: /sign/batch (signatures of many messages per request)
+    app().registerHandler("/sign/batch",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/sign/batch");
+            handleSignatures(startRequest(timer, req), req, std::move(callback), true, true);
+        },
+        {Post});
+
+    // Route: /verify/batch
+    app().registerHandler("/verify/batch",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/verify/batch");
+            handleSignatures(startRequest(timer, req), req, std::move(callback), false, true);
+        },
+        {Post});
+
+    // Route: /tokenize (deterministic tokens for identifiers)
+    app().registerHandler("/tokenize",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/tokenize");
+            handleTokens(startRequest(timer, req), req, std::move(callback), true);
+        },
+        {Post});
+
+    // Route: /detokenize (token vault lookup)
+    app().registerHandler("/detokenize",
+        [](const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+            static const VitalEdgeMetrics::Timer timer("route", "/detokenize");
+            handleTokens(startRequest(timer, req), req, std::move(callback), false);
+        },
+        {Post});
+
+    // Route: /encrypt/stream (AES Encryption of a streamed request body)
+    // The body is the raw plaintext and the response the raw ciphertext, with the
+    // IV in the X-VitalEdge-IV header and the key named by X-VitalEdge-Key-Id (or
+    // given raw in X-VitalEdge-Key).
+    app().registerHandler("/encrypt/stream",
+        [](const HttpRequestPtr& req, RequestStreamPtr&& stream,
+           std::function<void(const HttpResponsePtr&)>&& callback) {
+            const std::string& keyId = req->getHeader("x-vitaledge-key-id");
+            auto audit = auditEntry(VitalEdgeAudit::Operation::EncryptStream, req, keyId, 0);
+            std::shared_ptr<EncryptStreamJob> job;
+            try {
+                if (keyId.empty()) {
+                    job = std::make_shared<EncryptStreamJob>(req->getHeader("x-vitaledge-key"),
+                                                             req->getHeader("x-vitaledge-iv"));
+                } else if (auto key = VitalEdgeCrypto::KeyManager::findKey(keyId)) {
+                    job = std::make_shared<EncryptStreamJob>(*key, req->getHeader("x-vitaledge-iv"));
+                } else {
+                    recordAudit(audit, false);
+                    callback(errorResponse(HttpStatusCode::k400BadRequest, "Unknown key_id."));
+                    return;
+                }
+            } catch (const std::exception& e) {
+                recordAudit(audit, false);
+                callback(errorResponse(HttpStatusCode::k400BadRequest, e.what()));
+                return;
+            }
+            if (audit) job->audit(std::move(*audit));
+
+            auto resp = HttpResponse::newAsyncStreamResponse(
+                [job](ResponseStreamPtr response) { job->attach(std::move(response)); });
+            resp->setContentTypeCode(CT_APPLICATION_OCTET_STREAM);
+            callback(resp);
+
+            if (!stream) {
+                // Drogon buffered the body (request streaming unavailable)
+                job->consume(req->body().data(), req->body().size());
+                job->finish(nullptr);
+                return;
+            }
+            if (auto connection = req->getConnectionPtr().lock()) job->throttle(connection);
+            stream->setStreamReader(RequestStreamReader::newReader(
+                [job](const char* data, size_t length) { job->consume(data, length); },
+                [job](std::exception_ptr error) { job->finish(error); }));
+        },
+        {Post});
+
+    // Route: /metrics (latency histograms and counters in the Prometheus text format)
+    app().registerHandler("/metrics",
+        [](const HttpRequestPtr&, std::function<void(const HttpResponsePtr&)>&& callback) {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setContentTypeCode(CT_TEXT_PLAIN);
+            resp->setBody(VitalEdgeMetrics::render());
+            callback(resp);
+        },
+        {Get});
+}
@@ -0,0 +1,25 @@
+// HTTP routes of the service, kept apart from main() so the benchmark suite can
+// serve the same handlers in-process.
+#ifndef VITALEDGE_ROUTES_H
+#define VITALEDGE_ROUTES_H
+
+#include <cstddef>
+#include <string>
+
+// Payload size (bytes) at which requests move from the event loop to the crypto
+// executor
+void setInlineThreshold(size_t bytes);
+
+// Keyring file that /keys/rotate appends new key versions to, so rotations
+// survive a restart; without one they last until the process exits
+void setKeyringFile(const std::string& path);
+
+// Number of worker processes serving the port. With more than one, /keys/rotate
+// and /session answer 503: keys and sessions they create would exist in one
+// worker only, and rotations from several would write conflicting versions.
+void setWorkerCount(size_t workers);
+
+// Register every route with drogon::app(); call once before run()
+void registerRoutes();
+
+#endif // VITALEDGE_ROUTES_H
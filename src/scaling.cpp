@@ -0,0 +1,178 @@
+#include "scaling.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgePlacement.h"
+#include <drogon/drogon.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace drogon;
+
+namespace {
+
+// "CPUs 0-3" for a thread group's CPUs, which may repeat when threads share them
+std::string describeCpus(std::vector<int> cpus) {
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return (cpus.size() == 1 ? "CPU " : "CPUs ") + VitalEdgePlacement::formatCpus(cpus);
+}
+
+std::string describeNodes(const std::vector<VitalEdgePlacement::Node>& nodes, const std::vector<int>& cpus) {
+    std::vector<int> used;
+    for (int cpu : cpus) used.push_back(VitalEdgePlacement::nodeOf(nodes, cpu));
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    return (used.size() == 1 ? "node " : "nodes ") + VitalEdgePlacement::formatCpus(used);
+}
+
+void pinThread(const char* group, size_t index, int cpu) {
+    if (!VitalEdgePlacement::pinCurrentThread(cpu)) {
+        std::cerr << "Unable to pin " << group << " thread " << index << " to CPU " << cpu << std::endl;
+    }
+}
+
+int exitStatus(int waitStatus) {
+    return WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 128 + WTERMSIG(waitStatus);
+}
+
+} // namespace
+
+size_t workerCount(const char* value) {
+    if (!value || !*value) return 1;
+    if (std::strcmp(value, "numa") == 0) return VitalEdgePlacement::topology().size();
+    const std::string text(value);
+    if (text.find_first_not_of("0123456789") != std::string::npos || text.size() > 4) {
+        throw std::invalid_argument("VITALEDGE_WORKERS must be a number or \"numa\"");
+    }
+    return std::max<size_t>(1, std::stoul(text));
+}
+
+bool startWorkers(Scaling& scaling, int& status) {
+    if (scaling.workers <= 1) return true;
+
+    // The supervisor takes its signals with sigwait; workers get the old mask back
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, &previous);
+
+    const pid_t supervisor = getpid();
+    std::vector<pid_t> pids(scaling.workers, 0);
+    size_t running = 0;
+    status = 0;
+    bool stopping = false;
+    auto stopAll = [&](int signal) {
+        stopping = true;
+        for (pid_t pid : pids) {
+            if (pid > 0) kill(pid, signal);
+        }
+    };
+
+    std::cout << "Starting " << scaling.workers << " worker processes sharing one port" << std::endl;
+    for (size_t i = 0; i < scaling.workers; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            sigprocmask(SIG_SETMASK, &previous, nullptr);
+            // A worker must not outlive its supervisor
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != supervisor) _exit(1);
+            scaling.worker = i;
+            return true;
+        }
+        if (pid < 0) {
+            std::cerr << "Unable to start worker " << i << ": " << std::strerror(errno) << std::endl;
+            status = 1;
+            stopAll(SIGTERM);
+            break;
+        }
+        pids[i] = pid;
+        ++running;
+    }
+
+    while (running > 0) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) continue;
+        if (signal != SIGCHLD) {
+            // Each worker shuts down like a single server would
+            if (!stopping) std::cout << "Stopping workers" << std::endl;
+            stopAll(signal);
+            continue;
+        }
+
+        int waitStatus = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &waitStatus, WNOHANG)) > 0) {
+            auto it = std::find(pids.begin(), pids.end(), pid);
+            if (it == pids.end()) continue;
+            *it = 0;
+            --running;
+            if (stopping) continue;
+            // Serving with fewer workers would silently halve capacity; let the
+            // process manager restart the whole server instead
+            std::cerr << "Worker " << (it - pids.begin()) << " (pid " << pid << ") exited with status "
+                      << exitStatus(waitStatus) << "; stopping the others" << std::endl;
+            status = exitStatus(waitStatus) != 0 ? exitStatus(waitStatus) : 1;
+            stopAll(SIGTERM);
+        }
+    }
+    return false;
+}
+
+void applyScaling(const Scaling& scaling) {
+    const std::vector<VitalEdgePlacement::Node> nodes = VitalEdgePlacement::topology();
+    const std::vector<int> cpus = VitalEdgePlacement::workerCpus(nodes, scaling.worker, scaling.workers);
+
+    // A worker keeps to its own CPUs, and to its node's memory when they share one;
+    // threads started from here on inherit both
+    const int node = cpus.empty() ? -1 : VitalEdgePlacement::nodeOf(nodes, cpus.front());
+    bool localMemory = false;
+    if (scaling.workers > 1 && !cpus.empty()) {
+        VitalEdgePlacement::confineCurrentThread(cpus);
+        const bool oneNode = std::all_of(cpus.begin(), cpus.end(),
+                                         [&](int cpu) { return VitalEdgePlacement::nodeOf(nodes, cpu) == node; });
+        localMemory = oneNode && nodes.size() > 1 && VitalEdgePlacement::preferNode(node);
+    }
+
+    const size_t ioThreads = std::max<size_t>(1, scaling.ioThreads);
+    size_t cryptoThreads = scaling.cryptoThreads;
+    if (cryptoThreads == 0) cryptoThreads = cpus.size() > ioThreads ? cpus.size() - ioThreads : 1;
+    const VitalEdgePlacement::Plan plan = VitalEdgePlacement::plan(cpus, ioThreads, cryptoThreads);
+    const bool pin = scaling.pinThreads && !cpus.empty();
+
+    VitalEdgeExecutor::ThreadStart onStart;
+    if (pin) onStart = [cryptoCpus = plan.cryptoCpus](size_t i) { pinThread("crypto", i, cryptoCpus[i]); };
+    VitalEdgeExecutor::configure(cryptoThreads, std::move(onStart));
+
+    app().setThreadNum(ioThreads);
+    if (pin) {
+        // Event loop threads exist once the app is running
+        app().registerBeginningAdvice([ioCpus = plan.ioCpus] {
+            for (size_t i = 0; i < ioCpus.size(); ++i) {
+                app().getIOLoop(i)->runInLoop([i, cpu = ioCpus[i]] { pinThread("IO", i, cpu); });
+            }
+        });
+    }
+    if (scaling.workers > 1) app().enableReusePort();
+
+    std::cout << "Placement: worker " << scaling.worker << " of " << scaling.workers << " (pid " << getpid()
+              << ") on " << describeCpus(cpus) << " (" << describeNodes(nodes, cpus) << ")";
+    if (localMemory) std::cout << ", memory from node " << node;
+    std::cout << "\nPlacement: " << ioThreads << " IO and " << cryptoThreads << " crypto threads";
+    if (pin) {
+        std::cout << ", IO pinned to " << describeCpus(plan.ioCpus) << ", crypto pinned to "
+                  << describeCpus(plan.cryptoCpus);
+    } else {
+        std::cout << ", not pinned";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,34 @@
+// Process and thread layout of the server: pre-forked workers sharing the port
+// through SO_REUSEPORT, event loop and crypto thread counts, and their CPU and
+// NUMA placement.
+#ifndef VITALEDGE_SCALING_H
+#define VITALEDGE_SCALING_H
+
+#include <cstddef>
+
+struct Scaling {
+    size_t workers = 1;       // server processes
+    size_t worker = 0;        // index of this process
+    size_t ioThreads = 1;     // Drogon event loops
+    size_t cryptoThreads = 0; // 0 = one per CPU of the process not running an event loop
+    bool pinThreads = false;  // pin each thread to its own CPU
+};
+
+// Worker count for a VITALEDGE_WORKERS value: a number, or "numa" for one per
+// NUMA node. Unset or 0 means a single process. Throws std::invalid_argument
+// for anything else.
+size_t workerCount(const char* value);
+
+// With more than one worker, fork them and return true in each, with worker
+// set. The calling process stays behind as their supervisor: it forwards
+// SIGTERM and SIGINT, stops every worker once one exits, and then returns false
+// with the exit status to report. A single process just returns true.
+bool startWorkers(Scaling& scaling, int& status);
+
+// Place this process and its threads: confine a worker to its share of the
+// CPUs and its node's memory, size the crypto executor and Drogon's event loops,
+// pin them if asked, enable SO_REUSEPORT for workers, and print the placement.
+// Runs before the executor or Drogon starts a thread.
+void applyScaling(const Scaling& scaling);
+
+#endif // VITALEDGE_SCALING_H
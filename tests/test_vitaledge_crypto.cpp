@@ -1,7 +1,42 @@
 #include <gtest/gtest.h>
 #include "VitalEdgeCrypto.h"
+#include "VitalEdgeAudit.h"
+#include "VitalEdgeBase64.h"
+#include "VitalEdgeChunkedAEAD.h"
+#include "VitalEdgeCipherEngine.h"
+#include "VitalEdgeCompression.h"
+#include "VitalEdgeEnvelope.h"
+#include "VitalEdgeExecutor.h"
+#include "VitalEdgeFieldPath.h"
+#include "VitalEdgeFileCrypt.h"
+#include "VitalEdgeKeyManager.h"
+#include "VitalEdgeKeyring.h"
+#include "VitalEdgeMetrics.h"
+#include "VitalEdgePlacement.h"
+#include "VitalEdgeRandom.h"
+#include "VitalEdgeRecord.h"
+#include "VitalEdgeReencrypt.h"
+#include "VitalEdgeSecureMemory.h"
+#include "VitalEdgeSession.h"
+#include "VitalEdgeStreamCipher.h"
+#include "VitalEdgeTokenVault.h"
+#include "VitalEdgeWire.h"
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/pem.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <thread>
+#include <set>
 #include <sstream>
+#include <vector>
 
 // Test AES encryption and decryption
 TEST(VitalEdgeCryptoTest, AESEncryptionDecryption) {
@@ -15,6 +50,214 @@ TEST(VitalEdgeCryptoTest, AESEncryptionDecryption) {
     EXPECT_EQ(plaintext, decrypted); // Ensure decrypted text matches original
 }
 
+// Reference AES-256-CBC using a fresh context per call, as encryptAES used to
+static std::string referenceEncryptAES(const std::string& plaintext, const std::string& key, const std::string& iv) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    std::string out(plaintext.size() + 16, '\0');
+    int len = 0, total = 0;
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, (const unsigned char*)key.data(), (const unsigned char*)iv.data());
+    EVP_EncryptUpdate(ctx, (unsigned char*)&out[0], &len, (const unsigned char*)plaintext.data(), plaintext.size());
+    total = len;
+    EVP_EncryptFinal_ex(ctx, (unsigned char*)&out[total], &len);
+    EVP_CIPHER_CTX_free(ctx);
+    out.resize(total + len);
+    return out;
+}
+
+// Cached contexts must behave exactly like fresh ones, across keys and IVs
+TEST(VitalEdgeCryptoTest, AESCachedContextsMatchReference) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < VitalEdgeCipherEngine::kThreadCacheSize + 2; ++i) {
+        keys.push_back(VitalEdgeCrypto::generateRandomKey(32));
+    }
+
+    for (int round = 0; round < 3; ++round) {
+        for (const auto& key : keys) {
+            std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+            std::string plaintext(round * 17 + (unsigned char)key[0] % 40, 'x');
+
+            std::string encrypted = VitalEdgeCrypto::encryptAES(plaintext, key, iv);
+            EXPECT_EQ(referenceEncryptAES(plaintext, key, iv), encrypted);
+            EXPECT_EQ(plaintext, VitalEdgeCrypto::decryptAES(encrypted, key, iv));
+        }
+    }
+    VitalEdgeCipherEngine::clearThreadCache();
+}
+
+// A failed decrypt must not poison the cached context for the next call
+TEST(VitalEdgeCryptoTest, AESRecoversAfterFailedDecrypt) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    std::string encrypted = VitalEdgeCrypto::encryptAES("Test AES Recovery", key, iv);
+
+    EXPECT_THROW(VitalEdgeCrypto::decryptAES(encrypted.substr(0, encrypted.size() - 1), key, iv), std::runtime_error);
+    EXPECT_EQ("Test AES Recovery", VitalEdgeCrypto::decryptAES(encrypted, key, iv));
+}
+
+TEST(VitalEdgeCryptoTest, AESRejectsShortKey) {
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    EXPECT_THROW(VitalEdgeCrypto::encryptAES("data", "short", iv), std::invalid_argument);
+}
+
+// A bad item reports its own error and the rest of the batch still round-trips
+TEST(VitalEdgeCryptoTest, AESBatchEncryptionDecryption) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string otherKey = VitalEdgeCrypto::generateRandomKey(32);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    std::vector<std::string> records = {"hr=72", "", "spo2=98", std::string(100, 'b')};
+
+    std::vector<VitalEdgeCrypto::BatchItem> items;
+    for (size_t i = 0; i < records.size(); ++i) {
+        items.push_back({records[i], i % 2 ? otherKey : key, iv});
+    }
+    items.push_back({"bad key", "short", iv});
+
+    auto encrypted = VitalEdgeCrypto::encryptAESBatch(items.data(), items.size());
+    ASSERT_EQ(items.size(), encrypted.size());
+    EXPECT_FALSE(encrypted.ok(4));
+    EXPECT_TRUE(encrypted.output(4).empty());
+
+    std::vector<std::string> ciphertexts;
+    ciphertexts.reserve(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        ASSERT_TRUE(encrypted.ok(i)) << encrypted.errors[i];
+        ciphertexts.emplace_back(encrypted.output(i));
+        EXPECT_EQ(VitalEdgeCrypto::encryptAES(records[i], i % 2 ? otherKey : key, iv), ciphertexts.back());
+        items[i].data = ciphertexts.back();
+    }
+
+    auto decrypted = VitalEdgeCrypto::decryptAESBatch(items.data(), records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        ASSERT_TRUE(decrypted.ok(i)) << decrypted.errors[i];
+        EXPECT_EQ(records[i], decrypted.output(i));
+    }
+}
+
+// Streaming in uneven chunks gives the same bytes as the one-shot calls
+TEST(VitalEdgeCryptoTest, AESStreamMatchesOneShot) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    std::string plaintext;
+    for (int i = 0; i < 5000; ++i) plaintext += char('a' + i % 26);
+
+    auto runStream = [&](const std::string& input, bool encrypt) {
+        VitalEdgeStreamCipher stream(key, iv, encrypt);
+        std::vector<unsigned char> chunk(VitalEdgeStreamCipher::maxUpdateOutput(977));
+        std::string output;
+        for (size_t offset = 0; offset < input.size(); offset += 977) {
+            size_t length = std::min<size_t>(977, input.size() - offset);
+            size_t written = stream.update((const unsigned char*)input.data() + offset, length, chunk.data());
+            output.append((const char*)chunk.data(), written);
+        }
+        output.append((const char*)chunk.data(), stream.finish(chunk.data()));
+        return output;
+    };
+
+    std::string encrypted = runStream(plaintext, true);
+    EXPECT_EQ(VitalEdgeCrypto::encryptAES(plaintext, key, iv), encrypted);
+    EXPECT_EQ(plaintext, runStream(encrypted, false));
+
+    VitalEdgeStreamCipher finished(key, iv, true);
+    unsigned char block[VitalEdgeStreamCipher::kBlockSize];
+    finished.finish(block);
+    EXPECT_THROW(finished.update(block, 1, block), std::logic_error);
+}
+
+TEST(VitalEdgeCryptoTest, GCMEncryptionDecryption) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string nonce = VitalEdgeCrypto::generateRandomIV(12);
+
+    std::string sealed = VitalEdgeCrypto::encryptGCM("Test GCM Encryption", key, nonce, "record-42");
+    EXPECT_EQ(std::string("Test GCM Encryption").size() + 16, sealed.size());
+    EXPECT_EQ("Test GCM Encryption", VitalEdgeCrypto::decryptGCM(sealed, key, nonce, "record-42"));
+
+    EXPECT_THROW(VitalEdgeCrypto::decryptGCM(sealed, key, nonce, "record-43"), std::runtime_error);
+    sealed[3] ^= 1;
+    EXPECT_THROW(VitalEdgeCrypto::decryptGCM(sealed, key, nonce, "record-42"), std::runtime_error);
+}
+
+// Repetitive vitals shrink before encryption and come back intact; data that
+// does not compress is stored, and frames are bounded on the way out
+TEST(VitalEdgeCryptoTest, CompressThenEncryptRoundTrips) {
+    std::string vitals = "[";
+    for (int i = 0; i < 500; ++i) {
+        vitals += "{\"t\":" + std::to_string(1700000000 + i) + ",\"hr\":" + std::to_string(70 + i % 5) +
+                  ",\"spo2\":98,\"resp\":16},";
+    }
+    vitals.back() = ']';
+    const std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    const std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    auto entry = VitalEdgeKeyring::add("compressed-vitals", key);
+
+    VitalEdgeCrypto::SecureString sealed, opened;
+    VitalEdgeCrypto::encryptAESCompressed(vitals, key, iv, VitalEdgeCompression::kDefaultLevel, sealed);
+    EXPECT_LT(sealed.size() * 4, vitals.size());
+    EXPECT_TRUE(VitalEdgeCrypto::isCompressed(sealed));
+    VitalEdgeCrypto::decryptAESCompressed(sealed, *entry, iv, opened);
+    EXPECT_EQ(vitals, std::string(opened.data(), opened.size()));
+    EXPECT_THROW(VitalEdgeCrypto::decryptAESCompressed(sealed, key, iv, opened, vitals.size() - 1),
+                 std::invalid_argument);
+
+    const std::string noise = VitalEdgeCrypto::generateRandomKey(2000);
+    for (int level : {0, 1, VitalEdgeCompression::maxLevel()}) {
+        VitalEdgeCrypto::encryptAESCompressed(noise, *entry, iv, level, sealed);
+        // Stored, plus prefix and padding
+        EXPECT_EQ(VitalEdgeCrypto::kCompressedPrefixSize + noise.size() + VitalEdgeCrypto::kAESBlockSize, sealed.size())
+            << level;
+        VitalEdgeCrypto::decryptAESCompressed(sealed, key, iv, opened);
+        EXPECT_EQ(noise, std::string(opened.data(), opened.size()));
+    }
+
+    EXPECT_THROW(VitalEdgeCrypto::encryptAESCompressed(vitals, key, iv, VitalEdgeCompression::maxLevel() + 1, sealed),
+                 std::invalid_argument);
+    // Plain ciphertext never looks compressed, even when it starts with the prefix
+    const std::string plain = VitalEdgeCrypto::encryptAES(vitals, key, iv);
+    EXPECT_FALSE(VitalEdgeCrypto::isCompressed(plain));
+    EXPECT_FALSE(VitalEdgeCrypto::isCompressed(VitalEdgeCrypto::kCompressedPrefix + plain.substr(4)));
+    EXPECT_THROW(VitalEdgeCrypto::decryptAESCompressed(plain, key, iv, opened), std::invalid_argument);
+    // A prefixed ciphertext whose plaintext has no frame header
+    EXPECT_THROW(VitalEdgeCrypto::decryptAESCompressed(VitalEdgeCrypto::kCompressedPrefix + plain, key, iv, opened),
+                 std::invalid_argument);
+}
+
+TEST(VitalEdgeChunkedAEADTest, SealOpenAndRandomAccess) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string plaintext;
+    for (int i = 0; i < 10000; ++i) plaintext += char(i * 7);
+
+    std::string sealed = VitalEdgeChunkedAEAD::seal(plaintext, key, 1024);
+    EXPECT_EQ(VitalEdgeChunkedAEAD::sealedSize(plaintext.size(), 1024), sealed.size());
+    EXPECT_EQ(10u, VitalEdgeChunkedAEAD::segmentCount(sealed));
+    EXPECT_EQ(plaintext, VitalEdgeChunkedAEAD::open(sealed, key));
+    EXPECT_EQ(plaintext.substr(3 * 1024, 1024), VitalEdgeChunkedAEAD::openSegment(sealed, key, 3));
+    EXPECT_EQ(plaintext.substr(9 * 1024), VitalEdgeChunkedAEAD::openSegment(sealed, key, 9));
+
+    std::string empty = VitalEdgeChunkedAEAD::seal("", key);
+    EXPECT_EQ("", VitalEdgeChunkedAEAD::open(empty, key));
+}
+
+TEST(VitalEdgeChunkedAEADTest, RejectsTampering) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string plaintext(4096, 'p');
+    std::string sealed = VitalEdgeChunkedAEAD::seal(plaintext, key, 1024);
+    const size_t stride = 1024 + VitalEdgeChunkedAEAD::kTagSize;
+
+    std::string flipped = sealed;
+    flipped[VitalEdgeChunkedAEAD::kHeaderSize + 2 * stride + 5] ^= 1;
+    EXPECT_THROW(VitalEdgeChunkedAEAD::open(flipped, key), std::runtime_error);
+    EXPECT_EQ(plaintext.substr(0, 1024), VitalEdgeChunkedAEAD::openSegment(flipped, key, 0));
+
+    // Swapping two segments breaks their index-derived nonces
+    std::string swapped = sealed;
+    std::swap_ranges(swapped.begin() + VitalEdgeChunkedAEAD::kHeaderSize,
+                     swapped.begin() + VitalEdgeChunkedAEAD::kHeaderSize + stride,
+                     swapped.begin() + VitalEdgeChunkedAEAD::kHeaderSize + stride);
+    EXPECT_THROW(VitalEdgeChunkedAEAD::open(swapped, key), std::runtime_error);
+
+    EXPECT_THROW(VitalEdgeChunkedAEAD::open(sealed.substr(0, sealed.size() - stride), key), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeChunkedAEAD::open(sealed, VitalEdgeCrypto::generateRandomKey(32)), std::runtime_error);
+}
+
 // Test RSA encryption and decryption
 // TEST(VitalEdgeCryptoTest, RSAEncryptionDecryption) {
 //     std::string plaintext = "Test RSA Encryption";
@@ -63,6 +306,251 @@ TEST(VitalEdgeCryptoTest, RSAEncryptionDecryption) {
     EXPECT_EQ(plaintext, decrypted);
 }
 
+// A key pair as (public PEM, private PEM); takes ownership of key
+static std::pair<std::string, std::string> pemKeyPair(EVP_PKEY* key) {
+    std::pair<std::string, std::string> pems;
+    for (int isPrivate = 0; isPrivate < 2; ++isPrivate) {
+        BIO* bio = BIO_new(BIO_s_mem());
+        if (isPrivate) {
+            PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+        } else {
+            PEM_write_bio_PUBKEY(bio, key);
+        }
+        char* data = nullptr;
+        long length = BIO_get_mem_data(bio, &data);
+        (isPrivate ? pems.second : pems.first).assign(data, length);
+        BIO_free(bio);
+    }
+    EVP_PKEY_free(key);
+    return pems;
+}
+
+// Generate an RSA key pair as (public PEM, private PEM)
+static std::pair<std::string, std::string> generateRSAKeyPair(unsigned int bits) {
+    return pemKeyPair(EVP_RSA_gen(bits));
+}
+
+// Repeated calls with one PEM reuse the parsed key; old entries are evicted LRU
+TEST(VitalEdgeKeyCacheTest, ReusesAndEvictsParsedKeys) {
+    VitalEdgeKeyCache::clear();
+    VitalEdgeKeyCache::setCapacity(2);
+    auto first = generateRSAKeyPair(2048);
+    auto second = generateRSAKeyPair(2048);
+
+    auto cached = VitalEdgeKeyCache::privateKey(first.second);
+    EXPECT_EQ(cached, VitalEdgeKeyCache::privateKey(first.second));
+    EXPECT_NE(cached, VitalEdgeKeyCache::publicKey(first.first));
+    EXPECT_EQ(2u, VitalEdgeKeyCache::size());
+
+    for (int i = 0; i < 3; ++i) {
+        auto encrypted = VitalEdgeCrypto::encryptRSA("Test RSA Cache", second.first);
+        EXPECT_EQ("Test RSA Cache", VitalEdgeCrypto::decryptRSA(encrypted, second.second));
+    }
+    EXPECT_EQ(2u, VitalEdgeKeyCache::size());
+    EXPECT_NE(cached, VitalEdgeKeyCache::privateKey(first.second)); // evicted and re-parsed
+
+    // An evicted entry held by a caller stays usable
+    auto encrypted = VitalEdgeCrypto::encryptRSA("Still valid", first.first);
+    EXPECT_EQ("Still valid", VitalEdgeCrypto::decryptRSA(encrypted, *cached));
+
+    EXPECT_THROW(VitalEdgeCrypto::encryptRSA("wrong key type", *cached), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeKeyCache::publicKey("not a pem"), std::runtime_error);
+
+    VitalEdgeKeyCache::setCapacity(64);
+}
+
+TEST(VitalEdgeKeyCacheTest, KeysRegisteredById) {
+    auto pair = generateRSAKeyPair(2048);
+    VitalEdgeKeyCache::registerKey("records-pub", pair.first, false);
+    VitalEdgeKeyCache::registerKey("records-priv", pair.second, true);
+    EXPECT_EQ(nullptr, VitalEdgeKeyCache::findKey("missing"));
+
+    auto encrypted = VitalEdgeCrypto::encryptRSA("By key id", *VitalEdgeKeyCache::findKey("records-pub"));
+    EXPECT_EQ("By key id", VitalEdgeCrypto::decryptRSA(encrypted, *VitalEdgeKeyCache::findKey("records-priv")));
+}
+
+// HMAC and Ed25519 signatures verify only for their own message and key, alone
+// or in batches large enough to fan out across the executor
+TEST(VitalEdgeCryptoTest, SignaturesVerifyAloneAndInBatches) {
+    auto hmacKey = VitalEdgeKeyring::add("signing-hmac", VitalEdgeCrypto::generateRandomKey(32));
+    const std::string message = "{\"patient\":\"12345\",\"heart_rate\":72}";
+    const std::string mac = VitalEdgeCrypto::signHMAC(message, *hmacKey);
+    EXPECT_EQ(VitalEdgeCrypto::kHMACSize, mac.size());
+    EXPECT_EQ(mac, VitalEdgeCrypto::signHMAC(message, *hmacKey));
+    EXPECT_NE(mac, hmacKey->hmac(message)); // labelled apart from other MACs under the key
+    EXPECT_TRUE(VitalEdgeCrypto::verifyHMAC(message, mac, *hmacKey));
+    EXPECT_FALSE(VitalEdgeCrypto::verifyHMAC(message + " ", mac, *hmacKey));
+    EXPECT_FALSE(VitalEdgeCrypto::verifyHMAC(message, mac.substr(1), *hmacKey));
+
+    auto pems = pemKeyPair(EVP_PKEY_Q_keygen(nullptr, nullptr, "ED25519"));
+    auto signer = VitalEdgeCrypto::KeyManager::registerSigningKey("signing-ed25519", pems.second);
+    auto verifier = VitalEdgeKeyCache::publicKey(pems.first);
+    EXPECT_EQ(signer, VitalEdgeCrypto::KeyManager::findSigningKey("signing-ed25519"));
+    const std::string signature = VitalEdgeCrypto::signEd25519(message, *signer);
+    EXPECT_EQ(VitalEdgeCrypto::kEd25519SignatureSize, signature.size());
+    EXPECT_TRUE(VitalEdgeCrypto::verifyEd25519(message, signature, *verifier));
+    EXPECT_TRUE(VitalEdgeCrypto::verifyEd25519(message, signature, *signer));
+    std::string tampered = signature;
+    tampered[10] ^= 1;
+    EXPECT_FALSE(VitalEdgeCrypto::verifyEd25519(message, tampered, *verifier));
+    EXPECT_THROW(VitalEdgeCrypto::signEd25519(message, *verifier), std::invalid_argument);
+
+    auto rsa = generateRSAKeyPair(2048);
+    EXPECT_THROW(VitalEdgeCrypto::KeyManager::registerSigningKey("signing-rsa", rsa.second), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeCrypto::verifyEd25519(message, signature, *VitalEdgeKeyCache::publicKey(rsa.first)),
+                 std::invalid_argument);
+    EXPECT_EQ(nullptr, VitalEdgeCrypto::KeyManager::findSigningKey("signing-rsa"));
+
+    std::vector<VitalEdgeCrypto::VerifyItem> items;
+    for (size_t i = 0; i < 5 * VitalEdgeCrypto::kParallelVerifyItems; ++i) {
+        const bool hmac = i % 2 == 0;
+        const bool good = i % 3 != 0;
+        VitalEdgeCrypto::VerifyItem item{message, hmac ? mac : signature};
+        if (hmac) item.hmacKey = hmacKey.get();
+        else item.ed25519Key = verifier.get();
+        if (!good) item.signature = hmac ? std::string_view(signature).substr(0, mac.size()) : tampered;
+        items.push_back(item);
+    }
+    items.push_back(VitalEdgeCrypto::VerifyItem{message, mac}); // no key
+    std::vector<uint8_t> valid = VitalEdgeCrypto::verifyBatch(items.data(), items.size());
+    ASSERT_EQ(items.size(), valid.size());
+    for (size_t i = 0; i + 1 < items.size(); ++i) EXPECT_EQ(i % 3 != 0, valid[i] != 0) << i;
+    EXPECT_EQ(0, valid.back());
+}
+
+// The client's side of the session handshake, as its documentation describes it
+static std::string clientSessionKey(EVP_PKEY* client, const std::string& clientPublic,
+                                    const std::string& serverPublic) {
+    EVP_PKEY* server = EVP_PKEY_new_raw_public_key_ex(nullptr, "X25519", nullptr,
+                                                      (const unsigned char*)serverPublic.data(), serverPublic.size());
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_from_pkey(nullptr, client, nullptr);
+    unsigned char secret[32];
+    size_t secretLen = sizeof(secret);
+    EXPECT_EQ(1, EVP_PKEY_derive_init(ctx));
+    EXPECT_EQ(1, EVP_PKEY_derive_set_peer(ctx, server));
+    EXPECT_EQ(1, EVP_PKEY_derive(ctx, secret, &secretLen));
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(server);
+
+    std::string salt = clientPublic + serverPublic;
+    std::string key(32, '\0');
+    EVP_KDF* hkdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+    EVP_KDF_CTX* kdf = EVP_KDF_CTX_new(hkdf);
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char*)"SHA256", 0),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, secret, secretLen),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, &salt[0], salt.size()),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, (void*)"vitaledge-session-v1", 20),
+        OSSL_PARAM_construct_end(),
+    };
+    EXPECT_EQ(1, EVP_KDF_derive(kdf, (unsigned char*)&key[0], key.size(), params));
+    EVP_KDF_CTX_free(kdf);
+    EVP_KDF_free(hkdf);
+    return key;
+}
+
+// Both ends of a handshake derive the same key; sessions end when closed, when
+// they expire, and new ones are refused while the table is full
+TEST(VitalEdgeSessionTest, HandshakeDerivesTheClientsKeyAndSessionsExpire) {
+    VitalEdgeSession::clear();
+    EVP_PKEY* client = EVP_PKEY_Q_keygen(nullptr, nullptr, "X25519");
+    std::string clientPublic(VitalEdgeSession::kPublicKeySize, '\0');
+    size_t publicLen = clientPublic.size();
+    ASSERT_EQ(1, EVP_PKEY_get_raw_public_key(client, (unsigned char*)&clientPublic[0], &publicLen));
+
+    VitalEdgeSession::Handshake handshake = VitalEdgeSession::establish(clientPublic);
+    EXPECT_EQ(VitalEdgeSession::kIdSize, handshake.sessionId.size());
+    EXPECT_EQ(15u * 60, handshake.expiresIn);
+    const std::string key = clientSessionKey(client, clientPublic, handshake.publicKey);
+    EVP_PKEY_free(client);
+
+    auto session = VitalEdgeSession::find(handshake.sessionId);
+    ASSERT_NE(nullptr, session);
+    const std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    const std::string encrypted = VitalEdgeCrypto::encryptAES("Heart rate 72", key, iv);
+    EXPECT_EQ("Heart rate 72", VitalEdgeCrypto::decryptAES(encrypted, *session, iv));
+
+    // Every handshake is a fresh key, even from the same client key
+    VitalEdgeSession::Handshake second = VitalEdgeSession::establish(clientPublic);
+    EXPECT_NE(handshake.sessionId, second.sessionId);
+    EXPECT_NE(handshake.publicKey, second.publicKey);
+    EXPECT_EQ(2u, VitalEdgeSession::size());
+
+    EXPECT_TRUE(VitalEdgeSession::close(handshake.sessionId));
+    EXPECT_FALSE(VitalEdgeSession::close(handshake.sessionId));
+    EXPECT_EQ(nullptr, VitalEdgeSession::find(handshake.sessionId));
+    EXPECT_EQ(nullptr, VitalEdgeSession::find("not-a-session"));
+    EXPECT_THROW(VitalEdgeSession::establish("short"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeSession::establish(std::string(32, '\0')), std::invalid_argument); // low-order point
+
+    VitalEdgeSession::setTTL(std::chrono::milliseconds(20));
+    VitalEdgeSession::Handshake brief = VitalEdgeSession::establish(clientPublic);
+    EXPECT_NE(nullptr, VitalEdgeSession::find(brief.sessionId));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_EQ(nullptr, VitalEdgeSession::find(brief.sessionId));
+    VitalEdgeSession::setTTL(std::chrono::minutes(15));
+
+    // One session per shard: some handshake among the next 17 lands in a full shard
+    VitalEdgeSession::clear();
+    VitalEdgeSession::setCapacity(16);
+    size_t opened = 0;
+    try {
+        for (; opened < 17; ++opened) VitalEdgeSession::establish(clientPublic);
+    } catch (const std::runtime_error&) {
+    }
+    EXPECT_LE(opened, 16u);
+    EXPECT_EQ(opened, VitalEdgeSession::size());
+    VitalEdgeSession::setCapacity(100000);
+    VitalEdgeSession::clear();
+}
+
+// Envelopes carry payloads far larger than the RSA modulus, and messages sharing
+// a data key are unwrapped with one RSA operation
+TEST(VitalEdgeEnvelopeTest, SealOpenAndCacheUnwrappedKeys) {
+    VitalEdgeEnvelope::clearCache();
+    auto pair = generateRSAKeyPair(2048);
+    auto publicKey = VitalEdgeKeyCache::publicKey(pair.first);
+    auto privateKey = VitalEdgeKeyCache::privateKey(pair.second);
+
+    std::string large(100000, 'e');
+    std::string envelope = VitalEdgeCrypto::encryptEnvelope(large, pair.first);
+    EXPECT_EQ(large, VitalEdgeCrypto::decryptEnvelope(envelope, pair.second));
+    EXPECT_EQ(1u, VitalEdgeEnvelope::cacheSize());
+
+    VitalEdgeEnvelope::DataKey dataKey(*publicKey);
+    std::string first = VitalEdgeEnvelope::seal("first", dataKey);
+    std::string second = VitalEdgeEnvelope::seal("second", dataKey);
+    EXPECT_NE(first, VitalEdgeEnvelope::seal("first", dataKey)); // fresh nonce per message
+    EXPECT_EQ("first", VitalEdgeEnvelope::open(first, *privateKey));
+    EXPECT_EQ("second", VitalEdgeEnvelope::open(second, *privateKey));
+    EXPECT_EQ(2u, VitalEdgeEnvelope::cacheSize());
+
+    // A cached data key is never served to a different private key
+    auto other = generateRSAKeyPair(2048);
+    EXPECT_THROW(VitalEdgeEnvelope::open(first, other.second), std::runtime_error);
+
+    std::string tampered = second;
+    tampered[tampered.size() - 20] ^= 1;
+    EXPECT_THROW(VitalEdgeEnvelope::open(tampered, *privateKey), std::runtime_error);
+    EXPECT_THROW(VitalEdgeEnvelope::open("VEE1", *privateKey), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeEnvelope::open(first, *publicKey), std::invalid_argument);
+
+    // Envelopes sealed separately to one public key share a data key, so opening
+    // them unwraps it once
+    VitalEdgeEnvelope::clearCache();
+    const std::string a = VitalEdgeCrypto::encryptEnvelope("a", pair.first, true);
+    const std::string b = VitalEdgeCrypto::encryptEnvelope("b", pair.first, true);
+    EXPECT_EQ(a.substr(0, 8 + 256), b.substr(0, 8 + 256)); // header and 2048-bit wrapped key
+    EXPECT_NE(envelope.substr(0, 8 + 256), a.substr(0, 8 + 256));
+    EXPECT_EQ("a", VitalEdgeCrypto::decryptEnvelope(a, pair.second));
+    EXPECT_EQ("b", VitalEdgeCrypto::decryptEnvelope(b, pair.second));
+    EXPECT_EQ(1u, VitalEdgeEnvelope::cacheSize());
+
+    VitalEdgeEnvelope::setCacheCapacity(1);
+    EXPECT_EQ(1u, VitalEdgeEnvelope::cacheSize());
+    VitalEdgeEnvelope::setCacheCapacity(1024);
+}
+
 // Test random key generation
 TEST(VitalEdgeCryptoTest, RandomKeyGeneration) {
     std::string key1 = VitalEdgeCrypto::generateRandomKey(32);
@@ -81,6 +569,44 @@ TEST(VitalEdgeCryptoTest, ObfuscationDeobfuscation) {
     EXPECT_EQ(plaintext, deobfuscated);
 }
 
+// Every kernel the CPU supports matches OpenSSL's encoder and rejects bad input
+TEST(VitalEdgeBase64Test, KernelsMatchReference) {
+    const std::string detected = VitalEdgeBase64::implementation();
+    std::string data(300, '\0');
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (char)(i * 131 + 7);
+
+    for (const char* kernel : {"scalar", "ssse3", "avx2"}) {
+        if (!VitalEdgeBase64::useImplementation(kernel)) continue;
+        SCOPED_TRACE(kernel);
+        for (size_t length = 0; length <= data.size(); ++length) {
+            std::string reference(4 * ((length + 2) / 3) + 1, '\0');
+            reference.resize(EVP_EncodeBlock((unsigned char*)&reference[0], (const unsigned char*)data.data(), (int)length));
+
+            std::string encoded = VitalEdgeBase64::encode(std::string_view(data.data(), length));
+            ASSERT_EQ(reference, encoded);
+            ASSERT_EQ(data.substr(0, length), VitalEdgeBase64::decode(encoded));
+
+            // Unpadded input decodes too
+            ASSERT_EQ(data.substr(0, length), VitalEdgeBase64::decode(encoded.substr(0, encoded.find('='))));
+
+            // A bad character anywhere is caught, whichever kernel reaches it
+            if (!encoded.empty()) {
+                std::string bad = encoded;
+                bad[(length * 7) % bad.size()] = '*';
+                ASSERT_THROW(VitalEdgeBase64::decode(bad), std::invalid_argument);
+            }
+        }
+    }
+    EXPECT_THROW(VitalEdgeBase64::decode("QQ=A"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeBase64::decode("QQ==="), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeBase64::decode("QUJDR"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeBase64::decode("QR=="), std::invalid_argument); // non-zero trailing bits
+    EXPECT_THROW(VitalEdgeBase64::decode("QUJD\nRA=="), std::invalid_argument);
+
+    EXPECT_TRUE(VitalEdgeBase64::useImplementation(detected));
+    EXPECT_FALSE(VitalEdgeBase64::useImplementation("neon"));
+}
+
 TEST(KeyManagerTest, SaveAndLoadKey) {
     std::string key = "TestKey";
     std::string filepath = "test_key.txt";
@@ -94,6 +620,683 @@ TEST(KeyManagerTest, SaveAndLoadKey) {
     std::remove(filepath.c_str());
 }
 
+// Keyring entries encrypt exactly like the raw key they were built from
+TEST(KeyManagerTest, KeyringMatchesRawKeys) {
+    std::string key = VitalEdgeKeyManager::generateKey("AES");
+    ASSERT_EQ(key.size(), 32u);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    std::string nonce = VitalEdgeCrypto::generateRandomIV(12);
+
+    VitalEdgeKeyring::add("test-key", key);
+    auto entry = VitalEdgeCrypto::KeyManager::findKey("test-key");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(VitalEdgeCrypto::KeyManager::findKey("missing"), nullptr);
+
+    std::string plaintext = "Keyring plaintext spanning more than one block";
+    std::string encrypted = VitalEdgeCrypto::encryptAES(plaintext, *entry, iv);
+    EXPECT_EQ(encrypted, VitalEdgeCrypto::encryptAES(plaintext, key, iv));
+    EXPECT_EQ(VitalEdgeCrypto::decryptAES(encrypted, *entry, iv), plaintext);
+
+    std::string sealed = VitalEdgeCrypto::encryptGCM(plaintext, *entry, nonce, "aad");
+    EXPECT_EQ(sealed, VitalEdgeCrypto::encryptGCM(plaintext, key, nonce, "aad"));
+    EXPECT_EQ(VitalEdgeCrypto::decryptGCM(sealed, *entry, nonce, "aad"), plaintext);
+
+    // HMAC is deterministic per key and keyed: another key gives another MAC
+    std::string mac = entry->hmac("data");
+    EXPECT_EQ(mac.size(), VitalEdgeKeyring::Entry::kMacSize);
+    EXPECT_EQ(entry->hmac("data"), mac);
+    auto other = VitalEdgeKeyring::add("other-key", VitalEdgeKeyManager::generateKey("AES"));
+    EXPECT_NE(other->hmac("data"), mac);
+
+    // A batch can mix keyring and raw-key items
+    VitalEdgeCrypto::BatchItem items[2] = {{plaintext, "", iv, entry.get()}, {plaintext, key, iv}};
+    VitalEdgeCrypto::BatchResult result = VitalEdgeCrypto::encryptAESBatch(items, 2);
+    ASSERT_TRUE(result.ok(0) && result.ok(1));
+    EXPECT_EQ(result.output(0), encrypted);
+    EXPECT_EQ(result.output(1), encrypted);
+
+    // Removal hides the key from new lookups; holders keep a working entry
+    EXPECT_TRUE(VitalEdgeKeyring::remove("test-key"));
+    EXPECT_EQ(VitalEdgeCrypto::KeyManager::findKey("test-key"), nullptr);
+    EXPECT_EQ(VitalEdgeCrypto::decryptAES(encrypted, *entry, iv), plaintext);
+
+    EXPECT_THROW(VitalEdgeKeyring::add("short", "0123456789abcdef"), std::invalid_argument);
+    VitalEdgeKeyring::clear();
+}
+
+TEST(KeyManagerTest, LoadKeyringFile) {
+    std::string filepath = "test_keyring.txt";
+    {
+        std::ofstream file(filepath);
+        file << "# key_id base64-key\n"
+             << "alpha MDEyMzQ1Njc4OWFiY2RlZjAxMjM0NTY3ODlhYmNkZWY=\n"
+             << "\n"
+             << "beta  ZmVkY2JhOTg3NjU0MzIxMGZlZGNiYTk4NzY1NDMyMTA=  # trailing comment\n";
+    }
+    EXPECT_EQ(VitalEdgeCrypto::KeyManager::loadKeyring(filepath), 2u);
+    EXPECT_EQ(VitalEdgeKeyring::size(), 2u);
+
+    std::string iv(16, 'i');
+    auto alpha = VitalEdgeCrypto::KeyManager::findKey("alpha");
+    ASSERT_NE(alpha, nullptr);
+    EXPECT_EQ(VitalEdgeCrypto::encryptAES("data", *alpha, iv),
+              VitalEdgeCrypto::encryptAES("data", "0123456789abcdef0123456789abcdef", iv));
+
+    {
+        std::ofstream file(filepath);
+        file << "gamma not-base64\n";
+    }
+    EXPECT_THROW(VitalEdgeCrypto::KeyManager::loadKeyring(filepath), std::invalid_argument);
+    EXPECT_EQ(VitalEdgeCrypto::KeyManager::findKey("gamma"), nullptr);
+
+    // Fields split on any whitespace; a fourth field is an error
+    std::ofstream(filepath) << "delta\tMDEyMzQ1Njc4OWFiY2RlZjAxMjM0NTY3ODlhYmNkZWY=\t2\r\n";
+    EXPECT_EQ(VitalEdgeCrypto::KeyManager::loadKeyring(filepath), 1u);
+    EXPECT_EQ(2u, VitalEdgeCrypto::KeyManager::findKey("delta")->version());
+    std::ofstream(filepath) << "delta MDEyMzQ1Njc4OWFiY2RlZjAxMjM0NTY3ODlhYmNkZWY= 3 extra\n";
+    EXPECT_THROW(VitalEdgeCrypto::KeyManager::loadKeyring(filepath), std::invalid_argument);
+
+    std::remove(filepath.c_str());
+    VitalEdgeKeyring::clear();
+}
+
+TEST(VitalEdgeFileCryptTest, FilesAndDirectoriesRoundTripThroughMappedContainers) {
+    namespace fs = std::filesystem;
+    const std::string rawKey(32, 'f');
+    auto entry = VitalEdgeKeyring::add("files-test", rawKey);
+    VitalEdgeFileCrypt::Key raw{rawKey};
+    VitalEdgeFileCrypt::Key keyring{"", entry.get()};
+
+    fs::remove_all("test_files");
+    fs::create_directories("test_files/in/nested");
+    std::string large(300000, '\0');
+    for (size_t i = 0; i < large.size(); ++i) large[i] = char(i * 31 % 251);
+    std::ofstream("test_files/in/large.bin", std::ios::binary) << large;
+    std::ofstream("test_files/in/nested/small.txt") << "heart rate 72";
+    std::ofstream("test_files/in/nested/empty.txt");
+
+    // Sealed with the raw key in 64 KiB segments, opened with the same key from the keyring
+    auto sealed = VitalEdgeFileCrypt::encrypt("test_files/in", "test_files/sealed", raw, 64 * 1024);
+    EXPECT_EQ(3u, sealed.files);
+    EXPECT_EQ(large.size() + 13, sealed.bytesIn);
+    EXPECT_EQ(VitalEdgeChunkedAEAD::sealedSize(large.size(), 64 * 1024), fs::file_size("test_files/sealed/large.bin"));
+    auto opened = VitalEdgeFileCrypt::decrypt("test_files/sealed", "test_files/out", keyring);
+    EXPECT_EQ(3u, opened.files);
+    EXPECT_EQ(sealed.bytesOut, opened.bytesIn);
+
+    auto contents = [](const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(large, contents("test_files/out/large.bin"));
+    EXPECT_EQ("heart rate 72", contents("test_files/out/nested/small.txt"));
+    EXPECT_EQ(0u, fs::file_size("test_files/out/nested/empty.txt"));
+
+    // A tampered container leaves no output behind, partial or otherwise
+    {
+        std::fstream file("test_files/sealed/large.bin", std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100000);
+        file.put('x');
+    }
+    EXPECT_THROW(VitalEdgeFileCrypt::decrypt("test_files/sealed/large.bin", "test_files/tampered.bin", raw),
+                 std::runtime_error);
+    EXPECT_FALSE(fs::exists("test_files/tampered.bin"));
+    EXPECT_FALSE(fs::exists("test_files/tampered.bin.partial"));
+    EXPECT_THROW(VitalEdgeFileCrypt::encrypt("test_files/in", "test_files/x", VitalEdgeFileCrypt::Key{"short"}),
+                 std::invalid_argument);
+
+    fs::remove_all("test_files");
+    VitalEdgeKeyring::remove("files-test");
+}
+
+TEST(VitalEdgeExecutorTest, SubmitAndParallelFor) {
+    VitalEdgeExecutor pool(4);
+
+    std::atomic<int> submitted{0};
+    std::vector<int> squares(1000);
+    pool.parallelFor(squares.size(), [&](size_t i) {
+        squares[i] = int(i * i);
+        if (i % 100 == 0) pool.submit([&] { submitted++; });
+    });
+    for (size_t i = 0; i < squares.size(); ++i) EXPECT_EQ(int(i * i), squares[i]);
+
+    // Nested parallelFor from inside a worker must not deadlock
+    std::atomic<int> nested{0};
+    pool.parallelFor(8, [&](size_t) {
+        pool.parallelFor(8, [&](size_t) { nested++; });
+    });
+    EXPECT_EQ(64, nested.load());
+
+    while (submitted.load() < 10) std::this_thread::yield();
+}
+
+TEST(VitalEdgeExecutorTest, ParallelForRethrows) {
+    VitalEdgeExecutor pool(2);
+    EXPECT_THROW(pool.parallelFor(16, [](size_t i) {
+        if (i == 7) throw std::runtime_error("item 7");
+    }), std::runtime_error);
+}
+
+TEST(VitalEdgePlacementTest, WorkersSplitNodesAndPinnedThreadsStayPut) {
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}), VitalEdgePlacement::parseCpus("0-3,8,10-11\n"));
+    EXPECT_EQ("0-3,8,10-11", VitalEdgePlacement::formatCpus({0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_TRUE(VitalEdgePlacement::parseCpus("").empty());
+    EXPECT_THROW(VitalEdgePlacement::parseCpus("3-1"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgePlacement::parseCpus("0,,1"), std::invalid_argument);
+
+    // Two nodes of four CPUs: two workers get a node each, four get half a node
+    const std::vector<VitalEdgePlacement::Node> nodes = {{0, {0, 1, 2, 3}}, {1, {4, 5, 6, 7}}};
+    EXPECT_EQ(std::vector<int>({4, 5, 6, 7}), VitalEdgePlacement::workerCpus(nodes, 1, 2));
+    EXPECT_EQ(std::vector<int>({2, 3}), VitalEdgePlacement::workerCpus(nodes, 1, 4));
+    EXPECT_EQ(std::vector<int>({1}), VitalEdgePlacement::workerCpus(nodes, 9, 16));
+    EXPECT_EQ(1, VitalEdgePlacement::nodeOf(nodes, 5));
+    EXPECT_EQ(-1, VitalEdgePlacement::nodeOf(nodes, 8));
+
+    // IO threads come first; crypto threads wrap around once the CPUs run out
+    const auto plan = VitalEdgePlacement::plan({4, 5, 6}, 1, 3);
+    EXPECT_EQ(std::vector<int>({4}), plan.ioCpus);
+    EXPECT_EQ(std::vector<int>({5, 6, 4}), plan.cryptoCpus);
+
+    // Executor workers pinned from their start hook run where they were put
+    const std::vector<VitalEdgePlacement::Node> local = VitalEdgePlacement::topology();
+    ASSERT_FALSE(local.empty());
+    ASSERT_FALSE(local.front().cpus.empty());
+    const int cpu = local.front().cpus.back();
+    std::atomic<int> pinned{0};
+    {
+        VitalEdgeExecutor pool(2, [&](size_t) {
+            if (VitalEdgePlacement::pinCurrentThread(cpu) && sched_getcpu() == cpu) pinned++;
+        });
+        std::atomic<int> ran{0};
+        pool.submit([&] { ran++; });
+        while (ran.load() == 0) std::this_thread::yield();
+    }
+    EXPECT_EQ(2, pinned.load());
+}
+
+TEST(VitalEdgeMetricsTest, HistogramsMergeThreadsAndRender) {
+    VitalEdgeMetrics::reset();
+    static const VitalEdgeMetrics::Timer timer("op", "metricsTest");
+
+    // Samples from a thread that has exited are kept
+    std::thread worker([] {
+        for (int i = 0; i < 99; ++i) timer.record(VitalEdgeMetrics::Phase::Total, 100, 1000);
+    });
+    worker.join();
+    timer.record(VitalEdgeMetrics::Phase::Total, 100, 1000000);
+    timer.recordError();
+
+    auto summary = VitalEdgeMetrics::summary("op", "metricsTest", VitalEdgeMetrics::Phase::Total);
+    EXPECT_EQ(100u, summary.count);
+    EXPECT_EQ(99u * 1000 + 1000000, summary.sumNanos);
+    EXPECT_EQ(100u * 100, summary.bytes);
+    EXPECT_EQ(1u, summary.errors);
+    // Quantiles are bucket bounds within 12.5% above the sample
+    EXPECT_GE(summary.p50, 1000u);
+    EXPECT_LE(summary.p50, 1125u);
+    EXPECT_GE(summary.p999, 1000000u);
+    EXPECT_LE(summary.p999, 1125000u);
+
+    // Library operations record themselves; a failing one counts an error
+    VitalEdgeCrypto::obfuscate("metrics");
+    EXPECT_THROW(VitalEdgeCrypto::deobfuscate("not base64!"), std::invalid_argument);
+    EXPECT_EQ(1u, VitalEdgeMetrics::summary("op", "obfuscate", VitalEdgeMetrics::Phase::Total).count);
+    EXPECT_EQ(1u, VitalEdgeMetrics::summary("op", "deobfuscate", VitalEdgeMetrics::Phase::Total).errors);
+
+    std::string text = VitalEdgeMetrics::render();
+    EXPECT_NE(std::string::npos, text.find("# TYPE vitaledge_duration_seconds histogram"));
+    EXPECT_NE(std::string::npos, text.find("vitaledge_duration_seconds_count{kind=\"op\",name=\"metricsTest\","
+                                           "phase=\"total\",size=\"256\"} 100"));
+    EXPECT_NE(std::string::npos, text.find("vitaledge_duration_seconds_bucket{kind=\"op\",name=\"metricsTest\","
+                                           "phase=\"total\",size=\"256\",le=\"1e-06\"} 0"));
+    EXPECT_NE(std::string::npos, text.find("vitaledge_duration_seconds_bucket{kind=\"op\",name=\"metricsTest\","
+                                           "phase=\"total\",size=\"256\",le=\"2.5e-06\"} 99"));
+    EXPECT_NE(std::string::npos, text.find("vitaledge_errors_total{kind=\"op\",name=\"metricsTest\"} 1"));
+
+    // Disabled metrics record nothing
+    VitalEdgeMetrics::setEnabled(false);
+    timer.record(VitalEdgeMetrics::Phase::Total, 100, 1000);
+    VitalEdgeMetrics::setEnabled(true);
+    EXPECT_EQ(100u, VitalEdgeMetrics::summary("op", "metricsTest", VitalEdgeMetrics::Phase::Total).count);
+}
+
+TEST(VitalEdgeAuditTest, RecordsSurviveRestartAndTamperingIsDetected) {
+    std::string filepath = "test_audit.log";
+    std::remove(filepath.c_str());
+    VitalEdgeAudit::Options options;
+    options.path = filepath;
+    options.ringCapacity = 16;
+
+    // Records from several threads, more than a ring holds, all reach the log
+    VitalEdgeAudit::start(options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 100; ++i) {
+                EXPECT_TRUE(VitalEdgeAudit::record(VitalEdgeAudit::Operation::Encrypt, "patients-2024", i,
+                                                   "10.0.0.7", true));
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    VitalEdgeAudit::record(VitalEdgeAudit::Operation::Decrypt, "", 32, "10.0.0.8", false);
+    EXPECT_TRUE(VitalEdgeAudit::flush());
+    VitalEdgeAudit::stop();
+
+    // Reopening appends and continues the sequence
+    VitalEdgeAudit::start(options);
+    VitalEdgeAudit::record(VitalEdgeAudit::Operation::Obfuscate, "", 5, "10.0.0.9", true);
+    VitalEdgeAudit::stop();
+
+    std::vector<VitalEdgeAudit::Record> records;
+    auto result = VitalEdgeAudit::read(filepath, [&](const VitalEdgeAudit::Record& r) { records.push_back(r); });
+    EXPECT_TRUE(result.complete) << result.error;
+    ASSERT_EQ(402u, records.size());
+    for (size_t i = 0; i < records.size(); ++i) EXPECT_EQ(i, records[i].sequence);
+    EXPECT_STREQ("patients-2024", records[0].keyId);
+    EXPECT_STREQ("10.0.0.7", records[0].caller);
+    EXPECT_EQ(uint16_t(VitalEdgeAudit::Operation::Decrypt), records[400].operation);
+    EXPECT_EQ(0, records[400].ok);
+    EXPECT_EQ(uint16_t(VitalEdgeAudit::Operation::Obfuscate), records[401].operation);
+
+    // Editing a record breaks its block's checksum
+    std::fstream file(filepath, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(32 + 32 + offsetof(VitalEdgeAudit::Record, bytes));
+    file.put('\x7f');
+    file.close();
+    result = VitalEdgeAudit::read(filepath, nullptr);
+    EXPECT_FALSE(result.complete);
+    EXPECT_EQ(0u, result.records);
+    EXPECT_THROW(VitalEdgeAudit::start(options), std::runtime_error);
+
+    // A torn last block is cut off when the log is reopened
+    std::remove(filepath.c_str());
+    VitalEdgeAudit::start(options);
+    VitalEdgeAudit::record(VitalEdgeAudit::Operation::Encrypt, "a", 1, "", true);
+    VitalEdgeAudit::flush();
+    VitalEdgeAudit::record(VitalEdgeAudit::Operation::Encrypt, "b", 2, "", true);
+    VitalEdgeAudit::stop();
+    std::ifstream in(filepath, std::ios::binary | std::ios::ate);
+    const auto length = static_cast<long>(in.tellg());
+    in.close();
+    ASSERT_EQ(0, truncate(filepath.c_str(), length - 10));
+    result = VitalEdgeAudit::read(filepath, nullptr);
+    EXPECT_TRUE(result.tornTail);
+    EXPECT_EQ(1u, result.records);
+
+    VitalEdgeAudit::start(options);
+    VitalEdgeAudit::record(VitalEdgeAudit::Operation::Encrypt, "c", 3, "", true);
+    VitalEdgeAudit::stop();
+    records.clear();
+    result = VitalEdgeAudit::read(filepath, [&](const VitalEdgeAudit::Record& r) { records.push_back(r); });
+    EXPECT_TRUE(result.complete) << result.error;
+    ASSERT_EQ(2u, records.size());
+    EXPECT_STREQ("c", records[1].keyId);
+    EXPECT_EQ(1u, records[1].sequence);
+
+    std::remove(filepath.c_str());
+}
+
+TEST(VitalEdgeWireTest, BatchFramesRoundTripWithInPlaceOutput) {
+    std::string key = VitalEdgeCrypto::generateRandomKey(32);
+    std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    std::string payload(1000, 'p');
+
+    // Buffer overloads match the string ones
+    std::string out(payload.size() + VitalEdgeCrypto::kAESBlockSize, '\0');
+    out.resize(VitalEdgeCrypto::encryptAES(std::string_view(payload), std::string_view(key), iv, &out[0]));
+    EXPECT_EQ(VitalEdgeCrypto::encryptAES(payload, key, iv), out);
+
+    std::string body;
+    VitalEdgeWire::appendItem(body, {"", key, iv, payload});
+    VitalEdgeWire::appendItem(body, {"", "short", iv, "x"});
+    VitalEdgeWire::appendItem(body, {"", key, iv, ""});
+    auto items = VitalEdgeWire::parseBatch(body, 10);
+    ASSERT_EQ(3u, items.size());
+    std::string versioned;
+    VitalEdgeWire::appendItem(versioned, {"records", "", iv, "x", 7});
+    EXPECT_EQ(7u, VitalEdgeWire::parseBatch(versioned, 10)[0].keyVersion);
+    EXPECT_EQ(payload, items[0].data);
+    EXPECT_EQ(body.data() + VitalEdgeWire::kItemHeaderSize + key.size() + iv.size(), items[0].data.data());
+
+    // Outputs land in place; an error longer than its item's reservation grows the body
+    VitalEdgeWire::BatchWriter writer(3 * VitalEdgeWire::kItemHeaderSize + payload.size() + 1 +
+                                      3 * VitalEdgeCrypto::kAESBlockSize);
+    for (const auto& item : items) {
+        try {
+            char* target = writer.output(item.data.size() + VitalEdgeCrypto::kAESBlockSize);
+            writer.commit(VitalEdgeCrypto::encryptAES(item.data, item.key, item.iv, target), 3);
+        } catch (const std::exception& e) {
+            writer.fail(e.what());
+        }
+    }
+    std::string response = writer.take();
+    auto results = VitalEdgeWire::parseBatchResponse(response);
+    ASSERT_EQ(3u, results.size());
+    EXPECT_EQ(VitalEdgeWire::Status::Ok, results[0].status);
+    EXPECT_EQ(VitalEdgeCrypto::encryptAES(payload, key, iv), results[0].output);
+    EXPECT_EQ(3u, results[0].keyVersion);
+    EXPECT_EQ(VitalEdgeWire::Status::Error, results[1].status);
+    EXPECT_EQ(0u, results[1].keyVersion);
+    EXPECT_FALSE(results[1].output.empty());
+    EXPECT_EQ(VitalEdgeWire::Status::Ok, results[2].status);
+    EXPECT_EQ(VitalEdgeCrypto::kAESBlockSize, results[2].output.size());
+
+    // Malformed framing is rejected
+    EXPECT_THROW(VitalEdgeWire::parseBatch(body.substr(0, body.size() - 1), 10), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeWire::parseBatch(body, 2), std::invalid_argument);
+    std::string both;
+    VitalEdgeWire::appendItem(both, {"alpha", key, iv, "x"});
+    EXPECT_THROW(VitalEdgeWire::parseBatch(both, 10), std::invalid_argument);
+    std::string rawWithVersion;
+    VitalEdgeWire::appendItem(rawWithVersion, {"", key, iv, "x", 2});
+    EXPECT_THROW(VitalEdgeWire::parseBatch(rawWithVersion, 10), std::invalid_argument);
+}
+
+TEST(VitalEdgeFieldPathTest, CompiledPathsAreCachedAndFieldsSealToTheirPath) {
+    VitalEdgeFieldPath::clearCache();
+    auto path = VitalEdgeFieldPath::compile("contacts[*].phone");
+    ASSERT_EQ(3u, path->segments().size());
+    EXPECT_EQ(VitalEdgeFieldPath::Segment::Kind::Member, path->segments()[0].kind);
+    EXPECT_EQ("contacts", path->segments()[0].name);
+    EXPECT_EQ(VitalEdgeFieldPath::Segment::Kind::Wildcard, path->segments()[1].kind);
+    EXPECT_EQ("phone", path->segments()[2].name);
+    EXPECT_EQ(VitalEdgeFieldPath::Segment::Kind::Index, VitalEdgeFieldPath::compile("visits[12]")->segments()[1].kind);
+    EXPECT_EQ(12u, VitalEdgeFieldPath::compile("visits[12]")->segments()[1].index);
+
+    // Compiled once: later lookups, from any thread, share the same object
+    EXPECT_EQ(path, VitalEdgeFieldPath::compile("contacts[*].phone"));
+    VitalEdgeFieldPath::Ptr fromThread;
+    std::thread([&] { fromThread = VitalEdgeFieldPath::compile("contacts[*].phone"); }).join();
+    EXPECT_EQ(path, fromThread);
+    EXPECT_EQ(2u, VitalEdgeFieldPath::cacheSize());
+
+    for (const char* bad : {"", ".a", "a.", "a..b", "a[", "a[x]", "a]", "a[1]b"}) {
+        EXPECT_THROW(VitalEdgeFieldPath::compile(bad), std::invalid_argument) << bad;
+    }
+
+    // Sealed values are randomized, and only open at the path they were sealed for
+    auto key = VitalEdgeKeyring::add("fields-test", std::string(32, 'f'));
+    std::string sealed = VitalEdgeCrypto::encryptField("555-0100", *key, "contacts[*].phone");
+    EXPECT_NE(sealed, VitalEdgeCrypto::encryptField("555-0100", *key, "contacts[*].phone"));
+    EXPECT_EQ("555-0100", VitalEdgeCrypto::decryptField(sealed, *key, "contacts[*].phone"));
+    EXPECT_THROW(VitalEdgeCrypto::decryptField(sealed, *key, "name"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeCrypto::decryptField("plain text", *key, "name"), std::invalid_argument);
+
+    // Values are bound to their concrete element: swapping two sealed phones is caught
+    std::string first = VitalEdgeCrypto::encryptField("555-0100", *key, "contacts[0].phone");
+    std::string second = VitalEdgeCrypto::encryptField("555-0199", *key, "contacts[1].phone");
+    EXPECT_EQ("555-0199", VitalEdgeCrypto::decryptField(second, *key, "contacts[1].phone"));
+    EXPECT_THROW(VitalEdgeCrypto::decryptField(second, *key, "contacts[0].phone"), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeCrypto::decryptField(first, *key, "contacts[1].phone"), std::invalid_argument);
+
+    // A value names its key version, so it still opens after a rotation, but not once that version is gone
+    auto rotated = VitalEdgeKeyring::add("fields-test", std::string(32, 'g'));
+    EXPECT_EQ(2u, rotated->version());
+    EXPECT_EQ("555-0100", VitalEdgeCrypto::decryptField(sealed, *rotated, "contacts[*].phone"));
+    VitalEdgeKeyring::remove("fields-test", 1);
+    EXPECT_THROW(VitalEdgeCrypto::decryptField(sealed, *rotated, "contacts[*].phone"), std::invalid_argument);
+    VitalEdgeKeyring::remove("fields-test");
+}
+
+TEST(VitalEdgeRandomTest, BufferedBytesNeverRepeatAcrossCallsThreadsOrForks) {
+    // IVs drawn through several buffer refills, plus one too large to buffer
+    std::set<std::string> seen;
+    unsigned char iv[16];
+    for (int i = 0; i < 1000; ++i) {
+        VitalEdgeRandom::bytes(iv, sizeof(iv));
+        EXPECT_TRUE(seen.insert(std::string((const char*)iv, sizeof(iv))).second);
+    }
+    std::string large(100000, '\0');
+    VitalEdgeRandom::bytes((unsigned char*)&large[0], large.size());
+    EXPECT_NE(std::string::npos, large.find_first_not_of('\0', large.size() - 64));
+
+    // Another thread has its own DRBG
+    std::thread([&] {
+        VitalEdgeRandom::bytes(iv, sizeof(iv));
+        EXPECT_TRUE(seen.insert(std::string((const char*)iv, sizeof(iv))).second);
+        VitalEdgeRandom::privateBytes(iv, sizeof(iv));
+        EXPECT_TRUE(seen.insert(std::string((const char*)iv, sizeof(iv))).second);
+    }).join();
+
+    // A forked child must not hand out what is left in its parent's buffer
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        VitalEdgeRandom::bytes(iv, sizeof(iv));
+        _exit(write(fds[1], iv, sizeof(iv)) == ssize_t(sizeof(iv)) ? 0 : 1);
+    }
+    unsigned char fromChild[16];
+    ASSERT_EQ(ssize_t(sizeof(fromChild)), read(fds[0], fromChild, sizeof(fromChild)));
+    waitpid(child, nullptr, 0);
+    close(fds[0]);
+    close(fds[1]);
+    VitalEdgeRandom::bytes(iv, sizeof(iv));
+    EXPECT_NE(0, std::memcmp(iv, fromChild, sizeof(iv)));
+
+    // Keys come through the same service
+    EXPECT_NE(VitalEdgeCrypto::generateRandomKey(32), VitalEdgeCrypto::generateRandomKey(32));
+    EXPECT_EQ(16u, VitalEdgeCrypto::generateRandomIV(16).size());
+}
+
+TEST(VitalEdgeSecureMemoryTest, BlocksAreZeroedAndReusedAcrossThreads) {
+    // A freed block comes back to the next allocation of its size class, zeroed
+    // (sizes here are of a class nothing else in the tests allocates)
+    char* block = (char*)VitalEdgeSecureMemory::allocate(6000);
+    std::memset(block, 'k', 6000);
+    VitalEdgeSecureMemory::deallocate(block, 6000);
+    char* again = (char*)VitalEdgeSecureMemory::allocate(5000);
+    EXPECT_EQ(block, again);
+    EXPECT_EQ(std::string(5000, '\0'), std::string(again, 5000));
+    EXPECT_EQ(0u, uintptr_t(again) % 16);
+
+    // Freed on another thread, it returns to this thread's arena
+    std::thread([again] { VitalEdgeSecureMemory::deallocate(again, 5000); }).join();
+    EXPECT_EQ(again, VitalEdgeSecureMemory::allocate(5000));
+    VitalEdgeSecureMemory::deallocate(again, 5000);
+
+    // Mapped and oversized blocks
+    for (size_t size : {size_t(100000), size_t(3) << 20}) {
+        char* large = (char*)VitalEdgeSecureMemory::allocate(size);
+        std::memset(large, 'p', size);
+        VitalEdgeSecureMemory::deallocate(large, size);
+    }
+    const auto stats = VitalEdgeSecureMemory::stats();
+    EXPECT_GT(stats.lockedBytes + stats.unlockedBytes, 0u);
+
+    // Allocator-aware buffers through the crypto API
+    const std::string plaintext(1000, 'x');
+    const VitalEdgeCrypto::SecureString key = VitalEdgeCrypto::generateSecureKey(32);
+    const std::string iv = VitalEdgeCrypto::generateRandomIV(16);
+    VitalEdgeCrypto::SecureString ciphertext, decrypted;
+    VitalEdgeCrypto::encryptAES(plaintext, key, iv, ciphertext);
+    EXPECT_EQ(VitalEdgeCrypto::encryptAES(plaintext, std::string(key.data(), key.size()), iv),
+              std::string(ciphertext.data(), ciphertext.size()));
+    VitalEdgeCrypto::decryptAES(ciphertext, key, iv, decrypted);
+    EXPECT_EQ(plaintext, std::string(decrypted.data(), decrypted.size()));
+}
+
+TEST(VitalEdgeTokenVaultTest, TokensAreDeterministicAndTheVaultReopensWithoutRebuild) {
+    auto key = VitalEdgeKeyring::add("tokens-test", std::string(32, 't'));
+    auto other = VitalEdgeKeyring::add("tokens-other", std::string(32, 'o'));
+    std::string token = VitalEdgeCrypto::tokenize("MRN-0042", *key, "mrn");
+    EXPECT_EQ(2 * VitalEdgeCrypto::kTokenSize, token.size());
+    EXPECT_EQ(token, VitalEdgeCrypto::tokenize("MRN-0042", *key, "mrn"));
+    EXPECT_NE(token, VitalEdgeCrypto::tokenize("MRN-0043", *key, "mrn"));
+    EXPECT_NE(token, VitalEdgeCrypto::tokenize("MRN-0042", *key, "ssn"));
+    EXPECT_NE(token, VitalEdgeCrypto::tokenize("MRN-0042", *other, "mrn"));
+    EXPECT_THROW(VitalEdgeCrypto::tokenize("x", *key, std::string("a\0b", 3)), std::invalid_argument);
+
+    unsigned char raw[VitalEdgeCrypto::kTokenSize];
+    ASSERT_TRUE(VitalEdgeCrypto::tokenFromHex(token, raw));
+    EXPECT_EQ(token, VitalEdgeCrypto::tokenToHex(raw));
+    EXPECT_FALSE(VitalEdgeCrypto::tokenFromHex(token.substr(1), raw));
+    EXPECT_FALSE(VitalEdgeCrypto::tokenFromHex(std::string(token.size(), 'g'), raw));
+
+    // Enough values to grow the index from its minimum size several times
+    std::string filepath = "test_tokens.vault";
+    std::remove(filepath.c_str());
+    std::vector<std::string> tokens;
+    {
+        VitalEdgeTokenVault vault(filepath, 1);
+        EXPECT_EQ(1024u, vault.capacity());
+        for (int i = 0; i < 5000; ++i) {
+            std::string value = "patient-" + std::to_string(i);
+            VitalEdgeCrypto::tokenize(value, *key, "mrn", raw);
+            EXPECT_TRUE(vault.insert(raw, value, *key));
+            tokens.push_back(VitalEdgeCrypto::tokenToHex(raw));
+        }
+        EXPECT_FALSE(vault.insert(raw, "patient-4999", *key));
+        EXPECT_EQ(5000u, vault.size());
+        EXPECT_GE(vault.capacity() * 3, vault.size() * 4);
+    }
+
+    // Values are sealed, so the file never holds them in the clear
+    std::string file;
+    {
+        std::ifstream in(filepath, std::ios::binary);
+        file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    EXPECT_EQ(std::string::npos, file.find("patient-"));
+
+    // A crash after a slot is published but before it is counted leaves the header
+    // one short; reopening recounts instead of refusing the vault
+    {
+        const uint64_t crashedCount = 4999;
+        std::fstream out(filepath, std::ios::in | std::ios::out | std::ios::binary);
+        out.seekp(24);
+        out.write((const char*)&crashedCount, sizeof(crashedCount));
+    }
+
+    // Reopened as mapped, with every value still there, and opening only under its own key
+    size_t slotCount = 0;
+    {
+        VitalEdgeTokenVault vault(filepath);
+        EXPECT_EQ(5000u, vault.size());
+        slotCount = vault.capacity();
+        VitalEdgeCrypto::SecureString value;
+        for (int i = 0; i < 5000; i += 499) {
+            ASSERT_TRUE(VitalEdgeCrypto::tokenFromHex(tokens[i], raw));
+            ASSERT_TRUE(vault.find(raw, *key, value));
+            EXPECT_EQ("patient-" + std::to_string(i), std::string(value.data(), value.size()));
+            EXPECT_FALSE(vault.find(raw, *other, value));
+        }
+        VitalEdgeCrypto::tokenize("never stored", *key, "mrn", raw);
+        EXPECT_FALSE(vault.find(raw, *key, value));
+    }
+
+    // A slot pointing past the heap is caught on open, not on lookup
+    size_t used = 0;
+    while (used < slotCount && file[64 + used * 32 + 28] == 0) ++used;
+    ASSERT_LT(used, slotCount);
+    {
+        std::fstream out(filepath, std::ios::in | std::ios::out | std::ios::binary);
+        out.seekp(64 + used * 32 + 16);
+        out.write("\xff\xff\xff\xff\xff\xff\xff\x7f", 8);
+    }
+    EXPECT_THROW(VitalEdgeTokenVault vault(filepath), std::runtime_error);
+
+    std::ofstream("test_tokens.bad") << "not a vault at all, just some text that is long enough";
+    EXPECT_THROW(VitalEdgeTokenVault("test_tokens.bad"), std::runtime_error);
+    std::remove("test_tokens.bad");
+    std::remove(filepath.c_str());
+    VitalEdgeKeyring::remove("tokens-test");
+    VitalEdgeKeyring::remove("tokens-other");
+}
+
+TEST(VitalEdgeReencryptTest, RotatedRecordsAreRewrittenAndAnInterruptedJobResumes) {
+    // Versions from a keyring file, then a rotation appended to it
+    std::string keyring = "test_rotation_keyring.txt";
+    std::ofstream(keyring) << "records " << VitalEdgeBase64::encode(std::string(32, '1')) << " 1\n"
+                           << "records " << VitalEdgeBase64::encode(std::string(32, '2')) << " 2";
+    EXPECT_EQ(2u, VitalEdgeKeyring::loadFile(keyring));
+    EXPECT_EQ(1u, VitalEdgeKeyring::size());
+    auto v1 = VitalEdgeKeyring::find("records", 1);
+    ASSERT_NE(v1, nullptr);
+    EXPECT_EQ(2u, VitalEdgeKeyring::find("records")->version());
+    auto v3 = VitalEdgeCrypto::KeyManager::rotateKey("records", keyring);
+    EXPECT_EQ(3u, v3->version());
+    EXPECT_EQ(v3, VitalEdgeCrypto::KeyManager::findKey("records"));
+    // A key_id that would break the keyring file's lines is refused before it is written
+    EXPECT_THROW(VitalEdgeCrypto::KeyManager::rotateKey("records 9\nforged", keyring), std::invalid_argument);
+    EXPECT_THROW(VitalEdgeCrypto::KeyManager::rotateKey(std::string(129, 'k'), keyring), std::invalid_argument);
+    EXPECT_TRUE(VitalEdgeKeyring::validKeyId("ward-7.vitals_v2"));
+
+    // A record names its version, opens under it and only under its key_id
+    std::string record = VitalEdgeRecord::seal("vitals", *v1);
+    EXPECT_EQ(VitalEdgeRecord::sealedSize(6), record.size());
+    EXPECT_EQ("vitals", VitalEdgeRecord::open(record, "records"));
+    auto impostor = VitalEdgeKeyring::add("impostor", std::string(32, '1'));
+    EXPECT_THROW(VitalEdgeRecord::open(record, "impostor"), std::invalid_argument);
+    record[4] = 3; // claims to be under version 3
+    EXPECT_THROW(VitalEdgeRecord::open(record, "records"), std::invalid_argument);
+
+    // A file of records under versions 1 and 3, rewritten to 3 a few records per window
+    std::string filepath = "test_records.dat";
+    std::vector<std::string> plaintexts;
+    {
+        std::ofstream file(filepath, std::ios::binary);
+        for (int i = 0; i < 200; ++i) {
+            plaintexts.push_back(std::string(i * 7 % 300, char('a' + i % 26)));
+            file << VitalEdgeRecord::seal(plaintexts.back(), i % 4 ? *v1 : *v3);
+        }
+    }
+    VitalEdgeReencrypt::Options options;
+    options.keyId = "records";
+    options.windowBytes = 2048;
+    int checkpoints = 0;
+    options.progress = [&](const VitalEdgeReencrypt::Progress& progress) {
+        if (++checkpoints == 3) throw std::runtime_error("interrupted at " + std::to_string(progress.done));
+    };
+    EXPECT_THROW(VitalEdgeReencrypt::run({filepath}, options), std::runtime_error);
+    std::ifstream checkpoint(filepath + ".reencrypt.checkpoint");
+    uint64_t size = 0, done = 0;
+    ASSERT_TRUE(checkpoint >> size >> done);
+    EXPECT_LT(0u, done);
+    EXPECT_LT(done, size);
+
+    options.progress = nullptr;
+    VitalEdgeReencrypt::Report report = VitalEdgeReencrypt::run({filepath}, options);
+    EXPECT_EQ(1u, report.files);
+    EXPECT_EQ(200u, report.records);
+    EXPECT_EQ(size - done, report.bytes);
+    EXPECT_FALSE(std::ifstream(filepath + ".reencrypt.checkpoint").good());
+    EXPECT_FALSE(std::ifstream(filepath + ".reencrypt").good());
+
+    std::ifstream file(filepath, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t offset = 0;
+    for (const std::string& plaintext : plaintexts) {
+        auto header = VitalEdgeRecord::parseHeader((const unsigned char*)contents.data() + offset,
+                                                   contents.size() - offset);
+        EXPECT_EQ(3u, header.keyVersion);
+        EXPECT_EQ(plaintext, VitalEdgeRecord::open(contents.substr(offset, header.sealedSize()), "records"));
+        offset += header.sealedSize();
+    }
+    EXPECT_EQ(contents.size(), offset);
+
+    // Already at the target version: left alone
+    report = VitalEdgeReencrypt::run({filepath}, options);
+    EXPECT_EQ(0u, report.files);
+    EXPECT_EQ(1u, report.skippedFiles);
+
+    // The rotated key was persisted with its version
+    VitalEdgeKeyring::clear();
+    EXPECT_EQ(3u, VitalEdgeKeyring::loadFile(keyring));
+    EXPECT_EQ(3u, VitalEdgeKeyring::find("records")->version());
+    EXPECT_EQ(plaintexts[1], VitalEdgeRecord::open(contents.substr(VitalEdgeRecord::sealedSize(0),
+                                                                   VitalEdgeRecord::sealedSize(plaintexts[1].size())),
+                                                   "records"));
+    std::ofstream(keyring) << "records " << VitalEdgeBase64::encode(std::string(32, '1')) << " 0\n";
+    EXPECT_THROW(VitalEdgeKeyring::loadFile(keyring), std::invalid_argument);
+
+    std::remove(keyring.c_str());
+    std::remove(filepath.c_str());
+    VitalEdgeKeyring::clear();
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();